@@ -0,0 +1,155 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "bench/benchmarks.h"
+#include "bench/benchmark_report.h"
+
+#include <xmmintrin.h>
+#include <pmmintrin.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+
+std::vector<uint> ParseUIntList(const char *list);
+
+int main(int argc, const char *argv[]) {
+	// Match the renderer's floating point state, or the timings won't be representative
+	_MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+	_MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+
+	// Command line options
+	//     --output <file.json>       Write the results to this file
+	//     --spp <n>                  The number of samples per pixel to render each scene with
+	//     --threads <n,n,...>        The thread counts to render each scene with. Defaults to 1 and all the cores
+	//     --seed <n>                 Seeds the synthetic scenes and the microbenchmark inputs
+	//     --synthetic <n,n,...>      The number of spheres in each synthetic scaling scene
+	//     --stress <name>            Also benchmark a generated stress scene. IE. stress_100000_3_i_16_2. Can be repeated
+	//     --no-scenes                Skip the scene benchmarks
+	//     --no-micro                 Skip the microbenchmarks
+	//
+	// Convergence mode. Replaces the benchmarks above
+	//     --convergence <scene>      Measure the error versus time of <scene> against --reference
+	//     --reference <file.pfm>     The reference image
+	//     --write-reference          Render the reference with --spp samples per pixel instead, and write it to --reference
+	//     --checkpoint-by <spp|time> Measure the error at doubling spp, or doubling render time
+	//     --max-spp <n>              Stop each configuration after n samples per pixel
+	//     --max-seconds <n>          Stop each configuration after n seconds of render time
+	Lantern::SceneBenchmarkSettings settings;
+	const char *outputPath = "lantern_bench.json";
+	bool runScenes = true;
+	bool runMicro = true;
+	Lantern::ConvergenceSettings convergenceSettings;
+	bool writeReference = false;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			outputPath = argv[++i];
+		} else if (strcmp(argv[i], "--spp") == 0 && i + 1 < argc) {
+			settings.SamplesPerPixel = (uint)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			settings.ThreadCounts = ParseUIntList(argv[++i]);
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			settings.Seed = (uint)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc) {
+			settings.SyntheticSceneSizes = ParseUIntList(argv[++i]);
+		} else if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc) {
+			settings.StressScenes.push_back(argv[++i]);
+		} else if (strcmp(argv[i], "--no-scenes") == 0) {
+			runScenes = false;
+		} else if (strcmp(argv[i], "--no-micro") == 0) {
+			runMicro = false;
+		} else if (strcmp(argv[i], "--convergence") == 0 && i + 1 < argc) {
+			convergenceSettings.SceneName = argv[++i];
+		} else if (strcmp(argv[i], "--reference") == 0 && i + 1 < argc) {
+			convergenceSettings.ReferencePath = argv[++i];
+		} else if (strcmp(argv[i], "--write-reference") == 0) {
+			writeReference = true;
+		} else if (strcmp(argv[i], "--checkpoint-by") == 0 && i + 1 < argc) {
+			++i;
+			convergenceSettings.CheckpointType = strcmp(argv[i], "time") == 0 ? Lantern::ConvergenceCheckpoints::Time : Lantern::ConvergenceCheckpoints::SamplesPerPixel;
+		} else if (strcmp(argv[i], "--max-spp") == 0 && i + 1 < argc) {
+			convergenceSettings.MaxSamplesPerPixel = (uint)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--max-seconds") == 0 && i + 1 < argc) {
+			convergenceSettings.MaxSeconds = (float)atof(argv[++i]);
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	uint hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	if (settings.ThreadCounts.empty()) {
+		settings.ThreadCounts.push_back(1u);
+		if (hardwareThreads > 1u) {
+			settings.ThreadCounts.push_back(hardwareThreads);
+		}
+	}
+	if (settings.SyntheticSceneSizes.empty()) {
+		settings.SyntheticSceneSizes.push_back(256u);
+		settings.SyntheticSceneSizes.push_back(4096u);
+	}
+
+	Lantern::BenchmarkReport report;
+	report.AddConfig("seed", settings.Seed);
+	report.AddConfig("hardware_threads", hardwareThreads);
+
+	if (!convergenceSettings.SceneName.empty()) {
+		if (convergenceSettings.ReferencePath.empty()) {
+			printf("--convergence needs a --reference\n");
+			return 1;
+		}
+
+		convergenceSettings.Seed = settings.Seed;
+		if (writeReference) {
+			return Lantern::RenderReference(convergenceSettings.SceneName, settings.Seed, settings.SamplesPerPixel, convergenceSettings.ReferencePath.c_str()) ? 0 : 1;
+		}
+
+		report.AddConfig("max_spp", convergenceSettings.MaxSamplesPerPixel);
+		report.AddConfig("max_seconds", convergenceSettings.MaxSeconds);
+		if (!Lantern::RunConvergenceBenchmark(convergenceSettings, &report)) {
+			return 1;
+		}
+	} else {
+		report.AddConfig("spp", settings.SamplesPerPixel);
+
+		if (runMicro) {
+			Lantern::RunMicroBenchmarks(settings.Seed, &report);
+		}
+		if (runScenes) {
+			Lantern::RunSceneBenchmarks(settings, &report);
+		}
+	}
+
+	if (!report.WriteJSON(outputPath)) {
+		printf("Failed to write %s\n", outputPath);
+		return 1;
+	}
+	printf("Wrote %s\n", outputPath);
+
+	return 0;
+}
+
+std::vector<uint> ParseUIntList(const char *list) {
+	std::vector<uint> values;
+
+	const char *current = list;
+	while (*current != '\0') {
+		char *end;
+		unsigned long value = strtoul(current, &end, 10);
+		if (end == current) {
+			break;
+		}
+		values.push_back((uint)value);
+
+		current = *end == ',' ? end + 1 : end;
+	}
+
+	return values;
+}
@@ -0,0 +1,77 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "bench/benchmark_report.h"
+
+#include <cmath>
+#include <cstdio>
+
+
+namespace Lantern {
+
+void BenchmarkReport::AddConfig(const char *name, double value) {
+	m_config.push_back(Metric{name, value});
+}
+
+void BenchmarkReport::BeginResult(const char *group, const std::string &name) {
+	m_results.push_back(Result{group, name, std::vector<Metric>()});
+}
+
+void BenchmarkReport::AddMetric(const char *name, double value) {
+	m_results.back().Metrics.push_back(Metric{name, value});
+}
+
+void BenchmarkReport::PrintLastResult() const {
+	if (m_results.empty()) {
+		return;
+	}
+
+	const Result &result = m_results.back();
+	printf("%s/%s\n", result.Group.c_str(), result.Name.c_str());
+	for (const Metric &metric : result.Metrics) {
+		printf("    %-24s %.6g\n", metric.Name.c_str(), metric.Value);
+	}
+}
+
+static void WriteMetrics(FILE *file, const std::vector<BenchmarkReport::Metric> &metrics);
+
+bool BenchmarkReport::WriteJSON(const char *filePath) const {
+	FILE *file = fopen(filePath, "w");
+	if (file == nullptr) {
+		return false;
+	}
+
+	fprintf(file, "{\n\"config\":");
+	WriteMetrics(file, m_config);
+	fprintf(file, ",\n\"results\":[");
+
+	for (std::size_t i = 0; i < m_results.size(); ++i) {
+		const Result &result = m_results[i];
+		fprintf(file, "%s\n{\"group\":\"%s\",\"name\":\"%s\",\"metrics\":", i == 0 ? "" : ",", result.Group.c_str(), result.Name.c_str());
+		WriteMetrics(file, result.Metrics);
+		fprintf(file, "}");
+	}
+
+	fprintf(file, "\n]}\n");
+
+	return fclose(file) == 0;
+}
+
+static void WriteMetrics(FILE *file, const std::vector<BenchmarkReport::Metric> &metrics) {
+	fprintf(file, "{");
+	for (std::size_t i = 0; i < metrics.size(); ++i) {
+		fprintf(file, "%s\"%s\":", i == 0 ? "" : ",", metrics[i].Name.c_str());
+		// JSON has no nan or infinity, so those are written as null. %.17g round-trips the rest exactly
+		if (std::isfinite(metrics[i].Value)) {
+			fprintf(file, "%.17g", metrics[i].Value);
+		} else {
+			fprintf(file, "null");
+		}
+	}
+	fprintf(file, "}");
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,57 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+namespace Lantern {
+
+/**
+ * Collects the results of the benchmarks, and writes them out as JSON
+ *
+ * The JSON looks like:
+ *     {
+ *         "config": {"spp": 16, ...},
+ *         "results": [
+ *             {"group": "scene", "name": "balls/threads=8", "metrics": {"rays_per_second": 1.5e7, ...}},
+ *             ...
+ *         ]
+ *     }
+ * Names are stable between runs with the same settings, so two reports can be diffed result by result
+ */
+class BenchmarkReport {
+public:
+	struct Metric {
+		std::string Name;
+		double Value;
+	};
+
+	struct Result {
+		std::string Group;
+		std::string Name;
+		std::vector<Metric> Metrics;
+	};
+
+private:
+	std::vector<Metric> m_config;
+	std::vector<Result> m_results;
+
+public:
+	/** Records a setting the benchmarks were run with */
+	void AddConfig(const char *name, double value);
+	/** Starts a new result. Following calls to AddMetric() add to it */
+	void BeginResult(const char *group, const std::string &name);
+	void AddMetric(const char *name, double value);
+
+	/** Prints the last result to stdout, so long runs show progress */
+	void PrintLastResult() const;
+	bool WriteJSON(const char *filePath) const;
+};
+
+} // End of namespace Lantern
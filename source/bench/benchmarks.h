@@ -0,0 +1,110 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+
+#include <string>
+#include <vector>
+
+
+namespace Lantern {
+
+class BenchmarkReport;
+class Scene;
+
+struct SceneBenchmarkSettings {
+	SceneBenchmarkSettings()
+		: SamplesPerPixel(16u),
+		  Seed(1u) {
+	}
+
+	/** The number of full resolution frames rendered for each scene */
+	uint SamplesPerPixel;
+	/** Each scene is rendered once per thread count */
+	std::vector<uint> ThreadCounts;
+	/** Seeds the synthetic scenes */
+	uint Seed;
+	/** The number of spheres in each of the synthetic scaling scenes */
+	std::vector<uint> SyntheticSceneSizes;
+	/** The names of the stress scenes to render. See LoadBenchmarkScene() */
+	std::vector<std::string> StressScenes;
+};
+
+namespace ConvergenceCheckpoints {
+enum Type {
+	SamplesPerPixel,  // Measure the error at 1, 2, 4, 8, ... spp
+	Time              // Measure the error at 0.25, 0.5, 1, 2, ... seconds of render time
+};
+}
+
+struct ConvergenceSettings {
+	ConvergenceSettings()
+		: Seed(1u),
+		  CheckpointType(ConvergenceCheckpoints::SamplesPerPixel),
+		  MaxSamplesPerPixel(1024u),
+		  MaxSeconds(60.0f) {
+	}
+
+	/** The scene to render. See LoadBenchmarkScene() */
+	std::string SceneName;
+	/** Seeds the synthetic scenes */
+	uint Seed;
+	/** A high spp render of the same scene. See RenderReference() */
+	std::string ReferencePath;
+	ConvergenceCheckpoints::Type CheckpointType;
+	/** Each configuration stops at whichever of these limits it hits first */
+	uint MaxSamplesPerPixel;
+	float MaxSeconds;
+};
+
+/**
+ * Loads one of the benchmark scenes, and sets its background color. The scene isn't committed
+ *
+ * @param name    "balls", "dragon", "subdivision", "smoke", "synthetic_<number of spheres>", or
+ *                "stress_<spheres>_<subdivisions>_<i for instanced, u for unique>_<lights>_<glass layers>".
+ *                See StressSceneSettings
+ * @param seed    Seeds the synthetic scenes
+ * @return        False if the name is unknown, or the scene failed to load
+ */
+bool LoadBenchmarkScene(const std::string &name, uint seed, Scene *scene);
+
+/**
+ * Renders the sample scenes, and any stress scenes, headless, and reports the scene build time, time to the first frame,
+ * rays per second, and time per sample. The dragon and the stress scenes are rendered a second time with a lazy build.
+ *
+ * Tiles seed their samplers from the tile index and frame number, so the rendered image is the same
+ * for every thread count. The image hash is reported, so changes to the output can be caught as well
+ */
+void RunSceneBenchmarks(const SceneBenchmarkSettings &settings, BenchmarkReport *report);
+
+/**
+ * Times the building blocks of the renderer in isolation, on a single thread
+ *
+ * @param seed    Seeds the random inputs
+ */
+void RunMicroBenchmarks(uint seed, BenchmarkReport *report);
+
+/**
+ * Renders a scene with each renderer configuration, and measures the RMSE, relMSE, and FLIP-like error
+ * against a reference image at every checkpoint. Each checkpoint is reported as a separate result,
+ * so the results of a configuration form its error-versus-time curve.
+ *
+ * The error computation isn't included in the reported render time
+ *
+ * @return    False if the scene or the reference couldn't be loaded
+ */
+bool RunConvergenceBenchmark(const ConvergenceSettings &settings, BenchmarkReport *report);
+
+/**
+ * Renders a reference image for RunConvergenceBenchmark() with the default renderer configuration
+ *
+ * @return    False if the scene couldn't be loaded, or the image couldn't be written
+ */
+bool RenderReference(const std::string &sceneName, uint seed, uint samplesPerPixel, const char *filePath);
+
+} // End of namespace Lantern
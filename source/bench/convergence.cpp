@@ -0,0 +1,174 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "bench/benchmarks.h"
+#include "bench/benchmark_report.h"
+#include "bench/image_metrics.h"
+
+#include "scene/scene.h"
+#include "scene/image_io.h"
+
+#include "renderer/renderer.h"
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+namespace Lantern {
+
+// The render time of the first time checkpoint
+static const float kFirstTimeCheckpoint = 0.25f;
+// The samplers are seeded with the frame number, so the reference starts far from frame 0.
+// Otherwise its samples would be the same as those of the images it's compared against
+static const uint kReferenceFirstFrame = 1u << 24;
+
+struct RendererConfiguration {
+	const char *Name;
+	std::function<void(Renderer *)> Apply;
+};
+
+// Every configuration starts from the Renderer defaults
+static const RendererConfiguration kConfigurations[] = {
+	{"default", [](Renderer * /* renderer */) {
+	}},
+	{"primary_hit_cache", [](Renderer *renderer) {
+		renderer->CachePrimaryHits = true;
+	}}
+};
+
+static void GetMeanColors(const FrameBuffer &frameBuffer, std::vector<float3> *pixels) {
+	const float3 *colorData = frameBuffer.GetColorData();
+	const float *weights = frameBuffer.GetWeights();
+
+	pixels->resize(frameBuffer.Width * frameBuffer.Height);
+	for (uint i = 0; i < frameBuffer.Width * frameBuffer.Height; ++i) {
+		(*pixels)[i] = weights[i] > 0.0f ? colorData[i] / weights[i] : float3(0.0f);
+	}
+}
+
+static void RunConfiguration(const ConvergenceSettings &settings, const RendererConfiguration &configuration, const std::vector<float3> &reference, BenchmarkReport *report) {
+	Scene scene;
+	LoadBenchmarkScene(settings.SceneName, settings.Seed, &scene);
+	scene.Commit();
+
+	Renderer renderer(&scene);
+	configuration.Apply(&renderer);
+
+	const FrameBuffer &frameBuffer = scene.Camera.FrameBuffer;
+	uint width = frameBuffer.Width;
+	uint height = frameBuffer.Height;
+	std::vector<float3> image;
+
+	uint nextSamplesPerPixel = 1u;
+	float nextSeconds = kFirstTimeCheckpoint;
+	while (true) {
+		renderer.RenderFrame();
+
+		// Only the frames themselves are timed, so the error computation doesn't skew the curve
+		uint samplesPerPixel = renderer.FrameNumber();
+		float seconds = renderer.Stats().TotalSeconds();
+		bool finished = samplesPerPixel >= settings.MaxSamplesPerPixel || seconds >= settings.MaxSeconds;
+
+		// The results are named after the checkpoint, so the same result can be compared across runs.
+		// In time budget mode, the sample count at a given time varies from run to run
+		bool checkpoint;
+		std::string checkpointName;
+		if (settings.CheckpointType == ConvergenceCheckpoints::SamplesPerPixel) {
+			checkpoint = samplesPerPixel >= nextSamplesPerPixel;
+			while (nextSamplesPerPixel <= samplesPerPixel) {
+				nextSamplesPerPixel *= 2u;
+			}
+			checkpointName = "spp=" + std::to_string(samplesPerPixel);
+		} else {
+			checkpoint = seconds >= nextSeconds;
+			float budget = 0.0f;
+			while (nextSeconds <= seconds) {
+				budget = nextSeconds;
+				nextSeconds *= 2.0f;
+			}
+
+			if (checkpoint) {
+				char name[32];
+				snprintf(name, sizeof(name), "seconds=%g", budget);
+				checkpointName = name;
+			} else {
+				// Stopped by the sample limit before reaching the next time budget
+				checkpointName = "final";
+			}
+		}
+
+		if (checkpoint || finished) {
+			GetMeanColors(frameBuffer, &image);
+
+			report->BeginResult("convergence", settings.SceneName + "/" + configuration.Name + "/" + checkpointName);
+			report->AddMetric("spp", samplesPerPixel);
+			report->AddMetric("seconds", seconds);
+			report->AddMetric("rmse", RootMeanSquaredError(&image[0], &reference[0], width, height));
+			report->AddMetric("relmse", RelativeMeanSquaredError(&image[0], &reference[0], width, height));
+			report->AddMetric("flip", FlipLikeError(&image[0], &reference[0], width, height));
+			report->PrintLastResult();
+		}
+
+		if (finished) {
+			break;
+		}
+	}
+}
+
+bool RunConvergenceBenchmark(const ConvergenceSettings &settings, BenchmarkReport *report) {
+	uint referenceWidth;
+	uint referenceHeight;
+	std::vector<float3> reference;
+	if (!ReadPFM(settings.ReferencePath.c_str(), &referenceWidth, &referenceHeight, &reference)) {
+		printf("Failed to read the reference %s\n", settings.ReferencePath.c_str());
+		return false;
+	}
+
+	// Check the scene once up front, rather than for every configuration
+	{
+		Scene scene;
+		if (!LoadBenchmarkScene(settings.SceneName, settings.Seed, &scene)) {
+			printf("Failed to load the scene %s\n", settings.SceneName.c_str());
+			return false;
+		}
+		if (scene.Camera.FrameBuffer.Width != referenceWidth || scene.Camera.FrameBuffer.Height != referenceHeight) {
+			printf("The reference is %ux%u, but the scene renders at %ux%u\n", referenceWidth, referenceHeight, scene.Camera.FrameBuffer.Width, scene.Camera.FrameBuffer.Height);
+			return false;
+		}
+	}
+
+	for (const RendererConfiguration &configuration : kConfigurations) {
+		RunConfiguration(settings, configuration, reference, report);
+	}
+
+	return true;
+}
+
+bool RenderReference(const std::string &sceneName, uint seed, uint samplesPerPixel, const char *filePath) {
+	Scene scene;
+	if (!LoadBenchmarkScene(sceneName, seed, &scene)) {
+		printf("Failed to load the scene %s\n", sceneName.c_str());
+		return false;
+	}
+	scene.Commit();
+
+	Renderer renderer(&scene);
+	renderer.SetFrameNumber(kReferenceFirstFrame);
+	renderer.Run(kReferenceFirstFrame + samplesPerPixel);
+
+	std::vector<float3> image;
+	GetMeanColors(scene.Camera.FrameBuffer, &image);
+	if (!WritePFM(filePath, scene.Camera.FrameBuffer.Width, scene.Camera.FrameBuffer.Height, &image[0])) {
+		printf("Failed to write %s\n", filePath);
+		return false;
+	}
+
+	return true;
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,135 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "bench/image_metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+namespace Lantern {
+
+// Keeps the relative error finite for black reference pixels
+static const float kRelativeErrorEpsilon = 0.01f;
+// The standard deviation of the contrast sensitivity blur, in pixels
+static const float kFlipBlurSigma = 1.0f;
+// FLIP's exponent for compressing the color error
+static const float kFlipErrorExponent = 0.7f;
+
+float RootMeanSquaredError(const float3 *image, const float3 *reference, uint width, uint height) {
+	double sum = 0.0;
+	for (uint i = 0; i < width * height; ++i) {
+		for (uint c = 0; c < 3; ++c) {
+			double diff = image[i][c] - reference[i][c];
+			sum += diff * diff;
+		}
+	}
+
+	return (float)std::sqrt(sum / (3.0 * width * height));
+}
+
+float RelativeMeanSquaredError(const float3 *image, const float3 *reference, uint width, uint height) {
+	double sum = 0.0;
+	for (uint i = 0; i < width * height; ++i) {
+		for (uint c = 0; c < 3; ++c) {
+			double diff = image[i][c] - reference[i][c];
+			sum += diff * diff / (reference[i][c] * reference[i][c] + kRelativeErrorEpsilon);
+		}
+	}
+
+	return (float)(sum / (3.0 * width * height));
+}
+
+static float LabF(float t) {
+	const float delta = 6.0f / 29.0f;
+	return t > delta * delta * delta ? std::cbrt(t) : t / (3.0f * delta * delta) + 4.0f / 29.0f;
+}
+
+// Linear sRGB to CIE L*a*b*, with a D65 white point
+static float3 LinearRGBToLab(const float3 &rgb) {
+	float x = 0.4124564f * rgb.x + 0.3575761f * rgb.y + 0.1804375f * rgb.z;
+	float y = 0.2126729f * rgb.x + 0.7151522f * rgb.y + 0.0721750f * rgb.z;
+	float z = 0.0193339f * rgb.x + 0.1191920f * rgb.y + 0.9503041f * rgb.z;
+
+	float fx = LabF(x / 0.95047f);
+	float fy = LabF(y);
+	float fz = LabF(z / 1.08883f);
+
+	return float3(116.0f * fy - 16.0f, 500.0f * (fx - fy), 200.0f * (fy - fz));
+}
+
+static float HyAB(const float3 &a, const float3 &b) {
+	float da = a.y - b.y;
+	float db = a.z - b.z;
+	return std::abs(a.x - b.x) + std::sqrt(da * da + db * db);
+}
+
+// Tonemaps, converts to L*a*b*, and blurs an image
+static void PrepareFlipImage(const float3 *image, uint width, uint height, std::vector<float3> *output) {
+	uint numPixels = width * height;
+	std::vector<float3> lab(numPixels);
+	for (uint i = 0; i < numPixels; ++i) {
+		float3 color = max(image[i], float3(0.0f));
+		lab[i] = LinearRGBToLab(color / (color + float3(1.0f)));
+	}
+
+	int radius = (int)std::ceil(3.0f * kFlipBlurSigma);
+	std::vector<float> kernel(2 * radius + 1);
+	float kernelSum = 0.0f;
+	for (int i = -radius; i <= radius; ++i) {
+		kernel[i + radius] = std::exp(-(float)(i * i) / (2.0f * kFlipBlurSigma * kFlipBlurSigma));
+		kernelSum += kernel[i + radius];
+	}
+	for (float &weight : kernel) {
+		weight /= kernelSum;
+	}
+
+	// Separable blur, clamping at the edges
+	std::vector<float3> rowBlurred(numPixels);
+	for (int y = 0; y < (int)height; ++y) {
+		for (int x = 0; x < (int)width; ++x) {
+			float3 sum(0.0f);
+			for (int i = -radius; i <= radius; ++i) {
+				int sx = std::min(std::max(x + i, 0), (int)width - 1);
+				sum += lab[y * width + sx] * kernel[i + radius];
+			}
+			rowBlurred[y * width + x] = sum;
+		}
+	}
+
+	output->resize(numPixels);
+	for (int y = 0; y < (int)height; ++y) {
+		for (int x = 0; x < (int)width; ++x) {
+			float3 sum(0.0f);
+			for (int i = -radius; i <= radius; ++i) {
+				int sy = std::min(std::max(y + i, 0), (int)height - 1);
+				sum += rowBlurred[sy * width + x] * kernel[i + radius];
+			}
+			(*output)[y * width + x] = sum;
+		}
+	}
+}
+
+float FlipLikeError(const float3 *image, const float3 *reference, uint width, uint height) {
+	std::vector<float3> imageLab;
+	std::vector<float3> referenceLab;
+	PrepareFlipImage(image, width, height, &imageLab);
+	PrepareFlipImage(reference, width, height, &referenceLab);
+
+	// Like FLIP, normalize by the distance between the most different colors, pure green and pure blue
+	float maxDistance = HyAB(LinearRGBToLab(float3(0.0f, 1.0f, 0.0f)), LinearRGBToLab(float3(0.0f, 0.0f, 1.0f)));
+
+	double sum = 0.0;
+	for (uint i = 0; i < width * height; ++i) {
+		float error = std::min(HyAB(imageLab[i], referenceLab[i]) / maxDistance, 1.0f);
+		sum += std::pow(error, kFlipErrorExponent);
+	}
+
+	return (float)(sum / ((double)width * height));
+}
+
+} // End of namespace Lantern
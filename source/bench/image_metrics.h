@@ -0,0 +1,39 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+#include "math/vector_types.h"
+
+
+namespace Lantern {
+
+/**
+ * Root mean squared error over all the pixels and channels
+ */
+float RootMeanSquaredError(const float3 *image, const float3 *reference, uint width, uint height);
+
+/**
+ * Mean of the squared error divided by the squared reference value. So dark and bright regions
+ * contribute equally. A small epsilon keeps black reference pixels from dominating
+ */
+float RelativeMeanSquaredError(const float3 *image, const float3 *reference, uint width, uint height);
+
+/**
+ * A simplified take on FLIP. Andersson et al. 2020, "FLIP: A Difference Evaluator for Alternating Images"
+ *
+ * Both images are tonemapped, converted to L*a*b*, and blurred with a small Gaussian to mimic the
+ * contrast sensitivity of the eye. The per-pixel error is the HyAB color distance, normalized to
+ * [0, 1] and compressed like FLIP's color pipeline. Unlike FLIP, there is no separate feature
+ * (edge and point) term, so the absolute values aren't comparable with the real thing.
+ * It's only meant for comparing renderer configurations against each other
+ *
+ * @return    The mean per-pixel error, in [0, 1]
+ */
+float FlipLikeError(const float3 *image, const float3 *reference, uint width, uint height);
+
+} // End of namespace Lantern
@@ -0,0 +1,233 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "bench/benchmarks.h"
+#include "bench/benchmark_report.h"
+
+#include "camera/reconstruction_filter.h"
+
+#include "materials/bsdfs/lambert_bsdf.h"
+#include "materials/bsdfs/mirror_bsdf.h"
+#include "materials/bsdfs/ideal_specular_dielectric.h"
+#include "materials/bsdfs/ggx_conductor.h"
+#include "materials/bsdfs/ggx_dielectric.h"
+
+#include "math/uniform_sampler.h"
+#include "math/sampling.h"
+#include "math/vector_math.h"
+
+#include "renderer/surface_interaction.h"
+
+#include "scene/scene.h"
+#include "scene/sample_scenes.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+namespace Lantern {
+
+// The results of the benchmarked functions are summed into this, so the compiler can't optimize them away
+static volatile float g_sink;
+
+// The number of pre-generated inputs. Small enough to stay in cache, so we measure the function, not memory
+static const uint kNumInputs = 1u << 16;
+
+template <typename Func>
+static void TimeIterations(const std::string &name, uint numIterations, Func func, BenchmarkReport *report) {
+	// Warm up the caches and branch predictors
+	for (uint i = 0; i < numIterations / 16; ++i) {
+		func(i);
+	}
+
+	auto startTime = std::chrono::steady_clock::now();
+	for (uint i = 0; i < numIterations; ++i) {
+		func(i);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	report->BeginResult("micro", name);
+	report->AddMetric("iterations", numIterations);
+	report->AddMetric("ns_per_op", seconds * 1.0e9 / numIterations);
+	report->AddMetric("mops_per_second", numIterations / seconds * 1.0e-6);
+	report->PrintLastResult();
+}
+
+static void BenchmarkSampler(uint seed, BenchmarkReport *report) {
+	const uint kIterations = 1u << 26;
+
+	UniformSampler sampler(seed);
+	float sum = 0.0f;
+	TimeIterations("uniform_sampler_next_float", kIterations, [&](uint /* i */) {
+		sum += sampler.NextFloat();
+	}, report);
+	g_sink = sum;
+}
+
+static void BenchmarkFilters(uint seed, BenchmarkReport *report) {
+	const uint kIterations = 1u << 24;
+
+	UniformSampler sampler(seed);
+	std::vector<float> inputs(kNumInputs);
+	for (float &input : inputs) {
+		input = sampler.NextFloat();
+	}
+
+	const struct {
+		const char *Name;
+		ReconstructionFilter::Type Type;
+	} kFilters[] = {
+		{"filter_sample_box", ReconstructionFilter::Type::Box},
+		{"filter_sample_tent", ReconstructionFilter::Type::Tent},
+		{"filter_sample_gaussian", ReconstructionFilter::Type::Gaussian},
+		{"filter_sample_mitchell", ReconstructionFilter::Type::Mitchell},
+		{"filter_sample_lanczos", ReconstructionFilter::Type::Lanczos},
+		{"filter_sample_blackman_harris", ReconstructionFilter::Type::BlackmanHarris}
+	};
+
+	for (auto &filterInfo : kFilters) {
+		ReconstructionFilter filter(filterInfo.Type);
+
+		float sum = 0.0f;
+		TimeIterations(filterInfo.Name, kIterations, [&](uint i) {
+			float weight;
+			sum += filter.Sample(inputs[i % kNumInputs], &weight) * weight;
+		}, report);
+		g_sink = sum;
+	}
+}
+
+static void BenchmarkBSDF(const char *name, const BSDF &bsdf, uint seed, BenchmarkReport *report) {
+	const uint kIterations = 1u << 24;
+
+	UniformSampler sampler(seed);
+	float3a normal(0.0f, 1.0f, 0.0f);
+	std::vector<float3a> outputDirections(kNumInputs);
+	for (float3a &direction : outputDirections) {
+		direction = UniformSampleHemisphere(normal, &sampler);
+	}
+
+	float sum = 0.0f;
+	TimeIterations(name, kIterations, [&](uint i) {
+		SurfaceInteraction interaction;
+		interaction.Normal = normal;
+		interaction.OutputDirection = outputDirections[i % kNumInputs];
+		interaction.IORi = 1.0f;
+
+		bsdf.Sample(interaction, &sampler);
+		sum += interaction.InputDirection.x;
+	}, report);
+	g_sink = sum;
+}
+
+template <uint kPacketWidth, typename RayPacket>
+static void BenchmarkPacketIntersect(const std::string &name, const Scene &scene, const std::vector<Ray> &rays, 
+                                     void (Scene::*intersect)(const int *, RayPacket &) const, BenchmarkReport *report) {
+	uint numPackets = (uint)rays.size() / kPacketWidth;
+
+	alignas(64) int valid[kPacketWidth];
+	for (uint i = 0; i < kPacketWidth; ++i) {
+		valid[i] = -1;
+	}
+
+	float sum = 0.0f;
+	TimeIterations(name, numPackets, [&](uint packetIndex) {
+		// Packets are overwritten by the intersection, so they're rebuilt every time, the same as the renderer does
+		RayPacket packet;
+		for (uint i = 0; i < kPacketWidth; ++i) {
+			const Ray &ray = rays[packetIndex * kPacketWidth + i];
+			packet.orgx[i] = ray.Origin.x;
+			packet.orgy[i] = ray.Origin.y;
+			packet.orgz[i] = ray.Origin.z;
+			packet.dirx[i] = ray.Direction.x;
+			packet.diry[i] = ray.Direction.y;
+			packet.dirz[i] = ray.Direction.z;
+			packet.tnear[i] = ray.TNear;
+			packet.tfar[i] = ray.TFar;
+			packet.time[i] = ray.Time;
+			packet.mask[i] = ray.Mask;
+			packet.geomID[i] = INVALID_GEOMETRY_ID;
+			packet.primID[i] = INVALID_PRIMATIVE_ID;
+			packet.instID[i] = INVALID_INSTANCE_ID;
+		}
+
+		(scene.*intersect)(valid, packet);
+		sum += packet.tfar[0];
+	}, report);
+	g_sink = sum;
+}
+
+static void BenchmarkIntersect(uint seed, BenchmarkReport *report) {
+	Scene scene;
+	LoadBallsScene(&scene);
+	scene.Commit();
+
+	UniformSampler sampler(seed);
+
+	// Camera rays are as coherent as it gets
+	std::vector<Ray> coherentRays;
+	const FrameBuffer &frameBuffer = scene.Camera.FrameBuffer;
+	for (uint y = 0; y < frameBuffer.Height; ++y) {
+		for (uint x = 0; x < frameBuffer.Width; ++x) {
+			coherentRays.push_back(scene.Camera.CalculateRayFromPixel(x, y, &sampler));
+		}
+	}
+
+	// Random origins around the spheres, in random directions. Like the later bounces of a path
+	std::vector<Ray> incoherentRays;
+	for (std::size_t i = 0; i < coherentRays.size(); ++i) {
+		float3a origin((sampler.NextFloat() - 0.5f) * 20.0f, (sampler.NextFloat() - 0.5f) * 20.0f, (sampler.NextFloat() - 0.5f) * 20.0f);
+		incoherentRays.push_back(Ray(origin, UniformSampleSphere(&sampler), 0.001f));
+	}
+
+	const struct {
+		const char *Name;
+		const std::vector<Ray> *Rays;
+	} kRaySets[] = {
+		{"coherent", &coherentRays},
+		{"incoherent", &incoherentRays}
+	};
+
+	for (auto &raySet : kRaySets) {
+		const std::vector<Ray> &rays = *raySet.Rays;
+
+		float sum = 0.0f;
+		TimeIterations(std::string("rtc_intersect1_") + raySet.Name, (uint)rays.size(), [&](uint i) {
+			Ray ray = rays[i];
+			scene.Intersect(ray);
+			sum += ray.TFar;
+		}, report);
+		g_sink = sum;
+
+		if (scene.PacketWidth() >= 8u) {
+			BenchmarkPacketIntersect<8u, RTCRay8>(std::string("rtc_intersect8_") + raySet.Name, scene, rays, &Scene::Intersect8, report);
+		}
+		if (scene.PacketWidth() >= 16u) {
+			BenchmarkPacketIntersect<16u, RTCRay16>(std::string("rtc_intersect16_") + raySet.Name, scene, rays, &Scene::Intersect16, report);
+		}
+	}
+}
+
+void RunMicroBenchmarks(uint seed, BenchmarkReport *report) {
+	BenchmarkSampler(seed, report);
+	BenchmarkFilters(seed, report);
+
+	LambertBSDF lambert(float3(0.8f));
+	MirrorBSDF mirror(float3(0.95f));
+	IdealSpecularDielectric dielectric(float3(0.95f), 1.5f);
+	GGXConductor conductor(float3(0.95f, 0.64f, 0.54f), 0.3f);
+	GGXDielectric roughDielectric(float3(0.95f), 1.5f, 0.3f);
+	BenchmarkBSDF("bsdf_sample_lambert", lambert, seed, report);
+	BenchmarkBSDF("bsdf_sample_mirror", mirror, seed, report);
+	BenchmarkBSDF("bsdf_sample_dielectric", dielectric, seed, report);
+	BenchmarkBSDF("bsdf_sample_ggx_conductor", conductor, seed, report);
+	BenchmarkBSDF("bsdf_sample_ggx_dielectric", roughDielectric, seed, report);
+
+	BenchmarkIntersect(seed, report);
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,155 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "bench/benchmarks.h"
+#include "bench/benchmark_report.h"
+
+#include "scene/scene.h"
+#include "scene/sample_scenes.h"
+#include "scene/stress_scene_generator.h"
+
+#include "renderer/renderer.h"
+
+#include "math/hash.h"
+
+#include "profiling/memory_tracker.h"
+
+#include <tbb/task_arena.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace Lantern {
+
+static uint HashFrameBuffer(const FrameBuffer &frameBuffer) {
+	const float3 *colorData = frameBuffer.GetColorData();
+	const float *weights = frameBuffer.GetWeights();
+
+	uint hash = 0u;
+	for (uint i = 0; i < frameBuffer.Width * frameBuffer.Height; ++i) {
+		float3 color = weights[i] > 0.0f ? colorData[i] / weights[i] : float3(0.0f);
+		for (uint c = 0; c < 3; ++c) {
+			uint bits;
+			memcpy(&bits, &color[c], sizeof(uint));
+			hash = HashMix(hash, bits);
+		}
+	}
+
+	return HashFinalize(hash);
+}
+
+bool LoadBenchmarkScene(const std::string &name, uint seed, Scene *scene) {
+	scene->BackgroundColor = float3(0.846f, 0.933f, 0.949f);
+
+	const std::string kSyntheticPrefix = "synthetic_";
+	if (name == "balls") {
+		LoadBallsScene(scene);
+		return true;
+	} else if (name == "dragon") {
+		return LoadDragonScene(scene);
+	} else if (name == "subdivision") {
+		return LoadSubdivisionScene(scene, nullptr);
+	} else if (name == "smoke") {
+		return LoadSmokeScene(scene, nullptr, 0u, 0u, 0u);
+	} else if (name.compare(0, kSyntheticPrefix.size(), kSyntheticPrefix) == 0) {
+		uint numSpheres = (uint)strtoul(name.c_str() + kSyntheticPrefix.size(), nullptr, 10);
+		LoadSyntheticScene(scene, numSpheres, seed);
+		return true;
+	} else if (name.compare(0, 7, "stress_") == 0) {
+		StressSceneSettings settings;
+		char instancing;
+		if (sscanf(name.c_str(), "stress_%u_%u_%c_%u_%u", &settings.NumSpheres, &settings.SphereSubdivisions, &instancing, &settings.NumEmissiveMeshes, &settings.NumGlassLayers) != 5) {
+			return false;
+		}
+		settings.InstanceSpheres = instancing == 'i';
+		settings.Seed = seed;
+
+		uint64 numTriangles = GenerateStressScene(settings, scene);
+		printf("Generated %s with %llu triangles\n", name.c_str(), (unsigned long long)numTriangles);
+		return true;
+	}
+
+	return false;
+}
+
+static void RunSceneBenchmark(const std::string &name, uint seed, uint numThreads, uint samplesPerPixel, bool lazyBuild, BenchmarkReport *report) {
+	// Limit the TBB worker threads of everything run inside the arena, including the BVH build
+	tbb::task_arena arena((int)numThreads);
+	arena.execute([&]() {
+		Scene scene;
+		if (lazyBuild) {
+			scene.EnableLazyBuild();
+		}
+
+		auto loadStart = std::chrono::steady_clock::now();
+		if (!LoadBenchmarkScene(name, seed, &scene)) {
+			printf("Skipping %s. The scene failed to load\n", name.c_str());
+			return;
+		}
+
+		auto buildStart = std::chrono::steady_clock::now();
+		scene.Commit();
+		auto buildEnd = std::chrono::steady_clock::now();
+
+		// With a lazy build, most of the BVH builds land in the first frame
+		Renderer renderer(&scene);
+		renderer.RenderFrame();
+		auto firstFrameEnd = std::chrono::steady_clock::now();
+		while (renderer.FrameNumber() < samplesPerPixel) {
+			renderer.RenderFrame();
+		}
+
+		const RenderStats &stats = renderer.Stats();
+		const FrameBuffer &frameBuffer = scene.Camera.FrameBuffer;
+		double renderSeconds = stats.TotalSeconds();
+		double numPixels = (double)frameBuffer.Width * frameBuffer.Height;
+
+		report->BeginResult("scene", name + (lazyBuild ? "/lazy" : "") + "/threads=" + std::to_string(numThreads));
+		report->AddMetric("threads", numThreads);
+		report->AddMetric("lazy_build", lazyBuild ? 1u : 0u);
+		report->AddMetric("spp", samplesPerPixel);
+		report->AddMetric("load_seconds", std::chrono::duration<double>(buildStart - loadStart).count());
+		report->AddMetric("build_seconds", std::chrono::duration<double>(buildEnd - buildStart).count());
+		report->AddMetric("first_frame_seconds", std::chrono::duration<double>(firstFrameEnd - buildStart).count());
+		report->AddMetric("render_seconds", renderSeconds);
+		report->AddMetric("seconds_per_sample", renderSeconds / samplesPerPixel);
+		report->AddMetric("ns_per_path", renderSeconds * 1.0e9 / (numPixels * samplesPerPixel));
+		report->AddMetric("rays", (double)stats.Total().TotalRays());
+		report->AddMetric("rays_per_second", stats.TotalRaysPerSecond());
+		report->AddMetric("image_hash", HashFrameBuffer(frameBuffer));
+		report->AddMetric("memory_bytes", (double)TotalTrackedMemory());
+		report->AddMetric("embree_bytes", (double)TrackedMemory(MemoryCategory::Embree));
+		report->PrintLastResult();
+	});
+}
+
+void RunSceneBenchmarks(const SceneBenchmarkSettings &settings, BenchmarkReport *report) {
+	std::vector<std::string> sceneNames = {"balls", "dragon", "subdivision", "smoke"};
+	for (uint numSpheres : settings.SyntheticSceneSizes) {
+		sceneNames.push_back("synthetic_" + std::to_string(numSpheres));
+	}
+	sceneNames.insert(sceneNames.end(), settings.StressScenes.begin(), settings.StressScenes.end());
+
+	// The lazy build only changes how meshes are built, so it's only compared on the mesh heavy scenes
+	std::vector<std::string> lazySceneNames = {"dragon"};
+	lazySceneNames.insert(lazySceneNames.end(), settings.StressScenes.begin(), settings.StressScenes.end());
+
+	for (uint numThreads : settings.ThreadCounts) {
+		for (const std::string &sceneName : sceneNames) {
+			RunSceneBenchmark(sceneName, settings.Seed, numThreads, settings.SamplesPerPixel, false, report);
+		}
+		for (const std::string &sceneName : lazySceneNames) {
+			RunSceneBenchmark(sceneName, settings.Seed, numThreads, settings.SamplesPerPixel, true, report);
+		}
+	}
+}
+
+} // End of namespace Lantern
@@ -6,14 +6,100 @@
 
 #include "camera/frame_buffer.h"
 
+#include "camera/pinhole_camera.h"
+
+#include "scene/ray.h"
+
 
 namespace Lantern {
 
+const float FrameBuffer::kReprojectionDepthTolerance = 0.05f;
+const float FrameBuffer::kMaxFeatureDepth = 1.0e6f;
+
 FrameBuffer::FrameBuffer(uint width, uint height)
 		: Width(width),
 		  Height(height) {
 	m_colorData.resize(width * height);
 	m_weights.resize(width * height);
+	m_luminanceSquaredSums.resize(width * height);
+	m_albedoSums.resize(width * height);
+	m_normalSums.resize(width * height);
+	m_depthSums.resize(width * height);
+	m_primaryDepth.resize(width * height, infinity);
+	m_primaryGeomIds.resize(width * height, INVALID_GEOMETRY_ID);
+	m_historyReprojected.resize(width * height, 0);
+}
+
+void FrameBuffer::Reproject(const CameraView &oldView, const CameraView &newView, float historyDecay, float maxHistoryWeight) {
+	uint numPixels = Width * Height;
+
+	Buffer<float3> colorData(numPixels, float3(0.0f));
+	Buffer<float> weights(numPixels, 0.0f);
+	Buffer<float> luminanceSquaredSums(numPixels, 0.0f);
+	Buffer<float3> albedoSums(numPixels, float3(0.0f));
+	Buffer<float3> normalSums(numPixels, float3(0.0f));
+	Buffer<float> depthSums(numPixels, 0.0f);
+	Buffer<float> primaryDepth(numPixels, infinity);
+	Buffer<uint> primaryGeomIds(numPixels, INVALID_GEOMETRY_ID);
+
+	for (uint y = 0; y < Height; ++y) {
+		for (uint x = 0; x < Width; ++x) {
+			uint oldIndex = y * Width + x;
+
+			float weight = m_weights[oldIndex];
+			if (weight == 0.0f) {
+				continue;
+			}
+
+			// Reconstruct the primary hit using the center of the pixel
+			// Misses are at infinity, so only their direction matters
+			float3a direction = oldView.PixelDirection(x + 0.5f, y + 0.5f);
+			float depth = infinity;
+			uint geomId = m_primaryGeomIds[oldIndex];
+			if (geomId != INVALID_GEOMETRY_ID) {
+				float3a position = oldView.Origin + direction * m_primaryDepth[oldIndex];
+				direction = position - newView.Origin;
+				depth = length(direction);
+			}
+
+			float newX, newY;
+			if (!newView.ProjectDirection(direction, &newX, &newY)) {
+				continue;
+			}
+
+			uint newIndex = (uint)newY * Width + (uint)newX;
+
+			// Depth test. Misses only win against other misses, and only if they got there first
+			if (weights[newIndex] != 0.0f && !(depth < primaryDepth[newIndex])) {
+				continue;
+			}
+
+			float newWeight = std::min(weight * historyDecay, maxHistoryWeight);
+			float scale = newWeight / weight;
+			colorData[newIndex] = m_colorData[oldIndex] * scale;
+			weights[newIndex] = newWeight;
+			luminanceSquaredSums[newIndex] = m_luminanceSquaredSums[oldIndex] * scale;
+			// Albedo and normals are close enough for small camera moves. Depth is measured from the new view
+			albedoSums[newIndex] = m_albedoSums[oldIndex] * scale;
+			normalSums[newIndex] = m_normalSums[oldIndex] * scale;
+			depthSums[newIndex] = std::min(depth, kMaxFeatureDepth) * newWeight;
+			primaryDepth[newIndex] = depth;
+			primaryGeomIds[newIndex] = geomId;
+		}
+	}
+
+	m_colorData.swap(colorData);
+	m_weights.swap(weights);
+	m_luminanceSquaredSums.swap(luminanceSquaredSums);
+	m_albedoSums.swap(albedoSums);
+	m_normalSums.swap(normalSums);
+	m_depthSums.swap(depthSums);
+	m_primaryDepth.swap(primaryDepth);
+	m_primaryGeomIds.swap(primaryGeomIds);
+
+	for (uint i = 0; i < numPixels; ++i) {
+		m_historyReprojected[i] = m_weights[i] != 0.0f ? 1 : 0;
+	}
 }
 
 } // End of namespace Lantern
@@ -8,12 +8,32 @@
 
 #include "math/int_types.h"
 #include "math/vector_types.h"
+#include "math/vector_math.h"
 
+#include "profiling/memory_tracker.h"
+
+#include <algorithm>
+#include <cstring>
 #include <vector>
 
 
 namespace Lantern {
 
+struct CameraView;
+
+/**
+ * Everything the FrameBuffer accumulates for a single pixel
+ * Used to move partially accumulated pixels between FrameBuffers
+ */
+struct PixelAccumulation {
+	float3 ColorSum;
+	float Weight;
+	float LuminanceSquaredSum;
+	float3 AlbedoSum;
+	float3 NormalSum;
+	float DepthSum;
+};
+
 class FrameBuffer {
 public:
 	FrameBuffer(uint width, uint height);
@@ -23,8 +43,25 @@ public:
 	uint Height;
 
 private:
-	std::vector<float3> m_colorData;
-	std::vector<float> m_weights;
+	template <typename T>
+	using Buffer = TrackedVector<T, MemoryCategory::FrameBuffer>;
+
+	Buffer<float3> m_colorData;
+	Buffer<float> m_weights;
+	// The sum of the squared luminance of each sample. Used to estimate the per-pixel variance
+	Buffer<float> m_luminanceSquaredSums;
+
+	// First hit feature buffers. Used to guide the denoiser
+	// These are accumulated with the same weights as the color
+	Buffer<float3> m_albedoSums;
+	Buffer<float3> m_normalSums;
+	Buffer<float> m_depthSums;
+
+	// Primary hit data of the latest sample in each pixel
+	// Used to validate reprojected history
+	Buffer<float> m_primaryDepth;
+	Buffer<uint> m_primaryGeomIds;
+	Buffer<uint8> m_historyReprojected;
 
 public:
 	void SplatPixel(uint x, uint y, float3 &color) {
@@ -32,22 +69,188 @@ public:
 
 		m_colorData[index] += color;
 		m_weights[index] += 1.0f;
+
+		float luminance = Luminance(color);
+		m_luminanceSquaredSums[index] += luminance * luminance;
+	}
+
+	/**
+	 * Adds the first hit features of a sample to a pixel.
+	 * Should be called once for each SplatPixel() of a full resolution sample
+	 *
+	 * @param x         The x coordinate of the pixel
+	 * @param y         The y coordinate of the pixel
+	 * @param albedo    The albedo of the first hit
+	 * @param normal    The shading normal of the first hit
+	 * @param depth     The distance from the camera to the first hit. Misses are clamped to kMaxFeatureDepth
+	 */
+	void SplatFeatures(uint x, uint y, const float3 &albedo, const float3 &normal, float depth) {
+		uint index = y * Width + x;
+
+		m_albedoSums[index] += albedo;
+		m_normalSums[index] += normal;
+		m_depthSums[index] += std::min(depth, kMaxFeatureDepth);
+	}
+
+	/**
+	 * Writes the same color to every pixel in a size x size block, clamped to the edges of the buffer.
+	 * Used to upscale reduced-resolution preview frames for display
+	 *
+	 * @param x        The x coordinate of the top-left pixel of the block
+	 * @param y        The y coordinate of the top-left pixel of the block
+	 * @param size     The width and height of the block
+	 * @param color    The color to splat
+	 */
+	void SplatBlock(uint x, uint y, uint size, float3 &color) {
+		uint x1 = std::min(x + size, Width);
+		uint y1 = std::min(y + size, Height);
+
+		for (uint j = y; j < y1; ++j) {
+			for (uint i = x; i < x1; ++i) {
+				SplatPixel(i, j, color);
+			}
+		}
+	}
+
+	/**
+	 * Stores the primary hit of the latest sample in a pixel
+	 *
+	 * If the pixel's history was reprojected from a previous camera position, the hit is first
+	 * compared against the reprojected one. If they don't match, the pixel was disoccluded, so
+	 * we throw away its history
+	 *
+	 * Must be called *before* SplatPixel() for the same sample, so the sample itself is kept
+	 *
+	 * @param x          The x coordinate of the pixel
+	 * @param y          The y coordinate of the pixel
+	 * @param depth      The distance from the camera to the primary hit. Infinity if the ray missed
+	 * @param geomId     The geometry id of the primary hit. INVALID_GEOMETRY_ID if the ray missed
+	 */
+	void SplatPrimaryHit(uint x, uint y, float depth, uint geomId) {
+		uint index = y * Width + x;
+
+		if (m_historyReprojected[index] != 0) {
+			m_historyReprojected[index] = 0;
+
+			bool sameDepth = (depth == m_primaryDepth[index]) || 
+			                 std::abs(depth - m_primaryDepth[index]) <= kReprojectionDepthTolerance * depth;
+			if (geomId != m_primaryGeomIds[index] || !sameDepth) {
+				PixelAccumulation discarded;
+				TakePixel(x, y, &discarded);
+			}
+		}
+
+		m_primaryDepth[index] = depth;
+		m_primaryGeomIds[index] = geomId;
 	}
 
+	/**
+	 * Moves the accumulated samples from the point of view of oldView to the point of view of newView
+	 *
+	 * Each pixel is forward-projected using its primary hit. When multiple pixels land in the same place,
+	 * the closest one wins. The history that survives is weighted by historyDecay, so new samples quickly
+	 * dominate. Pixels that receive no history start from scratch.
+	 *
+	 * @param oldView             The camera view that the current samples were rendered with
+	 * @param newView             The camera view to reproject to
+	 * @param historyDecay        The factor applied to the weights of the reprojected history
+	 * @param maxHistoryWeight    The maximum weight a pixel's history can have, after decay
+	 */
+	void Reproject(const CameraView &oldView, const CameraView &newView, float historyDecay, float maxHistoryWeight);
+
 	void GetPixel(uint x, uint y, float3 &pixel) const {
 		uint index = y * Width + x;
 
 		pixel = m_colorData[index];
 	}
 
+	/**
+	 * Adds partially accumulated data to a pixel. Used to merge buffers rendered elsewhere
+	 *
+	 * @param x               The x coordinate of the pixel
+	 * @param y               The y coordinate of the pixel
+	 * @param accumulation    The data to add
+	 */
+	void MergePixel(uint x, uint y, const PixelAccumulation &accumulation) {
+		uint index = y * Width + x;
+
+		m_colorData[index] += accumulation.ColorSum;
+		m_weights[index] += accumulation.Weight;
+		m_luminanceSquaredSums[index] += accumulation.LuminanceSquaredSum;
+		m_albedoSums[index] += accumulation.AlbedoSum;
+		m_normalSums[index] += accumulation.NormalSum;
+		m_depthSums[index] += accumulation.DepthSum;
+	}
+
+	/**
+	 * Returns the accumulated data of a pixel, and clears it.
+	 * The inverse of MergePixel()
+	 */
+	void TakePixel(uint x, uint y, PixelAccumulation *accumulation) {
+		uint index = y * Width + x;
+
+		accumulation->ColorSum = m_colorData[index];
+		accumulation->Weight = m_weights[index];
+		accumulation->LuminanceSquaredSum = m_luminanceSquaredSums[index];
+		accumulation->AlbedoSum = m_albedoSums[index];
+		accumulation->NormalSum = m_normalSums[index];
+		accumulation->DepthSum = m_depthSums[index];
+
+		m_colorData[index] = float3(0.0f);
+		m_weights[index] = 0.0f;
+		m_luminanceSquaredSums[index] = 0.0f;
+		m_albedoSums[index] = float3(0.0f);
+		m_normalSums[index] = float3(0.0f);
+		m_depthSums[index] = 0.0f;
+	}
+
+	/**
+	 * Returns the variance of the luminance of the samples in a pixel
+	 */
+	float GetVariance(uint x, uint y) const {
+		uint index = y * Width + x;
+
+		float weight = m_weights[index];
+		if (weight == 0.0f) {
+			return 0.0f;
+		}
+
+		float mean = Luminance(m_colorData[index]) / weight;
+		return std::max(m_luminanceSquaredSums[index] / weight - mean * mean, 0.0f);
+	}
+
 	float3 *GetColorData() { return &m_colorData[0]; }
 	float *GetWeights() { return &m_weights[0]; }
+	float *GetLuminanceSquaredSums() { return &m_luminanceSquaredSums[0]; }
+	const float3 *GetColorData() const { return &m_colorData[0]; }
+	const float *GetWeights() const { return &m_weights[0]; }
+	const float *GetLuminanceSquaredSums() const { return &m_luminanceSquaredSums[0]; }
+	float3 *GetAlbedoSums() { return &m_albedoSums[0]; }
+	float3 *GetNormalSums() { return &m_normalSums[0]; }
+	float *GetDepthSums() { return &m_depthSums[0]; }
+	const float3 *GetAlbedoSums() const { return &m_albedoSums[0]; }
+	const float3 *GetNormalSums() const { return &m_normalSums[0]; }
+	const float *GetDepthSums() const { return &m_depthSums[0]; }
 
 	void Reset() {
 		// We rely on the fact that 0x0000 == 0.0f
 		memset(&m_colorData[0], 0, Width * Height * sizeof(float3));
 		memset(&m_weights[0], 0, Width * Height * sizeof(float));
+		memset(&m_luminanceSquaredSums[0], 0, Width * Height * sizeof(float));
+		memset(&m_albedoSums[0], 0, Width * Height * sizeof(float3));
+		memset(&m_normalSums[0], 0, Width * Height * sizeof(float3));
+		memset(&m_depthSums[0], 0, Width * Height * sizeof(float));
+		memset(&m_historyReprojected[0], 0, Width * Height * sizeof(uint8));
 	}
+
+private:
+	// The relative difference in depth that we still consider to be the same surface
+	// It needs to be fairly loose, since each sample is jittered within the pixel
+	static const float kReprojectionDepthTolerance;
+
+public:
+	// Depth features are clamped to this, so misses can be accumulated with everything else
+	static const float kMaxFeatureDepth;
 };
 
 } // End of namespace Lantern
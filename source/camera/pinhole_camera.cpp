@@ -87,7 +87,14 @@ void PinholeCamera::Pan(float dx, float dy) {
 	UpdateOrigin();
 }
 
-Ray PinholeCamera::CalculateRayFromPixel(uint x, uint y, UniformSampler *sampler) const {
+Ray PinholeCamera::CalculateRayFromPixel(uint x, uint y, UniformSampler *sampler, float *filterWeight) const {
+	float filterU = sampler->NextFloat();
+	float filterV = sampler->NextFloat();
+
+	return CalculateRayFromPixel(x, y, filterU, filterV, filterWeight);
+}
+
+Ray PinholeCamera::CalculateRayFromPixel(uint x, uint y, float filterU, float filterV, float *filterWeight) const {
 	Ray ray;
 
 	ray.Origin = m_origin;
@@ -99,8 +106,12 @@ Ray PinholeCamera::CalculateRayFromPixel(uint x, uint y, UniformSampler *sampler
 	ray.Mask = 0xFFFFFFFF;
 	ray.Time = 0.0f;
 
-	float u = m_filter.Sample(sampler->NextFloat());
-	float v = m_filter.Sample(sampler->NextFloat());
+	float weightU, weightV;
+	float u = m_filter.Sample(filterU, &weightU);
+	float v = m_filter.Sample(filterV, &weightV);
+	if (filterWeight != nullptr) {
+		*filterWeight = weightU * weightV;
+	}
 	
 	float3a viewVector((((x + 0.5f + u) / FrameBuffer.Width) * 2.0f - 1.0f) * m_tanFovXDiv2,
 	                   -(((y + 0.5f + v) / FrameBuffer.Height) * 2.0f - 1.0f) * m_tanFovYDiv2,
@@ -114,4 +125,18 @@ Ray PinholeCamera::CalculateRayFromPixel(uint x, uint y, UniformSampler *sampler
 	return ray;
 }
 
+CameraView PinholeCamera::GetView() const {
+	CameraView view;
+	view.Origin = m_origin;
+	view.XAxis = m_xAxis;
+	view.YAxis = m_yAxis;
+	view.ZAxis = m_zAxis;
+	view.TanFovXDiv2 = m_tanFovXDiv2;
+	view.TanFovYDiv2 = m_tanFovYDiv2;
+	view.Width = FrameBuffer.Width;
+	view.Height = FrameBuffer.Height;
+
+	return view;
+}
+
 } // End of namespace Lantern
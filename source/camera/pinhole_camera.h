@@ -18,6 +18,64 @@
 
 namespace Lantern {
 
+/**
+ * The data needed to generate and project rays for a single camera position
+ *
+ * Unlike PinholeCamera, which owns the FrameBuffer, this is cheap to copy.
+ * So it can be used to remember where the camera *was*
+ */
+struct CameraView {
+	float3a Origin;
+
+	float3a XAxis;
+	float3a YAxis;
+	float3a ZAxis;
+
+	float TanFovXDiv2;
+	float TanFovYDiv2;
+
+	uint Width;
+	uint Height;
+
+	/**
+	 * Calculates the normalized world-space direction from the camera origin through a point on the image plane
+	 *
+	 * @param x    The x coordinate on the image plane, in pixels. IE. The center of pixel 0 is 0.5
+	 * @param y    The y coordinate on the image plane, in pixels
+	 * @return     The world-space direction
+	 */
+	float3a PixelDirection(float x, float y) const {
+		float viewX = ((x / Width) * 2.0f - 1.0f) * TanFovXDiv2;
+		float viewY = -((y / Height) * 2.0f - 1.0f) * TanFovYDiv2;
+
+		return normalize(XAxis * viewX + YAxis * viewY - ZAxis);
+	}
+
+	/**
+	 * Projects a world-space direction from the camera origin back onto the image plane.
+	 * This is the inverse of PixelDirection()
+	 *
+	 * @param direction    The world-space direction. It does not need to be normalized
+	 * @param x            Filled with the x coordinate on the image plane, in pixels
+	 * @param y            Filled with the y coordinate on the image plane, in pixels
+	 * @return             False if the direction points behind the camera or lands outside the image
+	 */
+	bool ProjectDirection(float3a direction, float *x, float *y) const {
+		float localZ = -dot(direction, ZAxis);
+		if (localZ <= 0.0f) {
+			return false;
+		}
+
+		float viewX = dot(direction, XAxis) / localZ;
+		float viewY = dot(direction, YAxis) / localZ;
+
+		*x = (viewX / TanFovXDiv2 + 1.0f) * 0.5f * Width;
+		*y = (-viewY / TanFovYDiv2 + 1.0f) * 0.5f * Height;
+
+		return *x >= 0.0f && *x < Width && *y >= 0.0f && *y < Height;
+	}
+};
+
 class PinholeCamera {
 public:
 	PinholeCamera();
@@ -86,10 +144,34 @@ public:
 	/**
 	 * Calculates the world-space ray from the camera origin to the specified pixel
 	 *
-	 * @param x         The x coordinate of the pixel
-	 * @param y         The y coordinate of the pixel
+	 * @param x               The x coordinate of the pixel
+	 * @param y               The y coordinate of the pixel
+	 * @param filterWeight    If not null, filled with the weight the ray's radiance should be multiplied by.
+	 *                        It's only ever not 1.0 for filters with negative lobes
+	 */
+	Ray CalculateRayFromPixel(uint x, uint y, UniformSampler *sampler, float *filterWeight = nullptr) const;
+	/**
+	 * Calculates the world-space ray from the camera origin to the specified pixel,
+	 * using explicit random numbers to importance sample the reconstruction filter
+	 *
+	 * @param x               The x coordinate of the pixel
+	 * @param y               The y coordinate of the pixel
+	 * @param filterU         A random number in [0, 1) used to sample the filter in x
+	 * @param filterV         A random number in [0, 1) used to sample the filter in y
+	 * @param filterWeight    If not null, filled with the weight the ray's radiance should be multiplied by
+	 */
+	Ray CalculateRayFromPixel(uint x, uint y, float filterU, float filterV, float *filterWeight = nullptr) const;
+
+	/**
+	 * Returns the angle a pixel at the center of the image covers. Camera rays start as cones with this
+	 * spread angle, which is used to pick the mip level of textures
+	 */
+	float PixelSpreadAngle() const { return 2.0f * m_tanFovYDiv2 / FrameBuffer.Height; }
+
+	/**
+	 * Returns a copy of the current camera position and ray transform
 	 */
-	Ray CalculateRayFromPixel(uint x, uint y, UniformSampler *sampler) const;
+	CameraView GetView() const;
 
 private:
 	/**
@@ -7,8 +7,11 @@
 #include "camera/reconstruction_filter.h"
 
 #include "math/int_types.h"
+#include "math/vector_types.h"
 
 #include <algorithm>
+#include <cmath>
+#include <vector>
 
 
 namespace Lantern {
@@ -27,69 +30,41 @@ ReconstructionFilter::ReconstructionFilter(Type filterType)
 
 ReconstructionFilter::ReconstructionFilter(Type filterType, float width)
 		: m_filterType(filterType),
-		  m_width(m_width) {
+		  m_width(width) {
 	PreCompute();
 }
 
-float ReconstructionFilter::Sample(float x) const {
-	if (m_filterType == Type::Dirac) {
-		return 0.0f;
+// Mitchell and Netravali 1988, "Reconstruction Filters in Computer Graphics", with B = C = 1/3
+static float Mitchell1D(float x) {
+	const float B = 1.0f / 3.0f;
+	const float C = 1.0f / 3.0f;
+
+	x = std::abs(x);
+	if (x < 1.0f) {
+		return ((12.0f - 9.0f * B - 6.0f * C) * x * x * x + (-18.0f + 12.0f * B + 6.0f * C) * x * x + (6.0f - 2.0f * B)) * (1.0f / 6.0f);
 	}
-	if (m_filterType == Type::Box) {
-		return x - m_width;
+	if (x < 2.0f) {
+		return ((-B - 6.0f * C) * x * x * x + (6.0f * B + 30.0f * C) * x * x + (-12.0f * B - 48.0f * C) * x + (8.0f * B + 24.0f * C)) * (1.0f / 6.0f);
 	}
+	return 0.0f;
+}
 
-	// All the pdf's/cdf's are computed on the range [0.0, 1.0]
-	// However, we want to get an output in the range [-m_width, m_width]
-	// So we split the random variable in half, expand it back to [0.0, 1.0],
-	// and negate the result at the end if it's 'negative'
-	//
-	// 0.0              0.5              1.0
-	// |----------------|----------------|
-	//
-	//
-	// 0.0              0.5
-	// |----------------|
-	//
-	// x * 2.0
-	//
-	// 0.0                               1.0
-	// |- - - - - - - - - - - - - - - - -|
-	// 
-	//
-	// 0.5              1.0
-	// |----------------|
-	//
-	// (x - 0.5) * 2.0
-	//
-	// 0.0                               1.0
-	// |- - - - - - - - - - - - - - - - -|
-	bool negative = x < 0.5f;
-	x = negative ? x * 2.0f : (x - 0.5f) * 2.0f;
-
-	// Find the last index of the cdf whose value is smaller
-	// than our x value. This is the Inverse Tranform Method
-	// For more information see here:
-	// https://en.wikipedia.org/wiki/Inverse_transform_sampling
-	// http://web.ics.purdue.edu/~hwan/IE680/Lectures/Chap08Slides.pdf Pages 8-6 and 8-7 in particular
-	uint index = NUM_BINS;
-	for (uint i = 1; i < NUM_BINS + 1; ++i) {
-		if (x < m_cdf[i]) {
-			index = i - 1;
-			break;
-		}
+static float Sinc(float x) {
+	x = std::abs(x);
+	if (x < 1.0e-5f) {
+		return 1.0f;
 	}
-
-	float pdf = m_cdf[index + 1] - m_cdf[index];
-	float u = m_binSize * (index + ((x - m_cdf[index]) / pdf));
-
-	return negative ? -u : u;
+	return std::sin((float)M_PI * x) / ((float)M_PI * x);
 }
 
 float ReconstructionFilter::Evaluate(float x) const {
+	if (std::abs(x) > m_width) {
+		return 0.0f;
+	}
+
 	switch(m_filterType) {
 	case Type::Box: 
-		return (x >= -m_width && x <= m_width) ? 1.0f : 0.0f;
+		return 1.0f;
 	case Type::Tent: 
 		return m_width - std::abs(x);
 	case Type::Gaussian: 
@@ -97,6 +72,25 @@ float ReconstructionFilter::Evaluate(float x) const {
 			float alpha = 2.0f;
 			return std::exp(-alpha * x * x) - std::exp(-alpha * m_width * m_width);
 		}
+	case Type::Mitchell:
+		// The kernel is defined on [-2, 2]
+		return Mitchell1D(x * 2.0f / m_width);
+	case Type::Lanczos:
+		{
+			// A windowed sinc with kLobes lobes on either side, stretched over the width
+			const float kLobes = 2.0f;
+			float t = x * kLobes / m_width;
+			return Sinc(t) * Sinc(t / kLobes);
+		}
+	case Type::BlackmanHarris:
+		{
+			// The 4-term window, with n spanning [0, 1] over the width
+			float n = (x + m_width) / (2.0f * m_width);
+			return 0.35875f -
+			       0.48829f * std::cos(2.0f * (float)M_PI * n) +
+			       0.14128f * std::cos(4.0f * (float)M_PI * n) -
+			       0.01168f * std::cos(6.0f * (float)M_PI * n);
+		}
 	case Type::Dirac:
 	default: 
 		return 0.0f;
@@ -106,39 +100,61 @@ float ReconstructionFilter::Evaluate(float x) const {
 void ReconstructionFilter::PreCompute() {
 	// Dirac has an infinite pdf at 0.0f, aka it has no width.
 	// Therefore, we can't use the inverse transform method.
-	// That said, Dirac is so simple, we don't need to.
-	//
-	// We *can* compute the pdf for a box filter, but it's so
-	// simple, it's pointless to do the extra math
-	if (m_filterType == Type::Dirac || m_filterType == Type::Box) {
+	// Every sample lands on the pixel center instead
+	if (m_filterType == Type::Dirac || m_width <= 0.0f) {
+		std::fill(m_inverseCdf, m_inverseCdf + kInverseCdfSize + 1, 0.0f);
+		std::fill(m_sampleWeights, m_sampleWeights + kInverseCdfSize, 1.0f);
 		return;
 	}
 
-	m_binSize = m_width / (NUM_BINS - 1);
-	m_invBinSize = (NUM_BINS - 1) / m_width;
-
-	// Discritize the filter into a binned pdf
-	float normalizationFactor = 0.0f;
-	float pdf[NUM_BINS];
-	for (uint i = 0; i < NUM_BINS - 1; ++i) {
-		float temp = Evaluate(i * m_binSize);
-		pdf[i] = temp;
-		normalizationFactor += temp;
+	// Tabulate the cdf of |f| over [-m_width, m_width] at a much finer resolution than the inverse,
+	// treating f as constant across each segment. We keep the running integral of f alongside it
+	const uint kCdfResolution = 4096;
+	std::vector<float> cdf(kCdfResolution + 1);
+	std::vector<float> signedIntegral(kCdfResolution + 1);
+	float segmentWidth = 2.0f * m_width / kCdfResolution;
+
+	cdf[0] = 0.0f;
+	signedIntegral[0] = 0.0f;
+	for (uint i = 0; i < kCdfResolution; ++i) {
+		float value = Evaluate(-m_width + (i + 0.5f) * segmentWidth);
+		cdf[i + 1] = cdf[i] + std::abs(value) * segmentWidth;
+		signedIntegral[i + 1] = signedIntegral[i] + value * segmentWidth;
 	}
-	// Gaurantee the last bin of the pdf is 0.0f
-	pdf[NUM_BINS - 1] = 0.0f;
+	float absIntegral = cdf[kCdfResolution];
+
+	// Invert the cdf. This is the Inverse Tranform Method
+	// For more information see here:
+	// https://en.wikipedia.org/wiki/Inverse_transform_sampling
+	// http://web.ics.purdue.edu/~hwan/IE680/Lectures/Chap08Slides.pdf Pages 8-6 and 8-7 in particular
+	uint segment = 0;
+	for (uint i = 0; i < kInverseCdfSize + 1; ++i) {
+		float target = absIntegral * i / kInverseCdfSize;
+		while (segment < kCdfResolution - 1 && cdf[segment + 1] < target) {
+			++segment;
+		}
 
-	// Normalize the pdf. AKA, we want the area under the curve to equal 1.0f
-	for (uint i = 0; i < NUM_BINS - 1; ++i) {
-		pdf[i] /= normalizationFactor;
+		float segmentMass = cdf[segment + 1] - cdf[segment];
+		float t = segmentMass > 0.0f ? std::min(std::max((target - cdf[segment]) / segmentMass, 0.0f), 1.0f) : 0.0f;
+		m_inverseCdf[i] = -m_width + (segment + t) * segmentWidth;
 	}
 
-	// Create the cdf from the pdf
-	m_cdf[0] = 0.0f;
-	for (uint i = 1; i < NUM_BINS; ++i) {
-		m_cdf[i] = m_cdf[i - 1] + pdf[i - 1];
+	// Sampling |f| instead of f means each sample has to be weighted by f / pdf
+	// = sign(f) * (integral of |f|) / (integral of f), so the expected weight is still 1.0
+	// An entry can straddle a zero crossing, so we use the mean sign of f over the entry
+	auto integralAt = [&](const std::vector<float> &integral, float x) {
+		float position = (x + m_width) / segmentWidth;
+		uint index = std::min((uint)std::max(position, 0.0f), kCdfResolution - 1);
+		float t = std::min(position - index, 1.0f);
+		return integral[index] + t * (integral[index + 1] - integral[index]);
+	};
+
+	float weightScale = absIntegral / signedIntegral[kCdfResolution];
+	for (uint i = 0; i < kInverseCdfSize; ++i) {
+		float absMass = integralAt(cdf, m_inverseCdf[i + 1]) - integralAt(cdf, m_inverseCdf[i]);
+		float signedMass = integralAt(signedIntegral, m_inverseCdf[i + 1]) - integralAt(signedIntegral, m_inverseCdf[i]);
+		m_sampleWeights[i] = absMass > 0.0f ? weightScale * signedMass / absMass : weightScale;
 	}
-	m_cdf[NUM_BINS] = 1.0f;
 }
 
 float ReconstructionFilter::DefaultFilterWidth(Type filterType) const {
@@ -148,6 +164,9 @@ float ReconstructionFilter::DefaultFilterWidth(Type filterType) const {
 	case Type::Tent:
 		return 1.0f;
 	case Type::Gaussian:
+	case Type::Mitchell:
+	case Type::Lanczos:
+	case Type::BlackmanHarris:
 		return 2.0f;
 	case Type::Dirac: 
 	default:
@@ -6,7 +6,9 @@
 
 #pragma once
 
-#include "math/vector_types.h"
+#include "math/int_types.h"
+
+#include <algorithm>
 
 
 namespace Lantern {
@@ -30,6 +32,11 @@ namespace Lantern {
  * http://lgdv.cs.fau.de/publications/publication/Pub.2006.tech.IMMD.IMMD9.filter/
  * 
  * Using this information, I corrected the python code, then ported it back to c++ here
+ *
+ * Sampling inverts a finely tabulated cdf of |f|, so every filter costs the same lookup and lerp as the box.
+ * Filters with negative lobes (Mitchell, Lanczos) are sampled proportionally to |f|, and each sample
+ * carries the weight sign(f) * (integral of |f|) / (integral of f). The caller multiplies the radiance by
+ * the weights of both axes, so the estimator stays unbiased.
  */
 class ReconstructionFilter {
 public:
@@ -37,7 +44,10 @@ public:
 		Dirac,
 		Box,
 		Tent,
-		Gaussian
+		Gaussian,
+		Mitchell,
+		Lanczos,
+		BlackmanHarris
 	};
 
 public:
@@ -48,14 +58,29 @@ public:
 private:
 	Type m_filterType;
 	float m_width;
-	float m_binSize;
-	float m_invBinSize;
-	
-	#define NUM_BINS 32
-	float m_cdf[NUM_BINS + 1];
+
+	static const uint kInverseCdfSize = 512;
+	// The sample position for kInverseCdfSize + 1 evenly spaced cdf values. Sample() lerps between them
+	float m_inverseCdf[kInverseCdfSize + 1];
+	// The weight of the samples that land between two entries of m_inverseCdf
+	float m_sampleWeights[kInverseCdfSize];
 
 public:
-	float Sample(float x) const;
+	/**
+	 * Importance samples the filter
+	 *
+	 * @param x         A random number in [0, 1)
+	 * @param weight    Filled with the weight of the sample. 1.0 for filters without negative lobes
+	 * @return          The sample offset in [-width, width]
+	 */
+	inline float Sample(float x, float *weight) const {
+		float position = x * kInverseCdfSize;
+		uint index = std::min((uint)position, kInverseCdfSize - 1u);
+		float t = position - (float)index;
+
+		*weight = m_sampleWeights[index];
+		return m_inverseCdf[index] + t * (m_inverseCdf[index + 1] - m_inverseCdf[index]);
+	}
 	float Evaluate(float x) const;
 
 private:
@@ -5,122 +5,310 @@
 */
 
 #include "scene/scene.h"
-#include "scene/geometry_generator.h"
-#include "scene/obj_loader.h"
-
-#include "materials/material.h"
-#include "materials/bsdfs/lambert_bsdf.h"
-#include "materials/bsdfs/mirror_bsdf.h"
-#include "materials/bsdfs/ideal_specular_dielectric.h"
-#include "materials/media/non_scattering_medium.h"
-#include "materials/media/isotropic_scattering_medium.h"
+#include "scene/sample_scenes.h"
+#include "scene/environment_light.h"
 
 #include "visualizer/visualizer.h"
 
 #include "renderer/renderer.h"
+#include "renderer/distributed.h"
+#include "renderer/denoiser.h"
+
+#include "scene/image_io.h"
+
+#include "profiling/trace.h"
+#include "profiling/memory_tracker.h"
 
 #include <xmmintrin.h>
 #include <pmmintrin.h>
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
 
-void SetScene(Lantern::Scene &scene);
-void LoadObjScene(Lantern::Scene &scene);
-void LoadBallsScene(Lantern::Scene &scene);
+
+bool SetScene(Lantern::Scene &scene, const char *sceneName, const char *displacementPath, const char *densityPath, const uint densityResolution[3]);
+bool WriteOutputs(const Lantern::FrameBuffer &frameBuffer, const char *outputPath, const char *denoisedOutputPath);
+bool WriteTrace(const char *tracePath);
+bool WritePixelCosts(const Lantern::PixelCostBuffer &pixelCosts, const char *costPath);
 
 int main(int argc, const char *argv[]) {
 	_MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
 	_MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
 
+	// The scene, the budget, and the build mode have to be set before the scene is built, so they're parsed ahead of the other options
+	const char *sceneName = "dragon";
+	const char *displacementPath = nullptr;
+	const char *densityPath = nullptr;
+	uint densityResolution[3] = {0u, 0u, 0u};
+	bool lazyBuild = false;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+			sceneName = argv[i + 1];
+		} else if (strcmp(argv[i], "--displacement") == 0 && i + 1 < argc) {
+			displacementPath = argv[i + 1];
+		} else if (strcmp(argv[i], "--density") == 0 && i + 4 < argc) {
+			densityPath = argv[i + 1];
+			for (uint axis = 0; axis < 3; ++axis) {
+				densityResolution[axis] = (uint)atoi(argv[i + 2 + axis]);
+			}
+		} else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+			Lantern::SetMemoryBudget((uint64)(atof(argv[i + 1]) * 1024.0 * 1024.0));
+		} else if (strcmp(argv[i], "--lazy-build") == 0) {
+			lazyBuild = true;
+		}
+	}
+
 	Lantern::Scene scene;
-	SetScene(scene);
+	if (lazyBuild) {
+		scene.EnableLazyBuild();
+	}
+	if (!SetScene(scene, sceneName, displacementPath, densityPath, densityResolution)) {
+		printf("Failed to load the scene %s\n", sceneName);
+		return 1;
+	}
 
 	Lantern::Renderer renderer(&scene);
-	
 
+	// Command line options
+	//     --scene <name>                 dragon (the default), balls, subdivision, smoke, or an .obj file. OBJ materials can be diffuse, with a texture (map_Kd), or rough metal or glass (illum), and have a cutout mask (map_d)
+	//     --displacement <texture>       Displace the sheet of the subdivision scene by a texture, rather than procedural ripples
+	//     --density <raw> <w> <h> <d>    Fill the smoke scene with a raw grid of float densities, rather than procedural puffs
+	//     --headless                     Render without the Visualizer
+	//     --frames <n>                   The total number of frames to render in headless mode
+	//     --checkpoint <file>            Periodically checkpoint the render to this file
+	//     --checkpoint-interval <sec>    The minimum number of seconds between checkpoints
+	//     --resume <file>                Continue rendering from a checkpoint
+	//     --coordinator <address>        Split the headless render across worker processes. See renderer/distributed.h
+	//     --workers <n>                  The number of workers the coordinator waits for
+	//     --worker <address>             Render work items for the coordinator at <address>
+	//     --output <file.pfm>            Write the final headless render to this file
+	//     --denoise <file.pfm>           Denoise the final headless render, and write it to this file
+	//     --trace <file.json>            Write a Chrome trace of the last few frames when the render finishes
+	//     --cost <file.pfm>              Write the mean cycles, rays, and path length of each pixel to the r, g, and b channels
+	//     --memory-budget <MB>           Exit with a memory report as soon as the tracked memory would exceed this
+	//     --max-bounces <n>              The maximum number of bounces and medium scatter events in a path
+	//     --max-walk <n>                 The maximum number of scatter events in a single walk through a medium
+	//     --unguided-walks               Sample walks through media without biasing them towards the exit
+	//     --environment <file.pfm/.hdr>  Light the scene with a lat-long environment map, in place of the background color
+	//     --environment-scale <s>        Multiplies the radiance of the environment map
+	//     --texture-cache <MB>           The maximum size of the texture tiles kept in memory
+	//     --tessellation-cache <MB>      The size of Embree's cache of tessellated subdivision patches
+	//     --lazy-build                   Build each mesh's BVH on demand, and in the background, rather than before the first frame
 	bool visualizing = true;
+	uint numFrames = 1024u;
+	const char *resumePath = nullptr;
+	const char *outputPath = nullptr;
+	const char *denoisedOutputPath = nullptr;
+	const char *tracePath = nullptr;
+	const char *costPath = nullptr;
+	const char *environmentPath = nullptr;
+	float environmentScale = 1.0f;
+	Lantern::DistributedSettings distributedSettings;
+	bool coordinator = false;
+	bool worker = false;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			visualizing = false;
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			numFrames = (uint)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+			renderer.CheckpointPath = argv[++i];
+		} else if (strcmp(argv[i], "--checkpoint-interval") == 0 && i + 1 < argc) {
+			renderer.CheckpointInterval = (float)atof(argv[++i]);
+		} else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+			resumePath = argv[++i];
+		} else if (strcmp(argv[i], "--coordinator") == 0 && i + 1 < argc) {
+			coordinator = true;
+			visualizing = false;
+			distributedSettings.Address = argv[++i];
+		} else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+			distributedSettings.NumWorkers = (uint)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--worker") == 0 && i + 1 < argc) {
+			worker = true;
+			visualizing = false;
+			distributedSettings.Address = argv[++i];
+		} else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			outputPath = argv[++i];
+		} else if (strcmp(argv[i], "--denoise") == 0 && i + 1 < argc) {
+			denoisedOutputPath = argv[++i];
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			tracePath = argv[++i];
+		} else if ((strcmp(argv[i], "--scene") == 0 || strcmp(argv[i], "--displacement") == 0 || strcmp(argv[i], "--memory-budget") == 0) && i + 1 < argc) {
+			// Already handled above
+			++i;
+		} else if (strcmp(argv[i], "--density") == 0 && i + 4 < argc) {
+			// Already handled above
+			i += 4;
+		} else if (strcmp(argv[i], "--lazy-build") == 0) {
+			// Already handled above
+		} else if (strcmp(argv[i], "--max-bounces") == 0 && i + 1 < argc) {
+			renderer.MaxBounces = (uint)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--max-walk") == 0 && i + 1 < argc) {
+			renderer.MaxMediumWalkLength = (uint)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--unguided-walks") == 0) {
+			renderer.GuidedMediumWalks = false;
+		} else if (strcmp(argv[i], "--environment") == 0 && i + 1 < argc) {
+			environmentPath = argv[++i];
+		} else if (strcmp(argv[i], "--environment-scale") == 0 && i + 1 < argc) {
+			environmentScale = (float)atof(argv[++i]);
+		} else if (strcmp(argv[i], "--texture-cache") == 0 && i + 1 < argc) {
+			scene.SetTextureCacheSize((uint64)(atof(argv[++i]) * 1024.0 * 1024.0));
+		} else if (strcmp(argv[i], "--tessellation-cache") == 0 && i + 1 < argc) {
+			scene.SetTessellationCacheSize((uint64)(atof(argv[++i]) * 1024.0 * 1024.0));
+		} else if (strcmp(argv[i], "--cost") == 0 && i + 1 < argc) {
+			costPath = argv[++i];
+			renderer.CollectPixelCosts = true;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+		}
+	}
+
+	if (environmentPath != nullptr) {
+		uint width, height;
+		std::vector<float3> pixels;
+		if (!Lantern::ReadImage(environmentPath, &width, &height, &pixels)) {
+			printf("Failed to read %s\n", environmentPath);
+			return 1;
+		}
+		scene.SetEnvironmentLight(new Lantern::EnvironmentLight(width, height, &pixels[0], environmentScale));
+	}
+
+	if (resumePath != nullptr) {
+		if (renderer.LoadCheckpoint(resumePath)) {
+			printf("Resuming from frame %u\n", renderer.FrameNumber());
+		} else {
+			printf("Failed to load checkpoint %s\n", resumePath);
+			return 1;
+		}
+	}
+
+	if (worker) {
+		bool success = Lantern::RunRenderWorker(&renderer, distributedSettings.Address);
+		success = WriteTrace(tracePath) && success;
+		return success ? 0 : 1;
+	}
+
+	if (coordinator) {
+		if (costPath != nullptr) {
+			printf("--cost is ignored by the coordinator. The costs are measured on the workers\n");
+		}
+		bool success = Lantern::RunRenderCoordinator(&renderer, distributedSettings, numFrames);
+		if (!renderer.CheckpointPath.empty()) {
+			renderer.SaveCheckpoint(renderer.CheckpointPath);
+		}
+		success = WriteOutputs(scene.Camera.FrameBuffer, outputPath, denoisedOutputPath) && success;
+		success = WriteTrace(tracePath) && success;
+		return success ? 0 : 1;
+	}
+
 	if (visualizing) {
 		Lantern::Visualizer visualizer(&renderer, &scene);
 		visualizer.Run();
 	} else {
-		// renderer.Run();
+		renderer.Run(numFrames);
+		bool success = WriteOutputs(scene.Camera.FrameBuffer, outputPath, denoisedOutputPath);
+		success = WriteTrace(tracePath) && success;
+		success = WritePixelCosts(renderer.PixelCosts(), costPath) && success;
+		return success ? 0 : 1;
 	}
 }
 
-void SetScene(Lantern::Scene &scene) {
-	scene.BackgroundColor = float3(0.846f, 0.933f, 0.949f);
+bool WriteOutputs(const Lantern::FrameBuffer &frameBuffer, const char *outputPath, const char *denoisedOutputPath) {
+	uint width = frameBuffer.Width;
+	uint height = frameBuffer.Height;
+	std::vector<float3> pixels(width * height);
+	bool success = true;
 
-	#if 1
-		LoadObjScene(scene);
-	#else
-		LoadBallsScene(scene);
-	#endif
+	if (outputPath != nullptr) {
+		const float3 *colorData = frameBuffer.GetColorData();
+		const float *weights = frameBuffer.GetWeights();
+		for (uint i = 0; i < width * height; ++i) {
+			pixels[i] = weights[i] > 0.0f ? colorData[i] / weights[i] : float3(0.0f);
+		}
 
-	scene.Commit();
-}
+		if (!Lantern::WritePFM(outputPath, width, height, &pixels[0])) {
+			printf("Failed to write %s\n", outputPath);
+			success = false;
+		}
+	}
 
-void LoadObjScene(Lantern::Scene &scene) {
-	scene.SetCamera(1.25f, -M_PI_2, 2.0f, 1280.0f, 720.0f);
+	if (denoisedOutputPath != nullptr) {
+		auto startTime = std::chrono::steady_clock::now();
 
-	Lantern::IdealSpecularDielectric *glass = new Lantern::IdealSpecularDielectric(float3(1.0f), 1.35f);
-	Lantern::NonScatteringMedium *redTransmission = new Lantern::NonScatteringMedium(float3(0.9801986733f, 0.00609674656f, 0.00334596545f), 1.0f);
-	Lantern::IsotropicScatteringMedium *redScattering = new Lantern::IsotropicScatteringMedium(float3(0.9801986733f, 0.00609674656f, 0.00334596545f), 1.0f, 100.0f);
+		Lantern::Denoiser denoiser;
+		denoiser.Denoise(frameBuffer, &pixels[0]);
 
-	Lantern::Material *material = new Lantern::Material(glass, redScattering);
+		float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+		printf("Denoised in %.2f seconds\n", seconds);
 
-	// Create Dragon
-	std::vector<Lantern::Mesh> dragonMeshes;
-	Lantern::LoadMeshesFromObj("dragon.obj", dragonMeshes);
-	for (auto &mesh : dragonMeshes) {
-		scene.AddMesh(&mesh, material);
+		if (!Lantern::WritePFM(denoisedOutputPath, width, height, &pixels[0])) {
+			printf("Failed to write %s\n", denoisedOutputPath);
+			success = false;
+		}
 	}
-}
-
-void LoadBallsScene(Lantern::Scene &scene) {
-	scene.SetCamera(M_PI_2, 0.0f, 40.0f, 1280.0f, 720.0f);
 
-	// Create the materials
-	Lantern::Material *green = new Lantern::Material(new Lantern::LambertBSDF(float3(0.408f, 0.741f, 0.467f)), nullptr);
-	Lantern::Material *blue = new Lantern::Material(new Lantern::LambertBSDF(float3(0.392f, 0.584f, 0.929f)), nullptr);
-	Lantern::Material *orange = new Lantern::Material(new Lantern::LambertBSDF(float3(1.0f, 0.498f, 0.314f)), nullptr);
-	Lantern::Material *black = new Lantern::Material(new Lantern::LambertBSDF(float3(0.0f)), nullptr);
-	Lantern::Material *gray = new Lantern::Material(new Lantern::LambertBSDF(float3(0.9f, 0.9f, 0.9f)), nullptr);
-	Lantern::Material *mirror = new Lantern::Material(new Lantern::MirrorBSDF(float3(0.95f, 0.95f, 0.95f)), nullptr);
-	Lantern::Material *glass = new Lantern::Material(new Lantern::IdealSpecularDielectric(float3(0.95f), 1.5f), nullptr);
-
-	// Create the floor
-	Lantern::Mesh floorMesh;
-	Lantern::CreateGrid(50.0f, 50.0f, 2u, 2u, &floorMesh);
-	Lantern::TranslateMesh(float3(0.0f, -6.0f, 0.0f), &floorMesh);
-	scene.AddMesh(&floorMesh, gray);
+	return success;
+}
 
-	// Create the 9 spheres
-	Lantern::Mesh sphereMesh;
-	Lantern::Mesh *sphere = &sphereMesh;
-	Lantern::CreateGeosphere(2.0f, 3u, sphere);
+bool WriteTrace(const char *tracePath) {
+	if (tracePath == nullptr) {
+		return true;
+	}
 
-	scene.AddMesh(sphere, black, float3(1.0f), 800.0f);
+	if (!Lantern::WriteChromeTrace(tracePath)) {
+		printf("Failed to write %s\n", tracePath);
+		return false;
+	}
 
-	Lantern::TranslateMesh(float3(-4.0f, -4.0f, -4.0f), sphere);
-	scene.AddMesh(sphere, mirror);
+	return true;
+}
 
-	Lantern::TranslateMesh(float3(0.0f, 0.0f, 8.0f), sphere);
-	scene.AddMesh(sphere, blue);
+bool WritePixelCosts(const Lantern::PixelCostBuffer &pixelCosts, const char *costPath) {
+	if (costPath == nullptr) {
+		return true;
+	}
 
-	Lantern::TranslateMesh(float3(0.0f, 8.0f, 0.0f), sphere);
-	scene.AddMesh(sphere, glass);
+	uint width = pixelCosts.Width;
+	uint height = pixelCosts.Height;
+	std::vector<float3> pixels(width * height);
+	for (uint y = 0; y < height; ++y) {
+		for (uint x = 0; x < width; ++x) {
+			pixels[y * width + x] = pixelCosts.GetMeanCosts(x, y);
+		}
+	}
 
-	Lantern::TranslateMesh(float3(0.0f, 0.0f, -8.0f), sphere);
-	scene.AddMesh(sphere, orange);
+	if (pixels.empty() || !Lantern::WritePFM(costPath, width, height, &pixels[0])) {
+		printf("Failed to write %s\n", costPath);
+		return false;
+	}
 
-	Lantern::TranslateMesh(float3(8.0f, 0.0f, 0.0f), sphere);
-	scene.AddMesh(sphere, blue);
+	return true;
+}
 
-	Lantern::TranslateMesh(float3(0.0f, 0.0f, 8.0f), sphere);
-	scene.AddMesh(sphere, green);
+bool SetScene(Lantern::Scene &scene, const char *sceneName, const char *displacementPath, const char *densityPath, const uint densityResolution[3]) {
+	scene.BackgroundColor = float3(0.846f, 0.933f, 0.949f);
 
-	Lantern::TranslateMesh(float3(0.0f, -8.0f, 0.0f), sphere);
-	scene.AddMesh(sphere, mirror);
+	std::size_t nameLength = strlen(sceneName);
+	bool success;
+	if (strcmp(sceneName, "dragon") == 0) {
+		success = Lantern::LoadDragonScene(&scene);
+	} else if (strcmp(sceneName, "balls") == 0) {
+		Lantern::LoadBallsScene(&scene);
+		success = true;
+	} else if (strcmp(sceneName, "subdivision") == 0) {
+		success = Lantern::LoadSubdivisionScene(&scene, displacementPath);
+	} else if (strcmp(sceneName, "smoke") == 0) {
+		success = Lantern::LoadSmokeScene(&scene, densityPath, densityResolution[0], densityResolution[1], densityResolution[2]);
+	} else if (nameLength > 4 && strcmp(sceneName + nameLength - 4, ".obj") == 0) {
+		success = Lantern::LoadObjScene(&scene, sceneName);
+	} else {
+		success = false;
+	}
 
-	Lantern::TranslateMesh(float3(0.0f, 0.0f, -8.0f), sphere);
-	scene.AddMesh(sphere, glass);
+	if (success) {
+		scene.Commit();
+	}
+	return success;
 }
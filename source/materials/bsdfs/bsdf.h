@@ -10,10 +10,11 @@
 
 #include "materials/bsdfs/bsdf_lobe.h"
 
+#include "renderer/surface_interaction.h"
+
 
 namespace Lantern {
 
-struct SurfaceInteraction;
 class UniformSampler;
 
 class BSDF {
@@ -35,6 +36,17 @@ public:
 	virtual float3 Eval(SurfaceInteraction &interaction) const = 0;
 	virtual void Sample(SurfaceInteraction &interaction, UniformSampler *sampler) const = 0;
 	virtual float Pdf(SurfaceInteraction &interaction) const = 0;
+	/**
+	 * True if light passes straight through the surface without bending, only scaled by the albedo.
+	 * Shadow rays pass through these surfaces, so lights can be sampled from inside the volumes they bound
+	 */
+	virtual bool IsIndexMatched() const { return false; }
+
+	float3 Albedo() const { return m_albedo; }
+	/**
+	 * The albedo, textured by the material
+	 */
+	float3 Albedo(const SurfaceInteraction &interaction) const { return m_albedo * interaction.TextureColor; }
 };
 
 } // End of namespace Lantern
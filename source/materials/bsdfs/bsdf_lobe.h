@@ -15,7 +15,11 @@ enum Type {
 	SpecularReflection = (1 << 0),
 	SpecularTransmission = (1 << 1),
 	Diffuse = (1 << 2),
+	GlossyReflection = (1 << 3),
+	GlossyTransmission = (1 << 4),
 	Specular = SpecularReflection | SpecularTransmission,
+	Glossy = GlossyReflection | GlossyTransmission,
+	Transmission = SpecularTransmission | GlossyTransmission,
 };
 }
 
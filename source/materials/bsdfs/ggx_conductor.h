@@ -0,0 +1,95 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "materials/bsdfs/bsdf.h"
+#include "materials/bsdfs/microfacet.h"
+
+#include "renderer/surface_interaction.h"
+
+#include "math/uniform_sampler.h"
+#include "math/vector_math.h"
+
+
+namespace Lantern {
+
+/**
+ * A rough metal. GGX microfacets with a Schlick Fresnel
+ *
+ * A single scattering microfacet model loses the light that bounces between microfacets, which darkens
+ * rough metals noticeably. We scale the lobe back up with the precomputed albedo of the distribution.
+ * Turquin 2019, "Practical multiple scattering compensation for microfacet models"
+ */
+class GGXConductor : public BSDF {
+public:
+	/**
+	 * @param reflectance    The reflectance at normal incidence. AKA, F0
+	 * @param roughness      The perceptual roughness, in [0, 1]
+	 */
+	GGXConductor(float3 reflectance, float roughness)
+		: BSDF(BSDFLobe::GlossyReflection, reflectance),
+		  m_alpha(RoughnessToAlpha(roughness)) {
+		// Build the albedo table now, rather than stalling the first render thread to use it
+		GGXAlbedo(1.0f, m_alpha);
+	}
+
+private:
+	float m_alpha;
+
+public:
+	float3 Eval(SurfaceInteraction &interaction) const override {
+		float3a normal = FacingNormal(interaction);
+		float cosThetaO = dot(interaction.OutputDirection, normal);
+		float cosThetaI = dot(interaction.InputDirection, normal);
+		if (cosThetaO <= 0.0f || cosThetaI <= 0.0f) {
+			return float3(0.0f);
+		}
+
+		float3a halfVector = normalize(interaction.OutputDirection + interaction.InputDirection);
+		float VdotH = std::max(dot(interaction.OutputDirection, halfVector), 0.0f);
+		float3 reflectance = Albedo(interaction);
+		float3 fresnel = reflectance + (float3(1.0f) - reflectance) * std::pow(1.0f - VdotH, 5.0f);
+
+		// The cos(theta_i) of the rendering equation cancels out with the one in the denominator of the brdf
+		float singleScattering = GGXDistribution(dot(halfVector, normal), m_alpha) * GGXMaskingShadowing(cosThetaO, cosThetaI, m_alpha) / (4.0f * cosThetaO);
+
+		float albedo = GGXAlbedo(cosThetaO, m_alpha);
+		float3 compensation = float3(1.0f) + reflectance * (1.0f - albedo) / albedo;
+
+		return fresnel * singleScattering * compensation;
+	}
+
+	void Sample(SurfaceInteraction &interaction, UniformSampler *sampler) const override {
+		float3a normal = FacingNormal(interaction);
+		float3a halfVector = GGXSampleVisibleNormal(interaction.OutputDirection, normal, m_alpha, sampler->NextFloat(), sampler->NextFloat());
+
+		interaction.InputDirection = reflect(interaction.OutputDirection, halfVector);
+		interaction.SampledLobe = BSDFLobe::GlossyReflection;
+	}
+
+	float Pdf(SurfaceInteraction &interaction) const override {
+		float3a normal = FacingNormal(interaction);
+		float cosThetaO = dot(interaction.OutputDirection, normal);
+		if (cosThetaO <= 0.0f || dot(interaction.InputDirection, normal) <= 0.0f) {
+			return 0.0f;
+		}
+
+		// The pdf of the visible normal, times the jacobian of the reflection, 1 / (4 * dot(wo, h))
+		float3a halfVector = normalize(interaction.OutputDirection + interaction.InputDirection);
+		return GGXMasking(cosThetaO, m_alpha) * GGXDistribution(dot(halfVector, normal), m_alpha) / (4.0f * cosThetaO);
+	}
+
+private:
+	/**
+	 * The surface is two sided, so we work with the normal on the same side as wo
+	 */
+	float3a FacingNormal(const SurfaceInteraction &interaction) const {
+		return dot(interaction.OutputDirection, interaction.Normal) < 0.0f ? -interaction.Normal : interaction.Normal;
+	}
+};
+
+} // End of namespace Lantern
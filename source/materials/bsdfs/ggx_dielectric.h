@@ -0,0 +1,180 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "materials/bsdfs/bsdf.h"
+#include "materials/bsdfs/microfacet.h"
+
+#include "renderer/surface_interaction.h"
+
+#include "math/uniform_sampler.h"
+#include "math/vector_math.h"
+
+
+namespace Lantern {
+
+/**
+ * Rough glass. GGX microfacets that reflect or refract, chosen by the dielectric Fresnel of the microfacet
+ * Walter et al. 2007, "Microfacet Models for Refraction through Rough Surfaces"
+ *
+ * Like IdealSpecularDielectric, the transmitted radiance isn't scaled by the change in IOR.
+ * The energy lost to the bounces between microfacets is restored by dividing by the precomputed single
+ * scattering albedo, which splits it between reflection and refraction in the same ratio as the first bounce.
+ */
+class GGXDielectric : public BSDF {
+public:
+	/**
+	 * @param albedo       Multiplies both the reflection and the transmission
+	 * @param ior          The index of refraction of the inside of the surface
+	 * @param roughness    The perceptual roughness, in [0, 1]
+	 */
+	GGXDielectric(float3 albedo, float ior, float roughness)
+		: BSDF(BSDFLobe::Glossy, albedo),
+		  m_ior(ior),
+		  m_alpha(RoughnessToAlpha(roughness)) {
+		// Build the albedo table now, rather than stalling the first render thread to use it
+		GGXDielectricAlbedo(1.0f, m_alpha, m_ior);
+	}
+
+private:
+	float m_ior;
+	float m_alpha;
+
+	struct LocalGeometry {
+		// The normal on the same side as wo
+		float3a Normal;
+		float CosThetaO;
+		float IORi;
+		float IORo;
+	};
+
+	struct HalfVector {
+		float3a H;
+		float VdotH;
+		float LdotH;
+		bool Reflection;
+	};
+
+public:
+	float3 Eval(SurfaceInteraction &interaction) const override {
+		LocalGeometry geometry = GetLocalGeometry(interaction);
+		HalfVector half;
+		if (!GetHalfVector(interaction, geometry, &half)) {
+			return float3(0.0f);
+		}
+
+		float cosThetaI = std::abs(dot(interaction.InputDirection, geometry.Normal));
+		float fresnel = Fresnel(geometry.IORi, geometry.IORo, half.VdotH, SinSquaredThetaT(half.VdotH, geometry.IORi / geometry.IORo));
+		float D = GGXDistribution(dot(half.H, geometry.Normal), m_alpha);
+		float G = GGXMaskingShadowing(geometry.CosThetaO, cosThetaI, m_alpha);
+		float compensation = 1.0f / GGXDielectricAlbedo(geometry.CosThetaO, m_alpha, geometry.IORo / geometry.IORi);
+
+		// As with the conductor, cos(theta_i) cancels out
+		float value;
+		if (half.Reflection) {
+			value = fresnel * D * G / (4.0f * geometry.CosThetaO);
+		} else {
+			float denom = geometry.IORi * half.VdotH + geometry.IORo * half.LdotH;
+			value = (1.0f - fresnel) * D * G * half.VdotH * std::abs(half.LdotH) * geometry.IORo * geometry.IORo / (geometry.CosThetaO * denom * denom);
+		}
+
+		return Albedo(interaction) * value * compensation;
+	}
+
+	void Sample(SurfaceInteraction &interaction, UniformSampler *sampler) const override {
+		LocalGeometry geometry = GetLocalGeometry(interaction);
+		float3a halfVector = GGXSampleVisibleNormal(interaction.OutputDirection, geometry.Normal, m_alpha, sampler->NextFloat(), sampler->NextFloat());
+
+		float VdotH = dot(interaction.OutputDirection, halfVector);
+		float eta = geometry.IORi / geometry.IORo;
+		float sinSquaredThetaT = SinSquaredThetaT(VdotH, eta);
+		float fresnel = Fresnel(geometry.IORi, geometry.IORo, VdotH, sinSquaredThetaT);
+
+		if (sampler->NextFloat() <= fresnel) {
+			interaction.InputDirection = reflect(interaction.OutputDirection, halfVector);
+			interaction.SampledLobe = BSDFLobe::GlossyReflection;
+			interaction.IORo = interaction.IORi;
+		} else {
+			interaction.InputDirection = normalize(refract(interaction.OutputDirection, halfVector, VdotH, eta, sinSquaredThetaT));
+			interaction.SampledLobe = BSDFLobe::GlossyTransmission;
+			interaction.IORo = geometry.IORo;
+		}
+
+		// A reflection that ends up below the surface, or a refraction that ends up above it, is a wasted sample.
+		// Pdf() only accounts for the directions that stay on the right side, so we zero the direction, which makes it return 0
+		float cosThetaI = dot(interaction.InputDirection, geometry.Normal);
+		if ((interaction.SampledLobe == BSDFLobe::GlossyReflection) != (cosThetaI > 0.0f)) {
+			interaction.InputDirection = float3a(0.0f);
+		}
+	}
+
+	float Pdf(SurfaceInteraction &interaction) const override {
+		LocalGeometry geometry = GetLocalGeometry(interaction);
+		HalfVector half;
+		if (!GetHalfVector(interaction, geometry, &half)) {
+			return 0.0f;
+		}
+
+		float fresnel = Fresnel(geometry.IORi, geometry.IORo, half.VdotH, SinSquaredThetaT(half.VdotH, geometry.IORi / geometry.IORo));
+		float visibleNormalPdf = GGXMasking(geometry.CosThetaO, m_alpha) * half.VdotH * GGXDistribution(dot(half.H, geometry.Normal), m_alpha) / geometry.CosThetaO;
+
+		// Multiplied by the jacobian of the reflection or refraction
+		if (half.Reflection) {
+			return fresnel * visibleNormalPdf / (4.0f * half.VdotH);
+		}
+
+		float denom = geometry.IORi * half.VdotH + geometry.IORo * half.LdotH;
+		return (1.0f - fresnel) * visibleNormalPdf * geometry.IORo * geometry.IORo * std::abs(half.LdotH) / (denom * denom);
+	}
+
+private:
+	LocalGeometry GetLocalGeometry(const SurfaceInteraction &interaction) const {
+		// Same convention as IdealSpecularDielectric. If wo is on the back side, we're leaving the surface
+		LocalGeometry geometry;
+		geometry.Normal = interaction.Normal;
+		geometry.CosThetaO = dot(interaction.OutputDirection, interaction.Normal);
+		geometry.IORi = interaction.IORi;
+		geometry.IORo = m_ior;
+		if (geometry.CosThetaO < 0.0f) {
+			geometry.Normal = -geometry.Normal;
+			geometry.CosThetaO = -geometry.CosThetaO;
+			geometry.IORo = 1.0f;
+		}
+
+		return geometry;
+	}
+
+	/**
+	 * Finds the microfacet normal that reflects or refracts wo into wi
+	 *
+	 * @return    False if there isn't one facing wo
+	 */
+	bool GetHalfVector(const SurfaceInteraction &interaction, const LocalGeometry &geometry, HalfVector *half) const {
+		float cosThetaI = dot(interaction.InputDirection, geometry.Normal);
+		if (geometry.CosThetaO <= 0.0f || cosThetaI == 0.0f) {
+			return false;
+		}
+
+		half->Reflection = cosThetaI > 0.0f;
+		if (half->Reflection) {
+			half->H = normalize(interaction.OutputDirection + interaction.InputDirection);
+		} else {
+			half->H = normalize(interaction.OutputDirection * geometry.IORi + interaction.InputDirection * geometry.IORo);
+		}
+		if (dot(half->H, geometry.Normal) < 0.0f) {
+			half->H = -half->H;
+		}
+
+		half->VdotH = dot(interaction.OutputDirection, half->H);
+		half->LdotH = dot(interaction.InputDirection, half->H);
+
+		// wo has to see the microfacet, and wi has to leave from the matching side of it
+		return half->VdotH > 0.0f && (half->Reflection ? half->LdotH > 0.0f : half->LdotH < 0.0f);
+	}
+};
+
+} // End of namespace Lantern
@@ -28,7 +28,7 @@ private:
 
 public:
 	float3 Eval(SurfaceInteraction &interaction) const override {
-		return m_albedo;
+		return Albedo(interaction);
 	}
 
 	void Sample(SurfaceInteraction &interaction, UniformSampler *sampler) const override {
@@ -65,6 +65,10 @@ public:
 	float Pdf(SurfaceInteraction &interaction) const override {
 		return 1.0f;
 	}
+
+	bool IsIndexMatched() const override {
+		return m_ior == 1.0f;
+	}
 };
 
 } // End of namespace Lantern
@@ -23,7 +23,7 @@ public:
 
 public:
 	float3 Eval(SurfaceInteraction &interaction) const override {
-		return m_albedo * M_1_PI * dot(interaction.InputDirection, interaction.Normal);
+		return Albedo(interaction) * M_1_PI * dot(interaction.InputDirection, interaction.Normal);
 	}
 	
 	void Sample(SurfaceInteraction &interaction, UniformSampler *sampler) const override {
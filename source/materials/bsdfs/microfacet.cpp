@@ -0,0 +1,169 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "materials/bsdfs/microfacet.h"
+
+
+namespace Lantern {
+
+float3a GGXSampleVisibleNormal(const float3a &wo, const float3a &normal, float alpha, float u1, float u2) {
+	float3a tangent, bitangent;
+	CoordinateSystem(normal, &tangent, &bitangent);
+
+	// Stretch the view direction, so the distribution becomes a hemisphere
+	float3a stretched = normalize(float3a(alpha * dot(wo, tangent), alpha * dot(wo, bitangent), dot(wo, normal)));
+
+	// Build a basis around the stretched view direction
+	float lengthSquared = stretched.x * stretched.x + stretched.y * stretched.y;
+	float3a t1 = lengthSquared > 0.0f ? float3a(-stretched.y, stretched.x, 0.0f) / std::sqrt(lengthSquared) : float3a(1.0f, 0.0f, 0.0f);
+	float3a t2 = cross(stretched, t1);
+
+	// Sample the projected area of the hemisphere. The half of the disc facing away from the viewer is squashed,
+	// since part of it is hidden
+	float r = std::sqrt(u1);
+	float phi = 2.0f * (float)M_PI * u2;
+	float p1 = r * std::cos(phi);
+	float p2 = r * std::sin(phi);
+	float s = 0.5f * (1.0f + stretched.z);
+	p2 = (1.0f - s) * std::sqrt(std::max(1.0f - p1 * p1, 0.0f)) + s * p2;
+
+	// Project back up onto the hemisphere, and unstretch
+	float3a hemisphereNormal = t1 * p1 + t2 * p2 + stretched * std::sqrt(std::max(1.0f - p1 * p1 - p2 * p2, 0.0f));
+	float3a local = normalize(float3a(alpha * hemisphereNormal.x, alpha * hemisphereNormal.y, std::max(hemisphereNormal.z, 0.0f)));
+
+	return tangent * local.x + bitangent * local.y + normal * local.z;
+}
+
+static const uint kAlbedoTableSize = 32;
+static const uint kDielectricAlbedoTableSize = 16;
+static const uint kDielectricAlbedoTableEtas = 17;
+// The dielectric table covers IORs from 1 / kMaxTableEta to kMaxTableEta, spaced evenly in log space
+static const float kMaxTableEta = 3.0f;
+
+struct GGXAlbedoTable {
+	// [alpha][cosThetaO]. Both axes go from 0 to 1 inclusive
+	float Values[kAlbedoTableSize][kAlbedoTableSize];
+};
+
+struct GGXDielectricAlbedoTable {
+	// [eta][alpha][cosThetaO]
+	float Values[kDielectricAlbedoTableEtas][kDielectricAlbedoTableSize][kDielectricAlbedoTableSize];
+};
+
+/**
+ * Integrates the weight of a direction sampled from the visible normals, G2 / G1, with stratified samples.
+ * If eta is zero, the microfacets are perfect mirrors. Otherwise, they're dielectric, and the weight is
+ * split between the reflection and the refraction by the Fresnel
+ */
+static float IntegrateAlbedo(float cosThetaO, float alpha, float eta, uint strata) {
+	const float3a normal(0.0f, 0.0f, 1.0f);
+	float3a wo(std::sqrt(1.0f - cosThetaO * cosThetaO), 0.0f, cosThetaO);
+	float G1 = GGXMasking(cosThetaO, alpha);
+
+	double sum = 0.0;
+	for (uint i = 0; i < strata; ++i) {
+		for (uint j = 0; j < strata; ++j) {
+			float3a h = GGXSampleVisibleNormal(wo, normal, alpha, (i + 0.5f) / strata, (j + 0.5f) / strata);
+			float VdotH = dot(wo, h);
+
+			float fresnel = 1.0f;
+			float sinSquaredThetaT = 0.0f;
+			if (eta != 0.0f) {
+				sinSquaredThetaT = SinSquaredThetaT(VdotH, 1.0f / eta);
+				fresnel = Fresnel(1.0f, eta, VdotH, sinSquaredThetaT);
+			}
+
+			float3a reflected = reflect(wo, h);
+			if (reflected.z > 0.0f) {
+				sum += fresnel * GGXMaskingShadowing(cosThetaO, reflected.z, alpha) / G1;
+			}
+			if (fresnel < 1.0f) {
+				float3a refracted = refract(wo, h, VdotH, 1.0f / eta, sinSquaredThetaT);
+				if (refracted.z < 0.0f) {
+					sum += (1.0f - fresnel) * GGXMaskingShadowing(cosThetaO, -refracted.z, alpha) / G1;
+				}
+			}
+		}
+	}
+
+	return (float)(sum / (strata * strata));
+}
+
+static GGXAlbedoTable BuildGGXAlbedoTable() {
+	GGXAlbedoTable table;
+	for (uint a = 0; a < kAlbedoTableSize; ++a) {
+		float alpha = std::max((float)a / (kAlbedoTableSize - 1), 0.001f);
+		for (uint c = 0; c < kAlbedoTableSize; ++c) {
+			float cosThetaO = std::max((float)c / (kAlbedoTableSize - 1), 0.001f);
+			table.Values[a][c] = IntegrateAlbedo(cosThetaO, alpha, 0.0f, 64u);
+		}
+	}
+
+	return table;
+}
+
+static GGXDielectricAlbedoTable BuildGGXDielectricAlbedoTable() {
+	GGXDielectricAlbedoTable table;
+	for (uint e = 0; e < kDielectricAlbedoTableEtas; ++e) {
+		float eta = std::pow(kMaxTableEta, 2.0f * e / (kDielectricAlbedoTableEtas - 1) - 1.0f);
+		for (uint a = 0; a < kDielectricAlbedoTableSize; ++a) {
+			float alpha = std::max((float)a / (kDielectricAlbedoTableSize - 1), 0.001f);
+			for (uint c = 0; c < kDielectricAlbedoTableSize; ++c) {
+				float cosThetaO = std::max((float)c / (kDielectricAlbedoTableSize - 1), 0.001f);
+				table.Values[e][a][c] = IntegrateAlbedo(cosThetaO, alpha, eta, 32u);
+			}
+		}
+	}
+
+	return table;
+}
+
+/**
+ * Splits a table coordinate into the lower index and the interpolation weight of the upper one
+ */
+static uint TableCoordinate(float value, uint size, float *t) {
+	float x = std::min(std::max(value, 0.0f), 1.0f) * (size - 1);
+	uint x0 = std::min((uint)x, size - 2);
+	*t = x - x0;
+
+	return x0;
+}
+
+float GGXAlbedo(float cosThetaO, float alpha) {
+	// Built by the first thread to get here. The others wait for it
+	static const GGXAlbedoTable table = BuildGGXAlbedoTable();
+
+	float tx, ty;
+	uint x0 = TableCoordinate(cosThetaO, kAlbedoTableSize, &tx);
+	uint y0 = TableCoordinate(alpha, kAlbedoTableSize, &ty);
+
+	float v0 = table.Values[y0][x0] * (1.0f - tx) + table.Values[y0][x0 + 1] * tx;
+	float v1 = table.Values[y0 + 1][x0] * (1.0f - tx) + table.Values[y0 + 1][x0 + 1] * tx;
+
+	return v0 * (1.0f - ty) + v1 * ty;
+}
+
+float GGXDielectricAlbedo(float cosThetaO, float alpha, float eta) {
+	static const GGXDielectricAlbedoTable table = BuildGGXDielectricAlbedoTable();
+
+	float tx, ty, tz;
+	uint x0 = TableCoordinate(cosThetaO, kDielectricAlbedoTableSize, &tx);
+	uint y0 = TableCoordinate(alpha, kDielectricAlbedoTableSize, &ty);
+	uint z0 = TableCoordinate(0.5f * (std::log(eta) / std::log(kMaxTableEta) + 1.0f), kDielectricAlbedoTableEtas, &tz);
+
+	float result = 0.0f;
+	for (uint z = 0; z < 2; ++z) {
+		for (uint y = 0; y < 2; ++y) {
+			const float *row = table.Values[z0 + z][y0 + y];
+			float value = row[x0] * (1.0f - tx) + row[x0 + 1] * tx;
+			result += value * (y == 0 ? 1.0f - ty : ty) * (z == 0 ? 1.0f - tz : tz);
+		}
+	}
+
+	return result;
+}
+
+} // End of namespace Lantern
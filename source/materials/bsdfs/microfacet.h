@@ -0,0 +1,98 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/vector_types.h"
+#include "math/vector_math.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace Lantern {
+
+/**
+ * The helpers below are for the isotropic GGX / Trowbridge-Reitz microfacet distribution.
+ * Angles are measured from the macro surface normal. alpha is the width of the distribution.
+ *
+ * Walter et al. 2007, "Microfacet Models for Refraction through Rough Surfaces"
+ * Heitz 2014, "Understanding the Masking-Shadowing Function in Microfacet-Based BRDFs"
+ */
+
+/**
+ * Maps a perceptually linear roughness in [0, 1] to the GGX alpha
+ */
+inline float RoughnessToAlpha(float roughness) {
+	// Very small alphas turn D into a spike that float can't represent
+	return std::max(roughness * roughness, 0.001f);
+}
+
+inline float GGXDistribution(float cosThetaH, float alpha) {
+	float alphaSquared = alpha * alpha;
+	float denom = cosThetaH * cosThetaH * (alphaSquared - 1.0f) + 1.0f;
+
+	return alphaSquared / ((float)M_PI * denom * denom);
+}
+
+inline float GGXLambda(float cosTheta, float alpha) {
+	float cosSquared = cosTheta * cosTheta;
+	float tanSquared = std::max(1.0f - cosSquared, 0.0f) / cosSquared;
+
+	return 0.5f * (std::sqrt(1.0f + alpha * alpha * tanSquared) - 1.0f);
+}
+
+/**
+ * The Smith masking function, G1
+ */
+inline float GGXMasking(float cosTheta, float alpha) {
+	return 1.0f / (1.0f + GGXLambda(cosTheta, alpha));
+}
+
+/**
+ * The height correlated Smith masking-shadowing function, G2
+ */
+inline float GGXMaskingShadowing(float cosThetaO, float cosThetaI, float alpha) {
+	return 1.0f / (1.0f + GGXLambda(cosThetaO, alpha) + GGXLambda(cosThetaI, alpha));
+}
+
+/**
+ * Samples a microfacet normal from the distribution of normals visible from wo. The pdf of the normal is
+ * GGXMasking(wo) * max(0, dot(wo, h)) * GGXDistribution(h) / cos(wo)
+ *
+ * Only the visible normals are sampled, so, unlike sampling D directly, the sample is never wasted on a
+ * microfacet that faces away from wo, and the weights don't blow up at grazing angles.
+ * Heitz 2018, "Sampling the GGX Distribution of Visible Normals"
+ *
+ * @param wo        The direction towards the viewer. Must be above the surface
+ * @param normal    The macro surface normal
+ * @param alpha     The width of the distribution
+ * @param u1        A random number in [0, 1)
+ * @param u2        A random number in [0, 1)
+ * @return          The microfacet normal, in world space
+ */
+float3a GGXSampleVisibleNormal(const float3a &wo, const float3a &normal, float alpha, float u1, float u2);
+
+/**
+ * Returns the fraction of light reflected by a GGX surface with perfectly reflecting microfacets, with
+ * a single bounce. The rest is the energy lost by ignoring the light that bounces between microfacets.
+ * The values come from a table, which is precomputed the first time it's used
+ *
+ * @param cosThetaO    The cosine of the angle between wo and the macro surface normal
+ * @param alpha        The width of the distribution
+ */
+float GGXAlbedo(float cosThetaO, float alpha);
+/**
+ * The same as GGXAlbedo(), but for smooth dielectric microfacets, which split the light between reflection
+ * and refraction. Refraction changes the masking of the outgoing light, so this depends on the IOR as well
+ *
+ * @param cosThetaO    The cosine of the angle between wo and the macro surface normal
+ * @param alpha        The width of the distribution
+ * @param eta          The IOR on the far side of the surface, divided by the IOR on the side of wo
+ */
+float GGXDielectricAlbedo(float cosThetaO, float alpha, float eta);
+
+} // End of namespace Lantern
@@ -24,7 +24,7 @@ public:
 
 public:
 	float3 Eval(SurfaceInteraction &interaction) const override {
-		return m_albedo;
+		return Albedo(interaction);
 	}
 
 	void Sample(SurfaceInteraction &interaction, UniformSampler *sampler) const override {
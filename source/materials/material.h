@@ -10,19 +10,29 @@ namespace Lantern {
 
 class BSDF;
 class Medium;
+class Texture;
 
 struct Material {
 	Material()
 		: BSDF(nullptr), 
-		  Medium(nullptr) {
+		  Medium(nullptr),
+		  AlbedoTexture(nullptr),
+		  AlphaTexture(nullptr) {
 	}
 	explicit Material(BSDF *bsdf, Medium *medium = nullptr)
 		: BSDF(bsdf),
-		  Medium(medium) {
+		  Medium(medium),
+		  AlbedoTexture(nullptr),
+		  AlphaTexture(nullptr) {
 	}
 
 	BSDF *BSDF;
 	Medium *Medium;
+	// If not null, multiplies the albedo of the BSDF. Only used on meshes with texture coordinates
+	const Texture *AlbedoTexture;
+	// If not null, a cutout mask. Rays pass through the surface with a probability of 1 - the red channel.
+	// Only used on meshes with texture coordinates, and must be set before the mesh is added to the scene
+	const Texture *AlphaTexture;
 };
 
 } // End of namespace Lantern
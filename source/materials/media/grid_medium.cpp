@@ -0,0 +1,200 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "materials/media/grid_medium.h"
+
+#include "materials/media/voxel_grid.h"
+
+#include "math/uniform_sampler.h"
+#include "math/sampling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace Lantern {
+
+// Once every channel of the ratio tracked transmittance drops below this, we start playing Russian roulette with it
+static const float kTransmittanceRouletteThreshold = 0.1f;
+
+GridMedium::GridMedium(float3 absorptionColor, float absorptionAtDistance, float scatteringCoefficient, const VoxelGrid *grid, float3 boundsMin, float3 boundsMax)
+		: Medium(absorptionColor, absorptionAtDistance),
+		  m_scatteringCoefficient(scatteringCoefficient),
+		  m_grid(grid),
+		  m_boundsMin(boundsMin),
+		  m_worldToGrid(float3((float)grid->Width(), (float)grid->Height(), (float)grid->Depth()) / (boundsMax - boundsMin)),
+		  m_majorantScale(std::max(m_absorptionCoefficient.x, std::max(m_absorptionCoefficient.y, m_absorptionCoefficient.z)) + scatteringCoefficient) {
+}
+
+GridMedium::GridRay GridMedium::ToGridSpace(const float3a &origin, const float3a &direction) const {
+	// The grid is only scaled and translated, so distances along the ray are the same in both spaces
+	GridRay ray;
+	ray.Origin = (float3(origin.x, origin.y, origin.z) - m_boundsMin) * m_worldToGrid;
+	ray.Direction = float3(direction.x, direction.y, direction.z) * m_worldToGrid;
+
+	return ray;
+}
+
+template <typename Callback>
+void GridMedium::TraverseMajorants(const GridRay &ray, float tMax, Callback callback) const {
+	const float infinity = std::numeric_limits<float>::infinity();
+	const float brickSize = (float)VoxelGrid::kBrickSize;
+	const float resolution[3] = {(float)m_grid->Width(), (float)m_grid->Height(), (float)m_grid->Depth()};
+	const int numBricks[3] = {(int)m_grid->BricksX(), (int)m_grid->BricksY(), (int)m_grid->BricksZ()};
+
+	// Clip the ray to the grid
+	float tEnter = 0.0f;
+	float tExit = tMax;
+	for (uint axis = 0; axis < 3; ++axis) {
+		if (ray.Direction[axis] == 0.0f) {
+			if (ray.Origin[axis] < 0.0f || ray.Origin[axis] > resolution[axis]) {
+				return;
+			}
+			continue;
+		}
+
+		float invDirection = 1.0f / ray.Direction[axis];
+		float t0 = -ray.Origin[axis] * invDirection;
+		float t1 = (resolution[axis] - ray.Origin[axis]) * invDirection;
+		tEnter = std::max(tEnter, std::min(t0, t1));
+		tExit = std::min(tExit, std::max(t0, t1));
+	}
+	if (tEnter >= tExit) {
+		return;
+	}
+
+	// Then walk the bricks with a 3D DDA
+	// Amanatides and Woo 1987, "A Fast Voxel Traversal Algorithm for Ray Tracing"
+	float3 entry = ray.Origin + ray.Direction * tEnter;
+	int brick[3];
+	int step[3];
+	float tNext[3];
+	float tDelta[3];
+	for (uint axis = 0; axis < 3; ++axis) {
+		brick[axis] = std::min(std::max((int)(entry[axis] / brickSize), 0), numBricks[axis] - 1);
+
+		if (ray.Direction[axis] > 0.0f) {
+			step[axis] = 1;
+			tNext[axis] = tEnter + ((brick[axis] + 1) * brickSize - entry[axis]) / ray.Direction[axis];
+			tDelta[axis] = brickSize / ray.Direction[axis];
+		} else if (ray.Direction[axis] < 0.0f) {
+			step[axis] = -1;
+			tNext[axis] = tEnter + (brick[axis] * brickSize - entry[axis]) / ray.Direction[axis];
+			tDelta[axis] = -brickSize / ray.Direction[axis];
+		} else {
+			step[axis] = 0;
+			tNext[axis] = infinity;
+			tDelta[axis] = infinity;
+		}
+	}
+
+	float t = tEnter;
+	while (t < tExit) {
+		uint axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+		float tBrickExit = std::min(tNext[axis], tExit);
+
+		float majorant = m_grid->Majorant(brick[0], brick[1], brick[2]) * m_majorantScale;
+		if (!callback(t, tBrickExit, majorant)) {
+			return;
+		}
+
+		t = tBrickExit;
+		brick[axis] += step[axis];
+		if (brick[axis] < 0 || brick[axis] >= numBricks[axis]) {
+			return;
+		}
+		tNext[axis] += tDelta[axis];
+	}
+}
+
+float GridMedium::SampleDistance(UniformSampler *sampler, const float3a &origin, const float3a &direction, float tFar, const MediumWalk * /* walk */, float3 *weight) const {
+	GridRay ray = ToGridSpace(origin, direction);
+	float3 absorptionCoefficient(m_absorptionCoefficient.x, m_absorptionCoefficient.y, m_absorptionCoefficient.z);
+
+	// Delta tracking. Each tentative collision is a real scatter with probability scattering / majorant.
+	// Otherwise, we carry on, weighting the throughput by the fraction of the remaining extinction that
+	// isn't absorption. So absorption darkens the path rather than terminating it
+	float distance = tFar;
+	float3 pathWeight(1.0f);
+	TraverseMajorants(ray, tFar, [&](float tStart, float tEnd, float majorant) {
+		if (majorant <= 0.0f) {
+			return true;
+		}
+
+		float t = tStart;
+		for (;;) {
+			t -= std::log(1.0f - sampler->NextFloat()) / majorant;
+			if (t >= tEnd) {
+				return true;
+			}
+
+			float density = m_grid->Density(ray.Origin + ray.Direction * t);
+			float scattering = density * m_scatteringCoefficient;
+			if (sampler->NextFloat() * majorant < scattering) {
+				distance = t;
+				return false;
+			}
+
+			float3 nullCollision = max(float3(majorant - scattering) - density * absorptionCoefficient, float3(0.0f));
+			pathWeight = pathWeight * nullCollision / (majorant - scattering);
+		}
+	});
+
+	*weight = *weight * pathWeight;
+	return distance;
+}
+
+float3a GridMedium::SampleScatterDirection(UniformSampler *sampler, float3a & /* wo */, float *pdf) const {
+	*pdf = 0.25f * M_1_PI; // 1 / (4 * PI)
+	return UniformSampleSphere(sampler);
+}
+
+float GridMedium::ScatterDirectionPdf(float3a & /* wi */, float3a & /* wo */) const {
+	return 0.25f * M_1_PI; // 1 / (4 * PI)
+}
+
+float3 GridMedium::Transmittance(UniformSampler *sampler, const float3a &origin, const float3a &direction, float distance) const {
+	GridRay ray = ToGridSpace(origin, direction);
+	float3 extinctionCoefficient(m_absorptionCoefficient.x + m_scatteringCoefficient,
+	                             m_absorptionCoefficient.y + m_scatteringCoefficient,
+	                             m_absorptionCoefficient.z + m_scatteringCoefficient);
+
+	// Ratio tracking
+	float3 transmittance(1.0f);
+	TraverseMajorants(ray, distance, [&](float tStart, float tEnd, float majorant) {
+		if (majorant <= 0.0f) {
+			return true;
+		}
+
+		float invMajorant = 1.0f / majorant;
+		float t = tStart;
+		for (;;) {
+			t -= std::log(1.0f - sampler->NextFloat()) * invMajorant;
+			if (t >= tEnd) {
+				return true;
+			}
+
+			float density = m_grid->Density(ray.Origin + ray.Direction * t);
+			transmittance = transmittance * max(float3(1.0f) - density * extinctionCoefficient * invMajorant, float3(0.0f));
+
+			// Russian roulette keeps us from stepping through the rest of a dense region for a tiny contribution
+			float maxTransmittance = std::max(transmittance.x, std::max(transmittance.y, transmittance.z));
+			if (maxTransmittance < kTransmittanceRouletteThreshold) {
+				float survival = maxTransmittance / kTransmittanceRouletteThreshold;
+				if (sampler->NextFloat() >= survival) {
+					transmittance = float3(0.0f);
+					return false;
+				}
+				transmittance = transmittance / survival;
+			}
+		}
+	});
+
+	return transmittance;
+}
+
+} // End of namespace Lantern
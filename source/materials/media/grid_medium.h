@@ -0,0 +1,70 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "materials/media/medium.h"
+
+#include "math/vector_types.h"
+
+
+namespace Lantern {
+
+class VoxelGrid;
+
+/**
+ * A heterogeneous, isotropically scattering medium, whose density comes from a VoxelGrid
+ *
+ * Free-flight distances are sampled with delta tracking, and transmittance is estimated with
+ * ratio tracking. Both walk the grid's bricks, using each brick's majorant, so empty bricks are
+ * skipped in a single step, and thin bricks are crossed in a few.
+ */
+class GridMedium : public Medium {
+public:
+	/**
+	 * @param absorptionColor          The color of the medium at a density of 1, after light has travelled absorptionAtDistance through it
+	 * @param absorptionAtDistance     See above
+	 * @param scatteringCoefficient    The scattering coefficient at a density of 1
+	 * @param grid                     The densities. The caller owns it, and must keep it alive as long as the medium
+	 * @param boundsMin                The world space corner the grid is stretched from
+	 * @param boundsMax                The world space corner the grid is stretched to
+	 */
+	GridMedium(float3 absorptionColor, float absorptionAtDistance, float scatteringCoefficient, const VoxelGrid *grid, float3 boundsMin, float3 boundsMax);
+
+private:
+	float m_scatteringCoefficient;
+	const VoxelGrid *m_grid;
+	float3 m_boundsMin;
+	// Scales world space offsets from m_boundsMin to voxel units
+	float3 m_worldToGrid;
+	// Converts a brick's maximum density to the maximum extinction in any channel
+	float m_majorantScale;
+
+	struct GridRay {
+		float3 Origin;
+		float3 Direction;
+	};
+
+public:
+	float SampleDistance(UniformSampler *sampler, const float3a &origin, const float3a &direction, float tFar, const MediumWalk *walk, float3 *weight) const override;
+
+	float3a SampleScatterDirection(UniformSampler *sampler, float3a &wo, float *pdf) const override;
+	float ScatterDirectionPdf(float3a &wi, float3a &wo) const override;
+
+	float3 Transmittance(UniformSampler *sampler, const float3a &origin, const float3a &direction, float distance) const override;
+
+private:
+	GridRay ToGridSpace(const float3a &origin, const float3a &direction) const;
+	/**
+	 * Walks the bricks the ray passes through, in order, calling
+	 * bool callback(float tStart, float tEnd, float majorant) for each one.
+	 * The walk stops early if the callback returns false
+	 */
+	template <typename Callback>
+	void TraverseMajorants(const GridRay &ray, float tMax, Callback callback) const;
+};
+
+} // End of namespace Lantern
@@ -12,42 +12,143 @@
 #include "math/uniform_sampler.h"
 #include "math/sampling.h"
 
+#include <algorithm>
 #include <cmath>
 
 
 namespace Lantern {
 
+// Guided walks mix in classical sampling, so paths heading deeper into the medium aren't starved of samples
+// Meng et al. 2016, "Improving the Dwivedi Sampling Scheme"
+static const float kGuidedProbability = 0.75f;
+// See DwivediEigenvalue()
+static const float kMinDwivediEigenvalue = 1.0001f;
+
 class IsotropicScatteringMedium : public Medium {
 public:
 	IsotropicScatteringMedium(float3 absorptionColor, float absorptionAtDistance, float scatteringCoefficient)
 		: Medium(absorptionColor, absorptionAtDistance),
-		  m_scatteringCoefficient(scatteringCoefficient) {
+		  m_scatteringCoefficient(scatteringCoefficient),
+		  m_extinctionCoefficient(m_absorptionCoefficient + float3a(scatteringCoefficient)),
+		  m_dwivediEigenvalue(DwivediEigenvalue(m_scatteringCoefficient, m_extinctionCoefficient)) {
+	}
+	IsotropicScatteringMedium(float3 absorptionColor, float absorptionAtDistance, float3 scatteringCoefficient)
+		: Medium(absorptionColor, absorptionAtDistance),
+		  m_scatteringCoefficient(scatteringCoefficient),
+		  m_extinctionCoefficient(m_absorptionCoefficient + float3a(scatteringCoefficient)),
+		  m_dwivediEigenvalue(DwivediEigenvalue(m_scatteringCoefficient, m_extinctionCoefficient)) {
 	}
 
 private:
-	float m_scatteringCoefficient;
+	float3a m_scatteringCoefficient;
+	float3a m_extinctionCoefficient;
+	// The diffusion eigenvalue (nu_0) of the channel with the highest albedo. Guided walks are tuned for it
+	float m_dwivediEigenvalue;
 
 public:
-	float SampleDistance(UniformSampler *sampler, float tFar, float *weight, float *pdf) const override {
-		float distance = -std::logf(sampler->NextFloat()) / m_scatteringCoefficient;
+	float SampleDistance(UniformSampler *sampler, const float3a & /* origin */, const float3a &direction, float tFar, const MediumWalk *walk, float3 *weight) const override {
+		// Chromatic media have a different free-flight distribution per channel. We pick a channel at random, sample its
+		// distribution, and weight the result with the balance heuristic over all three channels (aka, spectral MIS).
+		// That way, no channel's estimate blows up when its coefficient is much lower than the one we sampled
+		//
+		// Guided walks add a second technique per channel, where the extinction is stretched towards the exit, and shrunk away from it
+		float guidedProbability = 0.0f;
+		float3a guidedExtinction = m_extinctionCoefficient;
+		if (walk != nullptr && walk->Guided) {
+			guidedProbability = kGuidedProbability;
+			guidedExtinction = m_extinctionCoefficient * (1.0f - dot(direction, walk->ExitNormal) / m_dwivediEigenvalue);
+		}
+
+		uint channel = std::min((uint)(sampler->NextFloat() * 3.0f), 2u);
+		float extinction = sampler->NextFloat() < guidedProbability ? guidedExtinction[channel] : m_extinctionCoefficient[channel];
+		float distance = std::min(-std::log(1.0f - sampler->NextFloat()) / extinction, tFar);
+
+		float3a transmittance = exp(-m_extinctionCoefficient * distance);
+		float3a guidedTransmittance = exp(-guidedExtinction * distance);
 		if (distance >= tFar) {
-			*pdf = 1.0f;
+			// The probability of getting through is the average transmittance of the techniques
+			float3a probabilities = transmittance * (1.0f - guidedProbability) + guidedTransmittance * guidedProbability;
+			float probability = (probabilities.x + probabilities.y + probabilities.z) * (1.0f / 3.0f);
+			*weight = probability > 0.0f ? *weight * float3(transmittance / probability) : float3(0.0f);
 			return tFar;
 		}
 
-		*pdf = std::exp(-m_scatteringCoefficient * distance);
+		float3a densities = m_extinctionCoefficient * transmittance * (1.0f - guidedProbability) + guidedExtinction * guidedTransmittance * guidedProbability;
+		float pdf = (densities.x + densities.y + densities.z) * (1.0f / 3.0f);
+		*weight = pdf > 0.0f ? *weight * float3(m_scatteringCoefficient * transmittance / pdf) : float3(0.0f);
+
 		return distance;
 	}
 	float3a SampleScatterDirection(UniformSampler *sampler, float3a &wo, float *pdf) const override {
 		*pdf = 0.25f * M_1_PI; // 1 / (4 * PI)
 		return UniformSampleSphere(sampler);
 	}
+	float3a SampleWalkDirection(UniformSampler *sampler, float3a & /* wo */, const MediumWalk &walk, float3 *weight) const override {
+		if (!walk.Guided) {
+			return UniformSampleSphere(sampler);
+		}
+
+		// Dwivedi sampling. The cosine to the exit normal has the pdf 1 / (log((nu + 1) / (nu - 1)) * (nu - cosine)),
+		// which we mix with the phase function
+		float nu = m_dwivediEigenvalue;
+		float logRatio = std::log((nu + 1.0f) / (nu - 1.0f));
+
+		float3a wi;
+		if (sampler->NextFloat() < kGuidedProbability) {
+			float cosTheta = nu - (nu + 1.0f) * std::exp(-sampler->NextFloat() * logRatio);
+			cosTheta = std::min(std::max(cosTheta, -1.0f), 1.0f);
+			float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+			float phi = 2.0f * (float)M_PI * sampler->NextFloat();
+
+			float3a exitNormal = walk.ExitNormal;
+			wi = RotateToWorld(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta, exitNormal);
+		} else {
+			wi = UniformSampleSphere(sampler);
+		}
+
+		float phase = 0.25f * M_1_PI; // 1 / (4 * PI)
+		float guidedPdf = 0.5f * M_1_PI / (logRatio * (nu - dot(wi, walk.ExitNormal)));
+		*weight = *weight * (phase / (kGuidedProbability * guidedPdf + (1.0f - kGuidedProbability) * phase));
+
+		return wi;
+	}
 
 	float ScatterDirectionPdf(float3a &wi, float3a &wo) const override {
 		return 0.25f * M_1_PI; // 1 / (4 * PI)
 	}
-	float3 Transmission(float distance) const override {
-		return exp(-m_absorptionCoefficient * distance);
+	float3 Transmittance(UniformSampler * /* sampler */, const float3a & /* origin */, const float3a & /* direction */, float distance) const override {
+		return exp(-m_extinctionCoefficient * distance);
+	}
+
+private:
+	/**
+	 * Solves the transport equation's dispersion relation, 1 = albedo * nu * atanh(1 / nu), for the highest albedo channel
+	 */
+	static float DwivediEigenvalue(const float3a &scatteringCoefficient, const float3a &extinctionCoefficient) {
+		float albedo = 0.0f;
+		for (uint i = 0; i < 3; ++i) {
+			if (extinctionCoefficient[i] > 0.0f) {
+				albedo = std::max(albedo, scatteringCoefficient[i] / extinctionCoefficient[i]);
+			}
+		}
+		// nu goes to infinity as the albedo goes to 1, and the sampling degenerates to the classical one
+		albedo = std::min(std::max(albedo, 1.0e-3f), 0.9999f);
+
+		// albedo * atanh(x) / x increases monotonically from albedo at x = 0 to infinity at x = 1, so we bisect for x = 1 / nu
+		float low = 0.0f;
+		float high = 1.0f;
+		for (uint i = 0; i < 32; ++i) {
+			float x = 0.5f * (low + high);
+			if (albedo * std::atanh(x) / x < 1.0f) {
+				low = x;
+			} else {
+				high = x;
+			}
+		}
+
+		// At low albedos, nu approaches 1 as 1 + 2 * exp(-2 / albedo), and rounds to exactly 1 below an albedo of about 0.1.
+		// That would send log((nu + 1) / (nu - 1)) in the walk sampling to infinity, so we keep it a little above 1
+		return std::max(2.0f / (low + high), kMinDwivediEigenvalue);
 	}
 };
 
@@ -14,6 +14,24 @@
 namespace Lantern {
 class UniformSampler;
 
+/**
+ * The state of a path's random walk through a medium
+ */
+struct MediumWalk {
+	MediumWalk()
+		: ExitNormal(0.0f, 1.0f, 0.0f),
+		  Guided(false) {
+	}
+
+	// The outward normal of the surface the path entered the medium through
+	float3a ExitNormal;
+	/**
+	 * If true, media that support it bias the walk towards the surface the path entered through, treating it as
+	 * a plane. See Krivanek and d'Eon 2014, "A Zero-variance-based Sampling Scheme for Monte Carlo Subsurface Scattering"
+	 */
+	bool Guided;
+};
+
 class Medium {
 public:
 	Medium(float3 absorptionColor, float absorptionAtDistance) 
@@ -28,12 +46,48 @@ protected:
 	const float3a m_absorptionCoefficient;
 
 public:
-	virtual float SampleDistance(UniformSampler *sampler, float tFar, float *weight, float *pdf) const = 0;
+	/**
+	 * Samples the distance to the next scatter event along a ray through the medium
+	 *
+	 * @param sampler      The sampler to use for generating random numbers
+	 * @param origin       The origin of the ray
+	 * @param direction    The normalized direction of the ray
+	 * @param tFar         The distance to the surface the ray leaves the medium through
+	 * @param walk         The walk the ray is part of. May be nullptr
+	 * @param weight       Multiplied by the throughput weight of the ray up to the returned distance
+	 * @return             The distance to the scatter event, or tFar if the ray made it to the surface
+	 */
+	virtual float SampleDistance(UniformSampler *sampler, const float3a &origin, const float3a &direction, float tFar, const MediumWalk *walk, float3 *weight) const = 0;
 
 	virtual float3a SampleScatterDirection(UniformSampler *sampler, float3a &wo, float *pdf) const = 0;
+	/**
+	 * Samples the direction to continue a walk in after a scatter event. By default, this samples the phase function
+	 *
+	 * @param sampler    The sampler to use for generating random numbers
+	 * @param wo         The direction the ray was travelling in before the scatter
+	 * @param walk       The walk the ray is part of
+	 * @param weight     Multiplied by the phase function over the pdf of the sampled direction
+	 */
+	virtual float3a SampleWalkDirection(UniformSampler *sampler, float3a &wo, const MediumWalk & /* walk */, float3 * /* weight */) const {
+		// The phase function is sampled exactly, so the weight is left as is
+		float pdf;
+		return SampleScatterDirection(sampler, wo, &pdf);
+	}
+	/**
+	 * Phase functions are sampled exactly, so this is also the value of the phase function.
+	 * wo is the direction the ray was travelling in before the scatter
+	 */
 	virtual float ScatterDirectionPdf(float3a &wi, float3a &wo) const = 0;
 
-	virtual float3 Transmission(float distance) const = 0;
+	/**
+	 * Estimates the fraction of light that travels the given distance along the ray without being absorbed or scattered
+	 *
+	 * @param sampler      The sampler to use for generating random numbers. Unused by homogeneous media
+	 * @param origin       The origin of the ray
+	 * @param direction    The normalized direction of the ray
+	 * @param distance     The distance along the ray
+	 */
+	virtual float3 Transmittance(UniformSampler *sampler, const float3a &origin, const float3a &direction, float distance) const = 0;
 };
 
 } // End of namespace Lantern
@@ -22,8 +22,8 @@ public:
 	}
 
 public:
-	float SampleDistance(UniformSampler *sampler, float tFar, float *weight, float *pdf) const override {
-		*pdf = 1.0f;
+	float SampleDistance(UniformSampler *sampler, const float3a & /* origin */, const float3a & /* direction */, float tFar, const MediumWalk * /* walk */, float3 *weight) const override {
+		*weight = *weight * exp(-m_absorptionCoefficient * tFar);
 		return tFar;
 	}
 	
@@ -34,7 +34,7 @@ public:
 		return 1.0f;
 	}
 
-	float3 Transmission(float distance) const override {
+	float3 Transmittance(UniformSampler * /* sampler */, const float3a & /* origin */, const float3a & /* direction */, float distance) const override {
 		return exp(-m_absorptionCoefficient * distance);
 	}
 };
@@ -0,0 +1,173 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "materials/media/voxel_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+
+namespace Lantern {
+
+static bool IsLittleEndian() {
+	uint32 value = 1u;
+	return *(byte *)&value == 1u;
+}
+
+static void SwapBytes(float *value) {
+	byte *bytes = (byte *)value;
+	std::swap(bytes[0], bytes[3]);
+	std::swap(bytes[1], bytes[2]);
+}
+
+const uint VoxelGrid::kBrickSize;
+const uint VoxelGrid::kEmptyBrick;
+
+VoxelGrid::VoxelGrid()
+		: m_width(0u),
+		  m_height(0u),
+		  m_depth(0u),
+		  m_bricksX(0u),
+		  m_bricksY(0u),
+		  m_bricksZ(0u) {
+}
+
+void VoxelGrid::Init(const float *densities, uint width, uint height, uint depth) {
+	m_width = width;
+	m_height = height;
+	m_depth = depth;
+	m_bricksX = (width + kBrickSize - 1) / kBrickSize;
+	m_bricksY = (height + kBrickSize - 1) / kBrickSize;
+	m_bricksZ = (depth + kBrickSize - 1) / kBrickSize;
+
+	uint numBricks = m_bricksX * m_bricksY * m_bricksZ;
+	m_brickOffsets.assign(numBricks, kEmptyBrick);
+	m_brickMajorants.assign(numBricks, 0.0f);
+	m_voxels.clear();
+
+	auto denseVoxel = [&](int x, int y, int z) {
+		if (x < 0 || y < 0 || z < 0 || x >= (int)width || y >= (int)height || z >= (int)depth) {
+			return 0.0f;
+		}
+		return std::max(densities[((size_t)z * height + y) * width + x], 0.0f);
+	};
+
+	const int kBrickSizeInt = (int)kBrickSize;
+	for (uint bz = 0; bz < m_bricksZ; ++bz) {
+		for (uint by = 0; by < m_bricksY; ++by) {
+			for (uint bx = 0; bx < m_bricksX; ++bx) {
+				uint brick = (bz * m_bricksY + by) * m_bricksX + bx;
+				int x0 = (int)bx * kBrickSizeInt;
+				int y0 = (int)by * kBrickSizeInt;
+				int z0 = (int)bz * kBrickSizeInt;
+
+				// Interpolating anywhere inside the brick touches the voxels from one before it, to one after it
+				float majorant = 0.0f;
+				for (int z = z0 - 1; z <= z0 + kBrickSizeInt; ++z) {
+					for (int y = y0 - 1; y <= y0 + kBrickSizeInt; ++y) {
+						for (int x = x0 - 1; x <= x0 + kBrickSizeInt; ++x) {
+							majorant = std::max(majorant, denseVoxel(x, y, z));
+						}
+					}
+				}
+				m_brickMajorants[brick] = majorant;
+
+				bool empty = true;
+				for (int z = z0; z < z0 + kBrickSizeInt && empty; ++z) {
+					for (int y = y0; y < y0 + kBrickSizeInt && empty; ++y) {
+						for (int x = x0; x < x0 + kBrickSizeInt && empty; ++x) {
+							empty = denseVoxel(x, y, z) == 0.0f;
+						}
+					}
+				}
+				if (empty) {
+					continue;
+				}
+
+				m_brickOffsets[brick] = (uint)m_voxels.size();
+				for (int z = z0; z < z0 + kBrickSizeInt; ++z) {
+					for (int y = y0; y < y0 + kBrickSizeInt; ++y) {
+						for (int x = x0; x < x0 + kBrickSizeInt; ++x) {
+							m_voxels.push_back(denseVoxel(x, y, z));
+						}
+					}
+				}
+			}
+		}
+	}
+
+	m_voxels.shrink_to_fit();
+}
+
+bool VoxelGrid::LoadRaw(const char *filePath, uint width, uint height, uint depth) {
+	FILE *file = fopen(filePath, "rb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	std::vector<float> densities((size_t)width * height * depth);
+	bool success = !densities.empty() && fread(&densities[0], sizeof(float), densities.size(), file) == densities.size();
+	fclose(file);
+
+	if (!success) {
+		return false;
+	}
+
+	if (!IsLittleEndian()) {
+		for (float &density : densities) {
+			SwapBytes(&density);
+		}
+	}
+
+	Init(&densities[0], width, height, depth);
+	return true;
+}
+
+float VoxelGrid::Density(const float3 &position) const {
+	float x = position.x - 0.5f;
+	float y = position.y - 0.5f;
+	float z = position.z - 0.5f;
+	float floorX = std::floor(x);
+	float floorY = std::floor(y);
+	float floorZ = std::floor(z);
+	int x0 = (int)floorX;
+	int y0 = (int)floorY;
+	int z0 = (int)floorZ;
+	float tx = x - floorX;
+	float ty = y - floorY;
+	float tz = z - floorZ;
+
+	float c00 = Voxel(x0, y0, z0) * (1.0f - tx) + Voxel(x0 + 1, y0, z0) * tx;
+	float c10 = Voxel(x0, y0 + 1, z0) * (1.0f - tx) + Voxel(x0 + 1, y0 + 1, z0) * tx;
+	float c01 = Voxel(x0, y0, z0 + 1) * (1.0f - tx) + Voxel(x0 + 1, y0, z0 + 1) * tx;
+	float c11 = Voxel(x0, y0 + 1, z0 + 1) * (1.0f - tx) + Voxel(x0 + 1, y0 + 1, z0 + 1) * tx;
+
+	float c0 = c00 * (1.0f - ty) + c10 * ty;
+	float c1 = c01 * (1.0f - ty) + c11 * ty;
+
+	return c0 * (1.0f - tz) + c1 * tz;
+}
+
+float VoxelGrid::Voxel(int x, int y, int z) const {
+	if (x < 0 || y < 0 || z < 0 || x >= (int)m_width || y >= (int)m_height || z >= (int)m_depth) {
+		return 0.0f;
+	}
+
+	uint brick = ((z / kBrickSize) * m_bricksY + (y / kBrickSize)) * m_bricksX + (x / kBrickSize);
+	uint offset = m_brickOffsets[brick];
+	if (offset == kEmptyBrick) {
+		return 0.0f;
+	}
+
+	uint localX = x % kBrickSize;
+	uint localY = y % kBrickSize;
+	uint localZ = z % kBrickSize;
+	return m_voxels[offset + (localZ * kBrickSize + localY) * kBrickSize + localX];
+}
+
+} // End of namespace Lantern
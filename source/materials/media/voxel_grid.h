@@ -0,0 +1,85 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+#include "math/vector_types.h"
+
+#include "profiling/memory_tracker.h"
+
+
+namespace Lantern {
+
+/**
+ * A sparse grid of densities, for heterogeneous media
+ *
+ * The grid is split into bricks of kBrickSize^3 voxels, and only the bricks with a non-zero
+ * voxel are stored. Each brick also stores the largest density that can be interpolated
+ * anywhere inside it. Together, they form a coarse majorant grid, which lets the trackers
+ * take large steps through empty and thin regions of the medium.
+ */
+class VoxelGrid {
+public:
+	VoxelGrid();
+
+public:
+	static const uint kBrickSize = 8;
+
+private:
+	static const uint kEmptyBrick = 0xFFFFFFFF;
+
+	uint m_width;
+	uint m_height;
+	uint m_depth;
+	uint m_bricksX;
+	uint m_bricksY;
+	uint m_bricksZ;
+
+	// The index of the first voxel of each brick in m_voxels, or kEmptyBrick
+	TrackedVector<uint, MemoryCategory::Media> m_brickOffsets;
+	TrackedVector<float, MemoryCategory::Media> m_brickMajorants;
+	TrackedVector<float, MemoryCategory::Media> m_voxels;
+
+public:
+	/**
+	 * Builds the grid from a dense array of densities
+	 *
+	 * @param densities    width * height * depth densities, with x varying fastest, then y, then z
+	 * @param width        The number of voxels in x
+	 * @param height       The number of voxels in y
+	 * @param depth        The number of voxels in z
+	 */
+	void Init(const float *densities, uint width, uint height, uint depth);
+	/**
+	 * Reads a raw file of little endian, 32 bit float densities, in the same order as Init()
+	 *
+	 * @return    False if the file couldn't be read, or is too small for the resolution
+	 */
+	bool LoadRaw(const char *filePath, uint width, uint height, uint depth);
+
+	uint Width() const { return m_width; }
+	uint Height() const { return m_height; }
+	uint Depth() const { return m_depth; }
+	uint BricksX() const { return m_bricksX; }
+	uint BricksY() const { return m_bricksY; }
+	uint BricksZ() const { return m_bricksZ; }
+
+	/**
+	 * Trilinearly interpolates the density. Positions outside the grid have zero density
+	 *
+	 * @param position    The position in voxel units. Voxel centers are at integer + 0.5
+	 */
+	float Density(const float3 &position) const;
+	float Majorant(uint brickX, uint brickY, uint brickZ) const {
+		return m_brickMajorants[(brickZ * m_bricksY + brickY) * m_bricksX + brickX];
+	}
+
+private:
+	float Voxel(int x, int y, int z) const;
+};
+
+} // End of namespace Lantern
@@ -0,0 +1,263 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "materials/textures/texture.h"
+
+#include "scene/image_io.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+
+namespace Lantern {
+
+static const uint32 kTilesMagic = 0x5845544C; // 'LTEX'
+static const uint32 kTilesVersion = 1u;
+
+// The tiles are only a cache of the image, for the machine that wrote them, so they're in native byte order
+struct TilesHeader {
+	uint32 Magic;
+	uint32 Version;
+	uint32 Width;
+	uint32 Height;
+	uint32 NumLevels;
+	uint32 TileSize;
+};
+
+static bool SeekFile(FILE *file, uint64 offset) {
+	#ifdef _WIN32
+		return _fseeki64(file, (int64)offset, SEEK_SET) == 0;
+	#else
+		return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+	#endif
+}
+
+Texture::Texture()
+		: m_cache(nullptr),
+		  m_id(0u),
+		  m_lodOffset(0.0f),
+		  m_file(nullptr) {
+}
+
+Texture::~Texture() {
+	if (m_file != nullptr) {
+		fclose(m_file);
+	}
+}
+
+bool Texture::Open(const char *filePath, TileCache *cache) {
+	m_cache = cache;
+	m_id = cache->RegisterTexture();
+
+	std::string path(filePath);
+	const std::string kTilesExtension(".tiles");
+	if (path.size() >= kTilesExtension.size() && path.compare(path.size() - kTilesExtension.size(), kTilesExtension.size(), kTilesExtension) == 0) {
+		return OpenTiles(filePath);
+	}
+
+	std::string tilesPath = path + kTilesExtension;
+	if (OpenTiles(tilesPath.c_str())) {
+		return true;
+	}
+
+	return WriteTiles(filePath, tilesPath.c_str()) && OpenTiles(tilesPath.c_str());
+}
+
+bool Texture::OpenTiles(const char *tilesPath) {
+	FILE *file = fopen(tilesPath, "rb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	TilesHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.Magic != kTilesMagic || header.Version != kTilesVersion ||
+	    header.TileSize != TextureTile::kSize || header.NumLevels == 0 || header.Width == 0 || header.Height == 0) {
+		fclose(file);
+		return false;
+	}
+
+	m_levels.clear();
+	uint64 offset = sizeof(TilesHeader);
+	for (uint i = 0; i < header.NumLevels; ++i) {
+		Level level;
+		level.Width = std::max(header.Width >> i, 1u);
+		level.Height = std::max(header.Height >> i, 1u);
+		level.TilesX = (level.Width + TextureTile::kSize - 1) / TextureTile::kSize;
+		level.TilesY = (level.Height + TextureTile::kSize - 1) / TextureTile::kSize;
+		level.FileOffset = offset;
+		m_levels.push_back(level);
+
+		offset += (uint64)level.TilesX * level.TilesY * sizeof(TextureTile);
+	}
+	m_lodOffset = 0.5f * std::log2((float)header.Width * (float)header.Height);
+
+	if (m_file != nullptr) {
+		fclose(m_file);
+	}
+	m_file = file;
+
+	return true;
+}
+
+bool Texture::WriteTiles(const char *imagePath, const char *tilesPath) {
+	uint width, height;
+	std::vector<float3> pixels;
+	if (!ReadImage(imagePath, &width, &height, &pixels)) {
+		printf("Failed to read texture %s\n", imagePath);
+		return false;
+	}
+
+	FILE *file = fopen(tilesPath, "wb");
+	if (file == nullptr) {
+		printf("Failed to write %s\n", tilesPath);
+		return false;
+	}
+
+	uint numLevels = 1u;
+	while ((width >> numLevels) > 0 || (height >> numLevels) > 0) {
+		++numLevels;
+	}
+
+	TilesHeader header = {kTilesMagic, kTilesVersion, width, height, numLevels, TextureTile::kSize};
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	std::vector<float3> level = pixels;
+	uint levelWidth = width;
+	uint levelHeight = height;
+	TextureTile tile;
+	for (uint i = 0; i < numLevels && success; ++i) {
+		// Pad the edge tiles by clamping
+		uint tilesX = (levelWidth + TextureTile::kSize - 1) / TextureTile::kSize;
+		uint tilesY = (levelHeight + TextureTile::kSize - 1) / TextureTile::kSize;
+		for (uint ty = 0; ty < tilesY && success; ++ty) {
+			for (uint tx = 0; tx < tilesX && success; ++tx) {
+				for (uint y = 0; y < TextureTile::kSize; ++y) {
+					uint sourceY = std::min(ty * TextureTile::kSize + y, levelHeight - 1);
+					for (uint x = 0; x < TextureTile::kSize; ++x) {
+						uint sourceX = std::min(tx * TextureTile::kSize + x, levelWidth - 1);
+						tile.Texels[y * TextureTile::kSize + x] = level[sourceY * levelWidth + sourceX];
+					}
+				}
+				success = fwrite(&tile, sizeof(tile), 1, file) == 1;
+			}
+		}
+
+		// Box filter down to the next level
+		uint nextWidth = std::max(levelWidth >> 1, 1u);
+		uint nextHeight = std::max(levelHeight >> 1, 1u);
+		std::vector<float3> next(nextWidth * nextHeight);
+		for (uint y = 0; y < nextHeight; ++y) {
+			uint y0 = std::min(y * 2, levelHeight - 1);
+			uint y1 = std::min(y * 2 + 1, levelHeight - 1);
+			for (uint x = 0; x < nextWidth; ++x) {
+				uint x0 = std::min(x * 2, levelWidth - 1);
+				uint x1 = std::min(x * 2 + 1, levelWidth - 1);
+				next[y * nextWidth + x] = (level[y0 * levelWidth + x0] + level[y0 * levelWidth + x1] +
+				                           level[y1 * levelWidth + x0] + level[y1 * levelWidth + x1]) * 0.25f;
+			}
+		}
+		level.swap(next);
+		levelWidth = nextWidth;
+		levelHeight = nextHeight;
+	}
+
+	success = (fclose(file) == 0) && success;
+	if (!success) {
+		printf("Failed to write %s\n", tilesPath);
+		remove(tilesPath);
+	}
+
+	return success;
+}
+
+float3 Texture::Sample(float2 texCoord, float lod) const {
+	if (m_levels.empty()) {
+		return float3(0.0f);
+	}
+
+	// Written so that NaN and -inf go to the top level
+	float level = lod + m_lodOffset;
+	if (!(level > 0.0f)) {
+		level = 0.0f;
+	}
+	level = std::min(level, (float)(m_levels.size() - 1));
+
+	uint level0 = (uint)level;
+	float t = level - level0;
+	float3 color = Bilinear(level0, texCoord);
+	if (t > 0.0f) {
+		color = color * (1.0f - t) + Bilinear(level0 + 1, texCoord) * t;
+	}
+
+	return color;
+}
+
+float3 Texture::Bilinear(uint level, float2 texCoord) const {
+	const Level &info = m_levels[level];
+	float x = texCoord.x * info.Width - 0.5f;
+	float y = texCoord.y * info.Height - 0.5f;
+	float floorX = std::floor(x);
+	float floorY = std::floor(y);
+	float tx = x - floorX;
+	float ty = y - floorY;
+
+	auto wrap = [](float value, uint size) {
+		float wrapped = std::fmod(value, (float)size);
+		return (uint)(wrapped < 0.0f ? wrapped + size : wrapped) % size;
+	};
+	uint xs[2] = {wrap(floorX, info.Width), wrap(floorX + 1.0f, info.Width)};
+	uint ys[2] = {wrap(floorY, info.Height), wrap(floorY + 1.0f, info.Height)};
+
+	// The four texels are usually in the same tile, so we only look up a tile when it changes
+	float3 texels[4];
+	TileCache::TilePtr tile;
+	uint tileX = ~0u;
+	uint tileY = ~0u;
+	for (uint j = 0; j < 2; ++j) {
+		for (uint i = 0; i < 2; ++i) {
+			uint neededX = xs[i] / TextureTile::kSize;
+			uint neededY = ys[j] / TextureTile::kSize;
+			if (neededX != tileX || neededY != tileY) {
+				tile = GetTile(level, neededX, neededY);
+				tileX = neededX;
+				tileY = neededY;
+			}
+
+			texels[j * 2 + i] = tile->Texels[(ys[j] % TextureTile::kSize) * TextureTile::kSize + (xs[i] % TextureTile::kSize)];
+		}
+	}
+
+	return (texels[0] * (1.0f - tx) + texels[1] * tx) * (1.0f - ty) +
+	       (texels[2] * (1.0f - tx) + texels[3] * tx) * ty;
+}
+
+TileCache::TilePtr Texture::GetTile(uint level, uint tileX, uint tileY) const {
+	uint64 key = ((uint64)m_id << 40) | ((uint64)level << 32) | ((uint64)tileY << 16) | (uint64)tileX;
+
+	return m_cache->Get(key, [&](TextureTile *tile) {
+		ReadTile(level, tileX, tileY, tile);
+	});
+}
+
+void Texture::ReadTile(uint level, uint tileX, uint tileY, TextureTile *tile) const {
+	const Level &info = m_levels[level];
+	uint64 offset = info.FileOffset + ((uint64)tileY * info.TilesX + tileX) * sizeof(TextureTile);
+
+	bool success;
+	{
+		std::lock_guard<std::mutex> lock(m_fileLock);
+		success = SeekFile(m_file, offset) && fread(tile, sizeof(TextureTile), 1, m_file) == 1;
+	}
+
+	if (!success) {
+		// Black is easy to spot, and better than stopping the render
+		memset(tile, 0, sizeof(TextureTile));
+	}
+}
+
+} // End of namespace Lantern
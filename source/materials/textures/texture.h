@@ -0,0 +1,87 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "materials/textures/tile_cache.h"
+
+#include "math/int_types.h"
+#include "math/vector_types.h"
+
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+
+namespace Lantern {
+
+/**
+ * A mip-mapped RGB texture, whose texels are loaded a tile at a time, as they're needed
+ *
+ * The mip chain is stored on disk in a tiled file. Only the tiles that are actually sampled are read,
+ * and they're kept in a TileCache, so a scene's textures can be far larger than the memory they're
+ * rendered in. Texture coordinates repeat outside [0, 1), and (0, 0) is the top left of the image.
+ */
+class Texture {
+public:
+	Texture();
+	~Texture();
+
+private:
+	struct Level {
+		uint Width;
+		uint Height;
+		uint TilesX;
+		uint TilesY;
+		uint64 FileOffset;
+	};
+
+	TileCache *m_cache;
+	uint m_id;
+	std::vector<Level> m_levels;
+	// 0.5 * log2(width * height) of the top level. Converts a footprint in texture coordinates to a mip level
+	float m_lodOffset;
+
+	FILE *m_file;
+	mutable std::mutex m_fileLock;
+
+public:
+	/**
+	 * Opens a texture for sampling
+	 *
+	 * Images (.pfm or .hdr) are converted to a tiled file the first time they're opened, and it's saved next
+	 * to them, as <filePath>.tiles. Later runs open the tiled file directly.
+	 *
+	 * @param filePath    The image, or a .tiles file
+	 * @param cache       Holds the tiles once they're loaded. It must outlive the texture
+	 * @return            False if the texture couldn't be read
+	 */
+	bool Open(const char *filePath, TileCache *cache);
+
+	uint Width() const { return m_levels.empty() ? 0u : m_levels[0].Width; }
+	uint Height() const { return m_levels.empty() ? 0u : m_levels[0].Height; }
+
+	/**
+	 * Trilinearly filters the texture
+	 *
+	 * @param texCoord    The texture coordinates to sample
+	 * @param lod         log2 of the width of the footprint to filter, in texture coordinates. IE, -log2(width) is a single texel
+	 */
+	float3 Sample(float2 texCoord, float lod) const;
+
+private:
+	float3 Bilinear(uint level, float2 texCoord) const;
+	TileCache::TilePtr GetTile(uint level, uint tileX, uint tileY) const;
+	void ReadTile(uint level, uint tileX, uint tileY, TextureTile *tile) const;
+
+	bool OpenTiles(const char *tilesPath);
+	/**
+	 * Builds the mip chain of an image, and writes it out as tiles
+	 */
+	static bool WriteTiles(const char *imagePath, const char *tilesPath);
+};
+
+} // End of namespace Lantern
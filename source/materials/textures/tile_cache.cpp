@@ -0,0 +1,53 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "materials/textures/tile_cache.h"
+
+#include "profiling/memory_tracker.h"
+
+#include <algorithm>
+
+
+namespace Lantern {
+
+const uint TextureTile::kSize;
+const uint TileCache::kNumShards;
+
+TileCache::TileCache(uint64 capacity)
+		: m_tilesPerShard(1u),
+		  m_nextTextureId(0u),
+		  m_hits(0u),
+		  m_misses(0u) {
+	SetCapacity(capacity);
+}
+
+void TileCache::SetCapacity(uint64 capacity) {
+	// Every shard needs room for at least one tile, or a lookup could evict the tile it just loaded
+	uint64 tiles = capacity / sizeof(TextureTile);
+	m_tilesPerShard = (uint)std::max<uint64>(tiles / kNumShards, 1u);
+}
+
+std::shared_ptr<TextureTile> TileCache::AllocateTile() {
+	if (!TrackMemory(MemoryCategory::TextureTiles, sizeof(TextureTile))) {
+		OnMemoryBudgetExceeded(MemoryCategory::TextureTiles, sizeof(TextureTile));
+	}
+
+	return std::shared_ptr<TextureTile>(new TextureTile, [](TextureTile *tile) {
+		delete tile;
+		TrackMemory(MemoryCategory::TextureTiles, -(int64)sizeof(TextureTile));
+	});
+}
+
+void TileCache::MakeRoom(Shard &shard) {
+	uint maxTiles = m_tilesPerShard.load();
+	while (shard.NumTiles >= maxTiles && !shard.LruList.empty()) {
+		shard.Entries.erase(shard.LruList.back());
+		shard.LruList.pop_back();
+		--shard.NumTiles;
+	}
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,149 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+#include "math/vector_types.h"
+
+#include <atomic>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace Lantern {
+
+struct TextureTile {
+	static const uint kSize = 32;
+
+	float3 Texels[kSize * kSize];
+};
+
+/**
+ * A fixed size cache of texture tiles, shared by all the textures in a scene
+ *
+ * The tiles are split between shards by the hash of their key. Each shard has its own lock and LRU list,
+ * so threads looking up different tiles rarely wait on each other. When a shard is full, it evicts its
+ * least recently used tile. Tiles are reference counted, so a tile can be evicted while another thread is
+ * still filtering it.
+ *
+ * Tiles are loaded outside of the shard's lock. A miss inserts an in-flight entry, and threads that want
+ * the same tile wait on that entry until it's published, rather than holding up the rest of the shard.
+ */
+class TileCache {
+public:
+	/**
+	 * @param capacity    The maximum number of bytes of tiles to keep in memory
+	 */
+	explicit TileCache(uint64 capacity);
+
+public:
+	typedef std::shared_ptr<const TextureTile> TilePtr;
+
+private:
+	static const uint kNumShards = 16;
+
+	struct Shard {
+		Shard()
+			: NumTiles(0u) {
+		}
+
+		std::mutex Lock;
+		// The most recently used tile is at the front
+		std::list<uint64> LruList;
+		struct Entry {
+			// Becomes ready once the thread that missed has loaded the tile
+			std::shared_future<TilePtr> Tile;
+			std::list<uint64>::iterator LruPosition;
+		};
+		std::unordered_map<uint64, Entry> Entries;
+		uint NumTiles;
+	};
+
+	Shard m_shards[kNumShards];
+	std::atomic<uint> m_tilesPerShard;
+	std::atomic<uint> m_nextTextureId;
+
+	std::atomic<uint64> m_hits;
+	std::atomic<uint64> m_misses;
+
+public:
+	/**
+	 * Changes the capacity. If it shrinks, the extra tiles are evicted as new tiles are loaded
+	 */
+	void SetCapacity(uint64 capacity);
+	/**
+	 * Returns a unique id for a texture to build its tile keys from
+	 */
+	uint RegisterTexture() { return m_nextTextureId++; }
+
+	/**
+	 * Looks up a tile, loading it on a miss
+	 *
+	 * @param key     Uniquely identifies the tile. See Texture
+	 * @param load    Called as void load(TextureTile *tile) on a miss, to fill the tile. The shard isn't locked while it runs
+	 * @return        The tile. It stays valid as long as the pointer is held, even if the cache evicts it
+	 */
+	template <typename Loader>
+	TilePtr Get(uint64 key, Loader load);
+
+	uint64 Hits() const { return m_hits.load(); }
+	uint64 Misses() const { return m_misses.load(); }
+
+private:
+	/**
+	 * Allocates a tile, and records it in the memory tracker. The tracking is undone when the last reference is dropped
+	 */
+	static std::shared_ptr<TextureTile> AllocateTile();
+	/**
+	 * Evicts the least recently used tiles of the shard, until there's room for one more. The shard must be locked
+	 */
+	void MakeRoom(Shard &shard);
+};
+
+template <typename Loader>
+TileCache::TilePtr TileCache::Get(uint64 key, Loader load) {
+	// Mix the bits, so the tiles of one texture spread over all the shards
+	uint64 hash = key * 0x9E3779B97F4A7C15ull;
+	Shard &shard = m_shards[(hash >> 32) % kNumShards];
+
+	std::unique_lock<std::mutex> lock(shard.Lock);
+
+	auto iter = shard.Entries.find(key);
+	if (iter != shard.Entries.end()) {
+		++m_hits;
+		shard.LruList.splice(shard.LruList.begin(), shard.LruList, iter->second.LruPosition);
+
+		// The tile might still be loading, so we wait for it outside of the lock
+		std::shared_future<TilePtr> tile = iter->second.Tile;
+		lock.unlock();
+		return tile.get();
+	}
+
+	++m_misses;
+	MakeRoom(shard);
+
+	// Publish an in-flight entry, and load the tile outside of the lock. The entry can be evicted before the
+	// tile is loaded. That only means the next miss loads the tile again, since the waiters hold their own reference
+	std::promise<TilePtr> loaded;
+	shard.LruList.push_front(key);
+	Shard::Entry &entry = shard.Entries[key];
+	entry.Tile = loaded.get_future().share();
+	entry.LruPosition = shard.LruList.begin();
+	++shard.NumTiles;
+	lock.unlock();
+
+	std::shared_ptr<TextureTile> tile = AllocateTile();
+	load(tile.get());
+	loaded.set_value(tile);
+
+	return tile;
+}
+
+} // End of namespace Lantern
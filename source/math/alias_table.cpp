@@ -0,0 +1,72 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "math/alias_table.h"
+
+#include <vector>
+
+
+namespace Lantern {
+
+float BuildAliasTable(const float *weights, uint count, AliasEntry *table) {
+	double sum = 0.0;
+	for (uint i = 0; i < count; ++i) {
+		sum += weights[i];
+	}
+
+	if (sum <= 0.0) {
+		for (uint i = 0; i < count; ++i) {
+			table[i].Probability = 1.0f;
+			table[i].Alias = i;
+			table[i].Pdf = 1.0f / count;
+		}
+		return 0.0f;
+	}
+
+	// Scale the weights so the average is 1, and split them into the entries below and above the average
+	std::vector<float> scaled(count);
+	std::vector<uint> small;
+	std::vector<uint> large;
+	for (uint i = 0; i < count; ++i) {
+		scaled[i] = (float)(weights[i] * count / sum);
+		table[i].Pdf = (float)(weights[i] / sum);
+		if (scaled[i] < 1.0f) {
+			small.push_back(i);
+		} else {
+			large.push_back(i);
+		}
+	}
+
+	// Fill up each small entry with probability from a large one
+	while (!small.empty() && !large.empty()) {
+		uint s = small.back();
+		small.pop_back();
+		uint l = large.back();
+
+		table[s].Probability = scaled[s];
+		table[s].Alias = l;
+
+		scaled[l] = (scaled[l] + scaled[s]) - 1.0f;
+		if (scaled[l] < 1.0f) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+
+	// Whatever is left is within rounding error of 1
+	for (uint i : large) {
+		table[i].Probability = 1.0f;
+		table[i].Alias = i;
+	}
+	for (uint i : small) {
+		table[i].Probability = 1.0f;
+		table[i].Alias = i;
+	}
+
+	return (float)sum;
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,50 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+
+#include <algorithm>
+
+
+namespace Lantern {
+
+struct AliasEntry {
+	// The probability of keeping this entry, rather than switching to Alias
+	float Probability;
+	uint Alias;
+	// The probability of sampling this entry. AKA, its weight over the sum of the weights
+	float Pdf;
+};
+
+/**
+ * Builds a Walker alias table, for sampling from a discrete distribution in constant time
+ * The construction follows Vose 1991, "A Linear Algorithm for Generating Random Numbers with a Given Distribution"
+ *
+ * @param weights    The relative probabilities of each entry. Must be non-negative
+ * @param count      The number of entries
+ * @param table      Filled with count entries
+ * @return           The sum of the weights. If it's zero, the table samples the entries uniformly
+ */
+float BuildAliasTable(const float *weights, uint count, AliasEntry *table);
+
+/**
+ * Samples an entry from a table built with BuildAliasTable()
+ *
+ * @param table    The table
+ * @param count    The number of entries in the table
+ * @param u        A random number in [0, 1)
+ * @return         The index of the sampled entry
+ */
+inline uint SampleAliasTable(const AliasEntry *table, uint count, float u) {
+	float scaled = u * count;
+	uint index = std::min((uint)scaled, count - 1);
+
+	return (scaled - index) < table[index].Probability ? index : table[index].Alias;
+}
+
+} // End of namespace Lantern
@@ -9,7 +9,7 @@
 
 namespace Lantern {
 
-float3a RotateToWorld(float x, float y, float z, float3a &normal) {
+void CoordinateSystem(const float3a &normal, float3a *tangent, float3a *bitangent) {
 	// Find an axis that is not parallel to normal
 	float3a majorAxis;
 	if (abs(normal.x) < 0.57735026919f /* 1 / sqrt(3) */) {
@@ -21,8 +21,13 @@ float3a RotateToWorld(float x, float y, float z, float3a &normal) {
 	}
 
 	// Use majorAxis to create a coordinate system relative to world space
-	float3a u = normalize(cross(normal, majorAxis));
-	float3a v = cross(normal, u);
+	*tangent = normalize(cross(normal, majorAxis));
+	*bitangent = cross(normal, *tangent);
+}
+
+float3a RotateToWorld(float x, float y, float z, float3a &normal) {
+	float3a u, v;
+	CoordinateSystem(normal, &u, &v);
 	float3a w = normal;
 
 
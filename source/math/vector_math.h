@@ -25,6 +25,10 @@ inline bool any(float3a &a) {
 	return a.x == 0.0f || a.y == 0.0f || a.z == 0.0f;
 }
 
+/**
+ * Builds two tangents that form an orthonormal basis with normal
+ */
+void CoordinateSystem(const float3a &normal, float3a *tangent, float3a *bitangent);
 float3a RotateToWorld(float x, float y, float z, float3a &normal);
 
 inline float SinSquaredThetaT(float VdotN, float eta) {
@@ -44,6 +48,10 @@ inline float Fresnel(float IORi, float IORo, float VdotN, float sinSquaredThetaT
 	return 0.5f * (R_perpendicular * R_perpendicular + R_parallel * R_parallel);
 }
 
+inline float Luminance(const float3 &color) {
+	return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+}
+
 inline bool AnyNan(float3 &a) {
 	return isnan(a.x) || isnan(a.y) || isnan(a.z);
 }
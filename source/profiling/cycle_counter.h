@@ -0,0 +1,27 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#else
+	#include <x86intrin.h>
+#endif
+
+
+namespace Lantern {
+
+/**
+ * Returns the CPU timestamp counter. Only meaningful as a difference between two reads on the same thread
+ */
+inline uint64 ReadCycleCounter() {
+	return __rdtsc();
+}
+
+} // End of namespace Lantern
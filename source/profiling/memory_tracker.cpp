@@ -0,0 +1,103 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "profiling/memory_tracker.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+
+namespace Lantern {
+
+static std::atomic<int64> g_trackedMemory[MemoryCategory::NumCategories];
+static std::atomic<int64> g_totalTrackedMemory(0);
+static std::atomic<int64> g_peakTrackedMemory(0);
+static std::atomic<uint64> g_memoryBudget(0u);
+
+static const char *kMemoryCategoryNames[MemoryCategory::NumCategories] = {
+	"Embree",
+	"Mesh normals",
+	"Scene containers",
+	"Lights",
+	"Frame buffer",
+	"Render caches",
+	"Denoiser",
+	"Media",
+	"Mesh tex coords",
+	"Texture tiles",
+	"Spheres"
+};
+
+const char *MemoryCategoryName(MemoryCategory::Type category) {
+	return kMemoryCategoryNames[category];
+}
+
+bool TrackMemory(MemoryCategory::Type category, int64 bytes, bool allowOverBudget) {
+	int64 total = g_totalTrackedMemory.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+	uint64 budget = g_memoryBudget.load(std::memory_order_relaxed);
+	if (bytes > 0 && budget != 0u && (uint64)total > budget && !allowOverBudget) {
+		g_totalTrackedMemory.fetch_sub(bytes, std::memory_order_relaxed);
+		return false;
+	}
+
+	g_trackedMemory[category].fetch_add(bytes, std::memory_order_relaxed);
+
+	int64 peak = g_peakTrackedMemory.load(std::memory_order_relaxed);
+	while (total > peak && !g_peakTrackedMemory.compare_exchange_weak(peak, total, std::memory_order_relaxed)) {
+	}
+
+	return true;
+}
+
+uint64 TrackedMemory(MemoryCategory::Type category) {
+	return (uint64)g_trackedMemory[category].load(std::memory_order_relaxed);
+}
+
+uint64 TotalTrackedMemory() {
+	return (uint64)g_totalTrackedMemory.load(std::memory_order_relaxed);
+}
+
+uint64 PeakTrackedMemory() {
+	return (uint64)g_peakTrackedMemory.load(std::memory_order_relaxed);
+}
+
+void SetMemoryBudget(uint64 bytes) {
+	g_memoryBudget = bytes;
+}
+
+uint64 MemoryBudget() {
+	return g_memoryBudget.load(std::memory_order_relaxed);
+}
+
+static double ToMegabytes(uint64 bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+
+void PrintMemoryReport() {
+	printf("Memory:\n");
+	for (uint i = 0; i < MemoryCategory::NumCategories; ++i) {
+		printf("    %-20s %10.2f MB\n", kMemoryCategoryNames[i], ToMegabytes(TrackedMemory((MemoryCategory::Type)i)));
+	}
+	printf("    %-20s %10.2f MB\n", "Total", ToMegabytes(TotalTrackedMemory()));
+	printf("    %-20s %10.2f MB\n", "Peak", ToMegabytes(PeakTrackedMemory()));
+
+	uint64 budget = MemoryBudget();
+	if (budget != 0u) {
+		printf("    %-20s %10.2f MB\n", "Budget", ToMegabytes(budget));
+	}
+}
+
+void OnMemoryBudgetExceeded(MemoryCategory::Type category, uint64 bytes) {
+	printf("Allocating %.2f MB of %s would exceed the memory budget of %.2f MB\n", ToMegabytes(bytes), kMemoryCategoryNames[category], ToMegabytes(MemoryBudget()));
+	PrintMemoryReport();
+	fflush(stdout);
+
+	std::_Exit(EXIT_FAILURE);
+}
+
+} // End of namespace Lantern
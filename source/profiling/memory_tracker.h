@@ -0,0 +1,123 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+
+#include <cstddef>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+
+namespace Lantern {
+
+namespace MemoryCategory {
+enum Type {
+	Embree,           // BVHs, and Embree's copies of the mesh vertices and indices
+	MeshNormals,      // The per-vertex normals used for interpolation
+	SceneContainers,  // The material, light, and instance lookup tables of the Scene
+	Lights,
+	FrameBuffer,
+	RenderCaches,     // The primary hit cache, and the pixel cost buffer
+	Denoiser,
+	Media,            // The voxel grids of heterogeneous media
+	MeshTexCoords,    // The per-triangle texture coordinates and mip level biases
+	TextureTiles,     // The texture tiles held by the tile cache, and any still in use after being evicted
+	Spheres,          // The centers and radii of the analytic spheres
+	NumCategories
+};
+}
+
+const char *MemoryCategoryName(MemoryCategory::Type category);
+
+/**
+ * Records an allocation or a free. Safe to call from any thread
+ *
+ * @param category          What the memory is used for
+ * @param bytes             Positive for allocations, negative for frees
+ * @param allowOverBudget   Records the allocation even if it goes over the budget. For memory that's already been allocated
+ * @return                  False if the allocation would take the total over the budget. It isn't recorded in that case
+ */
+bool TrackMemory(MemoryCategory::Type category, int64 bytes, bool allowOverBudget = false);
+
+uint64 TrackedMemory(MemoryCategory::Type category);
+uint64 TotalTrackedMemory();
+/** The highest the total has been since the program started */
+uint64 PeakTrackedMemory();
+
+/**
+ * Sets a hard limit on the total tracked memory. 0 means no limit.
+ * Must be set before anything is allocated for it to be meaningful
+ */
+void SetMemoryBudget(uint64 bytes);
+uint64 MemoryBudget();
+
+/**
+ * Prints the bytes used by each category to stdout
+ */
+void PrintMemoryReport();
+
+/**
+ * Prints the memory report, and exits the process. Called when an allocation would go over the budget.
+ * Exiting with a report is far more useful than getting picked off by the OOM killer later.
+ * This can be called from any thread, so it skips the static destructors, which other threads may still be using
+ */
+void OnMemoryBudgetExceeded(MemoryCategory::Type category, uint64 bytes);
+
+/**
+ * A std allocator that records its allocations in a MemoryCategory
+ */
+template <typename T, MemoryCategory::Type kCategory>
+class TrackedAllocator {
+public:
+	typedef T value_type;
+
+	TrackedAllocator() {
+	}
+	template <typename U>
+	TrackedAllocator(const TrackedAllocator<U, kCategory> & /* other */) {
+	}
+
+	template <typename U>
+	struct rebind {
+		typedef TrackedAllocator<U, kCategory> other;
+	};
+
+public:
+	T *allocate(std::size_t count) {
+		std::size_t bytes = count * sizeof(T);
+		if (!TrackMemory(kCategory, (int64)bytes)) {
+			OnMemoryBudgetExceeded(kCategory, bytes);
+		}
+
+		return static_cast<T *>(::operator new(bytes));
+	}
+
+	void deallocate(T *pointer, std::size_t count) {
+		::operator delete(pointer);
+		TrackMemory(kCategory, -(int64)(count * sizeof(T)));
+	}
+};
+
+template <typename T, typename U, MemoryCategory::Type kCategory>
+bool operator==(const TrackedAllocator<T, kCategory> & /* a */, const TrackedAllocator<U, kCategory> & /* b */) {
+	return true;
+}
+
+template <typename T, typename U, MemoryCategory::Type kCategory>
+bool operator!=(const TrackedAllocator<T, kCategory> & /* a */, const TrackedAllocator<U, kCategory> & /* b */) {
+	return false;
+}
+
+template <typename T, MemoryCategory::Type kCategory>
+using TrackedVector = std::vector<T, TrackedAllocator<T, kCategory> >;
+
+template <typename Key, typename Value, MemoryCategory::Type kCategory>
+using TrackedUnorderedMap = std::unordered_map<Key, Value, std::hash<Key>, std::equal_to<Key>, TrackedAllocator<std::pair<const Key, Value>, kCategory> >;
+
+} // End of namespace Lantern
@@ -0,0 +1,156 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "profiling/trace.h"
+
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/cache_aligned_allocator.h>
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace Lantern {
+
+struct TraceEvent {
+	const char *Name;
+	std::chrono::steady_clock::time_point Begin;
+	std::chrono::steady_clock::time_point End;
+	uint Arg;
+};
+
+struct TraceThreadBuffer {
+	TraceThreadBuffer();
+
+	std::vector<TraceEvent> Events;
+	// Only written by the owning thread. Read by WriteChromeTrace(), once recording is paused
+	std::atomic<uint64> NumWritten;
+	uint ThreadID;
+};
+
+struct TraceThreadSnapshot {
+	std::vector<TraceEvent> Events;
+	uint ThreadID;
+};
+
+static std::atomic<bool> g_tracingEnabled(true);
+static std::atomic<uint> g_nextTraceThreadID(0u);
+static const std::chrono::steady_clock::time_point g_traceEpoch = std::chrono::steady_clock::now();
+static tbb::enumerable_thread_specific<TraceThreadBuffer, tbb::cache_aligned_allocator<TraceThreadBuffer>, tbb::ets_key_per_instance> g_traceBuffers;
+
+// While paused, RecordTraceEvent() drops events instead of touching g_traceBuffers.
+// g_activeRecorders counts the threads inside RecordTraceEvent(), so a snapshot can wait for them to drain
+static std::atomic<bool> g_tracePaused(false);
+static std::atomic<uint> g_activeRecorders(0u);
+// Only one snapshot can pause and resume recording at a time
+static std::mutex g_traceSnapshotLock;
+
+TraceThreadBuffer::TraceThreadBuffer()
+		: Events(kTraceEventsPerThread),
+		  NumWritten(0u),
+		  ThreadID(g_nextTraceThreadID++) {
+}
+
+void SetTracingEnabled(bool enabled) {
+	g_tracingEnabled = enabled;
+}
+
+bool IsTracingEnabled() {
+	return g_tracingEnabled.load(std::memory_order_relaxed);
+}
+
+void RecordTraceEvent(const char *name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end, uint arg) {
+	// Checked first as well, so paused threads don't keep the count from draining
+	if (g_tracePaused.load(std::memory_order_relaxed)) {
+		return;
+	}
+	// These two have to be sequentially consistent. Otherwise a snapshot could miss the increment,
+	// while we miss the pause
+	g_activeRecorders.fetch_add(1u);
+	if (g_tracePaused.load()) {
+		g_activeRecorders.fetch_sub(1u, std::memory_order_release);
+		return;
+	}
+
+	TraceThreadBuffer &buffer = g_traceBuffers.local();
+
+	uint64 index = buffer.NumWritten.load(std::memory_order_relaxed);
+	TraceEvent &event = buffer.Events[index % kTraceEventsPerThread];
+	event.Name = name;
+	event.Begin = begin;
+	event.End = end;
+	event.Arg = arg;
+
+	buffer.NumWritten.store(index + 1, std::memory_order_release);
+	g_activeRecorders.fetch_sub(1u, std::memory_order_release);
+}
+
+static double MicrosecondsSinceEpoch(std::chrono::steady_clock::time_point time) {
+	return std::chrono::duration<double, std::micro>(time - g_traceEpoch).count();
+}
+
+/**
+ * Copies out the events of every thread, oldest first. Recording is paused, and the threads already
+ * recording are drained, for the duration of the copy. So nothing writes the ring buffers, or adds one, while we read them
+ */
+static void SnapshotTraceBuffers(std::vector<TraceThreadSnapshot> *snapshots) {
+	std::lock_guard<std::mutex> lock(g_traceSnapshotLock);
+
+	g_tracePaused.store(true);
+	while (g_activeRecorders.load() != 0u) {
+		std::this_thread::yield();
+	}
+
+	for (TraceThreadBuffer &buffer : g_traceBuffers) {
+		snapshots->emplace_back();
+		TraceThreadSnapshot &snapshot = snapshots->back();
+		snapshot.ThreadID = buffer.ThreadID;
+
+		uint64 numWritten = buffer.NumWritten.load(std::memory_order_acquire);
+		uint64 first = numWritten > kTraceEventsPerThread ? numWritten - kTraceEventsPerThread : 0u;
+		snapshot.Events.reserve((size_t)(numWritten - first));
+		for (uint64 i = first; i < numWritten; ++i) {
+			snapshot.Events.push_back(buffer.Events[i % kTraceEventsPerThread]);
+		}
+	}
+
+	g_tracePaused.store(false);
+}
+
+bool WriteChromeTrace(const char *filePath) {
+	FILE *file = fopen(filePath, "w");
+	if (file == nullptr) {
+		return false;
+	}
+
+	// Writing the file is slow, so we only pause recording for the copy
+	std::vector<TraceThreadSnapshot> snapshots;
+	SnapshotTraceBuffers(&snapshots);
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Lantern\"}}");
+
+	for (const TraceThreadSnapshot &snapshot : snapshots) {
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}", snapshot.ThreadID, snapshot.ThreadID);
+
+		for (const TraceEvent &event : snapshot.Events) {
+			double begin = MicrosecondsSinceEpoch(event.Begin);
+			double duration = MicrosecondsSinceEpoch(event.End) - begin;
+
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"arg\":%u}}",
+			        event.Name, snapshot.ThreadID, begin, duration, event.Arg);
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+
+	return fclose(file) == 0;
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,78 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+
+#include <chrono>
+
+
+namespace Lantern {
+
+/**
+ * A timeline of what each thread was doing, which can be written out as a Chrome trace
+ * (chrome://tracing or https://ui.perfetto.dev)
+ *
+ * Each thread records its events into its own preallocated ring buffer of kTraceEventsPerThread events,
+ * so recording takes no locks and never allocates after the first event. When a ring buffer is full,
+ * the oldest events are overwritten. So a trace always covers the last few frames.
+ *
+ * Recording an event costs two clock reads, a thread local lookup, and two atomic adds on a shared counter.
+ * Events are recorded per tile or coarser, so tracing is enabled by default.
+ * The names must be string literals, or otherwise outlive the trace.
+ */
+static const uint kTraceEventsPerThread = 1 << 16;
+
+void SetTracingEnabled(bool enabled);
+bool IsTracingEnabled();
+
+/**
+ * Adds a completed event to the calling thread's timeline
+ *
+ * @param name     The name of the event. Must outlive the trace
+ * @param begin    When the event began
+ * @param end      When the event ended
+ * @param arg      An arbitrary number shown with the event. IE. A tile index
+ */
+void RecordTraceEvent(const char *name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end, uint arg);
+
+/**
+ * Writes the recorded events of all the threads to a Chrome trace JSON file. Safe to call mid-render.
+ * Recording is briefly paused while the events are copied out, and events ending in that window are dropped
+ *
+ * @param filePath    The file to write
+ * @return            False if the file couldn't be written
+ */
+bool WriteChromeTrace(const char *filePath);
+
+/**
+ * Records an event covering the lifetime of the object
+ */
+class ScopedTrace {
+public:
+	ScopedTrace(const char *name, uint arg = 0u)
+		: m_name(name),
+		  m_arg(arg),
+		  m_enabled(IsTracingEnabled()) {
+		if (m_enabled) {
+			m_begin = std::chrono::steady_clock::now();
+		}
+	}
+	~ScopedTrace() {
+		if (m_enabled) {
+			RecordTraceEvent(m_name, m_begin, std::chrono::steady_clock::now(), m_arg);
+		}
+	}
+
+private:
+	const char *m_name;
+	uint m_arg;
+	bool m_enabled;
+	std::chrono::steady_clock::time_point m_begin;
+};
+
+} // End of namespace Lantern
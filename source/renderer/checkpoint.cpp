@@ -0,0 +1,161 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "renderer/checkpoint.h"
+
+#include "camera/frame_buffer.h"
+
+#include "profiling/trace.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#endif
+
+
+namespace Lantern {
+
+static const uint32 kCheckpointMagic = 0x43544E4C; // 'LNTC'
+static const uint32 kCheckpointVersion = 2u;
+
+struct CheckpointHeader {
+	uint32 Magic;
+	uint32 Version;
+	uint32 Width;
+	uint32 Height;
+	uint32 FrameNumber;
+};
+
+CheckpointWriter::CheckpointWriter()
+		: m_busy(false) {
+}
+
+CheckpointWriter::~CheckpointWriter() {
+	Wait();
+}
+
+bool CheckpointWriter::WriteAsync(const std::string &path, const FrameBuffer &frameBuffer, uint frameNumber) {
+	if (m_busy) {
+		return false;
+	}
+
+	ScopedTrace trace("Checkpoint snapshot");
+
+	// The previous thread has finished writing, but still needs to be joined
+	if (m_thread.joinable()) {
+		m_thread.join();
+	}
+
+	uint numPixels = frameBuffer.Width * frameBuffer.Height;
+	std::size_t colorSize = numPixels * sizeof(float3);
+	std::size_t floatSize = numPixels * sizeof(float);
+
+	CheckpointHeader header;
+	header.Magic = kCheckpointMagic;
+	header.Version = kCheckpointVersion;
+	header.Width = frameBuffer.Width;
+	header.Height = frameBuffer.Height;
+	header.FrameNumber = frameNumber;
+
+	// Snapshot everything on this thread, so rendering can continue while we write
+	m_data.resize(sizeof(CheckpointHeader) + 3 * colorSize + 3 * floatSize);
+	byte *data = &m_data[0];
+	memcpy(data, &header, sizeof(CheckpointHeader));
+	data += sizeof(CheckpointHeader);
+	memcpy(data, frameBuffer.GetColorData(), colorSize);
+	data += colorSize;
+	memcpy(data, frameBuffer.GetWeights(), floatSize);
+	data += floatSize;
+	memcpy(data, frameBuffer.GetLuminanceSquaredSums(), floatSize);
+	data += floatSize;
+	memcpy(data, frameBuffer.GetAlbedoSums(), colorSize);
+	data += colorSize;
+	memcpy(data, frameBuffer.GetNormalSums(), colorSize);
+	data += colorSize;
+	memcpy(data, frameBuffer.GetDepthSums(), floatSize);
+
+	m_busy = true;
+	m_thread = std::thread(&CheckpointWriter::WriteToDisk, this, path);
+
+	return true;
+}
+
+void CheckpointWriter::Wait() {
+	if (m_thread.joinable()) {
+		m_thread.join();
+	}
+}
+
+void CheckpointWriter::WriteToDisk(std::string path) {
+	ScopedTrace trace("Checkpoint write");
+	std::string tempPath = path + ".tmp";
+
+	FILE *file = fopen(tempPath.c_str(), "wb");
+	if (file == nullptr) {
+		printf("Failed to open checkpoint file %s\n", tempPath.c_str());
+		m_busy = false;
+		return;
+	}
+
+	bool success = fwrite(&m_data[0], 1, m_data.size(), file) == m_data.size();
+	success = (fflush(file) == 0) && success;
+	success = (fclose(file) == 0) && success;
+
+	// Atomically replace the old checkpoint
+	if (success) {
+		#ifdef _WIN32
+			success = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+		#else
+			success = rename(tempPath.c_str(), path.c_str()) == 0;
+		#endif
+	}
+
+	if (!success) {
+		printf("Failed to write checkpoint file %s\n", path.c_str());
+		remove(tempPath.c_str());
+	}
+
+	m_busy = false;
+}
+
+bool ReadCheckpoint(const std::string &path, FrameBuffer *frameBuffer, uint *frameNumber) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	CheckpointHeader header;
+	if (fread(&header, sizeof(CheckpointHeader), 1, file) != 1 ||
+	    header.Magic != kCheckpointMagic ||
+	    header.Version != kCheckpointVersion ||
+	    header.Width != frameBuffer->Width ||
+	    header.Height != frameBuffer->Height) {
+		fclose(file);
+		return false;
+	}
+
+	uint numPixels = frameBuffer->Width * frameBuffer->Height;
+	bool success = fread(frameBuffer->GetColorData(), sizeof(float3), numPixels, file) == numPixels &&
+	               fread(frameBuffer->GetWeights(), sizeof(float), numPixels, file) == numPixels &&
+	               fread(frameBuffer->GetLuminanceSquaredSums(), sizeof(float), numPixels, file) == numPixels &&
+	               fread(frameBuffer->GetAlbedoSums(), sizeof(float3), numPixels, file) == numPixels &&
+	               fread(frameBuffer->GetNormalSums(), sizeof(float3), numPixels, file) == numPixels &&
+	               fread(frameBuffer->GetDepthSums(), sizeof(float), numPixels, file) == numPixels;
+	fclose(file);
+
+	if (!success) {
+		frameBuffer->Reset();
+		return false;
+	}
+
+	*frameNumber = header.FrameNumber;
+	return true;
+}
+
+} // End of namespace Lantern
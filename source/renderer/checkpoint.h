@@ -0,0 +1,84 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace Lantern {
+
+class FrameBuffer;
+
+/**
+ * Writes the progressive render state to disk on a background thread
+ *
+ * A checkpoint contains the FrameBuffer accumulation buffers (color, sample weights, the
+ * squared luminance sums used for variance, and the denoiser features), and the frame number
+ * that seeds the samplers.
+ * Resuming from it continues the exact same sample sequence.
+ *
+ * The file layout is:
+ *     CheckpointHeader
+ *     float3 colorData[width * height]
+ *     float weights[width * height]
+ *     float luminanceSquaredSums[width * height]
+ *     float3 albedoSums[width * height]
+ *     float3 normalSums[width * height]
+ *     float depthSums[width * height]
+ *
+ * Files are written to a temporary path, then renamed over the target. So a render that is
+ * killed mid-write always leaves the previous checkpoint intact.
+ */
+class CheckpointWriter {
+public:
+	CheckpointWriter();
+	~CheckpointWriter();
+
+private:
+	std::thread m_thread;
+	std::atomic<bool> m_busy;
+
+	// The snapshot being written by the background thread
+	std::vector<byte> m_data;
+
+public:
+	/**
+	 * Copies the render state, and writes it to disk on a background thread.
+	 * The copy is a straight memcpy, so rendering is only stalled for as long as that takes
+	 *
+	 * @param path           The file to write to
+	 * @param frameBuffer    The FrameBuffer to save
+	 * @param frameNumber    The number of the next frame to be rendered
+	 * @return               False if the previous checkpoint is still being written. The checkpoint is skipped
+	 */
+	bool WriteAsync(const std::string &path, const FrameBuffer &frameBuffer, uint frameNumber);
+	/**
+	 * Blocks until any in-flight checkpoint has finished writing
+	 */
+	void Wait();
+	bool IsBusy() const { return m_busy; }
+
+private:
+	void WriteToDisk(std::string path);
+};
+
+/**
+ * Restores the render state from a checkpoint written by CheckpointWriter
+ *
+ * @param path           The file to read
+ * @param frameBuffer    The FrameBuffer to fill. It must have the same dimensions as the checkpoint
+ * @param frameNumber    Filled with the number of the next frame to be rendered
+ * @return               False if the file couldn't be read, or doesn't match the FrameBuffer
+ */
+bool ReadCheckpoint(const std::string &path, FrameBuffer *frameBuffer, uint *frameNumber);
+
+} // End of namespace Lantern
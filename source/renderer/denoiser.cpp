@@ -0,0 +1,275 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "renderer/denoiser.h"
+
+#include "camera/frame_buffer.h"
+
+#include "math/vector_math.h"
+
+#include "profiling/trace.h"
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace Lantern {
+
+// The patch distance given to neighbours outside the image, or without samples
+static const float kInvalidDistance = 1.0e4f;
+// Keeps the distance finite for pixels with zero variance
+static const float kVarianceEpsilon = 1.0e-8f;
+// Keeps the relative depth finite for pixels right in front of the camera
+static const float kDepthEpsilon = 1.0e-4f;
+
+Denoiser::Denoiser()
+		: SearchRadius(7u),
+		  PatchRadius(2u),
+		  Strength(0.45f),
+		  AlbedoSigma(0.1f),
+		  NormalSigma(0.3f),
+		  DepthSigma(0.1f),
+		  m_width(0u),
+		  m_height(0u) {
+}
+
+void Denoiser::Denoise(const FrameBuffer &frameBuffer, float3 *output) {
+	ScopedTrace trace("Denoise");
+
+	Resize(frameBuffer.Width, frameBuffer.Height);
+	LoadFrameBuffer(frameBuffer);
+
+	uint numPixels = m_width * m_height;
+	std::fill(m_weightSum.begin(), m_weightSum.end(), 0.0f);
+	for (uint c = 0; c < 3; ++c) {
+		std::fill(m_colorSum[c].begin(), m_colorSum[c].end(), 0.0f);
+	}
+
+	int radius = (int)SearchRadius;
+	for (int offsetY = -radius; offsetY <= radius; ++offsetY) {
+		for (int offsetX = -radius; offsetX <= radius; ++offsetX) {
+			AccumulateOffset(offsetX, offsetY);
+		}
+	}
+
+	for (uint i = 0; i < numPixels; ++i) {
+		if (m_weightSum[i] > 0.0f) {
+			float invWeight = 1.0f / m_weightSum[i];
+			output[i] = float3(m_colorSum[0][i] * invWeight, m_colorSum[1][i] * invWeight, m_colorSum[2][i] * invWeight);
+		} else {
+			output[i] = float3(0.0f);
+		}
+	}
+}
+
+void Denoiser::Resize(uint width, uint height) {
+	if (width == m_width && height == m_height) {
+		return;
+	}
+
+	m_width = width;
+	m_height = height;
+
+	uint numPixels = width * height;
+	for (uint c = 0; c < 3; ++c) {
+		m_color[c].resize(numPixels);
+		m_albedo[c].resize(numPixels);
+		m_normal[c].resize(numPixels);
+		m_variance[c].resize(numPixels);
+		m_colorSum[c].resize(numPixels);
+	}
+	m_depth.resize(numPixels);
+	m_valid.resize(numPixels);
+	m_distance.resize(numPixels);
+	m_rowSummedDistance.resize(numPixels);
+	m_weightSum.resize(numPixels);
+}
+
+void Denoiser::LoadFrameBuffer(const FrameBuffer &frameBuffer) {
+	const float3 *colorData = frameBuffer.GetColorData();
+	const float *weights = frameBuffer.GetWeights();
+	const float3 *albedoSums = frameBuffer.GetAlbedoSums();
+	const float3 *normalSums = frameBuffer.GetNormalSums();
+	const float *depthSums = frameBuffer.GetDepthSums();
+
+	uint width = m_width;
+	uint height = m_height;
+
+	tbb::parallel_for(uint(0), height, [&](uint y) {
+		for (uint x = 0; x < width; ++x) {
+			uint index = y * width + x;
+
+			float weight = weights[index];
+			if (weight == 0.0f) {
+				for (uint c = 0; c < 3; ++c) {
+					m_color[c][index] = 0.0f;
+					m_albedo[c][index] = 0.0f;
+					m_normal[c][index] = 0.0f;
+				}
+				m_depth[index] = 0.0f;
+				m_distance[index] = 0.0f;
+				m_valid[index] = 0.0f;
+				continue;
+			}
+
+			float invWeight = 1.0f / weight;
+			for (uint c = 0; c < 3; ++c) {
+				m_color[c][index] = colorData[index][c] * invWeight;
+				m_albedo[c][index] = albedoSums[index][c] * invWeight;
+				m_normal[c][index] = normalSums[index][c] * invWeight;
+			}
+			m_depth[index] = depthSums[index] * invWeight;
+			m_valid[index] = 1.0f;
+
+			// We want the variance of the mean, not of the samples
+			// The distance scratch buffer holds it until it's smoothed below
+			m_distance[index] = frameBuffer.GetVariance(x, y) * invWeight;
+		}
+	});
+
+	// The variance estimate is itself noisy at low sample counts, so we smooth it with a 3x3 box
+	// The FrameBuffer only tracks the variance of the luminance. Path tracing noise mostly comes from
+	// scaling the throughput, so we assume each channel's standard deviation scales with its mean
+	tbb::parallel_for(uint(0), height, [&](uint y) {
+		uint y0 = y > 0 ? y - 1 : y;
+		uint y1 = std::min(y + 1, height - 1);
+
+		for (uint x = 0; x < width; ++x) {
+			uint x0 = x > 0 ? x - 1 : x;
+			uint x1 = std::min(x + 1, width - 1);
+
+			float sum = 0.0f;
+			float count = 0.0f;
+			for (uint j = y0; j <= y1; ++j) {
+				for (uint i = x0; i <= x1; ++i) {
+					float valid = m_valid[j * width + i];
+					sum += m_distance[j * width + i] * valid;
+					count += valid;
+				}
+			}
+
+			uint index = y * width + x;
+			float variance = count > 0.0f ? sum / count : 0.0f;
+			float luminance = Luminance(float3(m_color[0][index], m_color[1][index], m_color[2][index]));
+			for (uint c = 0; c < 3; ++c) {
+				float ratio = luminance > 0.0f ? m_color[c][index] / luminance : 1.0f;
+				m_variance[c][index] = variance * ratio * ratio;
+			}
+		}
+	});
+}
+
+void Denoiser::AccumulateOffset(int offsetX, int offsetY) {
+	int width = (int)m_width;
+	int height = (int)m_height;
+	int patchRadius = (int)PatchRadius;
+
+	// The range of x for which x + offsetX is inside the image
+	int xBegin = std::max(0, -offsetX);
+	int xEnd = std::min(width, width - offsetX);
+
+	float strengthSquared = Strength * Strength;
+	float invAlbedoSigmaSquared = 1.0f / (AlbedoSigma * AlbedoSigma);
+	float invNormalSigmaSquared = 1.0f / (NormalSigma * NormalSigma);
+	float invDepthSigmaSquared = 1.0f / (DepthSigma * DepthSigma);
+	float invPatchArea = 1.0f / float((2 * patchRadius + 1) * (2 * patchRadius + 1));
+
+	// Per-pixel color distance between p and q = p + offset
+	// Uses the variance cancelled distance from Rousselle et al. 2012, "Adaptive Rendering with Non-Local Means Filtering"
+	tbb::parallel_for(0, height, [&](int y) {
+		float *distance = &m_distance[y * width];
+
+		int qy = y + offsetY;
+		if (qy < 0 || qy >= height || xBegin >= xEnd) {
+			std::fill(distance, distance + width, kInvalidDistance);
+			return;
+		}
+
+		for (int x = 0; x < xBegin; ++x) {
+			distance[x] = kInvalidDistance;
+		}
+		for (int x = xEnd; x < width; ++x) {
+			distance[x] = kInvalidDistance;
+		}
+
+		int p = y * width;
+		int q = qy * width + offsetX;
+		for (int x = xBegin; x < xEnd; ++x) {
+			float sum = 0.0f;
+			for (int c = 0; c < 3; ++c) {
+				float varianceP = m_variance[c][p + x];
+				float varianceQ = m_variance[c][q + x];
+
+				float diff = m_color[c][p + x] - m_color[c][q + x];
+				sum += (diff * diff - (varianceP + std::min(varianceP, varianceQ))) / (kVarianceEpsilon + strengthSquared * (varianceP + varianceQ));
+			}
+
+			float valid = m_valid[p + x] * m_valid[q + x];
+			distance[x] = valid * sum * (1.0f / 3.0f) + (1.0f - valid) * kInvalidDistance;
+		}
+	});
+
+	// Box filter the distances over the patch. First along the rows...
+	tbb::parallel_for(0, height, [&](int y) {
+		const float *distance = &m_distance[y * width];
+		float *rowSummed = &m_rowSummedDistance[y * width];
+
+		for (int x = 0; x < width; ++x) {
+			float sum = 0.0f;
+			for (int i = -patchRadius; i <= patchRadius; ++i) {
+				sum += distance[std::min(std::max(x + i, 0), width - 1)];
+			}
+			rowSummed[x] = sum;
+		}
+	});
+
+	// ...then along the columns, turning the patch distance into a weight as we go
+	tbb::parallel_for(0, height, [&](int y) {
+		int qy = y + offsetY;
+		if (qy < 0 || qy >= height) {
+			return;
+		}
+
+		int p = y * width;
+		int q = qy * width + offsetX;
+		for (int x = xBegin; x < xEnd; ++x) {
+			float patchDistance = 0.0f;
+			for (int j = -patchRadius; j <= patchRadius; ++j) {
+				int row = std::min(std::max(y + j, 0), height - 1);
+				patchDistance += m_rowSummedDistance[row * width + x];
+			}
+			patchDistance *= invPatchArea;
+
+			float colorWeight = std::exp(-std::max(patchDistance, 0.0f));
+
+			float albedoDistance = 0.0f;
+			float normalDistance = 0.0f;
+			for (int c = 0; c < 3; ++c) {
+				float albedoDiff = m_albedo[c][p + x] - m_albedo[c][q + x];
+				float normalDiff = m_normal[c][p + x] - m_normal[c][q + x];
+				albedoDistance += albedoDiff * albedoDiff;
+				normalDistance += normalDiff * normalDiff;
+			}
+			float depthDiff = (m_depth[p + x] - m_depth[q + x]) / (m_depth[p + x] + kDepthEpsilon);
+			float depthDistance = depthDiff * depthDiff;
+
+			float featureDistance = std::max(albedoDistance * invAlbedoSigmaSquared,
+			                                 std::max(normalDistance * invNormalSigmaSquared, depthDistance * invDepthSigmaSquared));
+			float featureWeight = std::exp(-featureDistance);
+
+			float weight = std::min(colorWeight, featureWeight) * m_valid[p + x] * m_valid[q + x];
+
+			m_weightSum[p + x] += weight;
+			for (int c = 0; c < 3; ++c) {
+				m_colorSum[c][p + x] += weight * m_color[c][q + x];
+			}
+		}
+	});
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,92 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+#include "math/vector_types.h"
+
+#include "profiling/memory_tracker.h"
+
+#include <vector>
+
+
+namespace Lantern {
+
+class FrameBuffer;
+
+/**
+ * A feature guided non-local means filter
+ *
+ * Each pixel is replaced by a weighted average of the pixels in a (2 * SearchRadius + 1)^2 window
+ * around it. Neighbours are weighted by two things:
+ *     1. How similar the colors of the patches around both pixels are, relative to the variance of
+ *        the pixel means. So noisy pixels are blurred more than converged ones
+ *     2. How similar the first hit albedo, normal, and depth of the two pixels are. The features
+ *        are nearly noise free, so they keep texture and geometry edges sharp where the color
+ *        is too noisy to tell
+ * The final weight is the minimum of the two.
+ *
+ * The search is done one offset at a time over the whole image, so the patch distances can be
+ * computed with a separable box filter. All the buffers are stored as planes of floats, so the
+ * inner loops vectorize. Rows are split across threads.
+ */
+class Denoiser {
+public:
+	Denoiser();
+
+public:
+	/** The radius of the window of neighbours each pixel is averaged with */
+	uint SearchRadius;
+	/** The radius of the patches compared between neighbours */
+	uint PatchRadius;
+	/** Scales the color variance. Higher values blur more */
+	float Strength;
+	/** The albedo difference at which neighbours start being rejected */
+	float AlbedoSigma;
+	/** The normal difference at which neighbours start being rejected */
+	float NormalSigma;
+	/** The relative depth difference at which neighbours start being rejected */
+	float DepthSigma;
+
+private:
+	typedef TrackedVector<float, MemoryCategory::Denoiser> Plane;
+
+	uint m_width;
+	uint m_height;
+
+	// The per-pixel means of the FrameBuffer
+	Plane m_color[3];
+	Plane m_variance[3];
+	Plane m_albedo[3];
+	Plane m_normal[3];
+	Plane m_depth;
+	// 1.0f if the pixel has any samples, 0.0f if not
+	Plane m_valid;
+
+	// Scratch buffers for a single offset
+	Plane m_distance;
+	Plane m_rowSummedDistance;
+
+	Plane m_weightSum;
+	Plane m_colorSum[3];
+
+public:
+	/**
+	 * Denoises the current contents of a FrameBuffer
+	 *
+	 * @param frameBuffer    The FrameBuffer to denoise. It must have features splatted for every sample
+	 * @param output         Filled with the denoised colors. Must have room for Width * Height pixels
+	 */
+	void Denoise(const FrameBuffer &frameBuffer, float3 *output);
+
+private:
+	void Resize(uint width, uint height);
+	void LoadFrameBuffer(const FrameBuffer &frameBuffer);
+	void AccumulateOffset(int offsetX, int offsetY);
+};
+
+} // End of namespace Lantern
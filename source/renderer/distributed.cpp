@@ -0,0 +1,491 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "renderer/distributed.h"
+
+#include "renderer/renderer.h"
+
+#include "scene/scene.h"
+
+#include "profiling/trace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+
+	typedef SOCKET SocketHandle;
+	#define INVALID_SOCKET_HANDLE INVALID_SOCKET
+	#define CloseSocket closesocket
+	#define PollSockets WSAPoll
+#else
+	#include <arpa/inet.h>
+	#include <netdb.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <poll.h>
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+
+	typedef int SocketHandle;
+	#define INVALID_SOCKET_HANDLE (-1)
+	#define CloseSocket close
+	#define PollSockets poll
+#endif
+
+
+namespace Lantern {
+
+namespace MessageType {
+enum Type : uint32 {
+	Hello = 1,    // Worker -> Coordinator. Payload: HelloMessage
+	WorkItem = 2, // Coordinator -> Worker. Payload: WorkItem
+	Result = 3,   // Worker -> Coordinator. Payload: WorkItem, then the pixel data of each tile
+	Shutdown = 4  // Coordinator -> Worker. No payload
+};
+}
+
+struct MessageHeader {
+	uint32 Type;
+	uint32 Size; // The size of the payload in bytes
+};
+
+struct HelloMessage {
+	uint32 Width;
+	uint32 Height;
+};
+
+struct WorkItem {
+	uint32 FirstFrame;
+	uint32 NumFrames;
+	uint32 FirstTile;
+	uint32 NumTiles;
+};
+
+// Each pixel is sent as a raw PixelAccumulation
+static const uint kFloatsPerPixel = sizeof(PixelAccumulation) / sizeof(float);
+
+
+static bool InitSockets() {
+	#ifdef _WIN32
+		WSADATA wsaData;
+		return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+	#else
+		return true;
+	#endif
+}
+
+static void ShutdownSockets() {
+	#ifdef _WIN32
+		WSACleanup();
+	#endif
+}
+
+static bool SendAll(SocketHandle socket, const void *data, std::size_t size) {
+	const char *bytes = (const char *)data;
+	while (size > 0) {
+		int sent = send(socket, bytes, (int)std::min<std::size_t>(size, 1 << 30), 0);
+		if (sent <= 0) {
+			return false;
+		}
+		bytes += sent;
+		size -= sent;
+	}
+
+	return true;
+}
+
+static bool ReceiveAll(SocketHandle socket, void *data, std::size_t size) {
+	char *bytes = (char *)data;
+	while (size > 0) {
+		int received = recv(socket, bytes, (int)std::min<std::size_t>(size, 1 << 30), 0);
+		if (received <= 0) {
+			return false;
+		}
+		bytes += received;
+		size -= received;
+	}
+
+	return true;
+}
+
+static bool SendMessage(SocketHandle socket, uint32 type, const void *payload, uint32 size) {
+	MessageHeader header;
+	header.Type = type;
+	header.Size = size;
+
+	return SendAll(socket, &header, sizeof(MessageHeader)) && (size == 0 || SendAll(socket, payload, size));
+}
+
+/**
+ * Creates a socket for the address, and either binds and listens on it, or connects to it
+ */
+static SocketHandle OpenSocket(const std::string &address, bool listening) {
+	if (address.compare(0, 5, "unix:") == 0) {
+		#ifdef _WIN32
+			printf("Unix sockets are not supported on Windows: %s\n", address.c_str());
+			return INVALID_SOCKET_HANDLE;
+		#else
+			std::string path = address.substr(5);
+
+			sockaddr_un socketAddress;
+			memset(&socketAddress, 0, sizeof(sockaddr_un));
+			socketAddress.sun_family = AF_UNIX;
+			if (path.size() >= sizeof(socketAddress.sun_path)) {
+				printf("Unix socket path is too long: %s\n", path.c_str());
+				return INVALID_SOCKET_HANDLE;
+			}
+			strcpy(socketAddress.sun_path, path.c_str());
+
+			SocketHandle handle = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (handle == INVALID_SOCKET_HANDLE) {
+				return INVALID_SOCKET_HANDLE;
+			}
+
+			bool success;
+			if (listening) {
+				// Clean up after a previous coordinator that didn't exit cleanly
+				unlink(path.c_str());
+				success = bind(handle, (sockaddr *)&socketAddress, sizeof(sockaddr_un)) == 0 && listen(handle, 64) == 0;
+			} else {
+				success = connect(handle, (sockaddr *)&socketAddress, sizeof(sockaddr_un)) == 0;
+			}
+
+			if (!success) {
+				CloseSocket(handle);
+				return INVALID_SOCKET_HANDLE;
+			}
+			return handle;
+		#endif
+	}
+
+	if (address.compare(0, 4, "tcp:") == 0) {
+		std::string hostAndPort = address.substr(4);
+		std::size_t colon = hostAndPort.rfind(':');
+		std::string host = colon == std::string::npos || colon == 0 ? "127.0.0.1" : hostAndPort.substr(0, colon);
+		std::string port = colon == std::string::npos ? hostAndPort : hostAndPort.substr(colon + 1);
+
+		addrinfo hints;
+		memset(&hints, 0, sizeof(addrinfo));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+		addrinfo *result = nullptr;
+		if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+			printf("Failed to resolve address: %s\n", address.c_str());
+			return INVALID_SOCKET_HANDLE;
+		}
+
+		SocketHandle handle = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+		bool success = handle != INVALID_SOCKET_HANDLE;
+		if (success) {
+			int enable = 1;
+			if (listening) {
+				setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (const char *)&enable, sizeof(int));
+				success = bind(handle, result->ai_addr, (int)result->ai_addrlen) == 0 && listen(handle, 64) == 0;
+			} else {
+				success = connect(handle, result->ai_addr, (int)result->ai_addrlen) == 0;
+				// Work items are tiny. Don't let Nagle hold them back
+				setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char *)&enable, sizeof(int));
+			}
+		}
+		freeaddrinfo(result);
+
+		if (!success) {
+			if (handle != INVALID_SOCKET_HANDLE) {
+				CloseSocket(handle);
+			}
+			return INVALID_SOCKET_HANDLE;
+		}
+		return handle;
+	}
+
+	printf("Unknown address format: %s. Expected unix:<path> or tcp:<host>:<port>\n", address.c_str());
+	return INVALID_SOCKET_HANDLE;
+}
+
+static uint NumTilePixels(Renderer *renderer, uint firstTile, uint numTiles) {
+	uint numPixels = 0;
+	for (uint tile = firstTile; tile < firstTile + numTiles; ++tile) {
+		uint x0, x1, y0, y1;
+		renderer->GetTileBounds(tile, &x0, &x1, &y0, &y1);
+		numPixels += (x1 - x0) * (y1 - y0);
+	}
+
+	return numPixels;
+}
+
+
+struct WorkerConnection {
+	SocketHandle Socket;
+	bool HasWorkItem;
+	WorkItem CurrentWorkItem;
+};
+
+bool RunRenderCoordinator(Renderer *renderer, const DistributedSettings &settings, uint numFrames) {
+	if (!InitSockets()) {
+		return false;
+	}
+
+	SocketHandle listenSocket = OpenSocket(settings.Address, true);
+	if (listenSocket == INVALID_SOCKET_HANDLE) {
+		printf("Failed to listen on %s\n", settings.Address.c_str());
+		ShutdownSockets();
+		return false;
+	}
+
+	FrameBuffer *frameBuffer = &renderer->GetScene()->Camera.FrameBuffer;
+
+	// Split the remaining frames into work items
+	std::deque<WorkItem> workQueue;
+	uint numTiles = renderer->NumTiles();
+	uint framesPerItem = std::max(settings.FramesPerWorkItem, 1u);
+	uint tilesPerItem = std::max(settings.TilesPerWorkItem, 1u);
+	for (uint frame = renderer->FrameNumber(); frame < numFrames; frame += framesPerItem) {
+		for (uint tile = 0; tile < numTiles; tile += tilesPerItem) {
+			WorkItem item;
+			item.FirstFrame = frame;
+			item.NumFrames = std::min(framesPerItem, numFrames - frame);
+			item.FirstTile = tile;
+			item.NumTiles = std::min(tilesPerItem, numTiles - tile);
+			workQueue.push_back(item);
+		}
+	}
+	std::size_t numWorkItems = workQueue.size();
+	std::size_t numCompleted = 0;
+
+	// Wait for all the workers to connect
+	std::vector<WorkerConnection> workers;
+	printf("Waiting for %u workers on %s\n", settings.NumWorkers, settings.Address.c_str());
+	while (workers.size() < settings.NumWorkers) {
+		SocketHandle workerSocket = accept(listenSocket, nullptr, nullptr);
+		if (workerSocket == INVALID_SOCKET_HANDLE) {
+			continue;
+		}
+
+		// Make sure the worker is rendering the same size image
+		MessageHeader header;
+		HelloMessage hello;
+		if (!ReceiveAll(workerSocket, &header, sizeof(MessageHeader)) || header.Type != MessageType::Hello || header.Size != sizeof(HelloMessage) ||
+		    !ReceiveAll(workerSocket, &hello, sizeof(HelloMessage)) || hello.Width != frameBuffer->Width || hello.Height != frameBuffer->Height) {
+			printf("Rejected a worker with a mismatched handshake\n");
+			CloseSocket(workerSocket);
+			continue;
+		}
+
+		WorkerConnection worker;
+		worker.Socket = workerSocket;
+		worker.HasWorkItem = false;
+		workers.push_back(worker);
+		printf("Worker %u connected\n", (uint)workers.size());
+	}
+
+	std::vector<float> pixelData;
+	std::vector<pollfd> pollSockets;
+	while (numCompleted < numWorkItems) {
+		// Hand out work to any idle workers
+		for (auto &worker : workers) {
+			if (worker.Socket == INVALID_SOCKET_HANDLE || worker.HasWorkItem || workQueue.empty()) {
+				continue;
+			}
+
+			worker.CurrentWorkItem = workQueue.front();
+			workQueue.pop_front();
+			worker.HasWorkItem = true;
+
+			if (!SendMessage(worker.Socket, MessageType::WorkItem, &worker.CurrentWorkItem, sizeof(WorkItem))) {
+				printf("Lost connection to a worker. Requeuing its work\n");
+				workQueue.push_front(worker.CurrentWorkItem);
+				CloseSocket(worker.Socket);
+				worker.Socket = INVALID_SOCKET_HANDLE;
+				worker.HasWorkItem = false;
+			}
+		}
+
+		// Wait for results
+		pollSockets.clear();
+		for (auto &worker : workers) {
+			if (worker.Socket != INVALID_SOCKET_HANDLE && worker.HasWorkItem) {
+				pollfd pollSocket;
+				pollSocket.fd = worker.Socket;
+				pollSocket.events = POLLIN;
+				pollSocket.revents = 0;
+				pollSockets.push_back(pollSocket);
+			}
+		}
+		if (pollSockets.empty()) {
+			printf("All workers disconnected with %u work items remaining\n", (uint)(numWorkItems - numCompleted));
+			break;
+		}
+		if (PollSockets(&pollSockets[0], (uint)pollSockets.size(), -1) <= 0) {
+			continue;
+		}
+
+		for (auto &pollSocket : pollSockets) {
+			if (pollSocket.revents == 0) {
+				continue;
+			}
+
+			WorkerConnection *worker = nullptr;
+			for (auto &candidate : workers) {
+				if (candidate.Socket == pollSocket.fd) {
+					worker = &candidate;
+					break;
+				}
+			}
+
+			const WorkItem &item = worker->CurrentWorkItem;
+			uint numPixels = NumTilePixels(renderer, item.FirstTile, item.NumTiles);
+			uint expectedSize = sizeof(WorkItem) + numPixels * kFloatsPerPixel * sizeof(float);
+
+			MessageHeader header;
+			WorkItem resultItem;
+			pixelData.resize(numPixels * kFloatsPerPixel);
+			bool success = ReceiveAll(worker->Socket, &header, sizeof(MessageHeader)) &&
+			               header.Type == MessageType::Result && header.Size == expectedSize &&
+			               ReceiveAll(worker->Socket, &resultItem, sizeof(WorkItem)) &&
+			               memcmp(&resultItem, &item, sizeof(WorkItem)) == 0 &&
+			               ReceiveAll(worker->Socket, &pixelData[0], numPixels * kFloatsPerPixel * sizeof(float));
+
+			if (!success) {
+				printf("Lost connection to a worker. Requeuing its work\n");
+				workQueue.push_front(item);
+				CloseSocket(worker->Socket);
+				worker->Socket = INVALID_SOCKET_HANDLE;
+				worker->HasWorkItem = false;
+				continue;
+			}
+
+			// Merge the tiles into our FrameBuffer
+			ScopedTrace trace("Merge work item", item.FirstTile);
+			const float *data = &pixelData[0];
+			for (uint tile = item.FirstTile; tile < item.FirstTile + item.NumTiles; ++tile) {
+				uint x0, x1, y0, y1;
+				renderer->GetTileBounds(tile, &x0, &x1, &y0, &y1);
+
+				for (uint y = y0; y < y1; ++y) {
+					for (uint x = x0; x < x1; ++x) {
+						PixelAccumulation accumulation;
+						memcpy(&accumulation, data, sizeof(PixelAccumulation));
+						frameBuffer->MergePixel(x, y, accumulation);
+						data += kFloatsPerPixel;
+					}
+				}
+			}
+
+			worker->HasWorkItem = false;
+			++numCompleted;
+			if (numCompleted % 64 == 0 || numCompleted == numWorkItems) {
+				printf("Completed %u / %u work items\n", (uint)numCompleted, (uint)numWorkItems);
+			}
+		}
+	}
+
+	for (auto &worker : workers) {
+		if (worker.Socket != INVALID_SOCKET_HANDLE) {
+			SendMessage(worker.Socket, MessageType::Shutdown, nullptr, 0);
+			CloseSocket(worker.Socket);
+		}
+	}
+	CloseSocket(listenSocket);
+	#ifndef _WIN32
+		if (settings.Address.compare(0, 5, "unix:") == 0) {
+			unlink(settings.Address.substr(5).c_str());
+		}
+	#endif
+	ShutdownSockets();
+
+	if (numCompleted != numWorkItems) {
+		return false;
+	}
+
+	renderer->SetFrameNumber(numFrames);
+	return true;
+}
+
+bool RunRenderWorker(Renderer *renderer, const std::string &address) {
+	if (!InitSockets()) {
+		return false;
+	}
+
+	SocketHandle coordinatorSocket = OpenSocket(address, false);
+	if (coordinatorSocket == INVALID_SOCKET_HANDLE) {
+		printf("Failed to connect to %s\n", address.c_str());
+		ShutdownSockets();
+		return false;
+	}
+
+	FrameBuffer *frameBuffer = &renderer->GetScene()->Camera.FrameBuffer;
+	frameBuffer->Reset();
+
+	HelloMessage hello;
+	hello.Width = frameBuffer->Width;
+	hello.Height = frameBuffer->Height;
+
+	bool success = SendMessage(coordinatorSocket, MessageType::Hello, &hello, sizeof(HelloMessage));
+
+	std::vector<byte> result;
+	while (success) {
+		MessageHeader header;
+		if (!ReceiveAll(coordinatorSocket, &header, sizeof(MessageHeader))) {
+			success = false;
+			break;
+		}
+		if (header.Type == MessageType::Shutdown) {
+			break;
+		}
+
+		WorkItem item;
+		if (header.Type != MessageType::WorkItem || header.Size != sizeof(WorkItem) || !ReceiveAll(coordinatorSocket, &item, sizeof(WorkItem))) {
+			success = false;
+			break;
+		}
+
+		ScopedTrace trace("Work item", item.FirstTile);
+		for (uint frame = item.FirstFrame; frame < item.FirstFrame + item.NumFrames; ++frame) {
+			renderer->RenderTiles(frame, item.FirstTile, item.NumTiles);
+		}
+
+		// Pack the tiles, and clear them for the next work item
+		uint numPixels = NumTilePixels(renderer, item.FirstTile, item.NumTiles);
+		result.resize(sizeof(WorkItem) + numPixels * kFloatsPerPixel * sizeof(float));
+		memcpy(&result[0], &item, sizeof(WorkItem));
+
+		float *data = (float *)&result[sizeof(WorkItem)];
+		for (uint tile = item.FirstTile; tile < item.FirstTile + item.NumTiles; ++tile) {
+			uint x0, x1, y0, y1;
+			renderer->GetTileBounds(tile, &x0, &x1, &y0, &y1);
+
+			for (uint y = y0; y < y1; ++y) {
+				for (uint x = x0; x < x1; ++x) {
+					PixelAccumulation accumulation;
+					frameBuffer->TakePixel(x, y, &accumulation);
+					memcpy(data, &accumulation, sizeof(PixelAccumulation));
+					data += kFloatsPerPixel;
+				}
+			}
+		}
+
+		success = SendMessage(coordinatorSocket, MessageType::Result, &result[0], (uint32)result.size());
+	}
+
+	CloseSocket(coordinatorSocket);
+	ShutdownSockets();
+
+	renderer->Stats().PrintSummary();
+
+	return success;
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,65 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+
+#include <string>
+
+
+namespace Lantern {
+
+class Renderer;
+
+/**
+ * Multi-process rendering of a single image
+ *
+ * One coordinator process splits the frames into work items. Each work item is a range of tiles,
+ * rendered for a range of frame numbers. Worker processes load the same scene, connect to the
+ * coordinator, and pull work items until there are none left. They send back the partially
+ * accumulated pixels of the tiles, which the coordinator merges into its FrameBuffer.
+ *
+ * The tile samplers are seeded from the tile index and the frame number, so a work item produces
+ * exactly the same samples no matter which process renders it. The merged FrameBuffer is equivalent
+ * to a single process render of the same number of frames, up to floating point summation order.
+ *
+ * If a worker disconnects, its in-flight work item is handed to another worker.
+ *
+ * Addresses are either
+ *     unix:<path>         A Unix domain socket. Not available on Windows
+ *     tcp:<host>:<port>   A TCP socket. <host> is optional for the coordinator, and defaults to 127.0.0.1
+ */
+struct DistributedSettings {
+	DistributedSettings()
+		: NumWorkers(1u),
+		  FramesPerWorkItem(4u),
+		  TilesPerWorkItem(256u) {
+	}
+
+	std::string Address;
+	/** The number of workers the coordinator waits for before handing out work */
+	uint NumWorkers;
+	uint FramesPerWorkItem;
+	uint TilesPerWorkItem;
+};
+
+/**
+ * Renders frames [renderer->FrameNumber(), numFrames) using remote workers, and merges the results
+ * into the renderer's FrameBuffer. On return, the renderer's frame number is numFrames
+ *
+ * @return    False if the socket couldn't be created, or all the workers disconnected before finishing
+ */
+bool RunRenderCoordinator(Renderer *renderer, const DistributedSettings &settings, uint numFrames);
+
+/**
+ * Connects to a coordinator and renders work items until the coordinator says to stop
+ *
+ * @return    False if the connection failed, or was lost before the coordinator said to stop
+ */
+bool RunRenderWorker(Renderer *renderer, const std::string &address);
+
+} // End of namespace Lantern
@@ -0,0 +1,68 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "renderer/path_recorder.h"
+
+#include <algorithm>
+
+
+namespace Lantern {
+
+PathRecorder::PathRecorder()
+		: m_x0(0u),
+		  m_y0(0u),
+		  m_x1(0u),
+		  m_y1(0u),
+		  m_framesRemaining(0u),
+		  m_recording(false),
+		  m_generation(1u) {
+}
+
+void PathRecorder::Start(uint x0, uint y0, uint x1, uint y1, uint numFrames) {
+	m_x0 = x0;
+	m_y0 = y0;
+	m_x1 = x1;
+	m_y1 = y1;
+	m_framesRemaining = numFrames;
+	m_recording = false;
+
+	// The thread buffers clear themselves the next time they're used
+	++m_generation;
+}
+
+void PathRecorder::EndFrame() {
+	if (m_recording) {
+		--m_framesRemaining;
+	}
+	m_recording = false;
+}
+
+void PathRecorder::GetPixelEvents(uint x, uint y, std::vector<PathEvent> *events) const {
+	events->clear();
+
+	for (const ThreadBuffer &buffer : m_threadBuffers) {
+		if (buffer.Generation != m_generation) {
+			continue;
+		}
+
+		// Only the newest kEventsPerThread events survive
+		uint64 first = buffer.NumWritten > kEventsPerThread ? buffer.NumWritten - kEventsPerThread : 0u;
+		for (uint64 i = first; i < buffer.NumWritten; ++i) {
+			const PathEvent &event = buffer.Events[i % kEventsPerThread];
+			if (event.PixelX == x && event.PixelY == y) {
+				events->push_back(event);
+			}
+		}
+	}
+
+	// Each path is traced by a single thread, so its events are already in order
+	// We just need to group the paths together
+	std::stable_sort(events->begin(), events->end(), [](const PathEvent &a, const PathEvent &b) {
+		return a.PathID < b.PathID;
+	});
+}
+
+} // End of namespace Lantern
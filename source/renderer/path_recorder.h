@@ -0,0 +1,190 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+#include "math/vector_types.h"
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <vector>
+
+
+namespace Lantern {
+
+namespace PathEventType {
+enum Type : uint8 {
+	Camera,                 // The camera ray was generated
+	Bounce,                 // The path hit a surface and sampled a new direction
+	NextEventEstimation,    // A light was sampled from the current vertex
+	MediumScatter,          // The path scattered inside a medium
+	RussianRoulette,        // The path was terminated by russian roulette
+	Miss,                   // The path left the scene
+	MaxBounces              // The path hit the bounce limit
+};
+}
+
+/**
+ * A single recorded event along a path
+ */
+struct PathEvent {
+	float3 Position;
+	// Camera, Bounce, MediumScatter: the direction the path continues in
+	// NextEventEstimation: the direction to the light sample
+	// Miss: the direction the path left the scene in
+	float3 Direction;
+	float3 Throughput;
+	uint PathID;
+	uint16 PixelX;
+	uint16 PixelY;
+	uint16 Bounce;
+	PathEventType::Type Type;
+};
+
+/**
+ * Records the events of the paths traced for a window of pixels, so they can be inspected later
+ *
+ * Each thread writes to its own ring buffer, so recording needs no locks. If a thread records more
+ * than kEventsPerThread events, the oldest ones are overwritten. The buffers must only be read
+ * while no frame is being rendered.
+ *
+ * The renderer only calls into the recorder through the LANTERN_BEGIN_PATH and LANTERN_RECORD_PATH_EVENT
+ * macros. Unless LANTERN_ENABLE_PATH_RECORDING is defined, they compile to nothing, so release builds
+ * pay nothing for it.
+ */
+class PathRecorder {
+public:
+	PathRecorder();
+
+public:
+	static const uint kEventsPerThread = 1 << 16;
+
+private:
+	struct ThreadBuffer {
+		ThreadBuffer()
+			: NumWritten(0u),
+			  Generation(0u),
+			  Active(false) {
+		}
+
+		std::vector<PathEvent> Events;
+		uint64 NumWritten;
+		// Recording generation the buffer was last cleared in
+		uint Generation;
+
+		// The path currently being traced by this thread
+		bool Active;
+		uint16 PixelX;
+		uint16 PixelY;
+		uint PathID;
+		uint16 Bounce;
+	};
+
+	mutable tbb::enumerable_thread_specific<ThreadBuffer> m_threadBuffers;
+
+	uint m_x0;
+	uint m_y0;
+	uint m_x1;
+	uint m_y1;
+	// The number of frames left to record
+	uint m_framesRemaining;
+	bool m_recording;
+	// Incremented every time recording is started, so stale thread buffers are cleared lazily
+	uint m_generation;
+
+public:
+	/**
+	 * Starts recording the paths of the pixels in [x0, x1) x [y0, y1) for the next numFrames frames.
+	 * Any previously recorded events are discarded
+	 */
+	void Start(uint x0, uint y0, uint x1, uint y1, uint numFrames);
+	void Stop() { m_framesRemaining = 0u; m_recording = false; }
+	bool IsRecording() const { return m_framesRemaining > 0u; }
+
+	/** Called by the renderer before and after every frame */
+	void BeginFrame() { m_recording = m_framesRemaining > 0u; }
+	void EndFrame();
+
+	/**
+	 * Starts a new path on the calling thread. Events are only recorded if the pixel is in the recorded window
+	 *
+	 * @param x         The x coordinate of the pixel the path belongs to
+	 * @param y         The y coordinate of the pixel the path belongs to
+	 * @param pathId    An id that is unique among the paths of the pixel. IE. The frame number
+	 */
+	void BeginPath(uint x, uint y, uint pathId) const {
+		if (!m_recording) {
+			return;
+		}
+
+		ThreadBuffer &buffer = GetThreadBuffer();
+		buffer.Active = x >= m_x0 && x < m_x1 && y >= m_y0 && y < m_y1;
+		buffer.PixelX = (uint16)x;
+		buffer.PixelY = (uint16)y;
+		buffer.PathID = pathId;
+		buffer.Bounce = 0u;
+	}
+
+	/**
+	 * Adds an event to the path currently being traced by the calling thread.
+	 * Bounce and MediumScatter events start a new path vertex
+	 */
+	void Record(PathEventType::Type type, const float3 &position, const float3 &direction, const float3 &throughput) const {
+		if (!m_recording) {
+			return;
+		}
+
+		ThreadBuffer &buffer = GetThreadBuffer();
+		if (!buffer.Active) {
+			return;
+		}
+
+		if (type == PathEventType::Bounce || type == PathEventType::MediumScatter) {
+			++buffer.Bounce;
+		}
+
+		PathEvent &event = buffer.Events[buffer.NumWritten % kEventsPerThread];
+		event.Position = position;
+		event.Direction = direction;
+		event.Throughput = throughput;
+		event.PathID = buffer.PathID;
+		event.PixelX = buffer.PixelX;
+		event.PixelY = buffer.PixelY;
+		event.Bounce = buffer.Bounce;
+		event.Type = type;
+
+		++buffer.NumWritten;
+	}
+
+	/**
+	 * Gathers the recorded events of a single pixel, grouped by path, and in the order they happened
+	 */
+	void GetPixelEvents(uint x, uint y, std::vector<PathEvent> *events) const;
+
+private:
+	ThreadBuffer &GetThreadBuffer() const {
+		ThreadBuffer &buffer = m_threadBuffers.local();
+		if (buffer.Generation != m_generation) {
+			buffer.Events.resize(kEventsPerThread);
+			buffer.NumWritten = 0u;
+			buffer.Generation = m_generation;
+		}
+
+		return buffer;
+	}
+};
+
+} // End of namespace Lantern
+
+
+#ifdef LANTERN_ENABLE_PATH_RECORDING
+	#define LANTERN_BEGIN_PATH(recorder, x, y, pathId) (recorder).BeginPath(x, y, pathId)
+	#define LANTERN_RECORD_PATH_EVENT(recorder, type, position, direction, throughput) (recorder).Record(type, position, direction, throughput)
+#else
+	#define LANTERN_BEGIN_PATH(recorder, x, y, pathId) ((void)(pathId))
+	#define LANTERN_RECORD_PATH_EVENT(recorder, type, position, direction, throughput) ((void)0)
+#endif
@@ -0,0 +1,99 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+#include "math/vector_types.h"
+
+#include "profiling/memory_tracker.h"
+
+#include <cstring>
+#include <vector>
+
+
+namespace Lantern {
+
+namespace PixelCost {
+enum Type {
+	Cycles = 0,     // CPU cycles spent on the pixel's paths
+	Rays = 1,       // Rays traced for the pixel, including shadow rays
+	PathLength = 2  // Ray segments along the pixel's paths
+};
+}
+
+/**
+ * Per-pixel sums of the cost of rendering each sample. Used to find the expensive parts of the image
+ *
+ * Like the FrameBuffer, each pixel is only ever written by the thread rendering its tile
+ */
+class PixelCostBuffer {
+public:
+	PixelCostBuffer()
+		: Width(0u),
+		  Height(0u) {
+	}
+
+public:
+	static const uint kNumCostTypes = 3;
+
+	uint Width;
+	uint Height;
+
+private:
+	// The sums of each cost type, interleaved per pixel
+	TrackedVector<float, MemoryCategory::RenderCaches> m_costSums;
+	TrackedVector<float, MemoryCategory::RenderCaches> m_samples;
+
+public:
+	void Resize(uint width, uint height) {
+		if (width != Width || height != Height) {
+			Width = width;
+			Height = height;
+			m_costSums.resize(width * height * kNumCostTypes);
+			m_samples.resize(width * height);
+		}
+		Reset();
+	}
+
+	void SplatCost(uint x, uint y, float cycles, float rays, float pathLength) {
+		uint index = y * Width + x;
+
+		float *costs = &m_costSums[index * kNumCostTypes];
+		costs[PixelCost::Cycles] += cycles;
+		costs[PixelCost::Rays] += rays;
+		costs[PixelCost::PathLength] += pathLength;
+		m_samples[index] += 1.0f;
+	}
+
+	/**
+	 * Returns the mean cost per sample of a pixel
+	 */
+	float GetMeanCost(uint x, uint y, PixelCost::Type type) const {
+		uint index = y * Width + x;
+
+		float samples = m_samples[index];
+		return samples > 0.0f ? m_costSums[index * kNumCostTypes + type] / samples : 0.0f;
+	}
+
+	/**
+	 * Returns the mean cost per sample of every type as a color. Cycles in x, rays in y, and path length in z
+	 */
+	float3 GetMeanCosts(uint x, uint y) const {
+		return float3(GetMeanCost(x, y, PixelCost::Cycles), GetMeanCost(x, y, PixelCost::Rays), GetMeanCost(x, y, PixelCost::PathLength));
+	}
+
+	bool IsEmpty() const { return Width == 0u; }
+
+	void Reset() {
+		if (!m_samples.empty()) {
+			memset(&m_costSums[0], 0, m_costSums.size() * sizeof(float));
+			memset(&m_samples[0], 0, m_samples.size() * sizeof(float));
+		}
+	}
+};
+
+} // End of namespace Lantern
@@ -0,0 +1,98 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+#include "math/vector_types.h"
+
+#include "profiling/memory_tracker.h"
+
+#include <vector>
+
+
+namespace Lantern {
+
+/**
+ * The first hit of a single camera ray
+ */
+struct CachedPrimaryHit {
+	float3 Direction;
+	float TFar;
+	uint GeomID;
+	uint PrimID;
+	float U;
+	float V;
+	float3 Normal; // Interpolated and normalized
+	float FilterWeight; // See ReconstructionFilter::Sample()
+};
+
+/**
+ * A per-pixel cache of camera ray hits
+ *
+ * While the camera is static, the first hit of each camera ray only varies within the
+ * reconstruction filter footprint. So, rather than re-tracing the camera ray every frame,
+ * we trace kSamplesPerPixel stratified camera rays per pixel once, and let later frames
+ * pick one of them at random.
+ *
+ * Using a fixed set of sub-pixel positions biases the anti-aliasing. So the cache is meant
+ * to be rebuilt with new positions every few frames. In the limit, the image converges to
+ * the same result as tracing every camera ray.
+ *
+ * Tiles are filled independently, so different threads can build different tiles at the same time
+ */
+class PrimaryHitCache {
+public:
+	PrimaryHitCache()
+		: m_width(0u),
+		  m_height(0u),
+		  m_valid(false) {
+	}
+
+public:
+	// Must be a square number, so the sub-pixel positions can be stratified
+	static const uint kSamplesPerPixel = 4;
+	static const uint kStrataPerAxis = 2;
+
+private:
+	uint m_width;
+	uint m_height;
+	bool m_valid;
+
+	float3a m_origin;
+	TrackedVector<CachedPrimaryHit, MemoryCategory::RenderCaches> m_hits;
+
+public:
+	bool IsValid() const { return m_valid; }
+	void Invalidate() { m_valid = false; }
+
+	/**
+	 * Marks the cache as valid, and resizes it if needed.
+	 * The caller is responsible for filling every pixel before the cache is read
+	 */
+	void Prepare(uint width, uint height, float3a origin) {
+		if (width != m_width || height != m_height) {
+			m_width = width;
+			m_height = height;
+			m_hits.resize(width * height * kSamplesPerPixel);
+		}
+
+		m_origin = origin;
+		m_valid = true;
+	}
+
+	/** The origin shared by all the cached camera rays */
+	float3a Origin() const { return m_origin; }
+
+	CachedPrimaryHit &Get(uint x, uint y, uint sample) {
+		return m_hits[(y * m_width + x) * kSamplesPerPixel + sample];
+	}
+	const CachedPrimaryHit &Get(uint x, uint y, uint sample) const {
+		return m_hits[(y * m_width + x) * kSamplesPerPixel + sample];
+	}
+};
+
+} // End of namespace Lantern
@@ -0,0 +1,95 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "renderer/render_stats.h"
+
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/cache_aligned_allocator.h>
+
+#include <cstdio>
+#include <cstring>
+
+
+namespace Lantern {
+
+// Cache aligned, so threads don't false share their counters
+static tbb::enumerable_thread_specific<RenderCounters, tbb::cache_aligned_allocator<RenderCounters>, tbb::ets_key_per_instance> g_threadCounters;
+
+RenderCounters &ThreadCounters() {
+	return g_threadCounters.local();
+}
+
+void RenderCounters::Reset() {
+	memset(this, 0, sizeof(RenderCounters));
+}
+
+void RenderCounters::Add(const RenderCounters &other) {
+	PrimaryRays += other.PrimaryRays;
+	ContinuationRays += other.ContinuationRays;
+	ShadowRays += other.ShadowRays;
+	Paths += other.Paths;
+	for (uint i = 0; i < kBounceHistogramSize; ++i) {
+		BounceHistogram[i] += other.BounceHistogram[i];
+	}
+	RussianRouletteTerminations += other.RussianRouletteTerminations;
+	MaxBounceTerminations += other.MaxBounceTerminations;
+	MediumScatterEvents += other.MediumScatterEvents;
+	MediumWalkTerminations += other.MediumWalkTerminations;
+	LightSampleRejections += other.LightSampleRejections;
+	NaNs += other.NaNs;
+}
+
+RenderStats::RenderStats()
+		: m_lastFrameSeconds(0.0f),
+		  m_totalSeconds(0.0f),
+		  m_numFrames(0u) {
+}
+
+void RenderStats::EndFrame(float seconds) {
+	m_lastFrame.Reset();
+	for (RenderCounters &counters : g_threadCounters) {
+		m_lastFrame.Add(counters);
+		counters.Reset();
+	}
+
+	m_total.Add(m_lastFrame);
+	m_lastFrameSeconds = seconds;
+	m_totalSeconds += seconds;
+	++m_numFrames;
+}
+
+void RenderStats::Reset() {
+	m_lastFrame.Reset();
+	m_total.Reset();
+	m_lastFrameSeconds = 0.0f;
+	m_totalSeconds = 0.0f;
+	m_numFrames = 0u;
+}
+
+void RenderStats::PrintSummary() const {
+	const RenderCounters &total = m_total;
+
+	printf("Render statistics over %u frames (%.2f seconds of rendering)\n", m_numFrames, m_totalSeconds);
+	printf("    Rays:                %llu (%.2f Mrays/s)\n", (unsigned long long)total.TotalRays(), TotalRaysPerSecond() * 1.0e-6f);
+	printf("        Primary:         %llu\n", (unsigned long long)total.PrimaryRays);
+	printf("        Continuation:    %llu\n", (unsigned long long)total.ContinuationRays);
+	printf("        Shadow:          %llu\n", (unsigned long long)total.ShadowRays);
+	printf("    Paths:               %llu\n", (unsigned long long)total.Paths);
+	printf("    Russian roulette:    %llu\n", (unsigned long long)total.RussianRouletteTerminations);
+	printf("    Over max bounces:    %llu\n", (unsigned long long)total.MaxBounceTerminations);
+	printf("    Medium scatters:     %llu\n", (unsigned long long)total.MediumScatterEvents);
+	printf("    Over max walk:       %llu\n", (unsigned long long)total.MediumWalkTerminations);
+	printf("    Light rejections:    %llu\n", (unsigned long long)total.LightSampleRejections);
+	printf("    NaNs:                %llu\n", (unsigned long long)total.NaNs);
+
+	printf("    Bounce histogram:\n");
+	for (uint i = 0; i < RenderCounters::kBounceHistogramSize; ++i) {
+		float percent = total.Paths > 0 ? 100.0f * total.BounceHistogram[i] / total.Paths : 0.0f;
+		printf("        %2u%s %6.2f%%\n", i, i + 1 == RenderCounters::kBounceHistogramSize ? "+" : " ", percent);
+	}
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,90 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+
+
+namespace Lantern {
+
+/**
+ * Counts of what the renderer did. Each thread increments its own copy, and they're summed once per frame
+ */
+struct RenderCounters {
+	RenderCounters() {
+		Reset();
+	}
+
+	// Bucket i counts the paths that ended after i bounces. The last bucket also counts all the longer paths
+	static const uint kBounceHistogramSize = 16;
+
+	uint64 PrimaryRays;
+	uint64 ContinuationRays;
+	// Rays traced to test the visibility of a light
+	uint64 ShadowRays;
+	uint64 Paths;
+	uint64 BounceHistogram[kBounceHistogramSize];
+	uint64 RussianRouletteTerminations;
+	uint64 MaxBounceTerminations;
+	uint64 MediumScatterEvents;
+	// Paths terminated for exceeding Renderer::MaxMediumWalkLength
+	uint64 MediumWalkTerminations;
+	// Light samples that contributed nothing. Either they were occluded, or below the horizon
+	uint64 LightSampleRejections;
+	// Path samples that came out NaN or infinite, and were replaced with black
+	uint64 NaNs;
+
+	void Reset();
+	void Add(const RenderCounters &other);
+	uint64 TotalRays() const { return PrimaryRays + ContinuationRays + ShadowRays; }
+};
+
+/**
+ * Returns the counters of the calling thread. The lookup is a single thread local access,
+ * so it's fine to use on the hot path
+ */
+RenderCounters &ThreadCounters();
+
+/**
+ * Gathers the per-thread counters into per-frame and total statistics
+ */
+class RenderStats {
+public:
+	RenderStats();
+
+private:
+	RenderCounters m_lastFrame;
+	RenderCounters m_total;
+	float m_lastFrameSeconds;
+	float m_totalSeconds;
+	uint m_numFrames;
+
+public:
+	/**
+	 * Sums up and resets the thread counters. Must not be called while a frame is being rendered
+	 *
+	 * @param seconds    How long the frame took to render
+	 */
+	void EndFrame(float seconds);
+	void Reset();
+
+	const RenderCounters &LastFrame() const { return m_lastFrame; }
+	const RenderCounters &Total() const { return m_total; }
+	float LastFrameSeconds() const { return m_lastFrameSeconds; }
+	float TotalSeconds() const { return m_totalSeconds; }
+	uint NumFrames() const { return m_numFrames; }
+
+	float LastFrameRaysPerSecond() const { return m_lastFrameSeconds > 0.0f ? m_lastFrame.TotalRays() / m_lastFrameSeconds : 0.0f; }
+	float TotalRaysPerSecond() const { return m_totalSeconds > 0.0f ? m_total.TotalRays() / m_totalSeconds : 0.0f; }
+
+	/**
+	 * Prints the total statistics to stdout
+	 */
+	void PrintSummary() const;
+};
+
+} // End of namespace Lantern
@@ -9,109 +9,485 @@
 #include "renderer/surface_interaction.h"
 
 #include "scene/scene.h"
+#include "scene/environment_light.h"
 #include "scene/ray.h"
 
 #include "materials/material.h"
 #include "materials/bsdfs/bsdf.h"
 #include "materials/media/medium.h"
+#include "materials/textures/texture.h"
 
 #include "math/uniform_sampler.h"
+#include "math/hash.h"
 #include "math/vector_math.h"
 #include "math/sampling.h"
 
+#include "profiling/trace.h"
+#include "profiling/cycle_counter.h"
+#include "profiling/memory_tracker.h"
+
 #include <tbb/parallel_for.h>
 
 #include <algorithm>
+#include <cmath>
 
 
 namespace Lantern {
 
+/**
+ * Returns true if the light a path finds after sampling this lobe was already counted by the direct lighting at the
+ * previous vertex. The direct lighting can't sample specular lobes, or transmission through rough surfaces
+ */
+static bool DirectLightingCountsLobe(BSDFLobe::Type sampledLobe) {
+	return (sampledLobe & (BSDFLobe::Specular | BSDFLobe::GlossyTransmission)) == 0;
+}
+
+// A direction sampled from a rough lobe stands in for a solid angle of about 1 / pdf around it. We widen the ray
+// cone by a fraction of that, so the textures seen after rough bounces are filtered more, and don't thrash the tile cache
+static const float kRoughBounceConeSpread = 0.125f;
+
+Renderer::Renderer(Scene *scene)
+		: ProgressivePreview(true),
+		  TemporalReprojection(false),
+		  HistoryDecay(0.5f),
+		  MaxHistoryWeight(64.0f),
+		  CachePrimaryHits(false),
+		  PrimaryHitCacheLifetime(16u),
+		  CollectPixelCosts(false),
+		  MaxBounces(1500u),
+		  MaxMediumWalkLength(256u),
+		  GuidedMediumWalks(true),
+		  CheckpointInterval(300.0f),
+		  m_scene(scene),
+		  m_frameNumber(0u),
+		  m_cameraMoved(false),
+		  m_previewScale(1u),
+		  m_lastView(scene->Camera.GetView()),
+		  m_primaryHitCacheFrame(0u),
+		  m_lastCheckpointTime(std::chrono::steady_clock::now()) {
+}
+
+void Renderer::Run(uint numFrames) {
+	auto startTime = std::chrono::steady_clock::now();
+	uint startFrame = m_frameNumber;
+
+	while (m_frameNumber < numFrames) {
+		RenderFrame();
+
+		if (m_frameNumber % 16 == 0 || m_frameNumber == numFrames) {
+			printf("Frame %u / %u\n", m_frameNumber, numFrames);
+		}
+	}
+
+	// Always leave a checkpoint of the finished render
+	if (!CheckpointPath.empty()) {
+		m_checkpointWriter.Wait();
+		SaveCheckpoint(CheckpointPath);
+		m_checkpointWriter.Wait();
+	}
+
+	float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+	printf("Rendered %u frames in %.2f seconds\n", m_frameNumber - startFrame, seconds);
+	m_stats.PrintSummary();
+
+	const TileCache &textureCache = m_scene->TextureCache();
+	uint64 tileLookups = textureCache.Hits() + textureCache.Misses();
+	if (tileLookups != 0) {
+		printf("Texture tile cache: %llu lookups, %.2f%% hits\n", (unsigned long long)tileLookups, 100.0 * textureCache.Hits() / tileLookups);
+	}
+
+	PrintMemoryReport();
+}
+
+bool Renderer::LoadCheckpoint(const std::string &path) {
+	if (!ReadCheckpoint(path, &m_scene->Camera.FrameBuffer, &m_frameNumber)) {
+		return false;
+	}
+
+	// Continue with full resolution accumulation
+	m_cameraMoved = false;
+	m_previewScale = 1u;
+	m_primaryHitCache.Invalidate();
+	m_lastView = m_scene->Camera.GetView();
+
+	return true;
+}
+
+bool Renderer::SaveCheckpoint(const std::string &path) {
+	m_lastCheckpointTime = std::chrono::steady_clock::now();
+	return m_checkpointWriter.WriteAsync(path, m_scene->Camera.FrameBuffer, m_frameNumber);
+}
+
 void Renderer::RenderFrame() {
-	uint width = m_scene->Camera.FrameBuffer.Width;
-	uint height = m_scene->Camera.FrameBuffer.Height;
+	ScopedTrace trace("RenderFrame", m_frameNumber);
+	auto startTime = std::chrono::steady_clock::now();
+
+	FrameBuffer *frameBuffer = &m_scene->Camera.FrameBuffer;
+	CameraView view = m_scene->Camera.GetView();
 
-	const int numTilesX = (width + kTileSize - 1) / kTileSize;
-	const int numTilesY = (height + kTileSize - 1) / kTileSize;
+	if (m_cameraMoved || !CachePrimaryHits) {
+		m_primaryHitCache.Invalidate();
+	}
+	if (m_cameraMoved) {
+		m_pixelCosts.Reset();
+	}
+
+	if (m_cameraMoved && TemporalReprojection && m_previewScale == 1u) {
+		// Keep what we can from the old view
+		// Preview frames are too coarse to be worth reprojecting, so those still go down the path below
+		m_cameraMoved = false;
+		ScopedTrace reprojectTrace("Reproject");
+		frameBuffer->Reproject(m_lastView, view, HistoryDecay, MaxHistoryWeight);
+	} else if (m_cameraMoved) {
+		// Start over at the coarsest preview level
+		m_cameraMoved = false;
+		m_previewScale = ProgressivePreview ? kMaxPreviewScale : 1u;
+		frameBuffer->Reset();
+	} else if (m_previewScale > 1u) {
+		// The camera was still for a frame, so refine the preview
+		// Preview frames are never accumulated, so we clear the old one
+		m_previewScale /= 2;
+		frameBuffer->Reset();
+	}
+
+	uint width = frameBuffer->Width;
+	uint height = frameBuffer->Height;
+
+	uint scale = m_previewScale;
+	uint frameNumber = m_frameNumber;
+
+	// Previews don't use the cache, since they only last a single frame
+	bool buildPrimaryHitCache = false;
+	if (CachePrimaryHits && scale == 1u && (!m_primaryHitCache.IsValid() || m_frameNumber - m_primaryHitCacheFrame >= PrimaryHitCacheLifetime)) {
+		m_primaryHitCache.Prepare(width, height, view.Origin);
+		m_primaryHitCacheFrame = m_frameNumber;
+		buildPrimaryHitCache = true;
+	}
 
-	tbb::parallel_for(size_t(0), size_t(numTilesX * numTilesY), [=](size_t i) {
-		RenderTile(i, width, height, numTilesX, numTilesY);
+	// Previews would only measure the cheap integrator, so we don't collect costs for them
+	PixelCostBuffer *pixelCosts = nullptr;
+	if (CollectPixelCosts && scale == 1u) {
+		if (m_pixelCosts.Width != width || m_pixelCosts.Height != height) {
+			m_pixelCosts.Resize(width, height);
+		}
+		pixelCosts = &m_pixelCosts;
+	}
+
+	m_pathRecorder.BeginFrame();
+
+	tbb::parallel_for(size_t(0), size_t(NumTiles()), [=](size_t i) {
+		if (buildPrimaryHitCache) {
+			BuildPrimaryHitCacheTile(i);
+		}
+		RenderTile(i, frameNumber, scale, pixelCosts);
 	});
 
+	m_pathRecorder.EndFrame();
+	m_stats.EndFrame(std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count());
+
+	m_lastView = view;
+
 	++m_frameNumber;
+
+	// Previews are thrown away as soon as the camera is still, so there's no point saving them
+	if (!CheckpointPath.empty() && scale == 1u) {
+		float secondsSinceCheckpoint = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_lastCheckpointTime).count();
+		if (secondsSinceCheckpoint >= CheckpointInterval) {
+			SaveCheckpoint(CheckpointPath);
+		}
+	}
+}
+
+/**
+ * Traces the camera rays of a tile in packets of kPacketWidth, and stores their hits in the cache
+ *
+ * The packets are filled in pixel order, with all the sub-pixel samples of a pixel next to each other,
+ * so each packet is as coherent as possible
+ */
+template <uint kPacketWidth, typename RayPacket>
+void TracePrimaryHitPackets(Scene *scene, PrimaryHitCache *cache, Ray *rays, uint2 *pixels, uint *samples, uint numRays, 
+                            void (Scene::*intersect)(const int *, RayPacket &) const) {
+	alignas(64) int valid[kPacketWidth];
+	RayPacket packet;
+
+	for (uint start = 0; start < numRays; start += kPacketWidth) {
+		uint count = std::min(kPacketWidth, numRays - start);
+
+		for (uint i = 0; i < kPacketWidth; ++i) {
+			// Pad out partial packets with copies of the first ray, and mask them off
+			Ray &ray = rays[start + (i < count ? i : 0)];
+			valid[i] = i < count ? -1 : 0;
+
+			packet.orgx[i] = ray.Origin.x;
+			packet.orgy[i] = ray.Origin.y;
+			packet.orgz[i] = ray.Origin.z;
+			packet.dirx[i] = ray.Direction.x;
+			packet.diry[i] = ray.Direction.y;
+			packet.dirz[i] = ray.Direction.z;
+			packet.tnear[i] = ray.TNear;
+			packet.tfar[i] = ray.TFar;
+			packet.time[i] = ray.Time;
+			packet.mask[i] = ray.Mask;
+			packet.geomID[i] = INVALID_GEOMETRY_ID;
+			packet.primID[i] = INVALID_PRIMATIVE_ID;
+			packet.instID[i] = INVALID_INSTANCE_ID;
+		}
+
+		(scene->*intersect)(valid, packet);
+
+		for (uint i = 0; i < count; ++i) {
+			Ray &ray = rays[start + i];
+			CachedPrimaryHit &hit = cache->Get(pixels[start + i].x, pixels[start + i].y, samples[start + i]);
+
+			hit.Direction = float3(ray.Direction.x, ray.Direction.y, ray.Direction.z);
+			hit.TFar = packet.tfar[i];
+			hit.GeomID = packet.geomID[i];
+			hit.PrimID = packet.primID[i];
+			hit.U = packet.u[i];
+			hit.V = packet.v[i];
+			if (hit.GeomID != INVALID_GEOMETRY_ID) {
+				hit.Normal = normalize(scene->InterpolateNormal(hit.GeomID, hit.PrimID, hit.U, hit.V));
+			}
+		}
+	}
 }
 
-// MurmurHash3
-inline uint HashMix(uint hash, uint k) {
-	const uint c1 = 0xcc9e2d51;
-	const uint c2 = 0x1b873593;
-	const uint r1 = 15;
-	const uint r2 = 13;
-	const uint m = 5;
-	const uint n = 0xe6546b64;
+void Renderer::BuildPrimaryHitCacheTile(uint index) {
+	ScopedTrace trace("Build primary hit cache tile", index);
+
+	const uint kSamplesPerPixel = PrimaryHitCache::kSamplesPerPixel;
+	const uint kStrataPerAxis = PrimaryHitCache::kStrataPerAxis;
+
+	uint x0, x1, y0, y1;
+	GetTileBounds(index, &x0, &x1, &y0, &y1);
+
+	// Use a different sequence from RenderTile(), so the sub-pixel positions aren't correlated with the paths
+	uint hash = 0u;
+	hash = HashMix(hash, index);
+	hash = HashMix(hash, m_frameNumber);
+	hash = HashFinalize(hash);
+
+	UniformSampler sampler(hash, ~m_frameNumber);
+
+	// Generate all the camera rays of the tile
+	Ray rays[kTileSize * kTileSize * kSamplesPerPixel];
+	uint2 pixels[kTileSize * kTileSize * kSamplesPerPixel];
+	uint samples[kTileSize * kTileSize * kSamplesPerPixel];
+	uint numRays = 0;
+
+	for (uint y = y0; y < y1; ++y) {
+		for (uint x = x0; x < x1; ++x) {
+			for (uint sample = 0; sample < kSamplesPerPixel; ++sample) {
+				// Stratify the filter samples
+				uint strataY = sample / kStrataPerAxis;
+				uint strataX = sample - strataY * kStrataPerAxis;
+
+				float filterU = (strataX + sampler.NextFloat()) / kStrataPerAxis;
+				float filterV = (strataY + sampler.NextFloat()) / kStrataPerAxis;
+
+				// The tracing below fills in the rest of the hit
+				rays[numRays] = m_scene->Camera.CalculateRayFromPixel(x, y, filterU, filterV, &m_primaryHitCache.Get(x, y, sample).FilterWeight);
+				pixels[numRays] = uint2(x, y);
+				samples[numRays] = sample;
+				++numRays;
+			}
+		}
+	}
+
+	ThreadCounters().PrimaryRays += numRays;
+
+	uint packetWidth = m_scene->PacketWidth();
+	if (packetWidth >= 16u) {
+		TracePrimaryHitPackets<16u, RTCRay16>(m_scene, &m_primaryHitCache, rays, pixels, samples, numRays, &Scene::Intersect16);
+	} else if (packetWidth >= 8u) {
+		TracePrimaryHitPackets<8u, RTCRay8>(m_scene, &m_primaryHitCache, rays, pixels, samples, numRays, &Scene::Intersect8);
+	} else {
+		for (uint i = 0; i < numRays; ++i) {
+			Ray &ray = rays[i];
+			m_scene->Intersect(ray);
+
+			CachedPrimaryHit &hit = m_primaryHitCache.Get(pixels[i].x, pixels[i].y, samples[i]);
+			hit.Direction = float3(ray.Direction.x, ray.Direction.y, ray.Direction.z);
+			hit.TFar = ray.TFar;
+			hit.GeomID = ray.GeomID;
+			hit.PrimID = ray.PrimID;
+			hit.U = ray.U;
+			hit.V = ray.V;
+			if (hit.GeomID != INVALID_GEOMETRY_ID) {
+				hit.Normal = normalize(m_scene->InterpolateNormal(hit.GeomID, hit.PrimID, hit.U, hit.V));
+			}
+		}
+	}
+}
 
-	k *= c1;
-	k = (k << r1) | (k >> (32 - r1));
-	k *= c2;
+void Renderer::RenderTiles(uint frameNumber, uint firstTile, uint numTiles) {
+	auto startTime = std::chrono::steady_clock::now();
 
-	hash ^= k;
-	hash = ((hash << r2) | (hash >> (32 - r2))) * m + n;
+	tbb::parallel_for(size_t(firstTile), size_t(firstTile + numTiles), [=](size_t i) {
+		RenderTile(i, frameNumber, 1u, nullptr);
+	});
 
-	return hash;
+	m_stats.EndFrame(std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count());
 }
 
-// MurmurHash3
-inline uint HashFinalize(uint hash) {
-	hash ^= hash >> 16;
-	hash *= 0x85ebca6b;
-	hash ^= hash >> 13;
-	hash *= 0xc2b2ae35;
-	hash ^= hash >> 16;
+uint Renderer::NumTiles() const {
+	uint width = m_scene->Camera.FrameBuffer.Width;
+	uint height = m_scene->Camera.FrameBuffer.Height;
+
+	uint numTilesX = (width + kTileSize - 1) / kTileSize;
+	uint numTilesY = (height + kTileSize - 1) / kTileSize;
 
-	return hash;
+	return numTilesX * numTilesY;
 }
 
-void Renderer::RenderTile(uint index, uint width, uint height, uint numTilesX, uint numTilesY) const {
+void Renderer::GetTileBounds(uint index, uint *x0, uint *x1, uint *y0, uint *y1) const {
+	uint width = m_scene->Camera.FrameBuffer.Width;
+	uint height = m_scene->Camera.FrameBuffer.Height;
+	uint numTilesX = (width + kTileSize - 1) / kTileSize;
+
 	uint tileY = index / numTilesX;
 	uint tileX = index - tileY * numTilesX;
 
-	uint x0 = tileX * kTileSize;
-	uint x1 = std::min(x0 + kTileSize, width);
-	uint y0 = tileY * kTileSize;
-	uint y1 = std::min(y0 + kTileSize, height);
+	*x0 = tileX * kTileSize;
+	*x1 = std::min(*x0 + kTileSize, width);
+	*y0 = tileY * kTileSize;
+	*y1 = std::min(*y0 + kTileSize, height);
+}
+
+void Renderer::RenderTile(uint index, uint frameNumber, uint scale, PixelCostBuffer *pixelCosts) const {
+	ScopedTrace trace("Tile", index);
+
+	uint x0, x1, y0, y1;
+	GetTileBounds(index, &x0, &x1, &y0, &y1);
 
 	uint hash = 0u;
 	hash = HashMix(hash, index);
-	hash = HashMix(hash, m_frameNumber);
+	hash = HashMix(hash, frameNumber);
 	hash = HashFinalize(hash);
 	
-	UniformSampler sampler(hash, m_frameNumber);
-
-	for (uint y = y0; y < y1; ++y) {
-		for (uint x = x0; x < x1; ++x) {
-			RenderPixel(x, y, &sampler);
+	UniformSampler sampler(hash, frameNumber);
+
+	FrameBuffer *frameBuffer = &m_scene->Camera.FrameBuffer;
+	RenderCounters &counters = ThreadCounters();
+
+	if (scale == 1u) {
+		for (uint y = y0; y < y1; ++y) {
+			for (uint x = x0; x < x1; ++x) {
+				// The rays and path length come from the difference in the thread's counters
+				uint64 startCycles = 0;
+				uint64 startRays = 0;
+				uint64 startContinuationRays = 0;
+				if (pixelCosts != nullptr) {
+					startRays = counters.TotalRays();
+					startContinuationRays = counters.ContinuationRays;
+					startCycles = ReadCycleCounter();
+				}
+
+				PrimaryHit primaryHit;
+				float3 color = RenderPixel(x, y, frameNumber, &sampler, false, &primaryHit);
+
+				if (pixelCosts != nullptr) {
+					uint64 cycles = ReadCycleCounter() - startCycles;
+					pixelCosts->SplatCost(x, y, (float)cycles, (float)(counters.TotalRays() - startRays), (float)(counters.ContinuationRays - startContinuationRays + 1));
+				}
+
+				frameBuffer->SplatPrimaryHit(x, y, primaryHit.Depth, primaryHit.GeomID);
+				frameBuffer->SplatPixel(x, y, color);
+				frameBuffer->SplatFeatures(x, y, primaryHit.Albedo, primaryHit.Normal, primaryHit.Depth);
+			}
+		}
+	} else {
+		// kTileSize is a multiple of all the preview scales, so the blocks never straddle tiles
+		// We trace a single path per block, and upscale by splatting the result to the whole block
+		for (uint y = y0; y < y1; y += scale) {
+			for (uint x = x0; x < x1; x += scale) {
+				PrimaryHit primaryHit;
+				float3 color = RenderPixel(x, y, frameNumber, &sampler, true, &primaryHit);
+				frameBuffer->SplatBlock(x, y, scale, color);
+			}
 		}
 	}
 }
 
-void Renderer::RenderPixel(uint x, uint y, UniformSampler *sampler) const {
-	Ray ray = m_scene->Camera.CalculateRayFromPixel(x, y, sampler);
+float3 Renderer::RenderPixel(uint x, uint y, uint frameNumber, UniformSampler *sampler, bool preview, PrimaryHit *primaryHit) const {
+	RenderCounters &counters = ThreadCounters();
+	++counters.Paths;
+
+	// Pick one of the cached camera ray hits, if we have them
+	const CachedPrimaryHit *cachedHit = nullptr;
+	Ray ray;
+	float filterWeight;
+	if (!preview && CachePrimaryHits && m_primaryHitCache.IsValid()) {
+		uint sample = std::min((uint)(sampler->NextFloat() * PrimaryHitCache::kSamplesPerPixel), PrimaryHitCache::kSamplesPerPixel - 1);
+		cachedHit = &m_primaryHitCache.Get(x, y, sample);
+
+		ray.Origin = m_primaryHitCache.Origin();
+		ray.Direction = cachedHit->Direction;
+		ray.TNear = 0.0f;
+		ray.TFar = cachedHit->TFar;
+		ray.GeomID = cachedHit->GeomID;
+		ray.PrimID = cachedHit->PrimID;
+		ray.InstID = INVALID_INSTANCE_ID;
+		ray.U = cachedHit->U;
+		ray.V = cachedHit->V;
+		ray.Mask = 0xFFFFFFFF;
+		ray.Time = 0.0f;
+		filterWeight = cachedHit->FilterWeight;
+	} else {
+		ray = m_scene->Camera.CalculateRayFromPixel(x, y, sampler, &filterWeight);
+	}
+
+	LANTERN_BEGIN_PATH(m_pathRecorder, x, y, frameNumber);
+	LANTERN_RECORD_PATH_EVENT(m_pathRecorder, PathEventType::Camera, ray.Origin, ray.Direction, float3(1.0f));
 
 	float3 color(0.0f);
 	float3 throughput(1.0f);
 	SurfaceInteraction interaction;
 	interaction.IORi = 1.0f; // Air
 	Medium *medium = nullptr;
+	MediumWalk walk;
+	walk.Guided = GuidedMediumWalks;
+	uint walkLength = 0;
+	// Shadow rays can't pass refractive boundaries, so there's no point sampling the lights from a medium behind one
+	bool sampleLightsInMedium = false;
+	// Whether the direct lighting at the previous vertex already counted the light or background the path finds next
+	bool directLightingCounted = false;
 	bool hitSurface = false;
+	// The ray cone, for filtering textures. Akenine-Moller et al. 2019, "Texture Level of Detail Strategies for Real-Time Ray Tracing"
+	float coneWidth = 0.0f;
+	float coneSpread = m_scene->Camera.PixelSpreadAngle();
 
 	// Bounce the ray around the scene
+	// Previews use a cheaper integrator. Fewer bounces and no participating media
 	uint bounces = 0;
-	const uint maxBounces = 1500;
+	const uint maxBounces = preview ? kPreviewMaxBounces : MaxBounces;
 	for (; bounces < maxBounces; ++bounces) {
-		m_scene->Intersect(ray);
+		if (bounces != 0 || cachedHit == nullptr) {
+			m_scene->Intersect(ray);
+			if (bounces == 0) {
+				++counters.PrimaryRays;
+			} else {
+				++counters.ContinuationRays;
+			}
+		}
 
-		// The ray missed. Return the background color
-		if (ray.GeomID == INVALID_GEOMETRY_ID) {
-			color += throughput * m_scene->BackgroundColor;
+		if (bounces == 0) {
+			primaryHit->GeomID = ray.GeomID;
+			primaryHit->Depth = ray.GeomID == (int)INVALID_GEOMETRY_ID ? infinity : ray.TFar;
+		}
+
+		// The ray missed. Return the environment, or the background color if there isn't one
+		if (ray.GeomID == (int)INVALID_GEOMETRY_ID) {
+			const EnvironmentLight *environment = m_scene->GetEnvironmentLight();
+			float3 background = environment != nullptr ? environment->Le(normalize(ray.Direction)) : m_scene->BackgroundColor;
+			if (bounces == 0) {
+				primaryHit->Albedo = background;
+			}
+			// Like the area lights, the environment is already counted by the direct lighting, unless we couldn't sample it
+			if (environment == nullptr || !directLightingCounted) {
+				color += throughput * background;
+			}
+			LANTERN_RECORD_PATH_EVENT(m_pathRecorder, PathEventType::Miss, ray.Origin, ray.Direction, throughput);
 			break;
 		}
 
@@ -120,22 +496,42 @@ void Renderer::RenderPixel(uint x, uint y, UniformSampler *sampler) const {
 		
 		// Calculate any transmission
 		if (medium != nullptr) {
-			float weight = 1.0f;
-			float pdf = 1.0f;
-			float distance = medium->SampleDistance(sampler, ray.TFar, &weight, &pdf);
-			float3 transmission = medium->Transmission(distance);
-			throughput = throughput * weight * transmission;
+			float3 weight(1.0f);
+			float distance = medium->SampleDistance(sampler, ray.Origin, normalize(ray.Direction), ray.TFar, &walk, &weight);
+			throughput = throughput * weight;
 
 			if (distance < ray.TFar) {
 				// Create a scatter event
 				hitSurface = false;
 				
 				ray.Origin = ray.Origin + ray.Direction * distance;
+				coneWidth += coneSpread * distance;
+				float3a wo = normalize(ray.Direction);
+
+				// Calculate the direct lighting
+				if (sampleLightsInMedium) {
+					SurfaceInteraction mediumInteraction;
+					mediumInteraction.Position = ray.Origin;
+					mediumInteraction.OutputDirection = -wo;
+					mediumInteraction.InMedium = true;
+					mediumInteraction.Medium = medium;
+					color += throughput * SampleOneLightInMedium(sampler, mediumInteraction, medium);
+				}
+
+				// If so, the MIS above already counted the light the scattered ray might hit
+				directLightingCounted = sampleLightsInMedium;
+
+				++counters.MediumScatterEvents;
+				if (++walkLength > MaxMediumWalkLength) {
+					++counters.MediumWalkTerminations;
+					LANTERN_RECORD_PATH_EVENT(m_pathRecorder, PathEventType::MaxBounces, ray.Origin, wo, throughput);
+					break;
+				}
 
 				// Reset the other ray properties
-				float directionPdf;
-				float3a wo = normalize(ray.Direction);
-				ray.Direction = medium->SampleScatterDirection(sampler, wo, &directionPdf);
+				float3 directionWeight(1.0f);
+				ray.Direction = medium->SampleWalkDirection(sampler, wo, walk, &directionWeight);
+				throughput = throughput * directionWeight;
 				ray.TNear = 0.001f;
 				ray.TFar = infinity;
 				ray.GeomID = INVALID_GEOMETRY_ID;
@@ -143,6 +539,8 @@ void Renderer::RenderPixel(uint x, uint y, UniformSampler *sampler) const {
 				ray.InstID = INVALID_INSTANCE_ID;
 				ray.Mask = 0xFFFFFFFF;
 				ray.Time = 0.0f;
+
+				LANTERN_RECORD_PATH_EVENT(m_pathRecorder, PathEventType::MediumScatter, ray.Origin, ray.Direction, throughput);
 			}
 		}
 
@@ -153,16 +551,36 @@ void Renderer::RenderPixel(uint x, uint y, UniformSampler *sampler) const {
 			// Otherwise, GetLight will return nullptr
 			Light *light = m_scene->GetLight(ray.GeomID);
 
-			// If this is the first bounce or if we just had a specular bounce,
+			// If this is the first bounce or if the direct lighting couldn't have sampled the light,
 			// we need to add the emmisive light
-			if ((bounces == 0 || (interaction.SampledLobe & BSDFLobe::Specular) != 0) && light != nullptr) {
+			if (!directLightingCounted && light != nullptr) {
 				color += throughput * light->Le();
 			}
 
 			interaction.Position = ray.Origin + ray.Direction * ray.TFar;
-			interaction.Normal = normalize(m_scene->InterpolateNormal(ray.GeomID, ray.PrimID, ray.U, ray.V));
+			if (bounces == 0 && cachedHit != nullptr) {
+				interaction.Normal = cachedHit->Normal;
+			} else {
+				interaction.Normal = normalize(m_scene->InterpolateNormal(ray.GeomID, ray.PrimID, ray.U, ray.V));
+			}
 			interaction.OutputDirection = normalize(-ray.Direction);
 			interaction.IORo = 0.0f;
+			interaction.Medium = medium;
+
+			coneWidth += coneSpread * ray.TFar;
+			interaction.TextureColor = float3(1.0f);
+			float2 texCoord;
+			float lodBias;
+			if (material->AlbedoTexture != nullptr && m_scene->InterpolateTexCoords(ray.GeomID, ray.PrimID, ray.U, ray.V, &texCoord, &lodBias)) {
+				// The cone's footprint stretches as the surface turns away from it
+				float cosTheta = std::max(std::abs(dot(interaction.OutputDirection, interaction.Normal)), 0.01f);
+				interaction.TextureColor = material->AlbedoTexture->Sample(texCoord, lodBias + std::log2(coneWidth / cosTheta));
+			}
+
+			if (bounces == 0) {
+				primaryHit->Albedo = material->BSDF->Albedo(interaction);
+				primaryHit->Normal = interaction.Normal;
+			}
 
 
 			// Calculate the direct lighting
@@ -170,17 +588,41 @@ void Renderer::RenderPixel(uint x, uint y, UniformSampler *sampler) const {
 
 
 			// Get the new ray direction
-			// Choose the direction based on the bsdf		
+			// Choose the direction based on the bsdf. Sample() can flip the normal, so we keep the original for the medium tracking below
+			float3a surfaceNormal = interaction.Normal;
 			material->BSDF->Sample(interaction, sampler);
 			float pdf = material->BSDF->Pdf(interaction);
+			if (pdf == 0.0f) {
+				// The sampled direction went below the surface
+				break;
+			}
+			if (!IsSpecular(interaction.SampledLobe)) {
+				coneSpread += kRoughBounceConeSpread / std::sqrt(pdf);
+			}
 
 			// Accumulate the weight
 			throughput = throughput * material->BSDF->Eval(interaction) / pdf;
 
+			LANTERN_RECORD_PATH_EVENT(m_pathRecorder, PathEventType::Bounce, interaction.Position, interaction.InputDirection, throughput);
+
+			// Shadow rays pass straight through index matched surfaces, so crossing one leaves the
+			// previous vertex's direct lighting in charge of whatever the path finds behind it
+			bool transmitted = (interaction.SampledLobe & BSDFLobe::Transmission) != 0;
+			if (!transmitted || !material->BSDF->IsIndexMatched()) {
+				directLightingCounted = DirectLightingCountsLobe(interaction.SampledLobe);
+			}
+
 			// Update the current IOR and medium if we refracted
-			if (interaction.SampledLobe == BSDFLobe::SpecularTransmission) {
+			// We only enter the material's medium if we refracted into the back side of the surface. Otherwise, we're leaving it
+			if (transmitted) {
 				interaction.IORi = interaction.IORo;
-				medium = material->Medium;
+				bool entering = dot(interaction.InputDirection, surfaceNormal) < 0.0f;
+				medium = (preview || !entering) ? nullptr : material->Medium;
+				if (medium != nullptr) {
+					walk.ExitNormal = normalize(surfaceNormal);
+					walkLength = 0;
+					sampleLightsInMedium = material->BSDF->IsIndexMatched();
+				}
 			}
 
 			// Shoot a new ray
@@ -203,6 +645,8 @@ void Renderer::RenderPixel(uint x, uint y, UniformSampler *sampler) const {
 		if (bounces > 3) {
 			float p = std::max(throughput.x, std::max(throughput.y, throughput.z));
 			if (sampler->NextFloat() > p) {
+				++counters.RussianRouletteTerminations;
+				LANTERN_RECORD_PATH_EVENT(m_pathRecorder, PathEventType::RussianRoulette, ray.Origin, ray.Direction, throughput);
 				break;
 			}
 
@@ -211,10 +655,21 @@ void Renderer::RenderPixel(uint x, uint y, UniformSampler *sampler) const {
 	}
 
 	if (bounces == maxBounces) {
-		printf("Over max bounces");
+		++counters.MaxBounceTerminations;
+		LANTERN_RECORD_PATH_EVENT(m_pathRecorder, PathEventType::MaxBounces, ray.Origin, ray.Direction, throughput);
 	}
+	++counters.BounceHistogram[std::min(bounces, RenderCounters::kBounceHistogramSize - 1)];
 
-	m_scene->Camera.FrameBuffer.SplatPixel(x, y, color);
+	// Filters with negative lobes give some samples a negative weight
+	color *= filterWeight;
+
+	// A single bad sample would poison the pixel forever, so we throw it away
+	if (!std::isfinite(color.x) || !std::isfinite(color.y) || !std::isfinite(color.z)) {
+		++counters.NaNs;
+		color = float3(0.0f);
+	}
+
+	return color;
 }
 
 float3 Renderer::SampleOneLight(UniformSampler *sampler, SurfaceInteraction interaction, BSDF *bsdf, Light *hitLight) const {
@@ -228,6 +683,11 @@ float3 Renderer::SampleOneLight(UniformSampler *sampler, SurfaceInteraction inte
 		return float3(0.0f);
 	}
 
+	// The lights can't sample a specular bsdf, and the path itself picks up whatever light it finds after one
+	if ((bsdf->SupportedLobes & ~BSDFLobe::Specular) == 0) {
+		return float3(0.0f);
+	}
+
 	// Don't let a light contribute light to itself
 	// Choose another one
 	Light *light;
@@ -243,11 +703,21 @@ float3 Renderer::EstimateDirect(Light *light, UniformSampler *sampler, SurfaceIn
 	float3 f;
 	float lightPdf, scatteringPdf;
 
+	// Glossy surfaces are two sided. Facing the normal towards the viewer means the lights' horizon check only lets
+	// reflections through. Transmission through rough dielectrics is picked up by the path instead.
+	// The bsdfs still get the original normal, since the dielectrics use it to tell whether they're inside
+	float3a surfaceNormal = interaction.Normal;
+	float3a horizonNormal = surfaceNormal;
+	if ((bsdf->SupportedLobes & BSDFLobe::Glossy) != 0 && dot(interaction.OutputDirection, surfaceNormal) < 0.0f) {
+		horizonNormal = -surfaceNormal;
+	}
 
 	// Sample lighting with multiple importance sampling
 	// Only sample if the BRDF is non-specular 
 	if ((bsdf->SupportedLobes & ~BSDFLobe::Specular) != 0) {
+		interaction.Normal = horizonNormal;
 		float3 Li = light->SampleLi(sampler, m_scene, interaction, &lightPdf);
+		interaction.Normal = surfaceNormal;
 
 		// Make sure the pdf isn't zero and the radiance isn't black
 		if (lightPdf != 0.0f && !all(Li)) {
@@ -258,7 +728,11 @@ float3 Renderer::EstimateDirect(Light *light, UniformSampler *sampler, SurfaceIn
 			if (scatteringPdf != 0.0f && !all(f)) {
 				float weight = PowerHeuristic(1, lightPdf, 1, scatteringPdf);
 				directLighting += f * Li * weight / lightPdf;
+
+				LANTERN_RECORD_PATH_EVENT(m_pathRecorder, PathEventType::NextEventEstimation, interaction.Position, interaction.InputDirection, f * Li * weight / lightPdf);
 			}
+		} else {
+			++ThreadCounters().LightSampleRejections;
 		}
 	}
 
@@ -268,19 +742,62 @@ float3 Renderer::EstimateDirect(Light *light, UniformSampler *sampler, SurfaceIn
 	f = bsdf->Eval(interaction);
 	scatteringPdf = bsdf->Pdf(interaction);
 	if (scatteringPdf != 0.0f && !all(f)) {
-		lightPdf = light->PdfLi(m_scene, interaction);
+		float3 Li;
+		interaction.Normal = horizonNormal;
+		lightPdf = light->PdfLi(sampler, m_scene, interaction, &Li);
 		if (lightPdf == 0.0f) {
 			// We didn't hit anything, so ignore the brdf sample
 			return directLighting;
 		}
 
 		float weight = PowerHeuristic(1, scatteringPdf, 1, lightPdf);
-		float3 Li = light->Le();
 		directLighting += f * Li * weight / scatteringPdf;
 	}
 
 	return directLighting;
 }
 
+float3 Renderer::SampleOneLightInMedium(UniformSampler *sampler, SurfaceInteraction interaction, const Medium *medium) const {
+	std::size_t numLights = m_scene->NumLights();
+	if (numLights == 0) {
+		return float3(0.0f);
+	}
+
+	Light *light = m_scene->RandomOneLight(sampler);
+
+	return numLights * EstimateDirectInMedium(light, sampler, interaction, medium);
+}
+
+float3 Renderer::EstimateDirectInMedium(Light *light, UniformSampler *sampler, SurfaceInteraction &interaction, const Medium *medium) const {
+	// Same as EstimateDirect(), but with the phase function in place of the bsdf
+	// The phase functions are sampled exactly, so their value is the same as their pdf
+	float3 directLighting = float3(0.0f);
+	float lightPdf, phasePdf;
+	// The media work with the direction the ray was travelling in
+	float3a wo = -interaction.OutputDirection;
+
+	// Sample lighting with multiple importance sampling
+	float3 Li = light->SampleLi(sampler, m_scene, interaction, &lightPdf);
+	if (lightPdf != 0.0f && !all(Li)) {
+		float phase = medium->ScatterDirectionPdf(interaction.InputDirection, wo);
+		float weight = PowerHeuristic(1, lightPdf, 1, phase);
+		directLighting += phase * Li * weight / lightPdf;
+
+		LANTERN_RECORD_PATH_EVENT(m_pathRecorder, PathEventType::NextEventEstimation, interaction.Position, interaction.InputDirection, phase * Li * weight / lightPdf);
+	} else {
+		++ThreadCounters().LightSampleRejections;
+	}
+
+	// Sample the phase function with multiple importance sampling
+	interaction.InputDirection = medium->SampleScatterDirection(sampler, wo, &phasePdf);
+	lightPdf = light->PdfLi(sampler, m_scene, interaction, &Li);
+	if (lightPdf != 0.0f) {
+		float weight = PowerHeuristic(1, phasePdf, 1, lightPdf);
+		directLighting += Li * weight;
+	}
+
+	return directLighting;
+}
+
 
 } // End of namespace Lantern
@@ -9,6 +9,17 @@
 #include "math/int_types.h"
 #include "math/vector_types.h"
 
+#include "camera/pinhole_camera.h"
+
+#include "renderer/primary_hit_cache.h"
+#include "renderer/checkpoint.h"
+#include "renderer/path_recorder.h"
+#include "renderer/render_stats.h"
+#include "renderer/pixel_cost_buffer.h"
+
+#include <chrono>
+#include <string>
+
 
 namespace Lantern {
 
@@ -17,28 +28,178 @@ struct SurfaceInteraction;
 class BSDF;
 class Scene;
 class Light;
+class Medium;
+
+/**
+ * Information about where the camera ray of a path landed
+ * Misses have the background color as their albedo, and a zero normal
+ */
+struct PrimaryHit {
+	PrimaryHit()
+		: Depth(infinity),
+		  GeomID(INVALID_GEOMETRY_ID),
+		  Albedo(0.0f),
+		  Normal(0.0f) {
+	}
+
+	float Depth;
+	uint GeomID;
+	float3 Albedo;
+	float3 Normal;
+};
 
 class Renderer {
 public:
-	Renderer(Scene *scene)
-		: m_scene(scene),
-		  m_frameNumber(0u) {
-	};
+	Renderer(Scene *scene);
+
+public:
+	/**
+	 * If true, camera moves restart rendering at 1/8th resolution with a cheaper integrator,
+	 * and refine to 1/4, 1/2, and finally full resolution on each frame without further input.
+	 * Full resolution accumulation only starts once the camera is still
+	 */
+	bool ProgressivePreview;
+	/**
+	 * If true, camera moves reproject the accumulated samples into the new view, rather than throwing
+	 * them away. Pixels that become disoccluded are rejected on their first new sample.
+	 * This takes priority over ProgressivePreview when the camera moves during full resolution accumulation
+	 */
+	bool TemporalReprojection;
+	/** The factor applied to the weight of the reprojected history on each camera move */
+	float HistoryDecay;
+	/** The maximum weight a pixel's reprojected history can have, in samples */
+	float MaxHistoryWeight;
+	/**
+	 * If true, camera ray hits are traced in packets and cached while the camera is static.
+	 * Frames pick from the cached hits, rather than tracing their own camera rays
+	 */
+	bool CachePrimaryHits;
+	/** The number of frames before the cached camera rays are re-traced with new sub-pixel positions */
+	uint PrimaryHitCacheLifetime;
+	/**
+	 * If true, the cycles, rays, and path length of every full resolution sample are accumulated per pixel.
+	 * The costs are reset whenever the camera moves
+	 */
+	bool CollectPixelCosts;
+	/** The maximum number of surface bounces and medium scatter events in a full resolution path */
+	uint MaxBounces;
+	/**
+	 * The maximum number of scatter events in a single walk through a medium. Longer walks are terminated.
+	 * This loses a little energy in dense media, but bounds the cost of a path
+	 */
+	uint MaxMediumWalkLength;
+	/**
+	 * If true, walks through media that support it are biased towards the surface they entered through.
+	 * This cuts the length of walks through dense, high albedo media by an order of magnitude. See MediumWalk
+	 */
+	bool GuidedMediumWalks;
+	/** If not empty, the render state is periodically checkpointed to this file */
+	std::string CheckpointPath;
+	/** The minimum number of seconds between checkpoints */
+	float CheckpointInterval;
 
 private:
 	static const uint kTileSize = 8;
+	static const uint kMaxPreviewScale = 8;
+	static const uint kPreviewMaxBounces = 4;
 
 	Scene *m_scene;
 	uint m_frameNumber;
 
+	bool m_cameraMoved;
+	uint m_previewScale;
+	// The camera view the FrameBuffer samples were rendered with
+	CameraView m_lastView;
+
+	PrimaryHitCache m_primaryHitCache;
+	uint m_primaryHitCacheFrame;
+
+	CheckpointWriter m_checkpointWriter;
+	std::chrono::steady_clock::time_point m_lastCheckpointTime;
+
+	PathRecorder m_pathRecorder;
+
+	RenderStats m_stats;
+
+	PixelCostBuffer m_pixelCosts;
+
 public:
+	/**
+	 * Renders without a Visualizer, until numFrames frames have been accumulated in total.
+	 * Frames restored from a checkpoint count towards the total
+	 */
+	void Run(uint numFrames);
 	void RenderFrame();
+	/**
+	 * Restores the FrameBuffer and frame number from a checkpoint, so rendering continues
+	 * the exact sample sequence it was on when the checkpoint was written.
+	 * Resuming is only bit-exact if the primary hit cache is disabled, since the cache
+	 * generations restart at the resumed frame
+	 *
+	 * @param path    The checkpoint file
+	 * @return        False if the checkpoint couldn't be read, or doesn't match the current FrameBuffer
+	 */
+	bool LoadCheckpoint(const std::string &path);
+	/**
+	 * Writes a checkpoint of the current render state on a background thread
+	 *
+	 * @param path    The checkpoint file
+	 * @return        False if the previous checkpoint is still being written
+	 */
+	bool SaveCheckpoint(const std::string &path);
+	Scene *GetScene() const { return m_scene; }
+	uint FrameNumber() const { return m_frameNumber; }
+	void SetFrameNumber(uint frameNumber) { m_frameNumber = frameNumber; }
+
+	/**
+	 * Renders a range of tiles at full resolution, exactly as RenderFrame() would when rendering
+	 * frame frameNumber. The samples are added to the FrameBuffer.
+	 * Used to split frames across processes. The frame number isn't modified
+	 *
+	 * @param frameNumber    The frame whose samples to render. Seeds the tile samplers
+	 * @param firstTile      The index of the first tile to render
+	 * @param numTiles       The number of tiles to render
+	 */
+	void RenderTiles(uint frameNumber, uint firstTile, uint numTiles);
+	uint NumTiles() const;
+	/**
+	 * Returns the pixel bounds of a tile. x1 and y1 are exclusive
+	 */
+	void GetTileBounds(uint index, uint *x0, uint *x1, uint *y0, uint *y1) const;
+	/**
+	 * Tells the renderer that the camera has changed, and that the accumulated samples are now invalid.
+	 * The FrameBuffer will be reset at the start of the next frame
+	 */
+	void OnCameraMoved() { m_cameraMoved = true; }
+	/**
+	 * Returns the size of the pixel blocks that the last frame was rendered with.
+	 * IE. 1 is full resolution, 8 is 1/8th resolution
+	 */
+	uint PreviewScale() const { return m_previewScale; }
+	/**
+	 * The paths of the frames are only recorded if LANTERN_ENABLE_PATH_RECORDING is defined
+	 */
+	PathRecorder &GetPathRecorder() { return m_pathRecorder; }
+	/**
+	 * The counters of the last frame, and the totals since the renderer was created
+	 */
+	const RenderStats &Stats() const { return m_stats; }
+	/**
+	 * Empty until a frame is rendered with CollectPixelCosts enabled
+	 */
+	const PixelCostBuffer &PixelCosts() const { return m_pixelCosts; }
 
 private:
-	void RenderTile(uint index, uint width, uint height, uint numTilesX, uint numTilesY) const;
-	void RenderPixel(uint x, uint y, UniformSampler *sampler) const;
+	void BuildPrimaryHitCacheTile(uint index);
+	void RenderTile(uint index, uint frameNumber, uint scale, PixelCostBuffer *pixelCosts) const;
+	float3 RenderPixel(uint x, uint y, uint frameNumber, UniformSampler *sampler, bool preview, PrimaryHit *primaryHit) const;
 	float3 SampleOneLight(UniformSampler *sampler, SurfaceInteraction interaction, BSDF *bsdf, Light *hitLight) const;
 	float3 EstimateDirect(Light *light, UniformSampler *sampler, SurfaceInteraction &interaction, BSDF *bsdf) const;
+	/**
+	 * Next event estimation for a scatter event inside a medium. Light samples are MIS weighted against phase function samples
+	 */
+	float3 SampleOneLightInMedium(UniformSampler *sampler, SurfaceInteraction interaction, const Medium *medium) const;
+	float3 EstimateDirectInMedium(Light *light, UniformSampler *sampler, SurfaceInteraction &interaction, const Medium *medium) const;
 };
 
 } // End of namespace Lantern
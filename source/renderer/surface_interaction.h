@@ -13,11 +13,16 @@
 
 namespace Lantern {
 
+class Medium;
+
 struct SurfaceInteraction {
 	SurfaceInteraction()
 		: SampledLobe(BSDFLobe::Null), 
 		  IORi(0.0f), 
-		  IORo(0.0f) {
+		  IORo(0.0f),
+		  InMedium(false),
+		  Medium(nullptr),
+		  TextureColor(1.0f) {
 	}
 
 	float3a Position;
@@ -27,6 +32,12 @@ struct SurfaceInteraction {
 	BSDFLobe::Type SampledLobe;
 	float IORi;
 	float IORo;
+	// True for scatter events inside a medium. They have no normal, and so no horizon
+	bool InMedium;
+	// The medium the interaction is in, or nullptr. Shadow rays are attenuated by it
+	Medium *Medium;
+	// The material's albedo texture at the interaction, or 1 if it doesn't have one
+	float3 TextureColor;
 };
 
 } // End of namespace Lantern
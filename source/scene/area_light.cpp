@@ -11,6 +11,7 @@
 #include "math/sampling.h"
 
 #include "renderer/surface_interaction.h"
+#include "renderer/render_stats.h"
 
 
 namespace Lantern {
@@ -30,7 +31,7 @@ float3 AreaLight::SampleLi(UniformSampler *sampler, Scene *scene, SurfaceInterac
 	interaction.InputDirection = direction;
 
 	// Check that the point on the circle is above the horizon
-	if (dot(direction, interaction.Normal) <= 0.0f) {
+	if (!interaction.InMedium && dot(direction, interaction.Normal) <= 0.0f) {
 		*pdf = 0.0f;
 		return float3(0.0f);
 	}
@@ -47,8 +48,10 @@ float3 AreaLight::SampleLi(UniformSampler *sampler, Scene *scene, SurfaceInterac
 	ray.Mask = 0xFFFFFFFF;
 	ray.Time = 0.0f;
 
-	scene->Intersect(ray);
-	if (ray.GeomID != m_geomId) {
+	++ThreadCounters().ShadowRays;
+	float3 transmittance;
+	scene->IntersectShadowRay(ray, interaction.Medium, sampler, &transmittance);
+	if (ray.GeomID != (int)m_geomId) {
 		*pdf = 0.0f;
 		return float3(0.0f);
 	}
@@ -58,14 +61,14 @@ float3 AreaLight::SampleLi(UniformSampler *sampler, Scene *scene, SurfaceInterac
 	float distanceSquared = sqr_length(intersectionPoint - interaction.Position);
 	*pdf = distanceSquared / (std::abs(dot(normalize(scene->InterpolateNormal(ray.GeomID, ray.PrimID, ray.U, ray.V)), -direction)) * m_area);
 
-	// Return the full radiance value
+	// Return the radiance that makes it through any media
 	// The value will be attenuated by the BRDF
-	return m_radiance;
+	return m_radiance * transmittance;
 }
 
-float AreaLight::PdfLi(Scene *scene, SurfaceInteraction &interaction) const {
+float AreaLight::PdfLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float3 *Li) const {
 	// Check that wi is above the horizon
-	if (dot(interaction.InputDirection, interaction.Normal) <= 0.0f) {
+	if (!interaction.InMedium && dot(interaction.InputDirection, interaction.Normal) <= 0.0f) {
 		return 0.0f;
 	}
 
@@ -81,10 +84,13 @@ float AreaLight::PdfLi(Scene *scene, SurfaceInteraction &interaction) const {
 	ray.Mask = 0xFFFFFFFF;
 	ray.Time = 0.0f;
 
-	scene->Intersect(ray);
-	if (ray.GeomID != m_geomId) {
+	++ThreadCounters().ShadowRays;
+	float3 transmittance;
+	scene->IntersectShadowRay(ray, interaction.Medium, sampler, &transmittance);
+	if (ray.GeomID != (int)m_geomId) {
 		return 0.0f;
 	}
+	*Li = m_radiance * transmittance;
 
 	// Calculate the pdf
 	float3a intersectionPoint = ray.Origin + ray.Direction * ray.TFar;
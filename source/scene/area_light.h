@@ -27,7 +27,7 @@ private:
 
 public:
 	float3 SampleLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float *pdf) const override;
-	float PdfLi(Scene *scene, SurfaceInteraction &interaction) const override;
+	float PdfLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float3 *Li) const override;
 };
 
 } // End of namespace Lantern
@@ -0,0 +1,75 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "materials/textures/texture.h"
+
+#include "math/vector_types.h"
+
+#include <algorithm>
+#include <limits>
+
+
+namespace Lantern {
+
+/**
+ * Moves the points of a subdivision surface along its normal, as Embree tessellates it
+ *
+ * Procedural displacements derive from this directly. Height() is called from Embree's build threads,
+ * so it has to be thread safe.
+ */
+class Displacement {
+public:
+	/**
+	 * @param maxHeight    The largest distance any point is moved, in either direction. Embree pads the bounds of the patches by this much
+	 */
+	explicit Displacement(float maxHeight)
+		: m_maxHeight(maxHeight) {
+	}
+	virtual ~Displacement() {}
+
+protected:
+	float m_maxHeight;
+
+public:
+	/**
+	 * @param position    The point on the undisplaced surface
+	 * @param normal      The normalized normal of the undisplaced surface
+	 * @param texCoord    The texture coordinates of the point, or (0, 0) if the mesh doesn't have any
+	 * @return            The distance to move the point along the normal. Within [-MaxHeight(), MaxHeight()]
+	 */
+	virtual float Height(const float3 &position, const float3 &normal, float2 texCoord) const = 0;
+	float MaxHeight() const { return m_maxHeight; }
+};
+
+/**
+ * Displaces the surface by the red channel of a texture. Texels are clamped to [0, 1], and a texel equal to
+ * midLevel leaves the surface where it is
+ */
+class TextureDisplacement : public Displacement {
+public:
+	TextureDisplacement(const Texture *texture, float scale, float midLevel = 0.5f)
+		: Displacement(scale * std::max(midLevel, 1.0f - midLevel)),
+		  m_texture(texture),
+		  m_scale(scale),
+		  m_midLevel(midLevel) {
+	}
+
+private:
+	const Texture *m_texture;
+	float m_scale;
+	float m_midLevel;
+
+public:
+	float Height(const float3 & /* position */, const float3 & /* normal */, float2 texCoord) const override {
+		// The tessellation rate decides how finely the texture is resolved, so we always sample the top level
+		float texel = std::min(std::max(m_texture->Sample(texCoord, -std::numeric_limits<float>::max()).x, 0.0f), 1.0f);
+		return (texel - m_midLevel) * m_scale;
+	}
+};
+
+} // End of namespace Lantern
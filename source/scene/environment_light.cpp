@@ -0,0 +1,146 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "scene/environment_light.h"
+
+#include "scene/scene.h"
+
+#include "math/vector_math.h"
+
+#include "renderer/surface_interaction.h"
+#include "renderer/render_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+namespace Lantern {
+
+EnvironmentLight::EnvironmentLight(uint width, uint height, const float3 *pixels, float scale)
+		: Light(float3(scale)),
+		  m_width(width),
+		  m_height(height),
+		  m_pixels(pixels, pixels + (size_t)width * height),
+		  m_marginal(height),
+		  m_conditional((size_t)width * height) {
+	for (float3 &pixel : m_pixels) {
+		pixel = pixel * scale;
+	}
+
+	// The pixels near the poles cover a smaller solid angle, so they're weighted by sin(theta)
+	std::vector<float> weights(width);
+	std::vector<float> rowWeights(height);
+	for (uint y = 0; y < height; ++y) {
+		float sinTheta = std::sin((y + 0.5f) * (float)M_PI / height);
+		for (uint x = 0; x < width; ++x) {
+			weights[x] = Luminance(m_pixels[y * width + x]) * sinTheta;
+		}
+
+		rowWeights[y] = BuildAliasTable(&weights[0], width, &m_conditional[y * width]);
+	}
+
+	BuildAliasTable(&rowWeights[0], height, &m_marginal[0]);
+}
+
+float EnvironmentLight::DirectionToPixel(const float3a &direction, uint *column, uint *row) const {
+	float theta = std::acos(std::min(std::max(direction.y, -1.0f), 1.0f));
+	float phi = std::atan2(direction.z, direction.x);
+	if (phi < 0.0f) {
+		phi += 2.0f * (float)M_PI;
+	}
+
+	*column = std::min((uint)(phi * 0.5f * (float)M_1_PI * m_width), m_width - 1);
+	*row = std::min((uint)(theta * (float)M_1_PI * m_height), m_height - 1);
+
+	return std::sin(theta);
+}
+
+float3 EnvironmentLight::Le(const float3a &direction) const {
+	uint column, row;
+	DirectionToPixel(direction, &column, &row);
+
+	return m_pixels[row * m_width + column];
+}
+
+float EnvironmentLight::Pdf(const float3a &direction) const {
+	uint column, row;
+	float sinTheta = DirectionToPixel(direction, &column, &row);
+	if (sinTheta <= 0.0f) {
+		return 0.0f;
+	}
+
+	// The pdf over the unit square of the image, converted to solid angle
+	// d(omega) = sin(theta) d(theta) d(phi) = 2 * PI^2 * sin(theta) du dv
+	float imagePdf = m_marginal[row].Pdf * m_conditional[row * m_width + column].Pdf * m_width * m_height;
+	return imagePdf / (2.0f * (float)M_PI * (float)M_PI * sinTheta);
+}
+
+bool EnvironmentLight::Unoccluded(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float3 *transmittance) const {
+	Ray ray;
+	ray.Origin = interaction.Position;
+	ray.Direction = interaction.InputDirection;
+	ray.TNear = 0.001f;
+	ray.TFar = infinity;
+	ray.GeomID = INVALID_GEOMETRY_ID;
+	ray.PrimID = INVALID_PRIMATIVE_ID;
+	ray.InstID = INVALID_INSTANCE_ID;
+	ray.Mask = 0xFFFFFFFF;
+	ray.Time = 0.0f;
+
+	++ThreadCounters().ShadowRays;
+	scene->IntersectShadowRay(ray, interaction.Medium, sampler, transmittance);
+
+	return ray.GeomID == (int)INVALID_GEOMETRY_ID;
+}
+
+float3 EnvironmentLight::SampleLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float *pdf) const {
+	uint row = SampleAliasTable(&m_marginal[0], m_height, sampler->NextFloat());
+	uint column = SampleAliasTable(&m_conditional[row * m_width], m_width, sampler->NextFloat());
+
+	// Jitter the direction inside the pixel
+	float theta = (row + sampler->NextFloat()) * (float)M_PI / m_height;
+	float phi = (column + sampler->NextFloat()) * 2.0f * (float)M_PI / m_width;
+	float sinTheta = std::sin(theta);
+	float3a direction(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+	interaction.InputDirection = direction;
+
+	// Check that the direction is above the horizon
+	if (sinTheta <= 0.0f || (!interaction.InMedium && dot(direction, interaction.Normal) <= 0.0f)) {
+		*pdf = 0.0f;
+		return float3(0.0f);
+	}
+
+	// Make sure there's nothing occluding us
+	float3 transmittance;
+	if (!Unoccluded(sampler, scene, interaction, &transmittance)) {
+		*pdf = 0.0f;
+		return float3(0.0f);
+	}
+
+	float imagePdf = m_marginal[row].Pdf * m_conditional[row * m_width + column].Pdf * m_width * m_height;
+	*pdf = imagePdf / (2.0f * (float)M_PI * (float)M_PI * sinTheta);
+
+	return m_pixels[row * m_width + column] * transmittance;
+}
+
+float EnvironmentLight::PdfLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float3 *Li) const {
+	// Check that wi is above the horizon
+	if (!interaction.InMedium && dot(interaction.InputDirection, interaction.Normal) <= 0.0f) {
+		return 0.0f;
+	}
+
+	float3 transmittance;
+	if (!Unoccluded(sampler, scene, interaction, &transmittance)) {
+		return 0.0f;
+	}
+
+	float3a direction = normalize(interaction.InputDirection);
+	*Li = Le(direction) * transmittance;
+	return Pdf(direction);
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,76 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "scene/light.h"
+
+#include "math/alias_table.h"
+
+#include "profiling/memory_tracker.h"
+
+
+namespace Lantern {
+
+/**
+ * An infinitely distant light, surrounding the scene, whose radiance comes from a lat-long image
+ *
+ * The top row of the image is straight up (+y), and the bottom row is straight down. The columns
+ * wrap around y, starting at +x and going towards +z.
+ *
+ * Directions are importance sampled in proportion to the luminance of the pixels, with one alias table
+ * to pick a row, and one alias table per row to pick a column inside it. So sampling is O(1), no matter
+ * the resolution of the image.
+ */
+class EnvironmentLight : public Light {
+public:
+	/**
+	 * @param width     The width of the image, in pixels
+	 * @param height    The height of the image, in pixels
+	 * @param pixels    width * height linear radiance values, row by row, starting at the top left
+	 * @param scale     Multiplies the radiance of the image
+	 */
+	EnvironmentLight(uint width, uint height, const float3 *pixels, float scale);
+
+private:
+	uint m_width;
+	uint m_height;
+	TrackedVector<float3, MemoryCategory::Lights> m_pixels;
+	// Picks a row
+	TrackedVector<AliasEntry, MemoryCategory::Lights> m_marginal;
+	// m_width entries per row, to pick a column inside the row
+	TrackedVector<AliasEntry, MemoryCategory::Lights> m_conditional;
+
+public:
+	float3 SampleLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float *pdf) const override;
+	float PdfLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float3 *Li) const override;
+
+	using Light::Le;
+	/**
+	 * Returns the radiance arriving from the environment along -direction
+	 *
+	 * @param direction    The direction from the scene towards the environment. Must be normalized
+	 */
+	float3 Le(const float3a &direction) const;
+	/**
+	 * Returns the solid angle pdf of SampleLi() choosing direction, ignoring occlusion
+	 */
+	float Pdf(const float3a &direction) const;
+
+private:
+	/**
+	 * Maps a direction to its (column, row) in the image, and returns sin(theta) of the direction
+	 */
+	float DirectionToPixel(const float3a &direction, uint *column, uint *row) const;
+	/**
+	 * Traces a shadow ray along interaction.InputDirection
+	 *
+	 * @return    False if the ray hit something before escaping the scene
+	 */
+	bool Unoccluded(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float3 *transmittance) const;
+};
+
+} // End of namespace Lantern
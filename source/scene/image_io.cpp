@@ -0,0 +1,287 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "scene/image_io.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace Lantern {
+
+static bool IsLittleEndian() {
+	uint32 value = 1u;
+	return *(byte *)&value == 1u;
+}
+
+static void SwapBytes(float *value) {
+	byte *bytes = (byte *)value;
+	std::swap(bytes[0], bytes[3]);
+	std::swap(bytes[1], bytes[2]);
+}
+
+bool WritePFM(const char *filePath, uint width, uint height, const float3 *pixels) {
+	FILE *file = fopen(filePath, "wb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	// A negative scale means little endian
+	fprintf(file, "PF\n%u %u\n%s\n", width, height, IsLittleEndian() ? "-1.0" : "1.0");
+
+	// PFM rows are stored bottom to top
+	bool success = true;
+	std::vector<float> row(width * 3);
+	for (uint y = height; y-- > 0;) {
+		for (uint x = 0; x < width; ++x) {
+			const float3 &pixel = pixels[y * width + x];
+			row[x * 3 + 0] = pixel.x;
+			row[x * 3 + 1] = pixel.y;
+			row[x * 3 + 2] = pixel.z;
+		}
+
+		success = success && fwrite(&row[0], sizeof(float), row.size(), file) == row.size();
+	}
+
+	success = (fclose(file) == 0) && success;
+	return success;
+}
+
+bool ReadPFM(const char *filePath, uint *width, uint *height, std::vector<float3> *pixels) {
+	FILE *file = fopen(filePath, "rb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	char type[3] = {};
+	float scale;
+	if (fscanf(file, "%2s %u %u %f", type, width, height, &scale) != 4 ||
+	    (strcmp(type, "PF") != 0 && strcmp(type, "Pf") != 0) ||
+	    *width == 0u || *height == 0u) {
+		fclose(file);
+		return false;
+	}
+	// Skip the single whitespace character after the header
+	fgetc(file);
+
+	uint channels = type[1] == 'F' ? 3u : 1u;
+	bool swapBytes = (scale < 0.0f) != IsLittleEndian();
+
+	pixels->resize(*width * *height);
+
+	bool success = true;
+	std::vector<float> row(*width * channels);
+	for (uint y = *height; y-- > 0 && success;) {
+		success = fread(&row[0], sizeof(float), row.size(), file) == row.size();
+
+		for (uint x = 0; x < *width && success; ++x) {
+			float3 &pixel = (*pixels)[y * *width + x];
+			for (uint c = 0; c < 3; ++c) {
+				float value = row[x * channels + (channels == 3u ? c : 0u)];
+				if (swapBytes) {
+					SwapBytes(&value);
+				}
+				pixel[c] = value;
+			}
+		}
+	}
+
+	fclose(file);
+	return success;
+}
+
+/**
+ * Reads a new style run length encoded scanline. Each of the 4 components is stored separately,
+ * as a series of runs (a count over 128, then the byte to repeat) and literal spans (a count, then the bytes)
+ */
+static bool ReadRLEScanline(FILE *file, uint width, byte *scanline) {
+	for (uint c = 0; c < 4; ++c) {
+		uint x = 0;
+		while (x < width) {
+			int count = fgetc(file);
+			if (count == EOF) {
+				return false;
+			}
+
+			if (count > 128) {
+				count -= 128;
+				int value = fgetc(file);
+				if (value == EOF || x + count > width) {
+					return false;
+				}
+				for (int i = 0; i < count; ++i, ++x) {
+					scanline[x * 4 + c] = (byte)value;
+				}
+			} else {
+				if (count == 0 || x + count > width) {
+					return false;
+				}
+				for (int i = 0; i < count; ++i, ++x) {
+					int value = fgetc(file);
+					if (value == EOF) {
+						return false;
+					}
+					scanline[x * 4 + c] = (byte)value;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Reads a flat, or old style run length encoded scanline. In the old encoding, a pixel of (1, 1, 1, n)
+ * repeats the previous pixel n times. Consecutive repeat pixels are higher digits of the count
+ *
+ * @param first    The first pixel of the scanline, which has already been read
+ */
+static bool ReadFlatScanline(FILE *file, uint width, const byte first[4], byte *scanline) {
+	uint shift = 0;
+	uint x = 0;
+	while (x < width) {
+		byte pixel[4];
+		if (x == 0 && shift == 0) {
+			memcpy(pixel, first, 4);
+		} else if (fread(pixel, 1, 4, file) != 4) {
+			return false;
+		}
+
+		if (pixel[0] == 1 && pixel[1] == 1 && pixel[2] == 1) {
+			uint count = (uint)pixel[3] << shift;
+			if (x == 0 || x + count > width) {
+				return false;
+			}
+			for (uint i = 0; i < count; ++i, ++x) {
+				memcpy(&scanline[x * 4], &scanline[(x - 1) * 4], 4);
+			}
+			shift += 8;
+		} else {
+			memcpy(&scanline[x * 4], pixel, 4);
+			++x;
+			shift = 0;
+		}
+	}
+
+	return true;
+}
+
+static float3 RGBEToFloat(const byte *rgbe, float exposure) {
+	if (rgbe[3] == 0) {
+		return float3(0.0f);
+	}
+
+	// The mantissas are the bottom of their interval, so we take the middle
+	float scale = std::ldexp(1.0f, (int)rgbe[3] - (128 + 8)) / exposure;
+	return float3((rgbe[0] + 0.5f) * scale, (rgbe[1] + 0.5f) * scale, (rgbe[2] + 0.5f) * scale);
+}
+
+bool ReadHDR(const char *filePath, uint *width, uint *height, std::vector<float3> *pixels) {
+	FILE *file = fopen(filePath, "rb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	// The header is a series of lines, ending with an empty one
+	char line[256];
+	if (fgets(line, sizeof(line), file) == nullptr || (strncmp(line, "#?RADIANCE", 10) != 0 && strncmp(line, "#?RGBE", 6) != 0)) {
+		fclose(file);
+		return false;
+	}
+	// The pixel values are the original radiance multiplied by every exposure in the header
+	float exposure = 1.0f;
+	while (true) {
+		if (fgets(line, sizeof(line), file) == nullptr) {
+			fclose(file);
+			return false;
+		}
+		if (line[0] == '\n' || (line[0] == '\r' && line[1] == '\n')) {
+			break;
+		}
+
+		if (strncmp(line, "FORMAT=", 7) == 0 && strncmp(line + 7, "32-bit_rle_rgbe", 15) != 0) {
+			fclose(file);
+			return false;
+		}
+		if (strncmp(line, "EXPOSURE=", 9) == 0) {
+			float value = (float)atof(line + 9);
+			if (value > 0.0f) {
+				exposure *= value;
+			}
+		}
+	}
+
+	// The resolution line. -Y means the first scanline is the top of the image
+	char yAxis[3] = {};
+	char xAxis[3] = {};
+	if (fscanf(file, "%2s %u %2s %u", yAxis, height, xAxis, width) != 4 ||
+	    (strcmp(yAxis, "-Y") != 0 && strcmp(yAxis, "+Y") != 0) || strcmp(xAxis, "+X") != 0 ||
+	    *width == 0u || *height == 0u) {
+		fclose(file);
+		return false;
+	}
+	// Skip the newline after the resolution
+	fgetc(file);
+	bool topToBottom = yAxis[0] == '-';
+
+	pixels->resize(*width * *height);
+
+	bool success = true;
+	std::vector<byte> scanline(*width * 4);
+	for (uint i = 0; i < *height && success; ++i) {
+		byte first[4];
+		success = fread(first, 1, 4, file) == 4;
+		if (!success) {
+			break;
+		}
+
+		// New style RLE scanlines start with 2, 2, and the width. It's only used for widths of 8 to 32767
+		if (*width >= 8u && *width < 32768u && first[0] == 2 && first[1] == 2 && (first[2] & 0x80) == 0) {
+			success = (((uint)first[2] << 8) | first[3]) == *width && ReadRLEScanline(file, *width, &scanline[0]);
+		} else {
+			success = ReadFlatScanline(file, *width, first, &scanline[0]);
+		}
+
+		uint y = topToBottom ? i : *height - 1 - i;
+		for (uint x = 0; x < *width && success; ++x) {
+			(*pixels)[y * *width + x] = RGBEToFloat(&scanline[x * 4], exposure);
+		}
+	}
+
+	fclose(file);
+	return success;
+}
+
+static bool HasExtension(const char *filePath, const char *extension) {
+	std::size_t pathLength = strlen(filePath);
+	std::size_t extensionLength = strlen(extension);
+	if (pathLength < extensionLength) {
+		return false;
+	}
+
+	const char *end = filePath + pathLength - extensionLength;
+	for (std::size_t i = 0; i < extensionLength; ++i) {
+		if (tolower(end[i]) != extension[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ReadImage(const char *filePath, uint *width, uint *height, std::vector<float3> *pixels) {
+	if (HasExtension(filePath, ".hdr") || HasExtension(filePath, ".pic")) {
+		return ReadHDR(filePath, width, height, pixels);
+	}
+
+	return ReadPFM(filePath, width, height, pixels);
+}
+
+} // End of namespace Lantern
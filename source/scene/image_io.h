@@ -0,0 +1,62 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+#include "math/vector_types.h"
+
+#include <vector>
+
+
+namespace Lantern {
+
+/**
+ * Writes an RGB image to a Portable Float Map (.pfm) file
+ *
+ * @param filePath    The file to write
+ * @param width       The width of the image
+ * @param height      The height of the image
+ * @param pixels      The pixels, in row major order, starting at the top left
+ * @return            False if the file couldn't be written
+ */
+bool WritePFM(const char *filePath, uint width, uint height, const float3 *pixels);
+
+/**
+ * Reads an RGB or greyscale Portable Float Map (.pfm) file
+ *
+ * @param filePath    The file to read
+ * @param width       Filled with the width of the image
+ * @param height      Filled with the height of the image
+ * @param pixels      Filled with the pixels, in row major order, starting at the top left
+ * @return            False if the file couldn't be read
+ */
+bool ReadPFM(const char *filePath, uint *width, uint *height, std::vector<float3> *pixels);
+
+/**
+ * Reads a Radiance RGBE (.hdr) file. Flat, and both old and new style run length encoded scanlines are supported.
+ * Only the standard -Y +X and +Y +X orientations are supported, and XYZE files are rejected
+ *
+ * @param filePath    The file to read
+ * @param width       Filled with the width of the image
+ * @param height      Filled with the height of the image
+ * @param pixels      Filled with the pixels, in row major order, starting at the top left
+ * @return            False if the file couldn't be read
+ */
+bool ReadHDR(const char *filePath, uint *width, uint *height, std::vector<float3> *pixels);
+
+/**
+ * Reads a .pfm or .hdr file, chosen by the file extension
+ *
+ * @param filePath    The file to read
+ * @param width       Filled with the width of the image
+ * @param height      Filled with the height of the image
+ * @param pixels      Filled with the pixels, in row major order, starting at the top left
+ * @return            False if the file couldn't be read
+ */
+bool ReadImage(const char *filePath, uint *width, uint *height, std::vector<float3> *pixels);
+
+} // End of namespace Lantern
@@ -25,8 +25,25 @@ public:
 	float3 m_radiance;
 
 public:
+	/**
+	 * Samples a direction towards the light, and fills interaction.InputDirection with it
+	 *
+	 * @param sampler        The sampler to use for generating random numbers
+	 * @param scene          The scene, for tracing the shadow ray
+	 * @param interaction    The point being lit
+	 * @param pdf            Filled with the solid angle pdf of the direction. 0 if the light is occluded
+	 * @return               The radiance arriving at the point, attenuated by any media along the way
+	 */
 	virtual float3 SampleLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float *pdf) const = 0;
-	virtual float PdfLi(Scene *scene, SurfaceInteraction &interaction) const = 0;
+	/**
+	 * Returns the solid angle pdf of SampleLi() choosing interaction.InputDirection
+	 *
+	 * @param sampler        The sampler to use for generating random numbers
+	 * @param scene          The scene, for tracing the shadow ray
+	 * @param interaction    The point being lit
+	 * @param Li             Filled with the radiance arriving at the point, attenuated by any media along the way. Only valid if the pdf isn't 0
+	 */
+	virtual float PdfLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float3 *Li) const = 0;
 	virtual float3 Le() const { return m_radiance; }
 };
 
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include "math/int_types.h"
 #include "math/vector_types.h"
 
 #include <vector>
@@ -23,4 +24,23 @@ struct Mesh {
 	float4 BoundingSphere;
 };
 
+/**
+ * The control cage of a Catmull-Clark subdivision surface
+ *
+ * Faces have 3 to 15 vertices, and are wound counter-clockwise when seen from the outside
+ */
+struct SubdivisionMesh {
+	std::vector<float3a> Positions;
+	// Optional. One per position
+	std::vector<float2> TexCoords;
+	// The number of vertices of each face. 3 to 15
+	std::vector<uint> FaceVertexCounts;
+	// The vertices of every face, one face after the other
+	std::vector<int> Indices;
+	// Optional. Pairs of vertex indices, marking the edges between them as creases
+	std::vector<int> CreaseIndices;
+	// One per crease. The larger the weight, the sharper the crease. Infinity is a hard edge
+	std::vector<float> CreaseWeights;
+};
+
 } // End of namespace Lantern
@@ -7,37 +7,184 @@
 #include "scene/obj_loader.h"
 
 #include "math/int_types.h"
+#include "math/vector_math.h"
 
 #include <tiny_obj_loader/tiny_obj_loader.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
 
 namespace Lantern {
 
+static const int kAllMaterials = -2;
+
+/**
+ * Copies the triangles of a shape that use a material into a mesh, along with the vertices they use
+ *
+ * @param materialId    The tiny_obj_loader material id of the triangles to copy, or kAllMaterials
+ */
+static void CopyShape(const tinyobj::mesh_t &shape, int materialId, Mesh *mesh) {
+	// Maps the vertices of the shape to those of the mesh
+	std::vector<int> vertexMap(shape.positions.size() / 3, -1);
+	// tiny_obj_loader skips the normals and texture coordinates of vertices that don't have them.
+	// So unless every vertex has them, we can't tell which vertex they belong to
+	bool hasNormals = shape.normals.size() / 3 == vertexMap.size();
+	bool hasTexCoords = shape.texcoords.size() / 2 == vertexMap.size();
+
+	for (uint i = 0; i + 2 < shape.indices.size(); i += 3) {
+		uint face = i / 3;
+		int faceMaterial = face < shape.material_ids.size() ? shape.material_ids[face] : -1;
+		if (materialId != kAllMaterials && faceMaterial != materialId) {
+			continue;
+		}
+
+		for (uint j = i; j < i + 3; ++j) {
+			uint vertex = shape.indices[j];
+			if (vertexMap[vertex] < 0) {
+				vertexMap[vertex] = (int)mesh->Positions.size();
+
+				// tiny_obj_loader uses LH coords
+				mesh->Positions.emplace_back(shape.positions[vertex * 3], shape.positions[vertex * 3 + 1], -shape.positions[vertex * 3 + 2]);
+				if (hasNormals) {
+					mesh->Normals.emplace_back(shape.normals[vertex * 3], shape.normals[vertex * 3 + 1], -shape.normals[vertex * 3 + 2]);
+				}
+				if (hasTexCoords) {
+					// OBJ puts (0, 0) at the bottom left of the image. We put it at the top left
+					mesh->TexCoords.emplace_back(shape.texcoords[vertex * 2], 1.0f - shape.texcoords[vertex * 2 + 1]);
+				}
+			}
+
+			mesh->Indices.push_back(vertexMap[vertex]);
+		}
+	}
+
+	// The sphere around the bounding box
+	float3 boundsMin(std::numeric_limits<float>::max());
+	float3 boundsMax(-std::numeric_limits<float>::max());
+	for (const float3a &position : mesh->Positions) {
+		boundsMin = min(boundsMin, float3(position.x, position.y, position.z));
+		boundsMax = max(boundsMax, float3(position.x, position.y, position.z));
+	}
+	float3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = mesh->Positions.empty() ? 0.0f : length(boundsMax - center);
+	mesh->BoundingSphere = float4(center.x, center.y, center.z, radius);
+}
+
+/**
+ * @return    The directory of the file, including the trailing separator. Empty if the path doesn't have one
+ */
+static std::string DirectoryOf(const char *filePath) {
+	std::string path(filePath);
+	std::size_t separator = path.find_last_of("/\\");
+	return separator == std::string::npos ? std::string() : path.substr(0, separator + 1);
+}
+
 void LoadMeshesFromObj(const char *filePath, std::vector<Mesh> &meshes) {
 	std::vector<tinyobj::shape_t> tinyObjShapes;
 	std::vector<tinyobj::material_t> tinyObjMaterials;
 	std::string err;
 
-	tinyobj::LoadObj(tinyObjShapes, tinyObjMaterials, err, filePath);
+	std::string directory = DirectoryOf(filePath);
+	tinyobj::LoadObj(tinyObjShapes, tinyObjMaterials, err, filePath, directory.c_str());
 
-	// We ignore materials for now
-
-	// Copy over the vertices and indices
 	for (auto &shape : tinyObjShapes) {
 		Mesh mesh;
-		for (uint i = 0; i < shape.mesh.positions.size(); i += 3) {
-			// tiny_obj_loader uses LH coords
-			mesh.Positions.emplace_back(shape.mesh.positions[i], shape.mesh.positions[i + 1], -shape.mesh.positions[i + 2]);
+		CopyShape(shape.mesh, kAllMaterials, &mesh);
+		meshes.push_back(mesh);
+	}
+}
+
+void LoadMeshesFromObj(const char *filePath, std::vector<Mesh> &meshes, std::vector<ObjMaterial> &materials, std::vector<uint> &meshMaterials) {
+	std::vector<tinyobj::shape_t> tinyObjShapes;
+	std::vector<tinyobj::material_t> tinyObjMaterials;
+	std::string err;
+
+	std::string directory = DirectoryOf(filePath);
+	tinyobj::LoadObj(tinyObjShapes, tinyObjMaterials, err, filePath, directory.c_str());
+
+	materials.clear();
+	for (const tinyobj::material_t &tinyObjMaterial : tinyObjMaterials) {
+		ObjMaterial material;
+		switch (tinyObjMaterial.illum) {
+		case 3:
+		case 5:
+		case 8:
+			material.MaterialType = ObjMaterial::Type::Metal;
+			break;
+		case 4:
+		case 6:
+		case 7:
+		case 9:
+			material.MaterialType = ObjMaterial::Type::Glass;
+			break;
+		default:
+			material.MaterialType = ObjMaterial::Type::Diffuse;
+			break;
 		}
-		for (uint i = 0; i < shape.mesh.normals.size(); i += 3) {
-			// tiny_obj_loader uses LH coords
-			mesh.Normals.emplace_back(shape.mesh.normals[i], shape.mesh.normals[i + 1], -shape.mesh.normals[i + 2]);
+
+		material.Diffuse = float3(tinyObjMaterial.diffuse[0], tinyObjMaterial.diffuse[1], tinyObjMaterial.diffuse[2]);
+		material.Specular = float3(tinyObjMaterial.specular[0], tinyObjMaterial.specular[1], tinyObjMaterial.specular[2]);
+		material.Transmittance = float3(tinyObjMaterial.transmittance[0], tinyObjMaterial.transmittance[1], tinyObjMaterial.transmittance[2]);
+		if (material.Transmittance.x == 0.0f && material.Transmittance.y == 0.0f && material.Transmittance.z == 0.0f) {
+			material.Transmittance = float3(1.0f);
 		}
-		for (uint i = 0; i < shape.mesh.indices.size(); ++i) {
-			mesh.Indices.push_back(shape.mesh.indices[i]);
+		material.IOR = tinyObjMaterial.ior != 1.0f ? tinyObjMaterial.ior : 1.5f;
+
+		auto roughness = tinyObjMaterial.unknown_parameter.find("Pr");
+		if (roughness != tinyObjMaterial.unknown_parameter.end()) {
+			material.Roughness = (float)atof(roughness->second.c_str());
+		} else {
+			// The perceptual roughness is the square root of alpha
+			float alpha = std::sqrt(2.0f / (std::max(tinyObjMaterial.shininess, 0.0f) + 2.0f));
+			material.Roughness = std::sqrt(alpha);
 		}
+		material.Roughness = std::min(std::max(material.Roughness, 0.0f), 1.0f);
 
-		meshes.push_back(mesh);
+		if (!tinyObjMaterial.diffuse_texname.empty()) {
+			// Exporters don't agree on what Kd should be alongside a texture. And tiny_obj_loader defaults
+			// a missing Kd to black. So the texture replaces Kd, rather than multiplying it
+			material.Diffuse = float3(1.0f);
+			material.DiffuseTexture = directory + tinyObjMaterial.diffuse_texname;
+		}
+		if (!tinyObjMaterial.alpha_texname.empty()) {
+			material.AlphaTexture = directory + tinyObjMaterial.alpha_texname;
+		}
+		materials.push_back(material);
+	}
+	// The default material, for faces without one
+	uint defaultMaterial = (uint)materials.size();
+	ObjMaterial gray;
+	gray.MaterialType = ObjMaterial::Type::Diffuse;
+	gray.Diffuse = float3(0.8f);
+	gray.Specular = float3(0.0f);
+	gray.Transmittance = float3(1.0f);
+	gray.IOR = 1.5f;
+	gray.Roughness = 1.0f;
+	materials.push_back(gray);
+
+	meshMaterials.clear();
+	for (auto &shape : tinyObjShapes) {
+		std::vector<int> materialIds(shape.mesh.material_ids);
+		if (materialIds.empty()) {
+			materialIds.push_back(-1);
+		}
+		std::sort(materialIds.begin(), materialIds.end());
+		materialIds.erase(std::unique(materialIds.begin(), materialIds.end()), materialIds.end());
+
+		for (int materialId : materialIds) {
+			Mesh mesh;
+			CopyShape(shape.mesh, materialId, &mesh);
+			if (mesh.Indices.empty()) {
+				continue;
+			}
+
+			bool validMaterial = materialId >= 0 && materialId < (int)tinyObjMaterials.size();
+			meshes.push_back(mesh);
+			meshMaterials.push_back(validMaterial ? (uint)materialId : defaultMaterial);
+		}
 	}
 }
 
@@ -10,11 +10,59 @@
 
 #include "materials/bsdfs/bsdf.h"
 
+#include <string>
 #include <vector>
 
 
 namespace Lantern {
 
+/**
+ * The parts of an OBJ material that we use
+ */
+struct ObjMaterial {
+	/**
+	 * Picked from the illumination model (illum). 3, 5, and 8 are metals. 4, 6, 7, and 9 are glass. Everything else is diffuse
+	 */
+	enum class Type {
+		Diffuse,
+		Metal,
+		Glass
+	};
+
+	Type MaterialType;
+	float3 Diffuse;
+	// Ks. The reflectance of a metal at normal incidence
+	float3 Specular;
+	// Kt. Tints the light passing through glass. White if the material doesn't have one
+	float3 Transmittance;
+	// Ni. The index of refraction of glass. tiny_obj_loader defaults a missing Ni to 1, so 1 is replaced by 1.5
+	float IOR;
+	// The perceptual roughness of metal and glass. Read from Pr if the material has it. Otherwise, it's converted from
+	// the Blinn-Phong exponent (Ns), by matching the GGX alpha to sqrt(2 / (Ns + 2))
+	float Roughness;
+	// map_Kd. Empty if the material doesn't have one. The path is relative to the working directory.
+	// Diffuse is white if there's a texture
+	std::string DiffuseTexture;
+	// map_d. Empty if the material doesn't have one. A cutout mask, read from the red channel
+	std::string AlphaTexture;
+};
+
+/**
+ * Loads each shape of an OBJ file as a mesh. The materials are ignored
+ *
+ * @param filePath    The .obj file
+ * @param meshes      The meshes are appended to this
+ */
 void LoadMeshesFromObj(const char *filePath, std::vector<Mesh> &meshes);
+/**
+ * Loads the shapes of an OBJ file, split into a mesh per material. The .mtl files and textures
+ * are looked up relative to the .obj file
+ *
+ * @param filePath         The .obj file
+ * @param meshes           The meshes are appended to this
+ * @param materials        Filled with the materials of the file. Faces without a material get a default gray one, at the end
+ * @param meshMaterials    Filled with the index in materials of each of the appended meshes
+ */
+void LoadMeshesFromObj(const char *filePath, std::vector<Mesh> &meshes, std::vector<ObjMaterial> &materials, std::vector<uint> &meshMaterials);
 
 } // End of namespace Lantern
@@ -57,6 +57,45 @@ public:
 
 typedef RTCRay Ray;
 
+/**
+ * The SOA layout of a ray packet, as expected by rtcIntersect8() / rtcIntersect16()
+ * Embree only forward declares the packet types, the same as RTCRay, so we define them ourselves
+ */
+template <unsigned kWidth>
+struct RayPacket {
+public:
+	float orgx[kWidth];
+	float orgy[kWidth];
+	float orgz[kWidth];
+
+	float dirx[kWidth];
+	float diry[kWidth];
+	float dirz[kWidth];
+
+	float tnear[kWidth];
+	float tfar[kWidth];
+
+	float time[kWidth];
+	unsigned mask[kWidth];
+
+	float Ngx[kWidth];
+	float Ngy[kWidth];
+	float Ngz[kWidth];
+
+	float u[kWidth];
+	float v[kWidth];
+
+	unsigned geomID[kWidth];
+	unsigned primID[kWidth];
+	unsigned instID[kWidth];
+};
+
+struct STRUCT_ALIGN(32) RTCRay8 : public RayPacket<8> {
+};
+
+struct STRUCT_ALIGN(64) RTCRay16 : public RayPacket<16> {
+};
+
 /*! Outputs ray to stream. */
 inline std::ostream& operator<<(std::ostream& cout, const Ray& ray) {
 	return std::cout << "{ " <<
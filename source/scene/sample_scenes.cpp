@@ -0,0 +1,381 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "scene/sample_scenes.h"
+
+#include "scene/scene.h"
+#include "scene/geometry_generator.h"
+#include "scene/obj_loader.h"
+#include "scene/displacement.h"
+
+#include "materials/material.h"
+#include "materials/bsdfs/lambert_bsdf.h"
+#include "materials/bsdfs/mirror_bsdf.h"
+#include "materials/bsdfs/ideal_specular_dielectric.h"
+#include "materials/bsdfs/ggx_conductor.h"
+#include "materials/bsdfs/ggx_dielectric.h"
+#include "materials/media/non_scattering_medium.h"
+#include "materials/media/isotropic_scattering_medium.h"
+#include "materials/media/grid_medium.h"
+#include "materials/media/voxel_grid.h"
+
+#include "math/uniform_sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace Lantern {
+
+bool LoadDragonScene(Scene *scene) {
+	scene->SetCamera(1.25f, -M_PI_2, 2.0f, 1280.0f, 720.0f);
+
+	IdealSpecularDielectric *glass = new IdealSpecularDielectric(float3(1.0f), 1.35f);
+	NonScatteringMedium *redTransmission = new NonScatteringMedium(float3(0.9801986733f, 0.00609674656f, 0.00334596545f), 1.0f);
+	IsotropicScatteringMedium *redScattering = new IsotropicScatteringMedium(float3(0.9801986733f, 0.00609674656f, 0.00334596545f), 1.0f, 100.0f);
+
+	Material *material = new Material(glass, redScattering);
+
+	// Create Dragon
+	std::vector<Mesh> dragonMeshes;
+	LoadMeshesFromObj("dragon.obj", dragonMeshes);
+	for (auto &mesh : dragonMeshes) {
+		scene->AddMesh(&mesh, material);
+	}
+
+	return !dragonMeshes.empty();
+}
+
+void LoadBallsScene(Scene *scene) {
+	scene->SetCamera(M_PI_2, 0.0f, 40.0f, 1280.0f, 720.0f);
+
+	// Create the materials
+	Material *green = new Material(new LambertBSDF(float3(0.408f, 0.741f, 0.467f)), nullptr);
+	Material *blue = new Material(new LambertBSDF(float3(0.392f, 0.584f, 0.929f)), nullptr);
+	Material *orange = new Material(new LambertBSDF(float3(1.0f, 0.498f, 0.314f)), nullptr);
+	Material *black = new Material(new LambertBSDF(float3(0.0f)), nullptr);
+	Material *gray = new Material(new LambertBSDF(float3(0.9f, 0.9f, 0.9f)), nullptr);
+	Material *mirror = new Material(new MirrorBSDF(float3(0.95f, 0.95f, 0.95f)), nullptr);
+	Material *glass = new Material(new IdealSpecularDielectric(float3(0.95f), 1.5f), nullptr);
+
+	// Create the floor
+	Mesh floorMesh;
+	CreateGrid(50.0f, 50.0f, 2u, 2u, &floorMesh);
+	TranslateMesh(float3(0.0f, -6.0f, 0.0f), &floorMesh);
+	scene->AddMesh(&floorMesh, gray);
+
+	// Create the 9 spheres
+	const float kRadius = 2.0f;
+	scene->AddSphere(float4(0.0f, 0.0f, 0.0f, kRadius), black, float3(1.0f), 800.0f);
+
+	scene->AddSphere(float4(-4.0f, -4.0f, -4.0f, kRadius), mirror);
+	scene->AddSphere(float4(-4.0f, -4.0f, 4.0f, kRadius), blue);
+	scene->AddSphere(float4(-4.0f, 4.0f, 4.0f, kRadius), glass);
+	scene->AddSphere(float4(-4.0f, 4.0f, -4.0f, kRadius), orange);
+	scene->AddSphere(float4(4.0f, 4.0f, -4.0f, kRadius), blue);
+	scene->AddSphere(float4(4.0f, 4.0f, 4.0f, kRadius), green);
+	scene->AddSphere(float4(4.0f, -4.0f, 4.0f, kRadius), mirror);
+	scene->AddSphere(float4(4.0f, -4.0f, -4.0f, kRadius), glass);
+}
+
+void LoadSyntheticScene(Scene *scene, uint numSpheres, uint seed) {
+	scene->SetCamera(M_PI_2 * 0.8f, M_PI_4, 60.0f, 1280.0f, 720.0f);
+
+	UniformSampler sampler(seed);
+
+	Material *gray = new Material(new LambertBSDF(float3(0.8f)), nullptr);
+	Material *black = new Material(new LambertBSDF(float3(0.0f)), nullptr);
+	Material *mirror = new Material(new MirrorBSDF(float3(0.95f)), nullptr);
+	Material *glass = new Material(new IdealSpecularDielectric(float3(0.95f), 1.5f), nullptr);
+
+	const float kCubeSize = 30.0f;
+
+	Mesh floorMesh;
+	CreateGrid(kCubeSize * 2.0f, kCubeSize * 2.0f, 2u, 2u, &floorMesh);
+	TranslateMesh(float3(0.0f, -kCubeSize * 0.5f, 0.0f), &floorMesh);
+	scene->AddMesh(&floorMesh, gray);
+
+	Mesh lightMesh;
+	CreateGeosphere(3.0f, 3u, &lightMesh);
+	TranslateMesh(float3(0.0f, kCubeSize, 0.0f), &lightMesh);
+	scene->AddMesh(&lightMesh, black, float3(1.0f), 5000.0f);
+
+	// Shrink the spheres as the count grows, so the cube doesn't fill up
+	float radius = 0.5f * kCubeSize / std::cbrt((float)std::max(numSpheres, 1u));
+	Mesh baseSphere;
+	CreateGeosphere(radius, 2u, &baseSphere);
+
+	for (uint i = 0; i < numSpheres; ++i) {
+		Mesh sphere = baseSphere;
+		float3 position = (float3(sampler.NextFloat(), sampler.NextFloat(), sampler.NextFloat()) - float3(0.5f)) * kCubeSize;
+		TranslateMesh(position, &sphere);
+
+		Material *material;
+		float rand = sampler.NextFloat();
+		if (rand < 0.1f) {
+			material = mirror;
+		} else if (rand < 0.2f) {
+			material = glass;
+		} else {
+			material = new Material(new LambertBSDF(float3(sampler.NextFloat(), sampler.NextFloat(), sampler.NextFloat())), nullptr);
+		}
+
+		scene->AddMesh(&sphere, material);
+	}
+}
+
+/**
+ * Ripples running across the texture coordinates of a surface
+ */
+class RippleDisplacement : public Displacement {
+public:
+	RippleDisplacement(float amplitude, float frequency)
+		: Displacement(amplitude),
+		  m_frequency(frequency) {
+	}
+
+private:
+	float m_frequency;
+
+public:
+	float Height(const float3 & /* position */, const float3 & /* normal */, float2 texCoord) const override {
+		float angle = 2.0f * (float)M_PI * m_frequency;
+		return m_maxHeight * std::sin(angle * texCoord.x) * std::sin(angle * texCoord.y);
+	}
+};
+
+bool LoadSubdivisionScene(Scene *scene, const char *displacementTexturePath) {
+	scene->SetCamera(M_PI_2 * 0.8f, M_PI_4, 12.0f, 1280.0f, 720.0f);
+
+	Material *gray = new Material(new LambertBSDF(float3(0.8f)), nullptr);
+	Material *orange = new Material(new LambertBSDF(float3(1.0f, 0.498f, 0.314f)), nullptr);
+	Material *blue = new Material(new LambertBSDF(float3(0.392f, 0.584f, 0.929f)), nullptr);
+
+	Mesh floorMesh;
+	CreateGrid(30.0f, 30.0f, 2u, 2u, &floorMesh);
+	TranslateMesh(float3(0.0f, -1.5f, 0.0f), &floorMesh);
+	scene->AddMesh(&floorMesh, gray);
+
+	// A cube cage, which subdivides into a rounded box. The edges of the top face are creased,
+	// so it stays flatter than the bottom
+	SubdivisionMesh cube;
+	for (uint i = 0; i < 8; ++i) {
+		cube.Positions.emplace_back((i & 1u) != 0 ? -1.0f : -4.0f, (i & 2u) != 0 ? 1.0f : -1.0f, (i & 4u) != 0 ? 1.5f : -1.5f);
+	}
+	const int kCubeIndices[24] = {
+		0, 2, 3, 1, // -z
+		4, 5, 7, 6, // +z
+		0, 4, 6, 2, // -x
+		1, 3, 7, 5, // +x
+		0, 1, 5, 4, // -y
+		2, 6, 7, 3  // +y
+	};
+	cube.Indices.assign(kCubeIndices, kCubeIndices + 24);
+	cube.FaceVertexCounts.assign(6, 4u);
+	const int kTopEdges[8] = {2, 6, 6, 7, 7, 3, 3, 2};
+	cube.CreaseIndices.assign(kTopEdges, kTopEdges + 8);
+	cube.CreaseWeights.assign(4, 4.0f);
+	scene->AddSubdivisionMesh(&cube, orange, 16.0f);
+
+	// A gently domed sheet, with texture coordinates running across it for the displacement
+	const uint kSheetQuads = 8u;
+	const float kSheetSize = 4.0f;
+	SubdivisionMesh sheet;
+	for (uint i = 0; i <= kSheetQuads; ++i) {
+		for (uint j = 0; j <= kSheetQuads; ++j) {
+			float s = (float)i / kSheetQuads;
+			float t = (float)j / kSheetQuads;
+			float x = (s - 0.5f) * kSheetSize;
+			float z = (t - 0.5f) * kSheetSize;
+			sheet.Positions.emplace_back(x + 2.5f, 0.5f - 0.1f * (x * x + z * z), z);
+			sheet.TexCoords.emplace_back(s, t);
+		}
+	}
+	for (uint i = 0; i < kSheetQuads; ++i) {
+		for (uint j = 0; j < kSheetQuads; ++j) {
+			// Counter-clockwise seen from above
+			int corner = (int)(i * (kSheetQuads + 1) + j);
+			sheet.Indices.push_back(corner);
+			sheet.Indices.push_back(corner + 1);
+			sheet.Indices.push_back(corner + kSheetQuads + 2);
+			sheet.Indices.push_back(corner + kSheetQuads + 1);
+			sheet.FaceVertexCounts.push_back(4u);
+		}
+	}
+
+	// The scene only keeps a pointer to the displacement, so it's never freed, like the materials
+	Displacement *displacement;
+	if (displacementTexturePath != nullptr) {
+		Texture *texture = scene->LoadTexture(displacementTexturePath);
+		if (texture == nullptr) {
+			printf("Failed to load texture %s\n", displacementTexturePath);
+			return false;
+		}
+		displacement = new TextureDisplacement(texture, 0.3f);
+	} else {
+		displacement = new RippleDisplacement(0.1f, 3.0f);
+	}
+	scene->AddSubdivisionMesh(&sheet, blue, 32.0f, displacement);
+
+	return true;
+}
+
+/**
+ * Fills a grid with a few overlapping puffs of smoke, which fade out towards their edges. The corners
+ * of the grid are left empty, so the trackers have empty bricks to skip
+ */
+static void CreateSmokePuffs(uint resolution, VoxelGrid *grid) {
+	const uint kNumPuffs = 5;
+	const float4 kPuffs[kNumPuffs] = {
+		float4(0.0f, -0.2f, 0.0f, 0.55f),
+		float4(-0.35f, 0.1f, 0.2f, 0.4f),
+		float4(0.3f, 0.25f, -0.15f, 0.35f),
+		float4(0.1f, 0.5f, 0.25f, 0.3f),
+		float4(-0.2f, -0.45f, -0.3f, 0.3f)
+	};
+
+	std::vector<float> densities((size_t)resolution * resolution * resolution);
+	for (uint z = 0; z < resolution; ++z) {
+		for (uint y = 0; y < resolution; ++y) {
+			for (uint x = 0; x < resolution; ++x) {
+				// The position in [-1, 1]^3
+				float3 p = float3((float)x + 0.5f, (float)y + 0.5f, (float)z + 0.5f) * (2.0f / resolution) - float3(1.0f);
+
+				float density = 0.0f;
+				for (uint i = 0; i < kNumPuffs; ++i) {
+					float3 offset = p - float3(kPuffs[i].x, kPuffs[i].y, kPuffs[i].z);
+					float falloff = 1.0f - dot(offset, offset) / (kPuffs[i].w * kPuffs[i].w);
+					density += std::max(falloff, 0.0f);
+				}
+				// Break up the smooth falloff with some wisps
+				float wisps = 0.75f + 0.25f * std::sin(11.0f * p.x + 3.0f * p.z) * std::sin(13.0f * p.y - 5.0f * p.x) * std::sin(7.0f * p.z + 2.0f * p.y);
+
+				densities[((size_t)z * resolution + y) * resolution + x] = std::min(density, 1.0f) * wisps;
+			}
+		}
+	}
+
+	grid->Init(&densities[0], resolution, resolution, resolution);
+}
+
+bool LoadSmokeScene(Scene *scene, const char *densityPath, uint width, uint height, uint depth) {
+	scene->SetCamera(M_PI_2 * 0.85f, -M_PI_2, 14.0f, 1280.0f, 720.0f);
+
+	// The medium only keeps a pointer to the grid, so it's never freed, like the materials
+	VoxelGrid *grid = new VoxelGrid();
+	if (densityPath != nullptr) {
+		if (!grid->LoadRaw(densityPath, width, height, depth)) {
+			printf("Failed to load the density grid %s\n", densityPath);
+			delete grid;
+			return false;
+		}
+	} else {
+		CreateSmokePuffs(64u, grid);
+	}
+
+	Material *gray = new Material(new LambertBSDF(float3(0.8f)), nullptr);
+	Material *black = new Material(new LambertBSDF(float3(0.0f)), nullptr);
+
+	Mesh floorMesh;
+	CreateGrid(40.0f, 40.0f, 2u, 2u, &floorMesh);
+	TranslateMesh(float3(0.0f, -3.0f, 0.0f), &floorMesh);
+	scene->AddMesh(&floorMesh, gray);
+
+	scene->AddSphere(float4(-4.0f, 6.0f, 3.0f, 1.0f), black, float3(1.0f, 0.9f, 0.8f), 2000.0f);
+
+	// Stretch the grid over a box, keeping its aspect ratio, with the longest side 6 units long
+	float3 size((float)grid->Width(), (float)grid->Height(), (float)grid->Depth());
+	size = size * (6.0f / std::max(size.x, std::max(size.y, size.z)));
+	float3 boundsMin = float3(0.0f, -3.0f + 0.5f * size.y, 0.0f) - size * 0.5f;
+	float3 boundsMax = boundsMin + size;
+
+	// The box is index matched, so light and shadow rays pass straight into the smoke
+	GridMedium *smoke = new GridMedium(float3(0.9f), 1.0f, 3.0f, grid, boundsMin, boundsMax);
+	Material *smokeMaterial = new Material(new IdealSpecularDielectric(float3(1.0f), 1.0f), smoke);
+
+	Mesh boxMesh;
+	CreateBox(size.x, size.y, size.z, &boxMesh);
+	TranslateMesh((boundsMin + boundsMax) * 0.5f, &boxMesh);
+	scene->AddMesh(&boxMesh, smokeMaterial);
+
+	return true;
+}
+
+bool LoadObjScene(Scene *scene, const char *filePath) {
+	std::vector<Mesh> meshes;
+	std::vector<ObjMaterial> objMaterials;
+	std::vector<uint> meshMaterials;
+	LoadMeshesFromObj(filePath, meshes, objMaterials, meshMaterials);
+	if (meshes.empty()) {
+		return false;
+	}
+
+	// Center the model on the origin, which is what the camera orbits
+	float3 boundsMin(std::numeric_limits<float>::max());
+	float3 boundsMax(-std::numeric_limits<float>::max());
+	for (const Mesh &mesh : meshes) {
+		for (const float3a &position : mesh.Positions) {
+			boundsMin = min(boundsMin, float3(position.x, position.y, position.z));
+			boundsMax = max(boundsMax, float3(position.x, position.y, position.z));
+		}
+	}
+	float3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = std::max(length(boundsMax - center), 1e-3f);
+
+	// Far enough back that the bounding sphere fits in the default field of view
+	scene->SetCamera(M_PI_2 * 0.8f, M_PI_4, radius / std::sin((float)M_PI_4 * 0.5f), 1280.0f, 720.0f);
+
+	// Materials often share a texture, so each one is only opened once
+	std::unordered_map<std::string, Texture *> textures;
+	auto loadTexture = [&](const std::string &path) -> Texture * {
+		if (path.empty()) {
+			return nullptr;
+		}
+
+		auto iter = textures.find(path);
+		if (iter == textures.end()) {
+			iter = textures.emplace(path, scene->LoadTexture(path.c_str())).first;
+			if (iter->second == nullptr) {
+				printf("Failed to load texture %s\n", path.c_str());
+			}
+		}
+		return iter->second;
+	};
+
+	std::vector<Material *> materials;
+	for (const ObjMaterial &objMaterial : objMaterials) {
+		Material *material;
+		switch (objMaterial.MaterialType) {
+		case ObjMaterial::Type::Metal:
+			material = new Material(new GGXConductor(objMaterial.Specular, objMaterial.Roughness), nullptr);
+			break;
+		case ObjMaterial::Type::Glass:
+			material = new Material(new GGXDielectric(objMaterial.Transmittance, objMaterial.IOR, objMaterial.Roughness), nullptr);
+			break;
+		default:
+			material = new Material(new LambertBSDF(objMaterial.Diffuse), nullptr);
+			material->AlbedoTexture = loadTexture(objMaterial.DiffuseTexture);
+			break;
+		}
+		// The mask has to be set before the meshes are added, so the filters are registered
+		material->AlphaTexture = loadTexture(objMaterial.AlphaTexture);
+		materials.push_back(material);
+	}
+
+	for (uint i = 0; i < meshes.size(); ++i) {
+		TranslateMesh(-center, &meshes[i]);
+		scene->AddMesh(&meshes[i], materials[meshMaterials[i]]);
+	}
+
+	return true;
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,68 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+
+
+namespace Lantern {
+
+class Scene;
+
+/**
+ * The scenes used by the interactive renderer and the benchmarks
+ *
+ * The loaders only add geometry and set the camera. The caller is responsible for calling Scene::Commit()
+ */
+
+/**
+ * The glass dragon, filled with a red scattering medium. Loads "dragon.obj" from the working directory
+ *
+ * @return    False if dragon.obj couldn't be loaded
+ */
+bool LoadDragonScene(Scene *scene);
+/**
+ * Nine analytic spheres of different materials over a gray floor. One of them is a spherical light
+ */
+void LoadBallsScene(Scene *scene);
+/**
+ * A cube of randomly placed diffuse, mirror, and glass spheres over a floor, lit by a single spherical area light.
+ * The same seed always generates the same scene
+ *
+ * @param numSpheres    The number of spheres to create. Used to scale the size of the BVH
+ * @param seed          Seeds the positions and materials of the spheres
+ */
+void LoadSyntheticScene(Scene *scene, uint numSpheres, uint seed);
+/**
+ * A creased, subdivided cube next to a displaced, subdivided sheet, over a floor. Both are tessellated lazily by Embree
+ *
+ * @param displacementTexturePath    Optional. Displaces the sheet by the texture. If null, the sheet is displaced by procedural ripples
+ * @return                           False if the displacement texture couldn't be loaded
+ */
+bool LoadSubdivisionScene(Scene *scene, const char *displacementTexturePath);
+/**
+ * A box of heterogeneous smoke, bounded by an index matched surface, and lit by a spherical light over a floor
+ *
+ * @param densityPath    Optional. A raw grid of little endian, 32 bit float densities, with x varying fastest, then y, then z.
+ *                       If null, the box is filled with procedural puffs
+ * @param width          The number of voxels in x. Ignored if densityPath is null
+ * @param height         The number of voxels in y. Ignored if densityPath is null
+ * @param depth          The number of voxels in z. Ignored if densityPath is null
+ * @return               False if the density grid couldn't be loaded
+ */
+bool LoadSmokeScene(Scene *scene, const char *densityPath, uint width, uint height, uint depth);
+/**
+ * An OBJ model, moved to the origin and lit by the background color. Materials are diffuse, with
+ * their diffuse color and texture (map_Kd), or rough metal or glass, picked by their illum. See
+ * ObjMaterial. All of them can have an alpha cutout mask (map_d)
+ *
+ * @param filePath    The .obj file
+ * @return            False if the file couldn't be loaded
+ */
+bool LoadObjScene(Scene *scene, const char *filePath);
+
+} // End of namespace Lantern
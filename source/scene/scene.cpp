@@ -8,44 +8,344 @@
 
 #include "scene/mesh_elements.h"
 #include "scene/area_light.h"
+#include "scene/environment_light.h"
+#include "scene/sphere_light.h"
+#include "scene/displacement.h"
 
 #include "math/vector_math.h"
+#include "math/hash.h"
 
 #include "materials/material.h"
+#include "materials/bsdfs/bsdf.h"
+#include "materials/media/medium.h"
+#include "materials/textures/texture.h"
+
+#include "profiling/trace.h"
+#include "profiling/memory_tracker.h"
 
 #include <embree2/rtcore.h>
 
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
 
 namespace Lantern {
 
+static const uint64 kDefaultTextureCacheSize = 256ull * 1024ull * 1024ull;
+// Lazy objects whose center is off screen are built after the ones on screen of a similar size
+static const float kOffScreenCoverageWeight = 0.01f;
+
+// The size of the last Embree allocation refused for going over the memory budget
+static std::atomic<int64> g_refusedEmbreeAllocation(0);
+
+static bool EmbreeMemoryMonitor(const ssize_t bytes, const bool post) {
+	// Post allocations have already happened, so Embree ignores the result. We still have to record them
+	if (!TrackMemory(MemoryCategory::Embree, (int64)bytes, post)) {
+		g_refusedEmbreeAllocation = (int64)bytes;
+		return false;
+	}
+
+	return true;
+}
+
 Scene::Scene()
 	: BackgroundColor(0.0f),
+	  m_environmentLight(nullptr),
 	  m_device(rtcNewDevice(nullptr)),
-	  m_scene(rtcDeviceNewScene(m_device, RTC_SCENE_STATIC, RTC_INTERSECT1 | RTC_INTERPOLATE)) {
+	  m_scene(nullptr),
+	  m_packetWidth(1u),
+	  m_algorithmFlags(0),
+	  m_lazyBuild(false),
+	  m_stopLazyBuilds(false),
+	  m_textureCache(kDefaultTextureCacheSize),
+	  m_meshAlphaFilter(AlphaFilterData{this, false}),
+	  m_prototypeAlphaFilter(AlphaFilterData{this, true}) {
+	rtcDeviceSetMemoryMonitorFunction(m_device, EmbreeMemoryMonitor);
+
+	// Enable the widest packet intersection the CPU supports, for coherent rays
+	RTCAlgorithmFlags algorithmFlags = RTC_INTERSECT1 | RTC_INTERPOLATE;
+	if (rtcDeviceGetParameter1i(m_device, RTC_CONFIG_INTERSECT16) != 0) {
+		algorithmFlags = algorithmFlags | RTC_INTERSECT16;
+		m_packetWidth = 16u;
+	} else if (rtcDeviceGetParameter1i(m_device, RTC_CONFIG_INTERSECT8) != 0) {
+		algorithmFlags = algorithmFlags | RTC_INTERSECT8;
+		m_packetWidth = 8u;
+	}
+
+	m_algorithmFlags = algorithmFlags;
+	m_scene = rtcDeviceNewScene(m_device, RTC_SCENE_STATIC, algorithmFlags);
 }
 
 Scene::~Scene() {
+	m_stopLazyBuilds = true;
+	if (m_lazyBuildThread.joinable()) {
+		m_lazyBuildThread.join();
+	}
+
 	rtcDeleteScene(m_scene);
+	for (RTCScene prototype : m_prototypes) {
+		rtcDeleteScene(prototype);
+	}
+	for (LazyObject *object : m_lazyObjects) {
+		rtcDeleteScene(object->ObjectScene);
+		delete object;
+		TrackMemory(MemoryCategory::SceneContainers, -(int64)sizeof(LazyObject));
+	}
+
+	for (NormalBuffer &buffer : m_normalBuffers) {
+		_aligned_free(buffer.Normals);
+		TrackMemory(MemoryCategory::MeshNormals, -(int64)buffer.Bytes);
+	}
+	for (Light *light : m_lightList) {
+		uint64 size = LightSize(light);
+		delete light;
+		TrackMemory(MemoryCategory::Lights, -(int64)size);
+	}
+	for (Texture *texture : m_textures) {
+		delete texture;
+	}
 	rtcDeleteDevice(m_device);
 }
 
 uint Scene::AddMeshInternal(Mesh *mesh, Material *material) {
-	uint meshId = rtcNewTriangleMesh(m_scene, RTC_GEOMETRY_STATIC, mesh->Indices.size() / 3, mesh->Positions.size());
+	uint meshId = m_lazyBuild ? AddLazyObject(mesh) : AddMeshToScene(m_scene, mesh);
+	m_materials[meshId] = material;
+	if (!mesh->TexCoords.empty()) {
+		BuildTexCoords(mesh, &m_meshTexCoords[meshId]);
+	}
+	if (material->AlphaTexture != nullptr) {
+		if (m_lazyBuild) {
+			// Lazy objects are traced like instances, so the filters find the mesh id the same way
+			SetAlphaFilters(m_lazyObjectMap[meshId]->ObjectScene, 0u, &m_prototypeAlphaFilter);
+		} else {
+			SetAlphaFilters(m_scene, meshId, &m_meshAlphaFilter);
+		}
+	}
+
+	return meshId;
+}
+
+uint Scene::AddMeshToScene(RTCScene scene, Mesh *mesh) {
+	uint meshId = rtcNewTriangleMesh(scene, RTC_GEOMETRY_STATIC, mesh->Indices.size() / 3, mesh->Positions.size());
+	CheckEmbreeMemory();
+
+	float3a *vertices = (float3a *)rtcMapBuffer(scene, meshId, RTC_VERTEX_BUFFER);
+	CheckEmbreeMemory();
+	memcpy(vertices, &mesh->Positions[0], mesh->Positions.size() * sizeof(float3a));
+	rtcUnmapBuffer(scene, meshId, RTC_VERTEX_BUFFER);
+
+	uint *indices = (uint *)rtcMapBuffer(scene, meshId, RTC_INDEX_BUFFER);
+	CheckEmbreeMemory();
+	memcpy(indices, &mesh->Indices[0], mesh->Indices.size() * sizeof(int));
+	rtcUnmapBuffer(scene, meshId, RTC_INDEX_BUFFER);
+
+	uint64 normalBytes = sizeof(float3) * mesh->Normals.size();
+	if (!TrackMemory(MemoryCategory::MeshNormals, (int64)normalBytes)) {
+		OnMemoryBudgetExceeded(MemoryCategory::MeshNormals, normalBytes);
+	}
+	float3 *normals = (float3 *)_aligned_malloc(normalBytes, 16);
+	memcpy(normals, &mesh->Normals[0], normalBytes);
+	rtcSetBuffer(scene, meshId, RTC_USER_VERTEX_BUFFER0, normals, 0u, sizeof(float3));
+	m_normalBuffers.push_back(NormalBuffer{normals, normalBytes});
+
+	return meshId;
+}
+
+uint Scene::AddLazyObject(Mesh *mesh) {
+	RTCScene objectScene = rtcDeviceNewScene(m_device, RTC_SCENE_STATIC, (RTCAlgorithmFlags)m_algorithmFlags);
+	AddMeshToScene(objectScene, mesh);
+
+	uint meshId = rtcNewUserGeometry(m_scene, 1u);
+	CheckEmbreeMemory();
+
+	if (!TrackMemory(MemoryCategory::SceneContainers, sizeof(LazyObject))) {
+		OnMemoryBudgetExceeded(MemoryCategory::SceneContainers, sizeof(LazyObject));
+	}
+	LazyObject *object = new LazyObject();
+	object->Owner = this;
+	object->MeshId = meshId;
+	object->ObjectScene = objectScene;
+	object->BoundsMin = float3(std::numeric_limits<float>::max());
+	object->BoundsMax = float3(-std::numeric_limits<float>::max());
+	for (const float3a &position : mesh->Positions) {
+		object->BoundsMin = min(object->BoundsMin, float3(position.x, position.y, position.z));
+		object->BoundsMax = max(object->BoundsMax, float3(position.x, position.y, position.z));
+	}
+	object->BoundingSphere = mesh->BoundingSphere;
+	object->Built = false;
+	m_lazyObjects.push_back(object);
+	m_lazyObjectMap[meshId] = object;
+
+	rtcSetUserData(m_scene, meshId, object);
+	rtcSetBoundsFunction(m_scene, meshId, &Scene::LazyObjectBounds);
+	rtcSetIntersectFunction(m_scene, meshId, &Scene::LazyObjectIntersect);
+	rtcSetOccludedFunction(m_scene, meshId, &Scene::LazyObjectOccluded);
+	if (m_packetWidth >= 8u) {
+		rtcSetIntersectFunction8(m_scene, meshId, &Scene::LazyObjectIntersectPacket<8u, RTCRay8>);
+		rtcSetOccludedFunction8(m_scene, meshId, &Scene::LazyObjectOccludedPacket<8u, RTCRay8>);
+	}
+	if (m_packetWidth >= 16u) {
+		rtcSetIntersectFunction16(m_scene, meshId, &Scene::LazyObjectIntersectPacket<16u, RTCRay16>);
+		rtcSetOccludedFunction16(m_scene, meshId, &Scene::LazyObjectOccludedPacket<16u, RTCRay16>);
+	}
+
+	return meshId;
+}
+
+uint Scene::AddPrototype(Mesh *mesh) {
+	RTCScene prototype = rtcDeviceNewScene(m_device, RTC_SCENE_STATIC, (RTCAlgorithmFlags)m_algorithmFlags);
+	AddMeshToScene(prototype, mesh);
+
+	m_prototypes.push_back(prototype);
+	m_prototypeTexCoords.emplace_back();
+	BuildTexCoords(mesh, &m_prototypeTexCoords.back());
+	return (uint)m_prototypes.size() - 1u;
+}
+
+uint Scene::AddInstance(uint prototypeId, float3 translation, float scale, Material *material) {
+	uint meshId = rtcNewInstance2(m_scene, m_prototypes[prototypeId]);
+
+	// 3x4 column major
+	float transform[12] = {
+		scale, 0.0f, 0.0f,
+		0.0f, scale, 0.0f,
+		0.0f, 0.0f, scale,
+		translation.x, translation.y, translation.z
+	};
+	rtcSetTransform2(m_scene, meshId, RTC_MATRIX_COLUMN_MAJOR, transform);
+
+	m_materials[meshId] = material;
+	m_instances[meshId] = Instance{prototypeId, scale};
+
+	// The filters belong to the prototype's mesh, so every instance of it pays for the callback.
+	// Instances without a mask pass straight through PassesAlphaTest()
+	if (material->AlphaTexture != nullptr) {
+		SetAlphaFilters(m_prototypes[prototypeId], 0u, &m_prototypeAlphaFilter);
+	}
+
+	return meshId;
+}
+
+uint Scene::AddSpheres(const float4 *spheres, uint numSpheres, Material *material) {
+	uint meshId = rtcNewUserGeometry(m_scene, numSpheres);
+	CheckEmbreeMemory();
+
+	SphereSet &set = m_sphereSets[meshId];
+	set.MeshId = meshId;
+	set.Spheres.assign(spheres, spheres + numSpheres);
+	SetSphereFunctions(m_scene, &set, m_packetWidth);
+
 	m_materials[meshId] = material;
+	return meshId;
+}
+
+void Scene::AddSphere(float4 sphere, Material *material) {
+	AddSpheres(&sphere, 1u, material);
+}
+
+void Scene::AddSphere(float4 sphere, Material *material, float3 color, float radiantPower) {
+	uint meshId = AddSpheres(&sphere, 1u, material);
+
+	if (!TrackMemory(MemoryCategory::Lights, sizeof(SphereLight))) {
+		OnMemoryBudgetExceeded(MemoryCategory::Lights, sizeof(SphereLight));
+	}
+	SphereLight *light = new SphereLight(color, radiantPower, sphere, meshId);
+	m_lightList.push_back(light);
+	m_lightMap[meshId] = light;
+}
+
+void Scene::AddSubdivisionMesh(const SubdivisionMesh *mesh, Material *material, float tessellationRate, const Displacement *displacement) {
+	std::size_t numCreases = mesh->CreaseWeights.size();
+	uint meshId = rtcNewSubdivisionMesh(m_scene, RTC_GEOMETRY_STATIC, mesh->FaceVertexCounts.size(), mesh->Indices.size(), mesh->Positions.size(), numCreases, 0u, 0u);
+	CheckEmbreeMemory();
 
 	float3a *vertices = (float3a *)rtcMapBuffer(m_scene, meshId, RTC_VERTEX_BUFFER);
+	CheckEmbreeMemory();
 	memcpy(vertices, &mesh->Positions[0], mesh->Positions.size() * sizeof(float3a));
 	rtcUnmapBuffer(m_scene, meshId, RTC_VERTEX_BUFFER);
 
 	uint *indices = (uint *)rtcMapBuffer(m_scene, meshId, RTC_INDEX_BUFFER);
+	CheckEmbreeMemory();
 	memcpy(indices, &mesh->Indices[0], mesh->Indices.size() * sizeof(int));
 	rtcUnmapBuffer(m_scene, meshId, RTC_INDEX_BUFFER);
 
-	float3 *normals = (float3 *)_aligned_malloc(sizeof(float3) * mesh->Normals.size(), 16);
-	memcpy(normals, &mesh->Normals[0], sizeof(float3) * mesh->Normals.size());
-	rtcSetBuffer(m_scene, meshId, RTC_USER_VERTEX_BUFFER0, normals, 0u, sizeof(float3));
+	uint *faces = (uint *)rtcMapBuffer(m_scene, meshId, RTC_FACE_BUFFER);
+	CheckEmbreeMemory();
+	memcpy(faces, &mesh->FaceVertexCounts[0], mesh->FaceVertexCounts.size() * sizeof(uint));
+	rtcUnmapBuffer(m_scene, meshId, RTC_FACE_BUFFER);
 
-	return meshId;
+	if (numCreases != 0) {
+		uint *creaseIndices = (uint *)rtcMapBuffer(m_scene, meshId, RTC_EDGE_CREASE_INDEX_BUFFER);
+		CheckEmbreeMemory();
+		memcpy(creaseIndices, &mesh->CreaseIndices[0], numCreases * 2 * sizeof(int));
+		rtcUnmapBuffer(m_scene, meshId, RTC_EDGE_CREASE_INDEX_BUFFER);
+
+		float *creaseWeights = (float *)rtcMapBuffer(m_scene, meshId, RTC_EDGE_CREASE_WEIGHT_BUFFER);
+		CheckEmbreeMemory();
+		memcpy(creaseWeights, &mesh->CreaseWeights[0], numCreases * sizeof(float));
+		rtcUnmapBuffer(m_scene, meshId, RTC_EDGE_CREASE_WEIGHT_BUFFER);
+	}
+
+	rtcSetTessellationRate(m_scene, meshId, tessellationRate);
+
+	SubdivisionSet &set = m_subdivisionSets[meshId];
+	set.MeshId = meshId;
+	set.Displacement = displacement;
+	set.Init(mesh);
+	SetSubdivisionDisplacement(m_scene, &set);
+
+	m_materials[meshId] = material;
+}
+
+void Scene::SetTessellationCacheSize(uint64 bytes) {
+	rtcDeviceSetParameter1i(m_device, RTC_SOFTWARE_CACHE_SIZE, (ssize_t)bytes);
+}
+
+uint64 Scene::LightSize(const Light *light) {
+	if (dynamic_cast<const EnvironmentLight *>(light) != nullptr) {
+		return sizeof(EnvironmentLight);
+	}
+	if (dynamic_cast<const SphereLight *>(light) != nullptr) {
+		return sizeof(SphereLight);
+	}
+
+	return sizeof(AreaLight);
+}
+
+void Scene::BuildTexCoords(const Mesh *mesh, MeshTexCoords *texCoords) {
+	if (mesh->TexCoords.size() != mesh->Positions.size()) {
+		return;
+	}
+
+	std::size_t numTriangles = mesh->Indices.size() / 3;
+	texCoords->Corners.resize(numTriangles * 3);
+	texCoords->LodBiases.resize(numTriangles);
+	for (std::size_t i = 0; i < numTriangles; ++i) {
+		int i0 = mesh->Indices[i * 3];
+		int i1 = mesh->Indices[i * 3 + 1];
+		int i2 = mesh->Indices[i * 3 + 2];
+
+		float2 t0 = mesh->TexCoords[i0];
+		float2 t1 = mesh->TexCoords[i1];
+		float2 t2 = mesh->TexCoords[i2];
+		texCoords->Corners[i * 3] = t0;
+		texCoords->Corners[i * 3 + 1] = t1;
+		texCoords->Corners[i * 3 + 2] = t2;
+
+		// Twice the areas. The factors of 2 cancel out
+		float2 e1 = t1 - t0;
+		float2 e2 = t2 - t0;
+		float texCoordArea = std::abs(e1.x * e2.y - e1.y * e2.x);
+		float worldArea = length(cross(mesh->Positions[i1] - mesh->Positions[i0], mesh->Positions[i2] - mesh->Positions[i0]));
+		texCoords->LodBiases[i] = 0.5f * std::log2(std::max(texCoordArea, 1e-20f) / std::max(worldArea, 1e-20f));
+	}
 }
 
 void Scene::AddMesh(Mesh *mesh, Material *material) {
@@ -68,13 +368,305 @@ void Scene::AddMesh(Mesh *mesh, Material *material, float3 color, float radiantP
 		totalArea += 0.5f * length(cross(v0 - v1, v0 - v2));
 	}
 
+	if (!TrackMemory(MemoryCategory::Lights, sizeof(AreaLight))) {
+		OnMemoryBudgetExceeded(MemoryCategory::Lights, sizeof(AreaLight));
+	}
 	AreaLight *light = new AreaLight(color, radiantPower, totalArea, meshId, mesh->BoundingSphere);
 	m_lightList.push_back(light);
 	m_lightMap[meshId] = light;
 }
 
+void Scene::SetEnvironmentLight(EnvironmentLight *light) {
+	if (m_environmentLight != nullptr) {
+		m_lightList.erase(std::find(m_lightList.begin(), m_lightList.end(), m_environmentLight));
+		delete m_environmentLight;
+		TrackMemory(MemoryCategory::Lights, -(int64)sizeof(EnvironmentLight));
+	}
+
+	if (!TrackMemory(MemoryCategory::Lights, sizeof(EnvironmentLight))) {
+		OnMemoryBudgetExceeded(MemoryCategory::Lights, sizeof(EnvironmentLight));
+	}
+	m_environmentLight = light;
+	m_lightList.push_back(light);
+}
+
+Texture *Scene::LoadTexture(const char *filePath) {
+	Texture *texture = new Texture();
+	if (!texture->Open(filePath, &m_textureCache)) {
+		delete texture;
+		return nullptr;
+	}
+
+	m_textures.push_back(texture);
+	return texture;
+}
+
 void Scene::Commit() const {
+	ScopedTrace trace("Scene::Commit");
+
+	// Instances are built on top of the prototype BVHs, so those have to be built first
+	for (RTCScene prototype : m_prototypes) {
+		rtcCommit(prototype);
+		CheckEmbreeMemory();
+	}
 	rtcCommit(m_scene);
+	CheckEmbreeMemory();
+
+	if (!m_lazyObjects.empty()) {
+		StartLazyBuilds();
+	}
+}
+
+void Scene::BuildLazyObject(LazyObject *object) const {
+	if (object->Built.load(std::memory_order_acquire)) {
+		return;
+	}
+
+	// Embree lets the first thread to commit the scene build it. Any others that commit it at the same time
+	// join in on the build's tasks, and return once it's done, so they don't need a lock of their own.
+	// Isolating the commit keeps the thread from picking up another tile while it waits, which could
+	// commit a second object from inside the first one's build
+	tbb::this_task_arena::isolate([&]() {
+		ScopedTrace trace("Scene::BuildLazyObject", object->MeshId);
+		rtcCommit(object->ObjectScene);
+		CheckEmbreeMemory();
+
+		object->Built.store(true, std::memory_order_release);
+	});
+}
+
+/**
+ * A rough estimate of the fraction of the image covered by a bounding sphere. Only used to order the lazy builds
+ */
+static float ScreenCoverage(const CameraView &view, const float4 &boundingSphere) {
+	float3a toCenter = float3a(boundingSphere.x, boundingSphere.y, boundingSphere.z) - view.Origin;
+	float distanceSquared = sqr_length(toCenter);
+	float radiusSquared = boundingSphere.w * boundingSphere.w;
+	if (distanceSquared <= radiusSquared) {
+		return 1.0f;
+	}
+
+	// The area of the projected disc, over the area of the image plane at a distance of 1
+	float coverage = (float)M_PI * radiusSquared / (distanceSquared - radiusSquared) / (4.0f * view.TanFovXDiv2 * view.TanFovYDiv2);
+	float x, y;
+	if (!view.ProjectDirection(toCenter, &x, &y)) {
+		coverage *= kOffScreenCoverageWeight;
+	}
+
+	return std::min(coverage, 1.0f);
+}
+
+void Scene::StartLazyBuilds() const {
+	if (m_lazyBuildThread.joinable()) {
+		return;
+	}
+
+	CameraView view = Camera.GetView();
+	std::vector<std::pair<float, LazyObject *> > buildOrder;
+	buildOrder.reserve(m_lazyObjects.size());
+	for (LazyObject *object : m_lazyObjects) {
+		buildOrder.emplace_back(ScreenCoverage(view, object->BoundingSphere), object);
+	}
+	std::sort(buildOrder.begin(), buildOrder.end(), [](const std::pair<float, LazyObject *> &a, const std::pair<float, LazyObject *> &b) {
+		return a.first > b.first;
+	});
+
+	m_lazyBuildThread = std::thread([this, buildOrder]() {
+		ScopedTrace trace("Scene::LazyBuilds", (uint)buildOrder.size());
+		for (const std::pair<float, LazyObject *> &entry : buildOrder) {
+			if (m_stopLazyBuilds) {
+				return;
+			}
+			BuildLazyObject(entry.second);
+		}
+	});
+}
+
+void Scene::LazyObjectBounds(void *userData, size_t /* item */, RTCBounds &bounds) {
+	const LazyObject *object = (const LazyObject *)userData;
+
+	bounds.lower_x = object->BoundsMin.x;
+	bounds.lower_y = object->BoundsMin.y;
+	bounds.lower_z = object->BoundsMin.z;
+	bounds.upper_x = object->BoundsMax.x;
+	bounds.upper_y = object->BoundsMax.y;
+	bounds.upper_z = object->BoundsMax.z;
+}
+
+void Scene::LazyObjectIntersect(void *userData, RTCRay &ray, size_t /* item */) {
+	LazyObject *object = (LazyObject *)userData;
+	object->Owner->BuildLazyObject(object);
+
+	// Traced like an Embree instance with an identity transform. The instance id is how the alpha filters find the mesh
+	int geomId = ray.GeomID;
+	int instId = ray.InstID;
+	ray.GeomID = INVALID_GEOMETRY_ID;
+	ray.InstID = object->MeshId;
+	rtcIntersect(object->ObjectScene, ray);
+
+	if (ray.GeomID == (int)INVALID_GEOMETRY_ID) {
+		ray.GeomID = geomId;
+		ray.InstID = instId;
+	} else {
+		ray.GeomID = object->MeshId;
+		ray.InstID = INVALID_INSTANCE_ID;
+	}
+}
+
+void Scene::LazyObjectOccluded(void *userData, RTCRay &ray, size_t /* item */) {
+	LazyObject *object = (LazyObject *)userData;
+	object->Owner->BuildLazyObject(object);
+
+	int instId = ray.InstID;
+	ray.InstID = object->MeshId;
+	rtcOccluded(object->ObjectScene, ray);
+	ray.InstID = instId;
+}
+
+static void IntersectPacket(const void *valid, RTCScene scene, RTCRay8 &rays) {
+	rtcIntersect8(valid, scene, rays);
+}
+
+static void IntersectPacket(const void *valid, RTCScene scene, RTCRay16 &rays) {
+	rtcIntersect16(valid, scene, rays);
+}
+
+static void OccludedPacket(const void *valid, RTCScene scene, RTCRay8 &rays) {
+	rtcOccluded8(valid, scene, rays);
+}
+
+static void OccludedPacket(const void *valid, RTCScene scene, RTCRay16 &rays) {
+	rtcOccluded16(valid, scene, rays);
+}
+
+template <unsigned kWidth, typename RayPacketType>
+void Scene::LazyObjectIntersectPacket(const void *valid, void *userData, RayPacketType &rays, size_t /* item */) {
+	LazyObject *object = (LazyObject *)userData;
+	object->Owner->BuildLazyObject(object);
+
+	unsigned geomIds[kWidth];
+	unsigned instIds[kWidth];
+	for (uint i = 0; i < kWidth; ++i) {
+		geomIds[i] = rays.geomID[i];
+		instIds[i] = rays.instID[i];
+		rays.geomID[i] = INVALID_GEOMETRY_ID;
+		rays.instID[i] = object->MeshId;
+	}
+
+	IntersectPacket(valid, object->ObjectScene, rays);
+
+	for (uint i = 0; i < kWidth; ++i) {
+		if (rays.geomID[i] == INVALID_GEOMETRY_ID) {
+			rays.geomID[i] = geomIds[i];
+			rays.instID[i] = instIds[i];
+		} else {
+			rays.geomID[i] = object->MeshId;
+			rays.instID[i] = INVALID_INSTANCE_ID;
+		}
+	}
+}
+
+template <unsigned kWidth, typename RayPacketType>
+void Scene::LazyObjectOccludedPacket(const void *valid, void *userData, RayPacketType &rays, size_t /* item */) {
+	LazyObject *object = (LazyObject *)userData;
+	object->Owner->BuildLazyObject(object);
+
+	unsigned instIds[kWidth];
+	for (uint i = 0; i < kWidth; ++i) {
+		instIds[i] = rays.instID[i];
+		rays.instID[i] = object->MeshId;
+	}
+
+	OccludedPacket(valid, object->ObjectScene, rays);
+
+	for (uint i = 0; i < kWidth; ++i) {
+		rays.instID[i] = instIds[i];
+	}
+}
+
+void Scene::SetAlphaFilters(RTCScene scene, uint meshId, AlphaFilterData *filterData) {
+	rtcSetUserData(scene, meshId, filterData);
+
+	rtcSetIntersectionFilterFunction(scene, meshId, &Scene::AlphaFilter);
+	rtcSetOcclusionFilterFunction(scene, meshId, &Scene::AlphaFilter);
+	if (m_packetWidth >= 8u) {
+		rtcSetIntersectionFilterFunction8(scene, meshId, &Scene::AlphaFilterPacket<8u, RTCRay8>);
+		rtcSetOcclusionFilterFunction8(scene, meshId, &Scene::AlphaFilterPacket<8u, RTCRay8>);
+	}
+	if (m_packetWidth >= 16u) {
+		rtcSetIntersectionFilterFunction16(scene, meshId, &Scene::AlphaFilterPacket<16u, RTCRay16>);
+		rtcSetOcclusionFilterFunction16(scene, meshId, &Scene::AlphaFilterPacket<16u, RTCRay16>);
+	}
+}
+
+static uint FloatBits(float value) {
+	uint bits;
+	memcpy(&bits, &value, sizeof(uint));
+	return bits;
+}
+
+static uint AlphaTestHash(float originX, float originY, float originZ, float directionX, float directionY, float directionZ, uint primId) {
+	uint hash = 0u;
+	hash = HashMix(hash, FloatBits(originX));
+	hash = HashMix(hash, FloatBits(originY));
+	hash = HashMix(hash, FloatBits(originZ));
+	hash = HashMix(hash, FloatBits(directionX));
+	hash = HashMix(hash, FloatBits(directionY));
+	hash = HashMix(hash, FloatBits(directionZ));
+	hash = HashMix(hash, primId);
+
+	return HashFinalize(hash);
+}
+
+bool Scene::PassesAlphaTest(uint meshId, uint primId, float u, float v, uint hash) const {
+	auto iter = m_materials.find(meshId);
+	if (iter == m_materials.end() || iter->second->AlphaTexture == nullptr) {
+		return true;
+	}
+
+	float2 texCoord;
+	float lodBias;
+	if (!InterpolateTexCoords(meshId, primId, u, v, &texCoord, &lodBias)) {
+		return true;
+	}
+
+	// Filters don't know the width of the ray cone, so we always test against the finest level
+	float alpha = iter->second->AlphaTexture->Sample(texCoord, -infinity).x;
+	return alpha > (float)(hash >> 8) * (1.0f / 16777216.0f);
+}
+
+void Scene::AlphaFilter(void *userData, RTCRay &ray) {
+	const AlphaFilterData *filterData = (const AlphaFilterData *)userData;
+	uint meshId = filterData->Instanced && ray.InstID != (int)INVALID_INSTANCE_ID ? ray.InstID : ray.GeomID;
+
+	uint hash = AlphaTestHash(ray.Origin.x, ray.Origin.y, ray.Origin.z, ray.Direction.x, ray.Direction.y, ray.Direction.z, ray.PrimID);
+	if (!filterData->Owner->PassesAlphaTest(meshId, ray.PrimID, ray.U, ray.V, hash)) {
+		ray.GeomID = INVALID_GEOMETRY_ID;
+	}
+}
+
+template <unsigned kWidth, typename RayPacketType>
+void Scene::AlphaFilterPacket(const void *valid, void *userData, RayPacketType &rays) {
+	const AlphaFilterData *filterData = (const AlphaFilterData *)userData;
+	const int *validLanes = (const int *)valid;
+
+	for (uint i = 0; i < kWidth; ++i) {
+		if (validLanes[i] == 0) {
+			continue;
+		}
+
+		uint meshId = filterData->Instanced && rays.instID[i] != INVALID_INSTANCE_ID ? rays.instID[i] : rays.geomID[i];
+		uint hash = AlphaTestHash(rays.orgx[i], rays.orgy[i], rays.orgz[i], rays.dirx[i], rays.diry[i], rays.dirz[i], rays.primID[i]);
+		if (!filterData->Owner->PassesAlphaTest(meshId, rays.primID[i], rays.u[i], rays.v[i], hash)) {
+			rays.geomID[i] = INVALID_GEOMETRY_ID;
+		}
+	}
+}
+
+void Scene::CheckEmbreeMemory() const {
+	if (rtcDeviceGetError(m_device) == RTC_OUT_OF_MEMORY) {
+		OnMemoryBudgetExceeded(MemoryCategory::Embree, (uint64)g_refusedEmbreeAllocation.load());
+	}
 }
 
 Light *Scene::RandomOneLight(UniformSampler *sampler) {
@@ -89,11 +681,105 @@ Light *Scene::RandomOneLight(UniformSampler *sampler) {
 
 void Scene::Intersect(Ray &ray) const {
 	rtcIntersect(m_scene, ray);
+
+	if (!m_prototypes.empty()) {
+		ResolveInstanceHit(&ray.GeomID, ray.InstID);
+	}
+}
+
+void Scene::IntersectShadowRay(Ray &ray, const Medium *medium, UniformSampler *sampler, float3 *transmittance) const {
+	// Keeps a ray stuck between two coincident surfaces from looping forever
+	const uint kMaxIndexMatchedSurfaces = 16;
+
+	float3 attenuation(1.0f);
+	for (uint i = 0; ; ++i) {
+		Intersect(ray);
+		if (ray.GeomID == (int)INVALID_GEOMETRY_ID) {
+			break;
+		}
+
+		if (medium != nullptr) {
+			attenuation = attenuation * medium->Transmittance(sampler, ray.Origin, normalize(ray.Direction), ray.TFar);
+		}
+
+		if (i == kMaxIndexMatchedSurfaces) {
+			break;
+		}
+		auto iter = m_materials.find(ray.GeomID);
+		if (iter == m_materials.end()) {
+			break;
+		}
+		Material *material = iter->second;
+		if (!material->BSDF->IsIndexMatched()) {
+			break;
+		}
+
+		// Pass through the surface, entering or leaving its medium
+		attenuation = attenuation * material->BSDF->Albedo();
+		float3a normal = InterpolateNormal(ray.GeomID, ray.PrimID, ray.U, ray.V);
+		medium = dot(ray.Direction, normal) < 0.0f ? material->Medium : nullptr;
+
+		ray.Origin = ray.Origin + ray.Direction * ray.TFar;
+		ray.TNear = 0.001f;
+		ray.TFar = infinity;
+		ray.GeomID = INVALID_GEOMETRY_ID;
+		ray.PrimID = INVALID_PRIMATIVE_ID;
+		ray.InstID = INVALID_INSTANCE_ID;
+	}
+
+	*transmittance = attenuation;
+}
+
+void Scene::Intersect8(const int *valid, RTCRay8 &rays) const {
+	rtcIntersect8(valid, m_scene, rays);
+
+	if (!m_prototypes.empty()) {
+		for (uint i = 0; i < 8; ++i) {
+			ResolveInstanceHit((int *)&rays.geomID[i], (int)rays.instID[i]);
+		}
+	}
+}
+
+void Scene::Intersect16(const int *valid, RTCRay16 &rays) const {
+	rtcIntersect16(valid, m_scene, rays);
+
+	if (!m_prototypes.empty()) {
+		for (uint i = 0; i < 16; ++i) {
+			ResolveInstanceHit((int *)&rays.geomID[i], (int)rays.instID[i]);
+		}
+	}
 }
 
 float3 Scene::InterpolateNormal(uint meshId, uint primId, float u, float v) const {
+	if (!m_sphereSets.empty() && m_sphereSets.find(meshId) != m_sphereSets.end()) {
+		return SphereNormal(u, v);
+	}
+	if (!m_subdivisionSets.empty()) {
+		auto iter = m_subdivisionSets.find(meshId);
+		if (iter != m_subdivisionSets.end()) {
+			return SubdivisionNormal(m_scene, iter->second, primId, u, v);
+		}
+	}
+
+	// Instances only use translation and uniform scale, so the prototype's normals are already correct
+	RTCScene scene = m_scene;
+	if (!m_instances.empty()) {
+		auto iter = m_instances.find(meshId);
+		if (iter != m_instances.end()) {
+			scene = m_prototypes[iter->second.Prototype];
+			meshId = 0u;
+		}
+	}
+	if (scene == m_scene && !m_lazyObjectMap.empty()) {
+		auto iter = m_lazyObjectMap.find(meshId);
+		if (iter != m_lazyObjectMap.end()) {
+			scene = iter->second->ObjectScene;
+			meshId = 0u;
+		}
+	}
+
 	float3 normal;
-	rtcInterpolate(m_scene, meshId, primId, u, v, RTC_USER_VERTEX_BUFFER0, &normal.x, nullptr, nullptr, 3);
+	rtcInterpolate(scene, meshId, primId, u, v, RTC_USER_VERTEX_BUFFER0, &normal.x, nullptr, nullptr, 3);
 
 	if (AnyNan(normal)) {
 		printf("nan");
@@ -102,4 +788,56 @@ float3 Scene::InterpolateNormal(uint meshId, uint primId, float u, float v) cons
 	return normal;
 }
 
+bool Scene::InterpolateTexCoords(uint meshId, uint primId, float u, float v, float2 *texCoord, float *lodBias) const {
+	if (!m_sphereSets.empty()) {
+		auto iter = m_sphereSets.find(meshId);
+		if (iter != m_sphereSets.end()) {
+			// The whole texture is wrapped around the sphere
+			float radius = iter->second.Spheres[primId].w;
+			*texCoord = float2(u, v);
+			*lodBias = -0.5f * std::log2(4.0f * (float)M_PI * radius * radius);
+			return true;
+		}
+	}
+	if (!m_subdivisionSets.empty()) {
+		auto iter = m_subdivisionSets.find(meshId);
+		if (iter != m_subdivisionSets.end()) {
+			if (iter->second.TexCoords.empty()) {
+				return false;
+			}
+
+			*texCoord = iter->second.InterpolateTexCoords(primId, u, v);
+			*lodBias = iter->second.LodBiases[primId];
+			return true;
+		}
+	}
+
+	const MeshTexCoords *texCoords = nullptr;
+	float scale = 1.0f;
+	if (!m_instances.empty()) {
+		auto iter = m_instances.find(meshId);
+		if (iter != m_instances.end()) {
+			texCoords = &m_prototypeTexCoords[iter->second.Prototype];
+			scale = iter->second.Scale;
+		}
+	}
+	if (texCoords == nullptr) {
+		auto iter = m_meshTexCoords.find(meshId);
+		if (iter == m_meshTexCoords.end()) {
+			return false;
+		}
+		texCoords = &iter->second;
+	}
+	if (texCoords->Corners.empty()) {
+		return false;
+	}
+
+	const float2 *corners = &texCoords->Corners[primId * 3];
+	*texCoord = corners[0] * (1.0f - u - v) + corners[1] * u + corners[2] * v;
+	// Scaling an instance scales the world space area of its triangles by scale^2
+	*lodBias = texCoords->LodBiases[primId] - std::log2(scale);
+
+	return true;
+}
+
 } // End of namespace Lantern
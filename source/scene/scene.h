@@ -12,7 +12,15 @@
 
 #include "scene/light.h"
 #include "scene/ray.h"
+#include "scene/sphere_geometry.h"
+#include "scene/subdivision_geometry.h"
 
+#include "materials/textures/tile_cache.h"
+
+#include "profiling/memory_tracker.h"
+
+#include <atomic>
+#include <thread>
 #include <unordered_map>
 
 
@@ -20,11 +28,20 @@ struct __RTCDevice;
 typedef __RTCDevice * RTCDevice;
 struct __RTCScene;
 typedef __RTCScene * RTCScene;
+struct RTCRay8;
+struct RTCRay16;
+struct RTCBounds;
 
 namespace Lantern {
 
 struct Material;
+class EnvironmentLight;
+class Medium;
+class Texture;
+class UniformSampler;
 struct Mesh;
+struct SubdivisionMesh;
+class Displacement;
 
 class Scene {
 public:
@@ -36,22 +53,162 @@ public:
 	float3 BackgroundColor;
 
 private:
-	std::unordered_map<uint, Material *> m_materials;
-	std::vector<Light *> m_lightList;
-	std::unordered_map<uint, Light *> m_lightMap;
+	TrackedUnorderedMap<uint, Material *, MemoryCategory::SceneContainers> m_materials;
+	TrackedVector<Light *, MemoryCategory::SceneContainers> m_lightList;
+	TrackedUnorderedMap<uint, Light *, MemoryCategory::SceneContainers> m_lightMap;
+	// Also in m_lightList, so it's sampled like any other light
+	EnvironmentLight *m_environmentLight;
 
 	RTCDevice m_device;
 	RTCScene m_scene;
+	uint m_packetWidth;
+	// The RTCAlgorithmFlags every scene is created with, so instances support the same queries as the top level scene
+	int m_algorithmFlags;
+
+	// Each prototype is a scene holding a single mesh
+	TrackedVector<RTCScene, MemoryCategory::SceneContainers> m_prototypes;
+	struct Instance {
+		uint Prototype;
+		float Scale;
+	};
+	// Maps the mesh id of an instance to its prototype
+	TrackedUnorderedMap<uint, Instance, MemoryCategory::SceneContainers> m_instances;
+
+	// In lazy mode, every mesh is built into its own scene, which is placed in the top level scene as a user
+	// geometry with the mesh's bounds. The mesh's BVH is only built when a ray first reaches those bounds, or
+	// when the background builder gets to it, whichever comes first
+	bool m_lazyBuild;
+	struct LazyObject {
+		const Scene *Owner;
+		uint MeshId;
+		RTCScene ObjectScene;
+		float3 BoundsMin;
+		float3 BoundsMax;
+		float4 BoundingSphere;
+		std::atomic<bool> Built;
+	};
+	TrackedVector<LazyObject *, MemoryCategory::SceneContainers> m_lazyObjects;
+	TrackedUnorderedMap<uint, LazyObject *, MemoryCategory::SceneContainers> m_lazyObjectMap;
+	mutable std::thread m_lazyBuildThread;
+	mutable std::atomic<bool> m_stopLazyBuilds;
+
+	// Maps the mesh id of a sphere set to its spheres. Embree calls back into the sets, so they can't move
+	TrackedUnorderedMap<uint, SphereSet, MemoryCategory::SceneContainers> m_sphereSets;
+
+	// Maps the mesh id of a subdivision surface to its data. Embree calls back into the sets, so they can't move
+	TrackedUnorderedMap<uint, SubdivisionSet, MemoryCategory::SceneContainers> m_subdivisionSets;
+
+	// Embree doesn't copy user vertex buffers, so we own the normals
+	struct NormalBuffer {
+		float3 *Normals;
+		uint64 Bytes;
+	};
+	TrackedVector<NormalBuffer, MemoryCategory::SceneContainers> m_normalBuffers;
+
+	// The texture coordinates are stored three per triangle, so they can be interpolated without the index buffer
+	struct MeshTexCoords {
+		TrackedVector<float2, MemoryCategory::MeshTexCoords> Corners;
+		// 0.5 * log2(texture space area / world space area) of each triangle. Ray cones use it to pick the mip level
+		TrackedVector<float, MemoryCategory::MeshTexCoords> LodBiases;
+	};
+	TrackedUnorderedMap<uint, MeshTexCoords, MemoryCategory::SceneContainers> m_meshTexCoords;
+	// Parallel to m_prototypes
+	TrackedVector<MeshTexCoords, MemoryCategory::SceneContainers> m_prototypeTexCoords;
+
+	TileCache m_textureCache;
+	TrackedVector<Texture *, MemoryCategory::SceneContainers> m_textures;
+
+	// The user data of the alpha cutout filters
+	struct AlphaFilterData {
+		const Scene *Owner;
+		// Prototype meshes are hit through an instance, so the mesh id of the hit is the instance id
+		bool Instanced;
+	};
+	AlphaFilterData m_meshAlphaFilter;
+	AlphaFilterData m_prototypeAlphaFilter;
 
 public:
 	void SetCamera(float phi, float theta, float radius, float clientWidth, float clientHeight, float fov = M_PI_4) {
 		Camera = PinholeCamera(phi, theta, radius, clientWidth, clientHeight, fov);
 	}
 
+	/**
+	 * Switches the scene to a two-level, lazy build. Commit() only builds the top level BVH over the bounds
+	 * of each mesh, so rendering can start almost straight away. The BVH of each mesh is built the first
+	 * time a ray reaches its bounds, and a background thread builds the rest, in order of their estimated
+	 * screen coverage from the current camera. Only affects meshes added after it's called
+	 */
+	void EnableLazyBuild() { m_lazyBuild = true; }
+
 	void AddMesh(Mesh *mesh, Material *material);
 	void AddMesh(Mesh *mesh, Material *material, float3 color, float radiantPower);
+	/**
+	 * Adds a mesh that can be placed many times with AddInstance(). The prototype itself isn't rendered.
+	 * All the instances share the prototype's vertices, normals, and BVH
+	 *
+	 * @return    The id of the prototype
+	 */
+	uint AddPrototype(Mesh *mesh);
+	/**
+	 * Places a copy of a prototype in the scene. Instances behave exactly like meshes. Hits report the
+	 * mesh id of the instance, and it has its own material. Instances can't be lights.
+	 * Only translation and uniform scale are supported, so the normals don't need to be transformed
+	 *
+	 * @param prototypeId    The id returned by AddPrototype()
+	 * @param translation    The position of the prototype's origin
+	 * @param scale          The uniform scale applied to the prototype, before the translation
+	 * @return               The mesh id of the instance
+	 */
+	uint AddInstance(uint prototypeId, float3 translation, float scale, Material *material);
+	/**
+	 * Adds a set of analytic spheres that share a material. They're intersected exactly, with exact
+	 * normals, and each one only costs its center and radius, rather than a tessellated mesh
+	 *
+	 * @param spheres       The center in xyz, and the radius in w, of each sphere
+	 * @param numSpheres    The number of spheres
+	 * @return              The mesh id of the set. Hits report the index of the sphere as the primitive id
+	 */
+	uint AddSpheres(const float4 *spheres, uint numSpheres, Material *material);
+	void AddSphere(float4 sphere, Material *material);
+	/**
+	 * Adds an emissive analytic sphere. See SphereLight
+	 */
+	void AddSphere(float4 sphere, Material *material, float3 color, float radiantPower);
+	/**
+	 * Adds a Catmull-Clark subdivision surface. Embree tessellates the patches lazily, as rays reach them,
+	 * and keeps the results in its tessellation cache. So memory scales with the patches rays actually
+	 * touch, rather than with the whole surface at the finest rate. See SetTessellationCacheSize()
+	 *
+	 * @param mesh                The control cage
+	 * @param tessellationRate    The number of quads generated along each edge of the cage
+	 * @param displacement        Optional. Moves the surface along its normal as it's tessellated. The caller owns it,
+	 *                            and must keep it alive as long as the scene
+	 */
+	void AddSubdivisionMesh(const SubdivisionMesh *mesh, Material *material, float tessellationRate, const Displacement *displacement = nullptr);
+	/**
+	 * Surrounds the scene with an environment light. Rays that miss the scene see the environment, rather
+	 * than BackgroundColor. The scene takes ownership of the light, and deletes any previous one
+	 */
+	void SetEnvironmentLight(EnvironmentLight *light);
 	void Commit() const;
 
+	/**
+	 * Opens a texture, to be sampled through the scene's tile cache. The scene owns the texture
+	 *
+	 * @param filePath    See Texture::Open()
+	 * @return            The texture, or nullptr if it couldn't be read
+	 */
+	Texture *LoadTexture(const char *filePath);
+	/**
+	 * Sets the maximum number of bytes of texture tiles kept in memory at once
+	 */
+	void SetTextureCacheSize(uint64 bytes) { m_textureCache.SetCapacity(bytes); }
+	/**
+	 * Sets the size of Embree's cache of tessellated subdivision patches. It's shared by every scene on the device
+	 */
+	void SetTessellationCacheSize(uint64 bytes);
+	const TileCache &TextureCache() const { return m_textureCache; }
+
 	Material *GetMaterial(uint meshId) {
 		return m_materials[meshId];
 	}
@@ -63,14 +220,89 @@ public:
 			return nullptr;
 		}
 	}
+	const EnvironmentLight *GetEnvironmentLight() const { return m_environmentLight; }
 	std::size_t NumLights() const { return m_lightList.size(); }
 	Light *RandomOneLight(UniformSampler *sampler);
 
 	void Intersect(Ray &ray) const;
+	/**
+	 * Intersects a shadow ray with the scene. The ray passes through index matched surfaces, like the
+	 * boundaries of volumes, and is attenuated by the media it passes through on the way
+	 *
+	 * @param ray              The ray. Filled with the first hit that isn't on an index matched surface
+	 * @param medium           The medium the ray starts in, or nullptr
+	 * @param sampler          Used to estimate the transmittance of heterogeneous media
+	 * @param transmittance    Filled with the fraction of light that makes it from the hit to the ray origin
+	 */
+	void IntersectShadowRay(Ray &ray, const Medium *medium, UniformSampler *sampler, float3 *transmittance) const;
+	/**
+	 * Returns the widest ray packet supported by the device, or 1 if packets aren't supported.
+	 * Intersect8() and Intersect16() can only be used if this is >= 8 or >= 16, respectively
+	 */
+	uint PacketWidth() const { return m_packetWidth; }
+	void Intersect8(const int *valid, RTCRay8 &rays) const;
+	void Intersect16(const int *valid, RTCRay16 &rays) const;
 	float3 InterpolateNormal(uint meshId, uint primId, float u, float v) const;
+	/**
+	 * Interpolates the texture coordinates of a hit. Spheres use the lat-long coordinates of the hit
+	 *
+	 * @param texCoord    Filled with the texture coordinates
+	 * @param lodBias     Filled with 0.5 * log2(texture space area / world space area) of the triangle. Adding
+	 *                    log2 of the width of a ray cone gives log2 of its width in texture space
+	 * @return            False if the mesh doesn't have texture coordinates
+	 */
+	bool InterpolateTexCoords(uint meshId, uint primId, float u, float v, float2 *texCoord, float *lodBias) const;
 
 private:
 	uint AddMeshInternal(Mesh *mesh, Material *material);
+	uint AddMeshToScene(RTCScene scene, Mesh *mesh);
+	static uint64 LightSize(const Light *light);
+	uint AddLazyObject(Mesh *mesh);
+	/**
+	 * Builds the BVH of a lazy object, if it hasn't been already. Safe to call from any thread.
+	 * Threads that ask for an object while it's being built join in on the build, and return once it's done
+	 */
+	void BuildLazyObject(LazyObject *object) const;
+	void StartLazyBuilds() const;
+	static void LazyObjectBounds(void *userData, size_t item, RTCBounds &bounds);
+	static void LazyObjectIntersect(void *userData, RTCRay &ray, size_t item);
+	static void LazyObjectOccluded(void *userData, RTCRay &ray, size_t item);
+	template <unsigned kWidth, typename RayPacketType>
+	static void LazyObjectIntersectPacket(const void *valid, void *userData, RayPacketType &rays, size_t item);
+	template <unsigned kWidth, typename RayPacketType>
+	static void LazyObjectOccludedPacket(const void *valid, void *userData, RayPacketType &rays, size_t item);
+	/**
+	 * Leaves texCoords empty if the mesh doesn't have texture coordinates
+	 */
+	static void BuildTexCoords(const Mesh *mesh, MeshTexCoords *texCoords);
+	/**
+	 * Embree reports allocations over the memory budget as out of memory errors. We turn those into a clean exit
+	 */
+	void CheckEmbreeMemory() const;
+	/**
+	 * Adds the alpha cutout filters to a mesh, for both intersection and occlusion queries, and every
+	 * packet width we use. Rejected hits are discarded inside Embree, so traversal simply carries on
+	 */
+	void SetAlphaFilters(RTCScene scene, uint meshId, AlphaFilterData *filterData);
+	/**
+	 * Stochastic alpha test. The hit is kept if the mask is above a random number, hashed from the ray and the hit.
+	 * So each ray makes a single decision for each surface, whichever query or packet width traced it
+	 *
+	 * @return    True if the hit should be kept
+	 */
+	bool PassesAlphaTest(uint meshId, uint primId, float u, float v, uint hash) const;
+	static void AlphaFilter(void *userData, RTCRay &ray);
+	template <unsigned kWidth, typename RayPacketType>
+	static void AlphaFilterPacket(const void *valid, void *userData, RayPacketType &rays);
+	/**
+	 * Hits inside an instance report the mesh id inside the prototype, and the instance id separately.
+	 * We replace the mesh id with the instance id, so the rest of the renderer doesn't need to know about instances
+	 */
+	void ResolveInstanceHit(int *geomId, int instId) const {
+		if (instId != (int)INVALID_INSTANCE_ID) {
+			*geomId = instId;
+		}
+	}
 };
 
 } // End of namespace Lantern
@@ -0,0 +1,177 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "scene/sphere_geometry.h"
+
+#include "scene/ray.h"
+
+#include <embree2/rtcore.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace Lantern {
+
+static void SphereBounds(void *userData, size_t item, RTCBounds &bounds) {
+	const SphereSet *set = (const SphereSet *)userData;
+	const float4 &sphere = set->Spheres[item];
+
+	bounds.lower_x = sphere.x - sphere.w;
+	bounds.lower_y = sphere.y - sphere.w;
+	bounds.lower_z = sphere.z - sphere.w;
+	bounds.upper_x = sphere.x + sphere.w;
+	bounds.upper_y = sphere.y + sphere.w;
+	bounds.upper_z = sphere.z + sphere.w;
+}
+
+/**
+ * Finds the nearest intersection of a ray with a sphere, inside (tNear, tFar)
+ *
+ * The quadratic is solved in the form from Haines et al. 2019, "Precision Improvements for Ray / Sphere Intersection",
+ * which keeps its precision when the sphere is small, or far away, compared to the length of the ray direction
+ *
+ * @return    The distance along the ray, or tFar if the ray misses
+ */
+static float IntersectSphere(const float4 &sphere, const float3 &origin, const float3 &direction, float tNear, float tFar) {
+	float3 center(sphere.x, sphere.y, sphere.z);
+	float3 toOrigin = origin - center;
+
+	float a = dot(direction, direction);
+	float b = -dot(toOrigin, direction);
+	float3 toClosest = toOrigin + direction * (b / a);
+	float discriminant = a * (sphere.w * sphere.w - dot(toClosest, toClosest));
+	if (discriminant < 0.0f) {
+		return tFar;
+	}
+
+	float c = dot(toOrigin, toOrigin) - sphere.w * sphere.w;
+	float q = b + std::copysign(std::sqrt(discriminant), b);
+	float t0 = c / q;
+	float t1 = q / a;
+	if (t0 > t1) {
+		std::swap(t0, t1);
+	}
+
+	if (t0 > tNear && t0 < tFar) {
+		return t0;
+	}
+	if (t1 > tNear && t1 < tFar) {
+		return t1;
+	}
+	return tFar;
+}
+
+static void SphereHitCoordinates(const float4 &sphere, const float3 &hitPoint, float3 *geometricNormal, float *u, float *v) {
+	float3 normal = (hitPoint - float3(sphere.x, sphere.y, sphere.z)) / sphere.w;
+	*geometricNormal = normal;
+
+	float phi = std::atan2(normal.z, normal.x);
+	if (phi < 0.0f) {
+		phi += 2.0f * (float)M_PI;
+	}
+	*u = phi * (float)(0.5 * M_1_PI);
+	*v = std::acos(std::min(std::max(normal.y, -1.0f), 1.0f)) * (float)M_1_PI;
+}
+
+static void SphereIntersect(void *userData, RTCRay &ray, size_t item) {
+	const SphereSet *set = (const SphereSet *)userData;
+	const float4 &sphere = set->Spheres[item];
+
+	float3 origin(ray.Origin.x, ray.Origin.y, ray.Origin.z);
+	float3 direction(ray.Direction.x, ray.Direction.y, ray.Direction.z);
+	float t = IntersectSphere(sphere, origin, direction, ray.TNear, ray.TFar);
+	if (t >= ray.TFar) {
+		return;
+	}
+
+	float3 normal;
+	SphereHitCoordinates(sphere, origin + direction * t, &normal, &ray.U, &ray.V);
+	ray.TFar = t;
+	ray.GeomNormal = float3a(normal.x, normal.y, normal.z);
+	ray.GeomID = set->MeshId;
+	ray.PrimID = (int)item;
+	// Embree doesn't clear the instance id of an earlier hit when a later hit is closer
+	ray.InstID = INVALID_INSTANCE_ID;
+}
+
+static void SphereOccluded(void *userData, RTCRay &ray, size_t item) {
+	const SphereSet *set = (const SphereSet *)userData;
+
+	float3 origin(ray.Origin.x, ray.Origin.y, ray.Origin.z);
+	float3 direction(ray.Direction.x, ray.Direction.y, ray.Direction.z);
+	if (IntersectSphere(set->Spheres[item], origin, direction, ray.TNear, ray.TFar) < ray.TFar) {
+		ray.GeomID = 0;
+	}
+}
+
+template <unsigned kWidth, typename RayPacketType>
+static void SphereIntersectPacket(const void *valid, void *userData, RayPacketType &rays, size_t item) {
+	const SphereSet *set = (const SphereSet *)userData;
+	const float4 &sphere = set->Spheres[item];
+	const int *validLanes = (const int *)valid;
+
+	for (uint i = 0; i < kWidth; ++i) {
+		if (validLanes[i] == 0) {
+			continue;
+		}
+
+		float3 origin(rays.orgx[i], rays.orgy[i], rays.orgz[i]);
+		float3 direction(rays.dirx[i], rays.diry[i], rays.dirz[i]);
+		float t = IntersectSphere(sphere, origin, direction, rays.tnear[i], rays.tfar[i]);
+		if (t >= rays.tfar[i]) {
+			continue;
+		}
+
+		float3 normal;
+		SphereHitCoordinates(sphere, origin + direction * t, &normal, &rays.u[i], &rays.v[i]);
+		rays.tfar[i] = t;
+		rays.Ngx[i] = normal.x;
+		rays.Ngy[i] = normal.y;
+		rays.Ngz[i] = normal.z;
+		rays.geomID[i] = set->MeshId;
+		rays.primID[i] = (unsigned)item;
+		rays.instID[i] = INVALID_INSTANCE_ID;
+	}
+}
+
+template <unsigned kWidth, typename RayPacketType>
+static void SphereOccludedPacket(const void *valid, void *userData, RayPacketType &rays, size_t item) {
+	const SphereSet *set = (const SphereSet *)userData;
+	const float4 &sphere = set->Spheres[item];
+	const int *validLanes = (const int *)valid;
+
+	for (uint i = 0; i < kWidth; ++i) {
+		if (validLanes[i] == 0) {
+			continue;
+		}
+
+		float3 origin(rays.orgx[i], rays.orgy[i], rays.orgz[i]);
+		float3 direction(rays.dirx[i], rays.diry[i], rays.dirz[i]);
+		if (IntersectSphere(sphere, origin, direction, rays.tnear[i], rays.tfar[i]) < rays.tfar[i]) {
+			rays.geomID[i] = 0u;
+		}
+	}
+}
+
+void SetSphereFunctions(RTCScene scene, SphereSet *set, uint packetWidth) {
+	uint meshId = set->MeshId;
+	rtcSetUserData(scene, meshId, set);
+	rtcSetBoundsFunction(scene, meshId, &SphereBounds);
+
+	rtcSetIntersectFunction(scene, meshId, &SphereIntersect);
+	rtcSetOccludedFunction(scene, meshId, &SphereOccluded);
+	if (packetWidth >= 8u) {
+		rtcSetIntersectFunction8(scene, meshId, &SphereIntersectPacket<8u, RTCRay8>);
+		rtcSetOccludedFunction8(scene, meshId, &SphereOccludedPacket<8u, RTCRay8>);
+	}
+	if (packetWidth >= 16u) {
+		rtcSetIntersectFunction16(scene, meshId, &SphereIntersectPacket<16u, RTCRay16>);
+		rtcSetOccludedFunction16(scene, meshId, &SphereOccludedPacket<16u, RTCRay16>);
+	}
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,52 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+#include "math/vector_types.h"
+
+#include "profiling/memory_tracker.h"
+
+#include <cmath>
+
+
+struct __RTCScene;
+typedef __RTCScene * RTCScene;
+
+namespace Lantern {
+
+/**
+ * A set of analytic spheres, intersected exactly through Embree user geometry
+ *
+ * Hits report the index of the sphere as the primitive id. u and v are the lat-long coordinates of
+ * the hit on the sphere, so the exact normal can be rebuilt from them with SphereNormal(). v is 0 at
+ * the top of the sphere (+y), and u goes around y, starting at +x and going towards +z.
+ */
+struct SphereSet {
+	uint MeshId;
+	// The center of each sphere in xyz, and its radius in w
+	TrackedVector<float4, MemoryCategory::Spheres> Spheres;
+};
+
+/**
+ * Sets the bounds, intersect, and occluded functions of a user geometry, for single rays and every packet width we use
+ *
+ * @param scene          The scene the user geometry was created in
+ * @param set            The spheres. Must stay at the same address as long as the scene
+ * @param packetWidth    See Scene::PacketWidth()
+ */
+void SetSphereFunctions(RTCScene scene, SphereSet *set, uint packetWidth);
+
+inline float3 SphereNormal(float u, float v) {
+	float phi = u * 2.0f * (float)M_PI;
+	float theta = v * (float)M_PI;
+	float sinTheta = std::sin(theta);
+
+	return float3(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+}
+
+} // End of namespace Lantern
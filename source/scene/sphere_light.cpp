@@ -0,0 +1,116 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "scene/sphere_light.h"
+
+#include "scene/scene.h"
+
+#include "math/vector_math.h"
+
+#include "renderer/surface_interaction.h"
+#include "renderer/render_stats.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace Lantern {
+
+float SphereLight::OneMinusCosConeAngle(const float3a &position) const {
+	float3a toCenter = float3a(m_sphere.x, m_sphere.y, m_sphere.z) - position;
+	float sinSquared = m_sphere.w * m_sphere.w / sqr_length(toCenter);
+	if (sinSquared >= 1.0f) {
+		return 0.0f;
+	}
+
+	// Written this way, rather than 1 - cos, so distant lights don't round to an empty cone
+	float cosConeAngle = std::sqrt(1.0f - sinSquared);
+	return sinSquared / (1.0f + cosConeAngle);
+}
+
+float3 SphereLight::SampleLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float *pdf) const {
+	float oneMinusCosMax = OneMinusCosConeAngle(interaction.Position);
+	if (oneMinusCosMax == 0.0f) {
+		*pdf = 0.0f;
+		return float3(0.0f);
+	}
+
+	// Uniformly sample the cone around the direction to the center
+	float oneMinusCos = sampler->NextFloat() * oneMinusCosMax;
+	float cosTheta = 1.0f - oneMinusCos;
+	float sinTheta = std::sqrt(std::max(oneMinusCos * (2.0f - oneMinusCos), 0.0f));
+	float phi = sampler->NextFloat() * 2.0f * (float)M_PI;
+
+	float3a axis = normalize(float3a(m_sphere.x, m_sphere.y, m_sphere.z) - interaction.Position);
+	float3a direction = normalize(RotateToWorld(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta, axis));
+	interaction.InputDirection = direction;
+
+	// Check that the direction is above the horizon
+	if (!interaction.InMedium && dot(direction, interaction.Normal) <= 0.0f) {
+		*pdf = 0.0f;
+		return float3(0.0f);
+	}
+
+	// Make sure there's nothing occluding us
+	Ray ray;
+	ray.Origin = interaction.Position;
+	ray.Direction = direction;
+	ray.TNear = 0.001f;
+	ray.TFar = infinity;
+	ray.GeomID = INVALID_GEOMETRY_ID;
+	ray.PrimID = INVALID_PRIMATIVE_ID;
+	ray.InstID = INVALID_INSTANCE_ID;
+	ray.Mask = 0xFFFFFFFF;
+	ray.Time = 0.0f;
+
+	++ThreadCounters().ShadowRays;
+	float3 transmittance;
+	scene->IntersectShadowRay(ray, interaction.Medium, sampler, &transmittance);
+	if (ray.GeomID != (int)m_geomId) {
+		*pdf = 0.0f;
+		return float3(0.0f);
+	}
+
+	*pdf = 1.0f / (2.0f * (float)M_PI * oneMinusCosMax);
+	return m_radiance * transmittance;
+}
+
+float SphereLight::PdfLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float3 *Li) const {
+	// Check that wi is above the horizon
+	if (!interaction.InMedium && dot(interaction.InputDirection, interaction.Normal) <= 0.0f) {
+		return 0.0f;
+	}
+
+	float oneMinusCosMax = OneMinusCosConeAngle(interaction.Position);
+	if (oneMinusCosMax == 0.0f) {
+		return 0.0f;
+	}
+
+	// Make sure there's nothing occluding us
+	Ray ray;
+	ray.Origin = interaction.Position;
+	ray.Direction = interaction.InputDirection;
+	ray.TNear = 0.001f;
+	ray.TFar = infinity;
+	ray.GeomID = INVALID_GEOMETRY_ID;
+	ray.PrimID = INVALID_PRIMATIVE_ID;
+	ray.InstID = INVALID_INSTANCE_ID;
+	ray.Mask = 0xFFFFFFFF;
+	ray.Time = 0.0f;
+
+	++ThreadCounters().ShadowRays;
+	float3 transmittance;
+	scene->IntersectShadowRay(ray, interaction.Medium, sampler, &transmittance);
+	if (ray.GeomID != (int)m_geomId) {
+		return 0.0f;
+	}
+	*Li = m_radiance * transmittance;
+
+	// Any direction that hits the sphere is inside the cone
+	return 1.0f / (2.0f * (float)M_PI * oneMinusCosMax);
+}
+
+} // End of namespace Lantern
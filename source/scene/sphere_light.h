@@ -0,0 +1,50 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "scene/light.h"
+
+
+namespace Lantern {
+
+/**
+ * An emissive analytic sphere
+ *
+ * Rather than sampling points on the surface, we sample directions uniformly inside the cone the sphere
+ * subtends, so every sample hits the visible part of the light, and the solid angle pdf is exact.
+ */
+class SphereLight : public Light {
+public:
+	/**
+	 * @param color          The color of the light
+	 * @param radiantPower   The total power emitted by the light
+	 * @param sphere         The center in xyz, and the radius in w
+	 * @param geomId         The mesh id of the sphere set holding the sphere
+	 */
+	SphereLight(float3 color, float radiantPower, float4 sphere, uint geomId)
+		: Light(color * radiantPower * M_1_PI / (4.0f * M_PI * sphere.w * sphere.w)),
+		  m_sphere(sphere),
+		  m_geomId(geomId) {
+	}
+
+private:
+	float4 m_sphere;
+	uint m_geomId;
+
+public:
+	float3 SampleLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float *pdf) const override;
+	float PdfLi(UniformSampler *sampler, Scene *scene, SurfaceInteraction &interaction, float3 *Li) const override;
+
+private:
+	/**
+	 * Returns 1 - the cosine of the half angle of the cone the sphere subtends from a point,
+	 * or 0 if the point is inside the sphere
+	 */
+	float OneMinusCosConeAngle(const float3a &position) const;
+};
+
+} // End of namespace Lantern
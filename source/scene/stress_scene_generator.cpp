@@ -0,0 +1,158 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "scene/stress_scene_generator.h"
+
+#include "scene/scene.h"
+#include "scene/geometry_generator.h"
+
+#include "materials/material.h"
+#include "materials/bsdfs/lambert_bsdf.h"
+#include "materials/bsdfs/mirror_bsdf.h"
+#include "materials/bsdfs/ideal_specular_dielectric.h"
+#include "materials/media/non_scattering_medium.h"
+#include "materials/media/isotropic_scattering_medium.h"
+
+#include "math/uniform_sampler.h"
+#include "math/hash.h"
+
+#include "profiling/trace.h"
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+namespace Lantern {
+
+// The side length of the cube the spheres are scattered in
+static const float kCubeSize = 30.0f;
+// The number of unique sphere meshes generated at once
+static const uint kSphereBatchSize = 4096u;
+// The total radiant power of all the lights
+static const float kTotalLightPower = 5000.0f;
+static const uint kNumDiffuseColors = 8u;
+// Spheres are kept out of the glass shells, so they don't intersect them
+static const uint kMaxPlacementAttempts = 16u;
+
+struct SpherePlacement {
+	float3 Position;
+	Material *Surface;
+};
+
+static uint64 NumTriangles(const Mesh &mesh) {
+	return mesh.Indices.size() / 3;
+}
+
+uint64 GenerateStressScene(const StressSceneSettings &settings, Scene *scene) {
+	ScopedTrace trace("GenerateStressScene");
+
+	scene->SetCamera(M_PI_2 * 0.8f, M_PI_4, 60.0f, 1280.0f, 720.0f);
+
+	// Sharing a few materials keeps the material count independent of the scene size
+	std::vector<Material *> materials;
+	for (uint i = 0; i < kNumDiffuseColors; ++i) {
+		UniformSampler sampler(HashFinalize(HashMix(settings.Seed, i)));
+		materials.push_back(new Material(new LambertBSDF(float3(sampler.NextFloat(), sampler.NextFloat(), sampler.NextFloat())), nullptr));
+	}
+	materials.push_back(new Material(new MirrorBSDF(float3(0.95f)), nullptr));
+	materials.push_back(new Material(new IdealSpecularDielectric(float3(0.95f), 1.5f), nullptr));
+
+	uint64 numTriangles = 0u;
+
+	Mesh floorMesh;
+	CreateGrid(kCubeSize * 2.0f, kCubeSize * 2.0f, 2u, 2u, &floorMesh);
+	TranslateMesh(float3(0.0f, -kCubeSize * 0.5f, 0.0f), &floorMesh);
+	scene->AddMesh(&floorMesh, materials[0]);
+	numTriangles += NumTriangles(floorMesh);
+
+	// Lights
+	Material *black = new Material(new LambertBSDF(float3(0.0f)), nullptr);
+	uint numLights = std::max(settings.NumEmissiveMeshes, 1u);
+	for (uint i = 0; i < numLights; ++i) {
+		UniformSampler sampler(HashFinalize(HashMix(HashMix(settings.Seed, i), 0x4c494748u)));
+
+		Mesh lightMesh;
+		CreateGeosphere(3.0f / std::sqrt((float)numLights), 1u, &lightMesh);
+		float3 position = numLights == 1u ? float3(0.0f, kCubeSize, 0.0f) :
+		                  float3((sampler.NextFloat() - 0.5f) * kCubeSize, kCubeSize * (0.5f + sampler.NextFloat() * 0.5f), (sampler.NextFloat() - 0.5f) * kCubeSize);
+		TranslateMesh(position, &lightMesh);
+		scene->AddMesh(&lightMesh, black, float3(1.0f), kTotalLightPower / numLights);
+		numTriangles += NumTriangles(lightMesh);
+	}
+
+	// Nested glass shells, alternately filled with a clear and a scattering medium
+	float outerShellRadius = kCubeSize * 0.2f;
+	for (uint i = 0; i < settings.NumGlassLayers; ++i) {
+		Medium *medium;
+		if (i % 2 == 0) {
+			medium = new NonScatteringMedium(float3(0.9f, 0.95f, 0.9f), 4.0f);
+		} else {
+			medium = new IsotropicScatteringMedium(float3(0.9f, 0.4f, 0.3f), 4.0f, 0.5f);
+		}
+		Material *material = new Material(new IdealSpecularDielectric(float3(1.0f), 1.3f + 0.1f * (i % 3)), medium);
+
+		Mesh shell;
+		CreateGeosphere(outerShellRadius * (1.0f - (float)i / (settings.NumGlassLayers + 1)), 4u, &shell);
+		scene->AddMesh(&shell, material);
+		numTriangles += NumTriangles(shell);
+	}
+	float exclusionRadius = settings.NumGlassLayers > 0u ? outerShellRadius : 0.0f;
+
+	// Shrink the spheres as the count grows, so the cube doesn't fill up
+	float radius = 0.5f * kCubeSize / std::cbrt((float)std::max(settings.NumSpheres, 1u));
+	Mesh baseSphere;
+	CreateGeosphere(1.0f, settings.SphereSubdivisions, &baseSphere);
+
+	std::vector<SpherePlacement> placements(settings.NumSpheres);
+	tbb::parallel_for(0u, settings.NumSpheres, [&](uint i) {
+		UniformSampler sampler(HashFinalize(HashMix(settings.Seed, i)));
+
+		float3 position;
+		for (uint attempt = 0; attempt < kMaxPlacementAttempts; ++attempt) {
+			position = (float3(sampler.NextFloat(), sampler.NextFloat(), sampler.NextFloat()) - float3(0.5f)) * kCubeSize;
+			if (length(position) > exclusionRadius + radius) {
+				break;
+			}
+		}
+
+		placements[i].Position = position;
+		placements[i].Surface = materials[std::min((uint)(sampler.NextFloat() * materials.size()), (uint)materials.size() - 1u)];
+	});
+
+	if (settings.InstanceSpheres) {
+		uint prototype = scene->AddPrototype(&baseSphere);
+		for (const SpherePlacement &placement : placements) {
+			scene->AddInstance(prototype, placement.Position, radius, placement.Surface);
+		}
+	} else {
+		// Building the meshes is the expensive part, so that's done in parallel.
+		// Adding them to the scene has to be serial
+		std::vector<Mesh> batch;
+		for (uint start = 0; start < settings.NumSpheres; start += kSphereBatchSize) {
+			uint count = std::min(kSphereBatchSize, settings.NumSpheres - start);
+			batch.resize(count);
+
+			tbb::parallel_for(0u, count, [&](uint i) {
+				Mesh &sphere = batch[i];
+				sphere = baseSphere;
+				ScaleMesh(radius, &sphere);
+				TranslateMesh(placements[start + i].Position, &sphere);
+			});
+
+			for (uint i = 0; i < count; ++i) {
+				scene->AddMesh(&batch[i], placements[start + i].Surface);
+			}
+		}
+	}
+	numTriangles += NumTriangles(baseSphere) * settings.NumSpheres;
+
+	return numTriangles;
+}
+
+} // End of namespace Lantern
@@ -0,0 +1,55 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+
+
+namespace Lantern {
+
+class Scene;
+
+struct StressSceneSettings {
+	StressSceneSettings()
+		: NumSpheres(1024u),
+		  SphereSubdivisions(3u),
+		  InstanceSpheres(false),
+		  NumEmissiveMeshes(1u),
+		  NumGlassLayers(0u),
+		  Seed(1u) {
+	}
+
+	/** The number of spheres scattered through the scene */
+	uint NumSpheres;
+	/** The number of times the spheres' icosahedrons are subdivided. Each sphere has 20 * 4^n triangles */
+	uint SphereSubdivisions;
+	/**
+	 * If true, the spheres are instances of a single prototype. So the scene can reach huge triangle counts
+	 * with little memory. If false, every sphere is a unique mesh, and gets its own vertices and BVH nodes
+	 */
+	bool InstanceSpheres;
+	/** The number of small spherical lights. The total light power is split between them */
+	uint NumEmissiveMeshes;
+	/** The number of nested glass shells in the center of the scene. Alternate layers are filled with a scattering medium */
+	uint NumGlassLayers;
+	/** The same settings and seed always generate the same scene */
+	uint Seed;
+};
+
+/**
+ * Generates a scene of controllable size and complexity, for measuring how BVH builds, memory, light
+ * sampling and tracing scale.
+ *
+ * Unique sphere meshes are generated in parallel, in batches, so peak memory stays close to that of
+ * the final scene. Each sphere is placed using its own sampler, seeded from its index, so the scene
+ * doesn't depend on the number of threads. The caller is responsible for calling Scene::Commit()
+ *
+ * @return    The total number of triangles in the scene, counting every instance
+ */
+uint64 GenerateStressScene(const StressSceneSettings &settings, Scene *scene);
+
+} // End of namespace Lantern
@@ -0,0 +1,192 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#include "scene/subdivision_geometry.h"
+
+#include "scene/displacement.h"
+#include "scene/mesh_elements.h"
+
+#include <embree2/rtcore.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace Lantern {
+
+// The step, in face coordinates, used to difference the displaced surface
+static const float kNormalDelta = 1e-3f;
+
+/**
+ * Embree splits faces that aren't quads into one quad per corner, as a single subdivision step would. Their hits
+ * encode the index of the quad in the high bits of u and v, and the position inside it in the low bits
+ *
+ * @param u    Replaced by the position inside the quad, in [0, 1]
+ * @param v    Replaced by the position inside the quad, in [0, 1]
+ * @return     The corner of the face that the quad starts from
+ */
+static uint DecodeSubPatch(float *u, float *v) {
+	float x = 4.0f * *u;
+	float y = 4.0f * *v;
+	float column = std::floor(x);
+	float row = std::floor(y);
+	*u = 2.0f * (x - column);
+	*v = 2.0f * (y - row);
+
+	return 4u * (uint)row + (uint)column;
+}
+
+/**
+ * The inverse of DecodeSubPatch()
+ */
+static void EncodeSubPatch(uint subPatch, float *u, float *v) {
+	*u = 0.25f * ((float)(subPatch % 4u) + 0.5f * *u);
+	*v = 0.25f * ((float)(subPatch / 4u) + 0.5f * *v);
+}
+
+void SubdivisionSet::Init(const SubdivisionMesh *mesh) {
+	std::size_t numFaces = mesh->FaceVertexCounts.size();
+	bool hasTexCoords = mesh->TexCoords.size() == mesh->Positions.size();
+
+	FaceOffsets.resize(numFaces + 1);
+	FaceOffsets[0] = 0u;
+	for (std::size_t i = 0; i < numFaces; ++i) {
+		FaceOffsets[i + 1] = FaceOffsets[i] + mesh->FaceVertexCounts[i];
+	}
+
+	if (!hasTexCoords) {
+		TexCoords.clear();
+		LodBiases.clear();
+		return;
+	}
+
+	TexCoords.resize(mesh->Indices.size());
+	for (std::size_t i = 0; i < mesh->Indices.size(); ++i) {
+		TexCoords[i] = mesh->TexCoords[mesh->Indices[i]];
+	}
+
+	// Quads are measured by their diagonals. The factors of 0.5 cancel out
+	LodBiases.resize(numFaces);
+	for (std::size_t i = 0; i < numFaces; ++i) {
+		const int *corners = &mesh->Indices[FaceOffsets[i]];
+		const float2 *texCoords = &TexCoords[FaceOffsets[i]];
+		uint last = mesh->FaceVertexCounts[i] == 4u ? 3u : 2u;
+
+		float3 p0 = mesh->Positions[corners[0]];
+		float3 p1 = mesh->Positions[corners[1]];
+		float3 p2 = mesh->Positions[corners[2]];
+		float3 pLast = mesh->Positions[corners[last]];
+		float worldArea = last == 3u ? length(cross(p2 - p0, pLast - p1)) : length(cross(p1 - p0, p2 - p0));
+
+		float2 e1 = last == 3u ? texCoords[2] - texCoords[0] : texCoords[1] - texCoords[0];
+		float2 e2 = last == 3u ? texCoords[3] - texCoords[1] : texCoords[2] - texCoords[0];
+		float texCoordArea = std::abs(e1.x * e2.y - e1.y * e2.x);
+
+		LodBiases[i] = 0.5f * std::log2(std::max(texCoordArea, 1e-20f) / std::max(worldArea, 1e-20f));
+	}
+}
+
+float2 SubdivisionSet::InterpolateTexCoords(uint face, float u, float v) const {
+	if (TexCoords.empty()) {
+		return float2(0.0f, 0.0f);
+	}
+
+	const float2 *corners = &TexCoords[FaceOffsets[face]];
+	uint numCorners = FaceOffsets[face + 1] - FaceOffsets[face];
+	if (numCorners == 4u) {
+		return corners[0] * ((1.0f - u) * (1.0f - v)) + corners[1] * (u * (1.0f - v)) + corners[2] * (u * v) + corners[3] * ((1.0f - u) * v);
+	}
+
+	// The sub-quad runs from its corner, with u towards the middle of the next edge, and v towards
+	// the middle of the previous one. Its far corner is the center of the face
+	uint corner = std::min(DecodeSubPatch(&u, &v), numCorners - 1u);
+	float2 center(0.0f, 0.0f);
+	for (uint i = 0; i < numCorners; ++i) {
+		center = center + corners[i];
+	}
+	center = center * (1.0f / numCorners);
+	float2 next = (corners[corner] + corners[(corner + 1u) % numCorners]) * 0.5f;
+	float2 previous = (corners[corner] + corners[(corner + numCorners - 1u) % numCorners]) * 0.5f;
+
+	return corners[corner] * ((1.0f - u) * (1.0f - v)) + next * (u * (1.0f - v)) + center * (u * v) + previous * ((1.0f - u) * v);
+}
+
+static void DisplaceSubdivisionSurface(void *userData, unsigned /* geomId */, unsigned primId,
+                                       const float *u, const float *v,
+                                       const float *nx, const float *ny, const float *nz,
+                                       float *px, float *py, float *pz,
+                                       size_t numPoints) {
+	const SubdivisionSet *set = (const SubdivisionSet *)userData;
+
+	for (size_t i = 0; i < numPoints; ++i) {
+		float3 normal(nx[i], ny[i], nz[i]);
+		float height = set->Displacement->Height(float3(px[i], py[i], pz[i]), normal, set->InterpolateTexCoords(primId, u[i], v[i]));
+
+		px[i] += normal.x * height;
+		py[i] += normal.y * height;
+		pz[i] += normal.z * height;
+	}
+}
+
+void SetSubdivisionDisplacement(RTCScene scene, SubdivisionSet *set) {
+	if (set->Displacement == nullptr) {
+		return;
+	}
+
+	rtcSetUserData(scene, set->MeshId, set);
+
+	// The bounds are relative to the undisplaced patches
+	float maxHeight = set->Displacement->MaxHeight();
+	RTCBounds bounds;
+	bounds.lower_x = bounds.lower_y = bounds.lower_z = -maxHeight;
+	bounds.upper_x = bounds.upper_y = bounds.upper_z = maxHeight;
+	rtcSetDisplacementFunction(scene, set->MeshId, &DisplaceSubdivisionSurface, &bounds);
+}
+
+static float3 LimitSurfaceNormal(RTCScene scene, uint meshId, uint face, float u, float v, float3 *position) {
+	float3 dPdu;
+	float3 dPdv;
+	rtcInterpolate(scene, meshId, face, u, v, RTC_VERTEX_BUFFER, &position->x, &dPdu.x, &dPdv.x, 3);
+
+	return normalize(cross(dPdu, dPdv));
+}
+
+static float3 DisplacedPosition(RTCScene scene, const SubdivisionSet &set, uint face, float u, float v) {
+	float3 position;
+	float3 normal = LimitSurfaceNormal(scene, set.MeshId, face, u, v, &position);
+
+	return position + normal * set.Displacement->Height(position, normal, set.InterpolateTexCoords(face, u, v));
+}
+
+float3 SubdivisionNormal(RTCScene scene, const SubdivisionSet &set, uint face, float u, float v) {
+	if (set.Displacement == nullptr) {
+		float3 position;
+		return LimitSurfaceNormal(scene, set.MeshId, face, u, v, &position);
+	}
+
+	// Other faces are differenced inside the sub-quad of the hit, so the steps can't land in a different one
+	bool quad = set.FaceOffsets[face + 1] - set.FaceOffsets[face] == 4u;
+	uint subPatch = quad ? 0u : DecodeSubPatch(&u, &v);
+	auto position = [&](float stepU, float stepV) {
+		if (!quad) {
+			EncodeSubPatch(subPatch, &stepU, &stepV);
+		}
+		return DisplacedPosition(scene, set, face, stepU, stepV);
+	};
+
+	// Step inwards at the edges of the quad, and flip the result to match
+	float du = u + kNormalDelta <= 1.0f ? kNormalDelta : -kNormalDelta;
+	float dv = v + kNormalDelta <= 1.0f ? kNormalDelta : -kNormalDelta;
+
+	float3 p = position(u, v);
+	float3 pu = position(u + du, v);
+	float3 pv = position(u, v + dv);
+	float3 normal = cross(pu - p, pv - p);
+
+	return normalize(du * dv < 0.0f ? -normal : normal);
+}
+
+} // End of namespace Lantern
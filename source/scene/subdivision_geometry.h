@@ -0,0 +1,67 @@
+/* Lantern - A path tracer
+*
+* Lantern is the legal property of Adrian Astley
+* Copyright Adrian Astley 2015 - 2016
+*/
+
+#pragma once
+
+#include "math/int_types.h"
+#include "math/vector_types.h"
+
+#include "profiling/memory_tracker.h"
+
+
+struct __RTCScene;
+typedef __RTCScene * RTCScene;
+
+namespace Lantern {
+
+class Displacement;
+struct SubdivisionMesh;
+
+/**
+ * The data we keep for a subdivision surface, alongside Embree's copy of the control cage
+ *
+ * Hits report the face as the primitive id. On quads, u and v run from the first corner to the second,
+ * and from the first corner to the fourth. Other faces are split into a quad per corner, and u and v
+ * encode the quad, as well as the position inside it. See the Embree documentation of rtcNewSubdivisionMesh.
+ */
+struct SubdivisionSet {
+	uint MeshId;
+	const Displacement *Displacement;
+	// The index of the first corner of each face, plus one past the last corner
+	TrackedVector<uint, MemoryCategory::SceneContainers> FaceOffsets;
+	// The texture coordinates of each corner of each face. Empty if the mesh doesn't have texture coordinates
+	TrackedVector<float2, MemoryCategory::MeshTexCoords> TexCoords;
+	// See Scene::InterpolateTexCoords(). One per face, computed from the control cage
+	TrackedVector<float, MemoryCategory::MeshTexCoords> LodBiases;
+
+	/**
+	 * Fills the set from the control cage. MeshId and Displacement are left to the caller
+	 */
+	void Init(const SubdivisionMesh *mesh);
+	/**
+	 * Bilinearly interpolates the texture coordinates of the face's corners, or of the sub-quad for faces that
+	 * aren't quads. Returns (0, 0) if there aren't any
+	 */
+	float2 InterpolateTexCoords(uint face, float u, float v) const;
+};
+
+/**
+ * Sets the displacement function of a subdivision mesh, if it has a Displacement
+ *
+ * @param scene    The scene the mesh was created in
+ * @param set      The mesh's data. Must stay at the same address as long as the scene
+ */
+void SetSubdivisionDisplacement(RTCScene scene, SubdivisionSet *set);
+
+/**
+ * Calculates the normal of a subdivision surface, including any displacement
+ *
+ * Displaced normals are found by finite differences of the displaced limit surface, so they follow
+ * the displacement smoothly, rather than the facets of the tessellation.
+ */
+float3 SubdivisionNormal(RTCScene scene, const SubdivisionSet &set, uint face, float u, float v);
+
+} // End of namespace Lantern
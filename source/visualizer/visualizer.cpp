@@ -10,11 +10,16 @@
 
 #include "scene/scene.h"
 
+#include "profiling/trace.h"
+#include "profiling/memory_tracker.h"
+
 #include <GLFW/glfw3.h>
 
 #include <imgui.h>
 #include <imgui_impl.h>
 
+#include <algorithm>
+#include <cfloat>
 #include <cstdio>
 #include <cstdlib>
 #include <chrono>
@@ -26,18 +31,32 @@ namespace Lantern {
 // Needed for message pump callbacks
 Visualizer *g_visualizer;
 
+const float Visualizer::kCostNormalizationPercentile = 0.99f;
+
 Visualizer::Visualizer(Renderer *renderer, Scene *scene)
 		: m_renderer(renderer),
 		  m_scene(scene),
+		  m_denoise(false),
+		  m_denoisedValid(false),
+		  m_lastDenoisedFrame(0u),
+		  m_costView(0),
+		  m_costOverlayOpacity(1.0f),
 		  m_window(nullptr),
 		  m_leftMouseCaptured(false),
-		  m_middleMouseCaptured(false) {
+		  m_middleMouseCaptured(false),
+		  m_inspectingPixel(false),
+		  m_inspectedPixelX(0u),
+		  m_inspectedPixelY(0u),
+		  m_framesToRecord(16),
+		  m_inspectedEventsValid(false) {
 	m_tempFrameBuffer = new float3[scene->Camera.FrameBuffer.Width * scene->Camera.FrameBuffer.Height];
+	m_denoisedFrameBuffer = new float3[scene->Camera.FrameBuffer.Width * scene->Camera.FrameBuffer.Height];
 	g_visualizer = this;
 }
 
 Visualizer::~Visualizer() {
 	delete[] m_tempFrameBuffer;
+	delete[] m_denoisedFrameBuffer;
 }
 
 static void error_callback(int error, const char *description) {
@@ -68,8 +87,69 @@ void Visualizer::Run() {
 		int minutes = std::chrono::duration_cast<std::chrono::minutes>(runTime).count();
 		int seconds = std::chrono::duration_cast<std::chrono::seconds>(runTime).count() - minutes * 60;
 		ImGui::Text("Run time - %d:%d (min:sec)", minutes, seconds);
+
+		uint previewScale = m_renderer->PreviewScale();
+		if (previewScale > 1u) {
+			ImGui::Text("Preview - 1/%u resolution", previewScale);
+		} else {
+			ImGui::Text("Full resolution");
+		}
+
+		const RenderStats &stats = m_renderer->Stats();
+		const RenderCounters &counters = stats.LastFrame();
+		ImGui::Text("%.2f Mrays/s", stats.LastFrameRaysPerSecond() * 1.0e-6f);
+		if (ImGui::CollapsingHeader("Counters")) {
+			ImGui::Text("Primary rays:        %llu", (unsigned long long)counters.PrimaryRays);
+			ImGui::Text("Continuation rays:   %llu", (unsigned long long)counters.ContinuationRays);
+			ImGui::Text("Shadow rays:         %llu", (unsigned long long)counters.ShadowRays);
+			ImGui::Text("Russian roulette:    %llu", (unsigned long long)counters.RussianRouletteTerminations);
+			ImGui::Text("Over max bounces:    %llu", (unsigned long long)counters.MaxBounceTerminations);
+			ImGui::Text("Medium scatters:     %llu", (unsigned long long)counters.MediumScatterEvents);
+			ImGui::Text("Over max walk:       %llu", (unsigned long long)counters.MediumWalkTerminations);
+			ImGui::Text("Light rejections:    %llu", (unsigned long long)counters.LightSampleRejections);
+			ImGui::Text("NaNs (total):        %llu", (unsigned long long)stats.Total().NaNs);
+
+			float histogram[RenderCounters::kBounceHistogramSize];
+			for (uint i = 0; i < RenderCounters::kBounceHistogramSize; ++i) {
+				histogram[i] = (float)counters.BounceHistogram[i];
+			}
+			ImGui::PlotHistogram("Bounces", histogram, RenderCounters::kBounceHistogramSize, 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+		}
+
+		if (ImGui::CollapsingHeader("Memory")) {
+			for (uint i = 0; i < MemoryCategory::NumCategories; ++i) {
+				ImGui::Text("%-20s %8.2f MB", MemoryCategoryName((MemoryCategory::Type)i), TrackedMemory((MemoryCategory::Type)i) / (1024.0f * 1024.0f));
+			}
+			ImGui::Text("%-20s %8.2f MB", "Total", TotalTrackedMemory() / (1024.0f * 1024.0f));
+			ImGui::Text("%-20s %8.2f MB", "Peak", PeakTrackedMemory() / (1024.0f * 1024.0f));
+			if (MemoryBudget() != 0u) {
+				ImGui::ProgressBar((float)TotalTrackedMemory() / MemoryBudget(), ImVec2(-1.0f, 0.0f), "Budget");
+			}
+		}
+
+		ImGui::Checkbox("Progressive preview", &m_renderer->ProgressivePreview);
+		ImGui::Checkbox("Temporal reprojection", &m_renderer->TemporalReprojection);
+		ImGui::Checkbox("Cache primary hits", &m_renderer->CachePrimaryHits);
+		ImGui::Checkbox("Guided medium walks", &m_renderer->GuidedMediumWalks);
+		ImGui::Checkbox("Denoise", &m_denoise);
+		ImGui::Combo("View", &m_costView, "Color\0Cycles\0Rays\0Path length\0");
+		m_renderer->CollectPixelCosts = m_costView != 0;
+		if (m_costView != 0) {
+			ImGui::SliderFloat("Overlay opacity", &m_costOverlayOpacity, 0.0f, 1.0f);
+		}
+		if (ImGui::Button("Save trace")) {
+			if (WriteChromeTrace("lantern_trace.json")) {
+				printf("Wrote lantern_trace.json\n");
+			} else {
+				printf("Failed to write lantern_trace.json\n");
+			}
+		}
 		ImGui::End();
 
+		#ifdef LANTERN_ENABLE_PATH_RECORDING
+			ShowPathInspector();
+		#endif
+
 		if (delta >= 0) {
 			CopyFrameBufferToGPU();
 			lastRender = std::chrono::high_resolution_clock::now();
@@ -90,6 +170,10 @@ void Visualizer::Run() {
 		glVertex2d(-1.0, 1.0);
 		glEnd();
 
+		#ifdef LANTERN_ENABLE_PATH_RECORDING
+			DrawInspectedPaths();
+		#endif
+
 		// Render UI
 		ImGui::Render();
 
@@ -112,6 +196,18 @@ void Visualizer::MouseButtonCallback(GLFWwindow *window, int button, int action,
 		g_visualizer->m_middleMouseCaptured = false;
 	}
 
+	#ifdef LANTERN_ENABLE_PATH_RECORDING
+		if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && mods == GLFW_MOD_CONTROL && !ImGui::GetIO().WantCaptureMouse) {
+			double x, y;
+			glfwGetCursorPos(window, &x, &y);
+
+			const FrameBuffer &frameBuffer = g_visualizer->m_scene->Camera.FrameBuffer;
+			if (x >= 0.0 && x < frameBuffer.Width && y >= 0.0 && y < frameBuffer.Height) {
+				g_visualizer->InspectPixel((uint)x, (uint)y);
+			}
+		}
+	#endif
+
 	g_visualizer->m_imGuiImpl.MouseButtonCallback(window, button, action, mods);
 }
 
@@ -124,7 +220,7 @@ void Visualizer::CursorPosCallback(GLFWwindow *window, double xpos, double ypos)
 		g_visualizer->m_scene->Camera.Rotate((float)(oldY - g_visualizer->m_lastMousePosY) / 300,
 		                                     (float)(oldX - g_visualizer->m_lastMousePosX) / 300);
 
-		g_visualizer->m_scene->Camera.FrameBuffer.Reset();
+		g_visualizer->OnCameraMoved();
 	} else if (g_visualizer->m_middleMouseCaptured) {
 		double oldX = g_visualizer->m_lastMousePosX;
 		double oldY = g_visualizer->m_lastMousePosY;
@@ -133,13 +229,13 @@ void Visualizer::CursorPosCallback(GLFWwindow *window, double xpos, double ypos)
 		g_visualizer->m_scene->Camera.Pan((float)(oldX - g_visualizer->m_lastMousePosX) * 0.01,
 		                                  (float)(g_visualizer->m_lastMousePosY - oldY) * 0.01);
 
-		g_visualizer->m_scene->Camera.FrameBuffer.Reset();
+		g_visualizer->OnCameraMoved();
 	}
 }
 
 void Visualizer::ScrollCallback(GLFWwindow *window, double xoffset, double yoffset) {
 	g_visualizer->m_scene->Camera.Zoom(yoffset);
-	g_visualizer->m_scene->Camera.FrameBuffer.Reset();
+	g_visualizer->OnCameraMoved();
 
 	g_visualizer->m_imGuiImpl.ScrollCallback(window, xoffset, yoffset);
 }
@@ -202,22 +298,268 @@ void Visualizer::Shutdown() {
 }
 
 
+void Visualizer::OnCameraMoved() {
+	m_renderer->OnCameraMoved();
+
+	// Wait for a few frames to accumulate before denoising again
+	m_denoisedValid = false;
+	m_lastDenoisedFrame = m_renderer->FrameNumber();
+}
+
+void Visualizer::InspectPixel(uint x, uint y) {
+	m_inspectingPixel = true;
+	m_inspectedPixelX = x;
+	m_inspectedPixelY = y;
+	m_inspectedEventsValid = false;
+	m_inspectedEvents.clear();
+
+	m_renderer->GetPathRecorder().Start(x, y, x + 1, y + 1, (uint)m_framesToRecord);
+}
+
+static const char *PathEventName(PathEventType::Type type) {
+	switch (type) {
+	case PathEventType::Camera: return "Camera";
+	case PathEventType::Bounce: return "Bounce";
+	case PathEventType::NextEventEstimation: return "Light sample";
+	case PathEventType::MediumScatter: return "Medium scatter";
+	case PathEventType::RussianRoulette: return "Russian roulette";
+	case PathEventType::Miss: return "Miss";
+	case PathEventType::MaxBounces: return "Max bounces";
+	default: return "Unknown";
+	}
+}
+
+void Visualizer::ShowPathInspector() {
+	PathRecorder &recorder = m_renderer->GetPathRecorder();
+
+	ImGui::SetNextWindowPos(ImVec2(0, 200), ImGuiSetCond_FirstUseEver);
+	ImGui::Begin("Path Inspector", nullptr, ImVec2(350, 400));
+	ImGui::SliderInt("Frames to record", &m_framesToRecord, 1, 256);
+
+	if (!m_inspectingPixel) {
+		ImGui::Text("Ctrl + click a pixel to record its paths");
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Text("Pixel (%u, %u)", m_inspectedPixelX, m_inspectedPixelY);
+	if (ImGui::Button("Record again")) {
+		InspectPixel(m_inspectedPixelX, m_inspectedPixelY);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Clear")) {
+		recorder.Stop();
+		m_inspectingPixel = false;
+		m_inspectedEvents.clear();
+		ImGui::End();
+		return;
+	}
+
+	if (recorder.IsRecording()) {
+		ImGui::Text("Recording...");
+		ImGui::End();
+		return;
+	}
+
+	if (!m_inspectedEventsValid) {
+		recorder.GetPixelEvents(m_inspectedPixelX, m_inspectedPixelY, &m_inspectedEvents);
+		m_inspectedEventsValid = true;
+	}
+
+	// List each path, with its events in a collapsible tree
+	std::size_t pathStart = 0;
+	while (pathStart < m_inspectedEvents.size()) {
+		uint pathId = m_inspectedEvents[pathStart].PathID;
+		std::size_t pathEnd = pathStart;
+		while (pathEnd < m_inspectedEvents.size() && m_inspectedEvents[pathEnd].PathID == pathId) {
+			++pathEnd;
+		}
+
+		const PathEvent &last = m_inspectedEvents[pathEnd - 1];
+		ImGui::PushID((int)pathId);
+		if (ImGui::TreeNode("Path", "Path %u - %u bounces - %s", pathId, (uint)last.Bounce, PathEventName(last.Type))) {
+			for (std::size_t i = pathStart; i < pathEnd; ++i) {
+				const PathEvent &event = m_inspectedEvents[i];
+				ImGui::Text("%2u %-16s (%.3f, %.3f, %.3f) T=(%.3f, %.3f, %.3f)", (uint)event.Bounce, PathEventName(event.Type),
+				            event.Position.x, event.Position.y, event.Position.z,
+				            event.Throughput.x, event.Throughput.y, event.Throughput.z);
+			}
+			ImGui::TreePop();
+		}
+		ImGui::PopID();
+
+		pathStart = pathEnd;
+	}
+
+	ImGui::End();
+}
+
+/**
+ * Projects a world-space point to OpenGL clip space, ignoring the edges of the image
+ *
+ * @return    False if the point is behind the camera
+ */
+static bool ProjectToClipSpace(const CameraView &view, float3a point, float *x, float *y) {
+	float3a direction = point - view.Origin;
+	float localZ = -dot(direction, view.ZAxis);
+	if (localZ <= 1.0e-4f) {
+		return false;
+	}
+
+	*x = dot(direction, view.XAxis) / (localZ * view.TanFovXDiv2);
+	*y = dot(direction, view.YAxis) / (localZ * view.TanFovYDiv2);
+	return true;
+}
+
+static void DrawLine(const CameraView &view, float3a start, float3a end) {
+	float x0, y0, x1, y1;
+	if (ProjectToClipSpace(view, start, &x0, &y0) && ProjectToClipSpace(view, end, &x1, &y1)) {
+		glVertex2f(x0, y0);
+		glVertex2f(x1, y1);
+	}
+}
+
+void Visualizer::DrawInspectedPaths() {
+	if (!m_inspectingPixel || m_inspectedEvents.empty()) {
+		return;
+	}
+
+	CameraView view = m_scene->Camera.GetView();
+
+	glDisable(GL_TEXTURE_2D);
+	glBegin(GL_LINES);
+
+	float3a vertex(0.0f);
+	for (const PathEvent &event : m_inspectedEvents) {
+		float3a position(event.Position.x, event.Position.y, event.Position.z);
+		float3a direction(event.Direction.x, event.Direction.y, event.Direction.z);
+
+		switch (event.Type) {
+		case PathEventType::Camera:
+			vertex = position;
+			break;
+		case PathEventType::Bounce:
+			glColor3f(1.0f, 0.8f, 0.2f);
+			DrawLine(view, vertex, position);
+			vertex = position;
+			break;
+		case PathEventType::MediumScatter:
+			glColor3f(1.0f, 0.3f, 0.2f);
+			DrawLine(view, vertex, position);
+			vertex = position;
+			break;
+		case PathEventType::NextEventEstimation:
+			// We don't know where the light sample is, so just show the direction
+			glColor3f(0.2f, 1.0f, 0.3f);
+			DrawLine(view, position, position + direction * (0.25f * length(position - view.Origin)));
+			break;
+		case PathEventType::Miss:
+			glColor3f(0.3f, 0.6f, 1.0f);
+			DrawLine(view, position, position + direction * 1000.0f);
+			break;
+		case PathEventType::RussianRoulette:
+		case PathEventType::MaxBounces:
+			// Draw a small cross where the path ended
+			glColor3f(1.0f, 0.2f, 1.0f);
+			{
+				float size = 0.01f * length(position - view.Origin);
+				DrawLine(view, position - view.XAxis * size, position + view.XAxis * size);
+				DrawLine(view, position - view.YAxis * size, position + view.YAxis * size);
+			}
+			break;
+		}
+	}
+
+	glEnd();
+
+	// The texture is modulated by the current color, so reset it
+	glColor3f(1.0f, 1.0f, 1.0f);
+	glEnable(GL_TEXTURE_2D);
+}
+
 void Visualizer::CopyFrameBufferToGPU() {
+	ScopedTrace trace("CopyFrameBufferToGPU");
+
 	FrameBuffer *frameBuffer = &m_scene->Camera.FrameBuffer;
 
 	uint width = frameBuffer->Width;
 	uint height = frameBuffer->Height;
 
+	// Denoising takes much longer than a frame, so we only do it every kDenoiseInterval frames
+	// Previews are left as-is, since they don't have any features
+	if (m_denoise && m_renderer->PreviewScale() == 1u) {
+		uint frameNumber = m_renderer->FrameNumber();
+		if (frameNumber - m_lastDenoisedFrame >= kDenoiseInterval) {
+			m_denoiser.Denoise(*frameBuffer, m_denoisedFrameBuffer);
+			m_denoisedValid = true;
+			m_lastDenoisedFrame = frameNumber;
+		}
+
+		if (m_denoisedValid) {
+			OverlayPixelCosts(m_denoisedFrameBuffer, m_tempFrameBuffer);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_FLOAT, m_tempFrameBuffer);
+			return;
+		}
+	}
+
 	float3 *colorData = frameBuffer->GetColorData();
 	float *weights = frameBuffer->GetWeights();
 
 	for (uint i = 0; i < width * height; ++i) {
 		m_tempFrameBuffer[i] = colorData[i] / weights[i];
 	}
+	OverlayPixelCosts(m_tempFrameBuffer, m_tempFrameBuffer);
 
 	// Update Texture
 	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_FLOAT, m_tempFrameBuffer);
 }
 
+// Polynomial fit of the Turbo colormap
+// Anton Mikhailov 2019, "Turbo, An Improved Rainbow Colormap for Visualization"
+static float3 TurboColormap(float x) {
+	x = std::min(std::max(x, 0.0f), 1.0f);
+
+	float r = 0.13572138f + x * (4.61539260f + x * (-42.66032258f + x * (132.13108234f + x * (-152.94239396f + x * 59.28637943f))));
+	float g = 0.09140261f + x * (2.19418839f + x * (4.84296658f + x * (-14.18503333f + x * (4.27729857f + x * 2.82956604f))));
+	float b = 0.10667330f + x * (12.64194608f + x * (-60.58204836f + x * (110.36276771f + x * (-89.90310912f + x * 27.34824973f))));
+
+	return float3(r, g, b);
+}
+
+void Visualizer::OverlayPixelCosts(const float3 *image, float3 *output) {
+	FrameBuffer *frameBuffer = &m_scene->Camera.FrameBuffer;
+	uint width = frameBuffer->Width;
+	uint height = frameBuffer->Height;
+	uint numPixels = width * height;
+
+	// Costs are only collected at full resolution, so there's nothing to show for previews
+	const PixelCostBuffer &pixelCosts = m_renderer->PixelCosts();
+	if (m_costView == 0 || m_renderer->PreviewScale() > 1u || pixelCosts.Width != width || pixelCosts.Height != height) {
+		if (output != image) {
+			std::copy(image, image + numPixels, output);
+		}
+		return;
+	}
+
+	PixelCost::Type type = (PixelCost::Type)(m_costView - 1);
+
+	m_costScratch.resize(numPixels);
+	for (uint y = 0; y < height; ++y) {
+		for (uint x = 0; x < width; ++x) {
+			m_costScratch[y * width + x] = pixelCosts.GetMeanCost(x, y, type);
+		}
+	}
+
+	std::vector<float> sorted(m_costScratch);
+	auto nth = sorted.begin() + (size_t)(kCostNormalizationPercentile * (numPixels - 1));
+	std::nth_element(sorted.begin(), nth, sorted.end());
+	float invMaxCost = *nth > 0.0f ? 1.0f / *nth : 0.0f;
+
+	for (uint i = 0; i < numPixels; ++i) {
+		float3 heat = TurboColormap(m_costScratch[i] * invMaxCost);
+		output[i] = image[i] * (1.0f - m_costOverlayOpacity) + heat * m_costOverlayOpacity;
+	}
+}
+
 
 } // End of namespace Lantern
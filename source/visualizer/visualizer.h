@@ -8,8 +8,13 @@
 
 #include "math/vector_types.h"
 
+#include "renderer/denoiser.h"
+#include "renderer/path_recorder.h"
+
 #include <imgui_impl.h>
 
+#include <vector>
+
 
 struct GLFWwindow;
 
@@ -28,6 +33,18 @@ private:
 	Scene *m_scene;
 	float3 *m_tempFrameBuffer;
 
+	Denoiser m_denoiser;
+	bool m_denoise;
+	float3 *m_denoisedFrameBuffer;
+	bool m_denoisedValid;
+	// The frame number of the last denoise, or of the last camera move if that was more recent
+	uint m_lastDenoisedFrame;
+
+	// 0 shows the color. Otherwise, the PixelCost::Type + 1 shown as a heatmap over the color
+	int m_costView;
+	float m_costOverlayOpacity;
+	std::vector<float> m_costScratch;
+
 	GLFWwindow *m_window;
 	double m_lastMousePosX;
 	double m_lastMousePosY;
@@ -36,6 +53,14 @@ private:
 
 	ImGui::ImGuiImpl m_imGuiImpl;
 
+	// Path inspector state. Only used if LANTERN_ENABLE_PATH_RECORDING is defined
+	bool m_inspectingPixel;
+	uint m_inspectedPixelX;
+	uint m_inspectedPixelY;
+	int m_framesToRecord;
+	bool m_inspectedEventsValid;
+	std::vector<PathEvent> m_inspectedEvents;
+
 public:
 	void Run();
 
@@ -49,6 +74,22 @@ private:
 	void Init();
 	void Shutdown();
 	void CopyFrameBufferToGPU();
+	/**
+	 * Blends a false color heatmap of the selected pixel cost over the image
+	 */
+	void OverlayPixelCosts(const float3 *image, float3 *output);
+	void OnCameraMoved();
+	/**
+	 * Starts recording the paths of a pixel. Once they're recorded, they're drawn over the image
+	 */
+	void InspectPixel(uint x, uint y);
+	void ShowPathInspector();
+	void DrawInspectedPaths();
+
+	// The number of frames between re-denoising the image
+	static const uint kDenoiseInterval = 16;
+	// The heatmap is normalized to this percentile of the cost, so a few outliers don't wash it out
+	static const float kCostNormalizationPercentile;
 };
 
 } // End of namespace Lantern